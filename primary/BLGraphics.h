@@ -31,6 +31,10 @@ protected:
     RECTMODE fRectMode = RECTMODE::CORNER;
 
     bool fUseFill = true;
+    // fUseFill lives outside the BLContext, so push()/pop()
+    // keep their own stack of it
+    std::vector<bool> fUseFillStack{};
+
     // Drawing Attributes
     float fDimensionScale = 1.0;
 
@@ -275,13 +279,24 @@ public:
     bool push() override 
     { 
         auto res = fCtx.save(); 
-        return res == BL_SUCCESS;
+        if (res != BL_SUCCESS)
+            return false;
+
+        fUseFillStack.push_back(fUseFill);
+        return true;
     }
     
     bool pop() override 
     { 
         auto res = fCtx.restore(); 
-        return res == BL_SUCCESS;
+        if (res != BL_SUCCESS)
+            return false;
+
+        if (!fUseFillStack.empty()) {
+            fUseFill = fUseFillStack.back();
+            fUseFillStack.pop_back();
+        }
+        return true;
     }
 
     // Coordinate transformation
@@ -505,6 +520,22 @@ public:
         incrCmd();
     }
 
+    // Just the fill, or just the stroke, of a path
+    void fillPath(const BLPath& path)
+    {
+        if (fUseFill) {
+            fCtx.fillPath(path);
+        }
+
+        incrCmd();
+    }
+
+    void strokePath(const BLPath& path)
+    {
+        fCtx.strokePath(path);
+        incrCmd();
+    }
+
     // Bitmaps
     void image(const BLImage& img, int x, int y) override
     {
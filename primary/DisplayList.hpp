@@ -0,0 +1,724 @@
+#pragma once
+
+// DisplayList
+// An IGraphics that remembers what it was told to draw, so it
+// can be drawn again, as many times as needed, into any other IGraphics.
+//
+// Unlike GraphicsEncoder, nothing is serialized.  Each call is stored as
+// a small, typed record, one after the other in a single block of memory.
+// Things that don't fit in a record (points, paths, styles, images,
+// strings) go into side tables, and the record holds their index.
+//
+//  DisplayList dl;
+//  drawBackground(dl);     // record once
+//  dl.mergeDraws();        // optional, see below
+//  ...
+//  dl.replay(ctx);         // every frame
+//
+// mergeDraws() goes through the recorded commands looking for runs of
+// the same kind of shape, drawn one after the other with nothing changing
+// in between, and turns each run into a single path.  Shapes are only merged
+// when they don't overlap (stroke included), so the result looks the same.
+// Runs of polygons (triangles, quads), of paths, and of lines (polylines,
+// beziers) are merged.  When replaying into a BLGraphics (or Surface), a
+// merged run is a single fill and a single stroke, in the same order
+// BLGraphics uses for that kind of shape.  Any other IGraphics gets the
+// original calls, as they were recorded.
+//
+
+#include "Graphics.h"
+#include "BLGraphics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+class DisplayList : public IGraphics
+{
+public:
+    enum DLOP : uint16_t {
+        DL_NONE = 0,
+
+        DL_STROKEBEFORETRANSFORM,
+        DL_ANGLEMODE,
+        DL_ELLIPSEMODE,
+        DL_RECTMODE,
+        DL_BLENDMODE,
+        DL_GLOBALOPACITY,
+        DL_STROKECAPS,
+        DL_STROKEJOIN,
+        DL_STROKEMITERLIMIT,
+        DL_STROKEWEIGHT,
+
+        DL_PUSH,
+        DL_POP,
+        DL_FLUSH,
+
+        DL_TRANSFORM,
+        DL_TRANSLATE,
+        DL_SCALE,
+        DL_ROTATE,
+
+        DL_NOFILL,
+        DL_FILL_STYLE,
+        DL_FILL_COLOR,
+        DL_FILLOPACITY,
+        DL_FILLRULE,
+        DL_NOSTROKE,
+        DL_STROKE_STYLE,
+        DL_STROKE_COLOR,
+
+        DL_CLEAR,
+        DL_CLEARRECT,
+        DL_BACKGROUND,
+        DL_CLIP,
+        DL_NOCLIP,
+
+        DL_SET,
+        DL_POINT,
+        DL_LINE,
+        DL_ARC,
+        DL_RECT,
+        DL_ROUNDRECT,
+        DL_ELLIPSE,
+        DL_CIRCLE,
+        DL_TRIANGLE,
+        DL_BEZIER,
+        DL_POLYLINE,
+        DL_POLYGON,
+        DL_QUAD,
+        DL_PATH,
+
+        DL_BEGINSHAPE,
+        DL_VERTEX,
+        DL_ENDSHAPE,
+
+        DL_IMAGE,
+        DL_IMAGE_SCALE,
+
+        DL_TEXTALIGN,
+        DL_TEXTFACE,
+        DL_TEXTFONT,
+        DL_TEXTSIZE,
+        DL_TEXT,
+        DL_TEXTBASELINE,
+
+        // Produced by mergeDraws()
+        DL_MERGED_POLYGONS,     // stroke, then fill
+        DL_MERGED_PATHS,        // fill, then stroke
+        DL_MERGED_LINES,        // stroke only
+    };
+
+private:
+    // Every record starts with one of these, and the
+    // payload follows, padded out to 8 bytes
+    struct DLHeader {
+        uint16_t op;
+        uint16_t reserved;
+        uint32_t size;          // header and payload
+    };
+
+    struct DLValue { double v; };
+    struct DLEnum { uint32_t v; };
+    struct DLColor { uint32_t v; };
+    struct DLIndex { uint32_t index; };
+    struct DLPair { double x, y; };
+    struct DLFour { double a, b, c, d; };
+    struct DLSix { double v[6]; };
+    struct DLEight { double v[8]; };
+    struct DLRotate { double angle, cx, cy; };
+    struct DLArc { double cx, cy, r, start, sweep; };
+    struct DLSet { double x, y; uint32_t color; };
+    struct DLClip { maths::rectf r; };
+    struct DLPoints { uint32_t first, count; };
+    struct DLAlign { uint32_t h, v; };
+    struct DLImage { uint32_t index; int x, y; };
+    struct DLScaleImage { uint32_t index; double v[8]; };
+    struct DLText { uint32_t offset; float x, y, x2, y2; };
+    struct DLMerged { uint32_t path; uint32_t first; uint32_t bytes; };
+
+    std::vector<uint8_t> fCommands{};
+    size_t fCommandCount{ 0 };
+
+    std::vector<BLPoint> fPoints{};
+    std::vector<BLPath> fPaths{};
+    std::vector<BLVar> fStyles{};
+    std::vector<BLImage> fImages{};
+    std::vector<BLFontFace> fFaces{};
+    std::vector<char> fStrings{};
+
+    // The records a merged command replaced
+    std::vector<uint8_t> fMerged{};
+
+    static constexpr size_t align8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+    template <typename T>
+    void emit(DLOP op, const T& payload)
+    {
+        size_t size = align8(sizeof(DLHeader) + sizeof(T));
+        size_t at = fCommands.size();
+        fCommands.resize(at + size);
+
+        DLHeader hdr{ (uint16_t)op, 0, (uint32_t)size };
+        memcpy(fCommands.data() + at, &hdr, sizeof(hdr));
+        memcpy(fCommands.data() + at + sizeof(DLHeader), &payload, sizeof(T));
+        fCommandCount++;
+    }
+
+    void emit(DLOP op)
+    {
+        size_t at = fCommands.size();
+        fCommands.resize(at + sizeof(DLHeader));
+
+        DLHeader hdr{ (uint16_t)op, 0, (uint32_t)sizeof(DLHeader) };
+        memcpy(fCommands.data() + at, &hdr, sizeof(hdr));
+        fCommandCount++;
+    }
+
+    template <typename T>
+    static const T& payload(const uint8_t* rec) { return *(const T*)(rec + sizeof(DLHeader)); }
+
+    uint32_t addPoints(const BLPoint* pts, size_t n)
+    {
+        uint32_t first = (uint32_t)fPoints.size();
+        fPoints.insert(fPoints.end(), pts, pts + n);
+        return first;
+    }
+
+    uint32_t addString(const char* str)
+    {
+        uint32_t offset = (uint32_t)fStrings.size();
+        if (str == nullptr)
+            str = "";
+        fStrings.insert(fStrings.end(), str, str + strlen(str) + 1);
+        return offset;
+    }
+
+public:
+    DisplayList() = default;
+
+    // Forget everything that was recorded
+    void reset()
+    {
+        fCommands.clear();
+        fCommandCount = 0;
+        fPoints.clear();
+        fPaths.clear();
+        fStyles.clear();
+        fImages.clear();
+        fFaces.clear();
+        fStrings.clear();
+        fMerged.clear();
+    }
+
+    bool empty() const { return fCommandCount == 0; }
+    size_t commandCount() const { return fCommandCount; }
+
+    // Memory taken by the command records alone
+    size_t commandBytes() const { return fCommands.size(); }
+
+
+    // Recording
+    void setDpiUnits(const int dpi, const float units) override {}
+
+    void strokeBeforeTransform(bool b) override { emit(DL_STROKEBEFORETRANSFORM, DLEnum{ b ? 1u : 0u }); }
+    void angleMode(const ANGLEMODE mode) override { emit(DL_ANGLEMODE, DLEnum{ (uint32_t)mode }); }
+    void ellipseMode(const ELLIPSEMODE mode) override { emit(DL_ELLIPSEMODE, DLEnum{ (uint32_t)mode }); }
+    void rectMode(const RECTMODE mode) override { emit(DL_RECTMODE, DLEnum{ (uint32_t)mode }); }
+    void blendMode(int mode) override { emit(DL_BLENDMODE, DLEnum{ (uint32_t)mode }); }
+    void globalOpacity(double opacity) override { emit(DL_GLOBALOPACITY, DLValue{ opacity }); }
+
+    void strokeCaps(int caps) override { emit(DL_STROKECAPS, DLEnum{ (uint32_t)caps }); }
+    void strokeJoin(int join) override { emit(DL_STROKEJOIN, DLEnum{ (uint32_t)join }); }
+    void strokeMiterLimit(float limit) override { emit(DL_STROKEMITERLIMIT, DLValue{ limit }); }
+    void strokeWeight(float weight) override { emit(DL_STROKEWEIGHT, DLValue{ weight }); }
+
+    bool push() override { emit(DL_PUSH); return true; }
+    bool pop() override { emit(DL_POP); return true; }
+    bool flush() override { emit(DL_FLUSH); return true; }
+
+    void transform(double* values) override
+    {
+        DLSix m{};
+        memcpy(m.v, values, sizeof(m.v));
+        emit(DL_TRANSFORM, m);
+    }
+    void translate(double dx, double dy) override { emit(DL_TRANSLATE, DLPair{ dx, dy }); }
+    void scale(double sx, double sy) override { emit(DL_SCALE, DLPair{ sx, sy }); }
+    void rotate(double angle, double cx, double cy) override { emit(DL_ROTATE, DLRotate{ angle, cx, cy }); }
+
+    void noFill() override { emit(DL_NOFILL); }
+    void fill(const BLVarCore& s) override
+    {
+        fStyles.push_back(static_cast<const BLVar&>(s));
+        emit(DL_FILL_STYLE, DLIndex{ (uint32_t)fStyles.size() - 1 });
+    }
+    void fill(const Pixel& c) override { emit(DL_FILL_COLOR, DLColor{ c.value }); }
+    void fillOpacity(double opacity) override { emit(DL_FILLOPACITY, DLValue{ opacity }); }
+    void fillRule(int rule) override { emit(DL_FILLRULE, DLEnum{ (uint32_t)rule }); }
+
+    void noStroke() override { emit(DL_NOSTROKE); }
+    void stroke(const BLVarCore& s) override
+    {
+        fStyles.push_back(static_cast<const BLVar&>(s));
+        emit(DL_STROKE_STYLE, DLIndex{ (uint32_t)fStyles.size() - 1 });
+    }
+    void stroke(const Pixel& c) override { emit(DL_STROKE_COLOR, DLColor{ c.value }); }
+
+    void clear() override { emit(DL_CLEAR); }
+    void clearRect(double x, double y, double w, double h) override { emit(DL_CLEARRECT, DLFour{ x, y, w, h }); }
+    void background(const Pixel& c) override { emit(DL_BACKGROUND, DLColor{ c.value }); }
+    void clip(const maths::rectf& bb) override { emit(DL_CLIP, DLClip{ bb }); }
+    void noClip() override { emit(DL_NOCLIP); }
+
+    void set(double x, double y, const Pixel& c) override { emit(DL_SET, DLSet{ x, y, c.value }); }
+    void point(double x, double y) override { emit(DL_POINT, DLPair{ x, y }); }
+    void line(double x1, double y1, double x2, double y2) override { emit(DL_LINE, DLFour{ x1, y1, x2, y2 }); }
+    void arc(double cx, double cy, double r, double start, double sweep) override { emit(DL_ARC, DLArc{ cx, cy, r, start, sweep }); }
+    void rect(double x, double y, double width, double height) override { emit(DL_RECT, DLFour{ x, y, width, height }); }
+    void rect(double x, double y, double width, double height, double xradius, double yradius) override
+    {
+        emit(DL_ROUNDRECT, DLSix{ { x, y, width, height, xradius, yradius } });
+    }
+    void ellipse(double a, double b, double c, double d) override { emit(DL_ELLIPSE, DLFour{ a, b, c, d }); }
+    void circle(double cx, double cy, double diameter) override { emit(DL_CIRCLE, DLRotate{ cx, cy, diameter }); }
+    void triangle(double x1, double y1, double x2, double y2, double x3, double y3) override
+    {
+        emit(DL_TRIANGLE, DLSix{ { x1, y1, x2, y2, x3, y3 } });
+    }
+    void bezier(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4) override
+    {
+        emit(DL_BEZIER, DLEight{ { x1, y1, x2, y2, x3, y3, x4, y4 } });
+    }
+    void polyline(const BLPoint* pts, size_t n) override { emit(DL_POLYLINE, DLPoints{ addPoints(pts, n), (uint32_t)n }); }
+    void polygon(const BLPoint* pts, size_t n) override { emit(DL_POLYGON, DLPoints{ addPoints(pts, n), (uint32_t)n }); }
+    void quad(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4) override
+    {
+        emit(DL_QUAD, DLEight{ { x1, y1, x2, y2, x3, y3, x4, y4 } });
+    }
+    void path(const BLPath& p) override
+    {
+        fPaths.push_back(p);
+        emit(DL_PATH, DLIndex{ (uint32_t)fPaths.size() - 1 });
+    }
+
+    void beginShape(SHAPEMODE shapeKind) override { emit(DL_BEGINSHAPE, DLEnum{ (uint32_t)shapeKind }); }
+    void vertex(double x, double y) override { emit(DL_VERTEX, DLPair{ x, y }); }
+    void endShape(SHAPEEND endKind) override { emit(DL_ENDSHAPE, DLEnum{ (uint32_t)endKind }); }
+
+    void image(const BLImage& img, int x, int y) override
+    {
+        fImages.push_back(img);
+        emit(DL_IMAGE, DLImage{ (uint32_t)fImages.size() - 1, x, y });
+    }
+    void scaleImage(const BLImage& src,
+        double srcX, double srcY, double srcWidth, double srcHeight,
+        double dstX, double dstY, double dstWidth, double dstHeight) override
+    {
+        fImages.push_back(src);
+        emit(DL_IMAGE_SCALE, DLScaleImage{ (uint32_t)fImages.size() - 1,
+            { srcX, srcY, srcWidth, srcHeight, dstX, dstY, dstWidth, dstHeight } });
+    }
+
+    void textAlign(ALIGNMENT horizontal, ALIGNMENT vertical) override { emit(DL_TEXTALIGN, DLAlign{ (uint32_t)horizontal, (uint32_t)vertical }); }
+    void textFace(const BLFontFace& face) override
+    {
+        fFaces.push_back(face);
+        emit(DL_TEXTFACE, DLIndex{ (uint32_t)fFaces.size() - 1 });
+    }
+    void textFont(const char* fontname) override { emit(DL_TEXTFONT, DLIndex{ addString(fontname) }); }
+    void textSize(float size) override { emit(DL_TEXTSIZE, DLValue{ size }); }
+    void text(const char* txt, float x, float y, float x2 = 0, float y2 = 0) override
+    {
+        emit(DL_TEXT, DLText{ addString(txt), x, y, x2, y2 });
+    }
+    void textAtBaseline(const char* txt, float x, float y, float x2 = 0, float y2 = 0) override
+    {
+        emit(DL_TEXTBASELINE, DLText{ addString(txt), x, y, x2, y2 });
+    }
+
+    // Measuring has to be done against a real context
+    // so these are not recorded, and know nothing
+    maths::vec2f textMeasure(const char* txt) override { return { 0, 0 }; }
+    float textAscent() override { return 0; }
+    float textDescent() override { return 0; }
+
+
+private:
+    template <typename G>
+    void replayRecords(G& ctx, const uint8_t* rec, const uint8_t* end) const
+    {
+        while (rec < end)
+        {
+            const DLHeader& hdr = *(const DLHeader*)rec;
+
+            switch (hdr.op)
+            {
+            case DL_STROKEBEFORETRANSFORM: ctx.strokeBeforeTransform(payload<DLEnum>(rec).v != 0); break;
+            case DL_ANGLEMODE: ctx.angleMode((ANGLEMODE)payload<DLEnum>(rec).v); break;
+            case DL_ELLIPSEMODE: ctx.ellipseMode((ELLIPSEMODE)payload<DLEnum>(rec).v); break;
+            case DL_RECTMODE: ctx.rectMode((RECTMODE)payload<DLEnum>(rec).v); break;
+            case DL_BLENDMODE: ctx.blendMode((int)payload<DLEnum>(rec).v); break;
+            case DL_GLOBALOPACITY: ctx.globalOpacity(payload<DLValue>(rec).v); break;
+            case DL_STROKECAPS: ctx.strokeCaps((int)payload<DLEnum>(rec).v); break;
+            case DL_STROKEJOIN: ctx.strokeJoin((int)payload<DLEnum>(rec).v); break;
+            case DL_STROKEMITERLIMIT: ctx.strokeMiterLimit((float)payload<DLValue>(rec).v); break;
+            case DL_STROKEWEIGHT: ctx.strokeWeight((float)payload<DLValue>(rec).v); break;
+
+            case DL_PUSH: ctx.push(); break;
+            case DL_POP: ctx.pop(); break;
+            case DL_FLUSH: ctx.flush(); break;
+
+            case DL_TRANSFORM: ctx.transform((double*)payload<DLSix>(rec).v); break;
+            case DL_TRANSLATE: { auto& p = payload<DLPair>(rec); ctx.translate(p.x, p.y); } break;
+            case DL_SCALE: { auto& p = payload<DLPair>(rec); ctx.scale(p.x, p.y); } break;
+            case DL_ROTATE: { auto& p = payload<DLRotate>(rec); ctx.rotate(p.angle, p.cx, p.cy); } break;
+
+            case DL_NOFILL: ctx.noFill(); break;
+            case DL_FILL_STYLE: ctx.fill(fStyles[payload<DLIndex>(rec).index]); break;
+            case DL_FILL_COLOR: ctx.fill(Pixel(payload<DLColor>(rec).v)); break;
+            case DL_FILLOPACITY: ctx.fillOpacity(payload<DLValue>(rec).v); break;
+            case DL_FILLRULE: ctx.fillRule((int)payload<DLEnum>(rec).v); break;
+            case DL_NOSTROKE: ctx.noStroke(); break;
+            case DL_STROKE_STYLE: ctx.stroke(fStyles[payload<DLIndex>(rec).index]); break;
+            case DL_STROKE_COLOR: ctx.stroke(Pixel(payload<DLColor>(rec).v)); break;
+
+            case DL_CLEAR: ctx.clear(); break;
+            case DL_CLEARRECT: { auto& p = payload<DLFour>(rec); ctx.clearRect(p.a, p.b, p.c, p.d); } break;
+            case DL_BACKGROUND: ctx.background(Pixel(payload<DLColor>(rec).v)); break;
+            case DL_CLIP: ctx.clip(payload<DLClip>(rec).r); break;
+            case DL_NOCLIP: ctx.noClip(); break;
+
+            case DL_SET: { auto& p = payload<DLSet>(rec); ctx.set(p.x, p.y, Pixel(p.color)); } break;
+            case DL_POINT: { auto& p = payload<DLPair>(rec); ctx.point(p.x, p.y); } break;
+            case DL_LINE: { auto& p = payload<DLFour>(rec); ctx.line(p.a, p.b, p.c, p.d); } break;
+            case DL_ARC: { auto& p = payload<DLArc>(rec); ctx.arc(p.cx, p.cy, p.r, p.start, p.sweep); } break;
+            case DL_RECT: { auto& p = payload<DLFour>(rec); ctx.rect(p.a, p.b, p.c, p.d); } break;
+            case DL_ROUNDRECT: { auto& p = payload<DLSix>(rec).v; ctx.rect(p[0], p[1], p[2], p[3], p[4], p[5]); } break;
+            case DL_ELLIPSE: { auto& p = payload<DLFour>(rec); ctx.ellipse(p.a, p.b, p.c, p.d); } break;
+            case DL_CIRCLE: { auto& p = payload<DLRotate>(rec); ctx.circle(p.angle, p.cx, p.cy); } break;
+            case DL_TRIANGLE: { auto& p = payload<DLSix>(rec).v; ctx.triangle(p[0], p[1], p[2], p[3], p[4], p[5]); } break;
+            case DL_BEZIER: { auto& p = payload<DLEight>(rec).v; ctx.bezier(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7]); } break;
+            case DL_POLYLINE: { auto& p = payload<DLPoints>(rec); ctx.polyline(fPoints.data() + p.first, p.count); } break;
+            case DL_POLYGON: { auto& p = payload<DLPoints>(rec); ctx.polygon(fPoints.data() + p.first, p.count); } break;
+            case DL_QUAD: { auto& p = payload<DLEight>(rec).v; ctx.quad(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7]); } break;
+            case DL_PATH: ctx.path(fPaths[payload<DLIndex>(rec).index]); break;
+
+            case DL_BEGINSHAPE: ctx.beginShape((SHAPEMODE)payload<DLEnum>(rec).v); break;
+            case DL_VERTEX: { auto& p = payload<DLPair>(rec); ctx.vertex(p.x, p.y); } break;
+            case DL_ENDSHAPE: ctx.endShape((SHAPEEND)payload<DLEnum>(rec).v); break;
+
+            case DL_IMAGE: { auto& p = payload<DLImage>(rec); ctx.image(fImages[p.index], p.x, p.y); } break;
+            case DL_IMAGE_SCALE: {
+                auto& p = payload<DLScaleImage>(rec);
+                ctx.scaleImage(fImages[p.index], p.v[0], p.v[1], p.v[2], p.v[3], p.v[4], p.v[5], p.v[6], p.v[7]);
+            }
+            break;
+
+            case DL_TEXTALIGN: { auto& p = payload<DLAlign>(rec); ctx.textAlign((ALIGNMENT)p.h, (ALIGNMENT)p.v); } break;
+            case DL_TEXTFACE: ctx.textFace(fFaces[payload<DLIndex>(rec).index]); break;
+            case DL_TEXTFONT: ctx.textFont(fStrings.data() + payload<DLIndex>(rec).index); break;
+            case DL_TEXTSIZE: ctx.textSize((float)payload<DLValue>(rec).v); break;
+            case DL_TEXT: { auto& p = payload<DLText>(rec); ctx.text(fStrings.data() + p.offset, p.x, p.y, p.x2, p.y2); } break;
+            case DL_TEXTBASELINE: { auto& p = payload<DLText>(rec); ctx.textAtBaseline(fStrings.data() + p.offset, p.x, p.y, p.x2, p.y2); } break;
+
+            case DL_MERGED_POLYGONS:
+            case DL_MERGED_PATHS:
+            case DL_MERGED_LINES: {
+                auto& m = payload<DLMerged>(rec);
+                if constexpr (std::is_base_of_v<BLGraphics, G>)
+                {
+                    const BLPath& p = fPaths[m.path];
+                    if (hdr.op == DL_MERGED_POLYGONS) {
+                        ctx.strokePath(p);
+                        ctx.fillPath(p);
+                    }
+                    else if (hdr.op == DL_MERGED_PATHS) {
+                        ctx.fillPath(p);
+                        ctx.strokePath(p);
+                    }
+                    else {
+                        ctx.strokePath(p);
+                    }
+                }
+                else
+                {
+                    replayRecords(ctx, fMerged.data() + m.first, fMerged.data() + m.first + m.bytes);
+                }
+            }
+            break;
+            }
+
+            rec += hdr.size;
+        }
+    }
+
+public:
+    //
+    // Replay everything that was recorded into another context
+    //
+    void replay(IGraphics& ctx) const
+    {
+        replayRecords(ctx, fCommands.data(), fCommands.data() + fCommands.size());
+    }
+
+    void replay(BLGraphics& ctx) const
+    {
+        replayRecords(ctx, fCommands.data(), fCommands.data() + fCommands.size());
+    }
+
+    void draw(IGraphics& ctx) const { replay(ctx); }
+    void draw(BLGraphics& ctx) const { replay(ctx); }
+
+
+    //
+    // Merging
+    // Returns how many draws were folded into others
+    //
+private:
+    // What the merge pass needs to know about the state
+    // at any point in the recording
+    struct MergeState {
+        BLMatrix2D matrix{ BLMatrix2D::makeIdentity() };
+        bool strokeKnown{ false };      // stroke set to something, or nothing
+        bool strokeNone{ false };
+        bool weightKnown{ false };
+        double weight{ 1.0 };
+        double miter{ 4.0 };
+    };
+
+    // Which merged command a recorded one can become, or DL_NONE
+    static DLOP mergeKind(uint16_t op)
+    {
+        switch (op)
+        {
+        case DL_TRIANGLE:
+        case DL_QUAD:
+        case DL_POLYGON:
+            return DL_MERGED_POLYGONS;
+        case DL_PATH:
+            return DL_MERGED_PATHS;
+        case DL_LINE:
+        case DL_POLYLINE:
+        case DL_BEZIER:
+            return DL_MERGED_LINES;
+        default:
+            return DL_NONE;
+        }
+    }
+
+    // Add the shape in a record to a path
+    void appendShape(BLPath& p, const uint8_t* rec) const
+    {
+        const DLHeader& hdr = *(const DLHeader*)rec;
+        switch (hdr.op)
+        {
+        case DL_TRIANGLE: {
+            auto& v = payload<DLSix>(rec).v;
+            BLPoint pts[3] = { {v[0], v[1]}, {v[2], v[3]}, {v[4], v[5]} };
+            p.addPolygon(pts, 3);
+        }
+        break;
+        case DL_QUAD: {
+            auto& v = payload<DLEight>(rec).v;
+            BLPoint pts[4] = { {v[0], v[1]}, {v[2], v[3]}, {v[4], v[5]}, {v[6], v[7]} };
+            p.addPolygon(pts, 4);
+        }
+        break;
+        case DL_POLYGON: {
+            auto& pp = payload<DLPoints>(rec);
+            p.addPolygon(fPoints.data() + pp.first, pp.count);
+        }
+        break;
+        case DL_PATH:
+            p.addPath(fPaths[payload<DLIndex>(rec).index]);
+            break;
+        case DL_LINE: {
+            auto& v = payload<DLFour>(rec);
+            p.moveTo(v.a, v.b);
+            p.lineTo(v.c, v.d);
+        }
+        break;
+        case DL_POLYLINE: {
+            auto& pp = payload<DLPoints>(rec);
+            p.addPolyline(fPoints.data() + pp.first, pp.count);
+        }
+        break;
+        case DL_BEZIER: {
+            auto& v = payload<DLEight>(rec).v;
+            p.moveTo(v[0], v[1]);
+            p.cubicTo(v[2], v[3], v[4], v[5], v[6], v[7]);
+        }
+        break;
+        }
+    }
+
+    // Bounding box of the shape in a record, with room for the
+    // stroke, and a pixel for antialiasing.  False if it can't be known.
+    bool shapeBounds(const uint8_t* rec, const MergeState& st, BLBox& box) const
+    {
+        BLPath p{};
+        appendShape(p, rec);
+        if (p.getBoundingBox(&box) != BL_SUCCESS)
+            return false;
+
+        const BLMatrix2D& m = st.matrix;
+        double det = std::fabs(m.m00 * m.m11 - m.m01 * m.m10);
+        double norm = std::sqrt(m.m00 * m.m00 + m.m01 * m.m01 + m.m10 * m.m10 + m.m11 * m.m11);
+        if ((det <= 0) || (norm <= 0))
+            return false;
+
+        // Smallest the transform can shrink things, so a pixel on
+        // the device is at most this many units here
+        double pixel = norm / det;
+
+        double pad = pixel;
+        if (!(st.strokeKnown && st.strokeNone))
+        {
+            if (!st.weightKnown)
+                return false;
+
+            // The stroke might be sized before or after the transform
+            double stroke = (st.weight / 2.0) * std::max(1.0, st.miter);
+            pad += std::max(stroke, stroke * pixel);
+        }
+
+        box.x0 -= pad;
+        box.y0 -= pad;
+        box.x1 += pad;
+        box.y1 += pad;
+
+        return true;
+    }
+
+    static bool boxesOverlap(const BLBox& a, const BLBox& b)
+    {
+        return (a.x0 < b.x1) && (b.x0 < a.x1) && (a.y0 < b.y1) && (b.y0 < a.y1);
+    }
+
+    static void trackState(const uint8_t* rec, MergeState& st, std::vector<MergeState>& stack)
+    {
+        const DLHeader& hdr = *(const DLHeader*)rec;
+        switch (hdr.op)
+        {
+        case DL_PUSH: stack.push_back(st); break;
+        case DL_POP:
+            if (!stack.empty()) {
+                st = stack.back();
+                stack.pop_back();
+            }
+            else {
+                st = MergeState{};
+            }
+            break;
+
+        case DL_TRANSFORM: {
+            auto& v = payload<DLSix>(rec).v;
+            st.matrix.transform(BLMatrix2D(v[0], v[1], v[2], v[3], v[4], v[5]));
+        }
+        break;
+        case DL_TRANSLATE: { auto& p = payload<DLPair>(rec); st.matrix.translate(p.x, p.y); } break;
+        case DL_SCALE: { auto& p = payload<DLPair>(rec); st.matrix.scale(p.x, p.y); } break;
+        case DL_ROTATE: { auto& p = payload<DLRotate>(rec); st.matrix.rotate(p.angle, p.cx, p.cy); } break;
+
+        case DL_NOSTROKE: st.strokeKnown = true; st.strokeNone = true; break;
+        case DL_STROKE_STYLE:
+        case DL_STROKE_COLOR: st.strokeKnown = true; st.strokeNone = false; break;
+        case DL_STROKEWEIGHT: st.weightKnown = true; st.weight = payload<DLValue>(rec).v; break;
+        case DL_STROKEMITERLIMIT: st.miter = payload<DLValue>(rec).v; break;
+        }
+    }
+
+public:
+    // Runs are kept to this many shapes, which bounds
+    // the cost of checking for overlaps
+    static constexpr size_t kMaxMergeRun = 256;
+
+    size_t mergeDraws()
+    {
+        std::vector<uint8_t> oldCommands;
+        oldCommands.swap(fCommands);
+        fCommandCount = 0;
+
+        const uint8_t* rec = oldCommands.data();
+        const uint8_t* end = rec + oldCommands.size();
+
+        MergeState st{};
+        std::vector<MergeState> stack{};
+        std::vector<BLBox> runBoxes{};
+        size_t merged = 0;
+
+        auto copyRecord = [this](const uint8_t* r) {
+            const DLHeader& h = *(const DLHeader*)r;
+            fCommands.insert(fCommands.end(), r, r + h.size);
+            fCommandCount++;
+        };
+
+        while (rec < end)
+        {
+            const DLHeader& hdr = *(const DLHeader*)rec;
+            DLOP kind = mergeKind(hdr.op);
+
+            if (kind == DL_NONE)
+            {
+                trackState(rec, st, stack);
+                copyRecord(rec);
+                rec += hdr.size;
+                continue;
+            }
+
+            // Gather the run of same kind shapes that follow, that don't overlap
+            const uint8_t* runEnd = rec;
+            runBoxes.clear();
+            while ((runEnd < end) && (runBoxes.size() < kMaxMergeRun))
+            {
+                const DLHeader& h = *(const DLHeader*)runEnd;
+                if (mergeKind(h.op) != kind)
+                    break;
+
+                BLBox box{};
+                if (!shapeBounds(runEnd, st, box))
+                    break;
+
+                bool overlaps = false;
+                for (const auto& b : runBoxes)
+                {
+                    if (boxesOverlap(b, box)) {
+                        overlaps = true;
+                        break;
+                    }
+                }
+                if (overlaps)
+                    break;
+
+                runBoxes.push_back(box);
+                runEnd += h.size;
+            }
+
+            if (runBoxes.size() < 2)
+            {
+                copyRecord(rec);
+                rec += hdr.size;
+                continue;
+            }
+
+            BLPath p{};
+            for (const uint8_t* r = rec; r < runEnd; r += ((const DLHeader*)r)->size)
+                appendShape(p, r);
+
+            fPaths.push_back(p);
+
+            uint32_t first = (uint32_t)fMerged.size();
+            fMerged.insert(fMerged.end(), rec, runEnd);
+            emit(kind, DLMerged{ (uint32_t)fPaths.size() - 1, first, (uint32_t)(runEnd - rec) });
+
+            merged += runBoxes.size() - 1;
+            rec = runEnd;
+        }
+
+        return merged;
+    }
+};
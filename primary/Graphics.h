@@ -76,6 +76,49 @@ GCMD_TEXT,
 GCMD_BEGINSHAPE,
 GCMD_VERTEX,
 GCMD_ENDSHAPE,
+
+GCMD_STROKEBEFORETRANSFORM,
+GCMD_GLOBALOPACITY,
+GCMD_TRANSFORM,
+GCMD_FILLOPACITY,
+GCMD_FILLRULE,
+GCMD_ARC,
+GCMD_TEXTBASELINE,
+};
+
+// How a stream of commands is encoded
+//
+// GRENCODING_RAW
+//  Each command is a 16-bit opcode, followed by its arguments as
+//  32-bit floats and ints.  There is no header.
+//
+// GRENCODING_COMPACT
+//  The stream starts with a header
+//    'G' 'C' version(uint8) features(varint) fractionBits(uint8)
+//  Opcodes, enums and counts are varints.  With GCS_FEATURE_DELTA_COORDS
+//  coordinates are fixed point, with 'fractionBits' bits of fraction, 
+//  written as zigzag varints relative to the previous coordinate.
+//  With GCS_FEATURE_BULK_POINTS, point lists (polyline, polygon, path)
+//  are written as arrays of 32-bit floats.
+//
+// The second byte of a raw stream is the high byte of an opcode, which is 
+// always 0, so the two can be told apart from the first couple of bytes.
+//
+enum GRENCODING {
+    GRENCODING_RAW = 0,
+    GRENCODING_COMPACT = 1,
+};
+
+static constexpr uint8_t GCS_MAGIC0 = 'G';
+static constexpr uint8_t GCS_MAGIC1 = 'C';
+static constexpr uint8_t GCS_VERSION = 1;
+
+enum GCS_FEATURES : uint32_t {
+    GCS_FEATURE_DELTA_COORDS = 0x01,    // quantized, delta encoded coordinates
+    GCS_FEATURE_ELIDE_STATE = 0x02,     // redundant state changes were not written
+    GCS_FEATURE_BULK_POINTS = 0x04,     // point lists as float arrays
+
+    GCS_FEATURE_ALL = 0x07,
 };
 
 // RectMode
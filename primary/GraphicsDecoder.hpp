@@ -7,19 +7,91 @@
 
 // A class to connect a stream of Graphics commands
 // to a Graphics interface that can execute them.
+//
+// Both encodings written by GraphicsEncoder are understood.  A compact
+// stream announces itself with a header, anything else is taken to be raw.
 class GraphicsDecoder
 {
     BinStream &fBS;
     std::shared_ptr<IGraphics> fGraphics;
 
+    bool fCompact{ false };
+    bool fValid{ true };
+    uint32_t fFeatures{ 0 };
+    int fFractionBits{ 0 };
+    double fQuantScale{ 1.0 };
+
+    // Last coordinate read, in quantized units
+    int64_t fPenX{ 0 };
+    int64_t fPenY{ 0 };
+
+    std::vector<BLPoint> fPoints{};
+    std::vector<float> fScratch{};
+
+    bool hasFeature(uint32_t f) const { return fCompact && ((fFeatures & f) != 0); }
+
+    uint64_t readVarUInt()
+    {
+        uint64_t value = 0;
+        int shift = 0;
+        while (!fBS.isEOF() && (shift < 64))
+        {
+            uint8_t b = fBS.readOctet();
+            value |= (uint64_t)(b & 0x7f) << shift;
+            if ((b & 0x80) == 0)
+                break;
+            shift += 7;
+        }
+
+        return value;
+    }
+
+    int64_t readVarInt()
+    {
+        uint64_t u = readVarUInt();
+        return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+    }
+
+    double dequantize(int64_t q) const
+    {
+        return (double)q / fQuantScale;
+    }
+
+    // The header of a compact stream
+    // 'G' 'C' version features fractionBits
+    void readHeader()
+    {
+        if ((fBS.remaining() < 2) || (fBS.peekOctet(0) != GCS_MAGIC0) || (fBS.peekOctet(1) != GCS_MAGIC1))
+            return;
+
+        fBS.skip(2);
+        uint8_t version = fBS.readUInt8();
+        if (version > GCS_VERSION)
+        {
+            fValid = false;
+            return;
+        }
+
+        fCompact = true;
+        fFeatures = (uint32_t)readVarUInt();
+        fFractionBits = fBS.readUInt8();
+        fQuantScale = (double)(1 << (fFractionBits > 16 ? 16 : fFractionBits));
+    }
+
     // Some convenience readers
     uint16_t readCommand()
     {
+        if (fCompact)
+            return (uint16_t)readVarUInt();
+
         return fBS.readUInt16();
     }
 
     uint32_t readUInt()
     {
+        if (fCompact)
+            return (uint32_t)readVarUInt();
+
         return fBS.readUInt32();
     }
 
@@ -30,19 +102,46 @@ class GraphicsDecoder
 
     BLPoint readCoord()
     {
+        if (hasFeature(GCS_FEATURE_DELTA_COORDS))
+        {
+            fPenX += readVarInt();
+            fPenY += readVarInt();
+            return { dequantize(fPenX), dequantize(fPenY) };
+        }
+
         float x = fBS.readFloat();
         float y = fBS.readFloat();
         return {x, y};
     }
 
-    BLRect readRect()
+    BLPoint readSize()
     {
-        float x = fBS.readFloat();
-        float y = fBS.readFloat();
+        if (hasFeature(GCS_FEATURE_DELTA_COORDS))
+        {
+            double w = dequantize(readVarInt());
+            double h = dequantize(readVarInt());
+            return { w, h };
+        }
+
         float w = fBS.readFloat();
         float h = fBS.readFloat();
+        return { w, h };
+    }
 
-        return {x,y,w,h};
+    double readLength()
+    {
+        if (hasFeature(GCS_FEATURE_DELTA_COORDS))
+            return dequantize(readVarInt());
+
+        return fBS.readFloat();
+    }
+
+    BLRect readRect()
+    {
+        BLPoint xy = readCoord();
+        BLPoint wh = readSize();
+
+        return {xy.x, xy.y, wh.x, wh.y};
     }
 
     Pixel readColor()
@@ -55,17 +154,101 @@ class GraphicsDecoder
 
     size_t readString(char *buff, size_t buffLen)
     {
-        return fBS.readStringZ(buffLen, buff); 
+        return fBS.readStringZ(buffLen, buff);
+    }
+
+    // A count, followed by that many points, into fPoints
+    size_t readPoints()
+    {
+        uint32_t n = readUInt();
+
+        if (hasFeature(GCS_FEATURE_BULK_POINTS))
+        {
+            // Don't believe a count the stream can't back up
+            size_t avail = fBS.remaining() / (2 * sizeof(float));
+            if (n > avail)
+                n = (uint32_t)avail;
+
+            fScratch.resize((size_t)n * 2);
+            const uint16_t one = 1;
+            if (*(const uint8_t*)&one == 1)
+                fBS.readBytes((uint8_t*)fScratch.data(), fScratch.size() * sizeof(float));
+            else
+                for (auto& f : fScratch)
+                    f = fBS.readFloat();
+
+            fPoints.resize(n);
+            for (size_t i = 0; i < n; i++)
+                fPoints[i] = BLPoint(fScratch[i * 2], fScratch[i * 2 + 1]);
+
+            return n;
+        }
+
+        fPoints.clear();
+        for (size_t i = 0; (i < n) && !fBS.isEOF(); i++)
+            fPoints.push_back(readCoord());
+
+        return fPoints.size();
+    }
+
+    bool readGradient(BLGradient& g)
+    {
+        uint32_t gtype = readUInt();
+        uint32_t extend = readUInt();
+
+        double values[BL_GRADIENT_VALUE_MAX_VALUE + 1];
+        for (size_t i = 0; i <= BL_GRADIENT_VALUE_MAX_VALUE; i++)
+            values[i] = readFloat();
+
+        double m[6];
+        for (size_t i = 0; i < 6; i++)
+            m[i] = readFloat();
+        BLMatrix2D matrix(m[0], m[1], m[2], m[3], m[4], m[5]);
+
+        uint32_t nStops = readUInt();
+        std::vector<BLGradientStop> stops;
+        for (size_t i = 0; (i < nStops) && !fBS.isEOF(); i++)
+        {
+            double offset = readFloat();
+            uint64_t rgba = fBS.readUInt64();
+            stops.push_back(BLGradientStop(offset, BLRgba64(rgba)));
+        }
+
+        return blGradientCreate(&g, (BLGradientType)gtype, values, (BLExtendMode)extend,
+            stops.data(), stops.size(), &matrix) == BL_SUCCESS;
+    }
+
+    // The payload of a FILL_STYLE or STROKE_STYLE command
+    // Raw streams don't have one
+    bool readStyle(BLVar& style)
+    {
+        if (!fCompact)
+            return false;
+
+        if (readUInt() != 1)
+            return false;
+
+        BLGradient g{};
+        if (!readGradient(g))
+            return false;
+
+        style = g;
+        return true;
     }
 
 public:
-    
+
     GraphicsDecoder(BinStream &bs, std::shared_ptr<IGraphics> g)
     :fBS(bs),
     fGraphics(g)
     {
+        readHeader();
     }
 
+    bool isCompact() const { return fCompact; }
+    bool isValid() const { return fValid; }
+    uint32_t features() const { return fFeatures; }
+
     void readNextCommand()
     {
         // First read the command
@@ -82,7 +265,7 @@ public:
             break;
 
             case GCMD_ANGLEMODE:{
-                fGraphics->angleMode(readUInt());
+                fGraphics->angleMode((ANGLEMODE)readUInt());
             }
             break;
             case GCMD_ELLIPSEMODE:{
@@ -97,6 +280,14 @@ public:
                 fGraphics->blendMode(readUInt());
             }
             break;
+            case GCMD_STROKEBEFORETRANSFORM: {
+                fGraphics->strokeBeforeTransform(readUInt() != 0);
+            }
+            break;
+            case GCMD_GLOBALOPACITY: {
+                fGraphics->globalOpacity(readFloat());
+            }
+            break;
 
             case GCMD_STROKECAPS: {
                 fGraphics->strokeCaps(readUInt());
@@ -106,6 +297,10 @@ public:
                 fGraphics->strokeJoin(readUInt());
             }
             break;
+            case GCMD_STROKEMITERLIMIT: {
+                fGraphics->strokeMiterLimit(readFloat());
+            }
+            break;
             case GCMD_STROKEWEIGHT: {
                 fGraphics->strokeWeight(readFloat());
             }
@@ -120,21 +315,30 @@ public:
             }
             break;
 
+            case GCMD_TRANSFORM: {
+                double m[6];
+                for (int i = 0; i < 6; i++)
+                    m[i] = readFloat();
+                fGraphics->transform(m);
+            }
+            break;
             case GCMD_TRANSLATE: {
-                BLPoint xy = readCoord();
-                fGraphics->translate(xy.x, xy.y);
+                float dx = readFloat();
+                float dy = readFloat();
+                fGraphics->translate(dx, dy);
             }
             break;
             case GCMD_SCALE: {
-                BLPoint xy = readCoord();
-                fGraphics->scale(xy.x, xy.y);
+                float sx = readFloat();
+                float sy = readFloat();
+                fGraphics->scale(sx, sy);
             }
             break;
             case GCMD_ROTATE: {
                 float angle = readFloat();
                 BLPoint xy = readCoord();
 
-                fGraphics->rotate(xy.x, xy.y, angle);
+                fGraphics->rotate(angle, xy.x, xy.y);
             }
             break;
 
@@ -143,6 +347,12 @@ public:
                 fGraphics->fill(c);
             }
             break;
+            case GCMD_FILL_STYLE: {
+                BLVar style{};
+                if (readStyle(style))
+                    fGraphics->fill(style);
+            }
+            break;
             case GCMD_FILL_GRADIENT: {
                 // BUGBUG - decode gradient
             }
@@ -155,6 +365,14 @@ public:
                 fGraphics->noFill();
             }
             break;
+            case GCMD_FILLOPACITY: {
+                fGraphics->fillOpacity(readFloat());
+            }
+            break;
+            case GCMD_FILLRULE: {
+                fGraphics->fillRule(readUInt());
+            }
+            break;
 
             case GCMD_STROKE_COLOR: {
                 BLRgba32 c = readColor();
@@ -162,6 +380,12 @@ public:
                 fGraphics->stroke(c);
             }
             break;
+            case GCMD_STROKE_STYLE: {
+                BLVar style{};
+                if (readStyle(style))
+                    fGraphics->stroke(style);
+            }
+            break;
             case GCMD_STROKE_NONE: {
                 fGraphics->noStroke();
             }
@@ -186,6 +410,11 @@ public:
                 fGraphics->clear();
             }
             break;
+            case GCMD_CLEARRECT: {
+                BLRect r = readRect();
+                fGraphics->clearRect(r.x, r.y, r.w, r.h);
+            }
+            break;
 
             case GCMD_BACKGROUND: {
                 Pixel c = readColor();
@@ -194,7 +423,7 @@ public:
             break;
             case GCMD_CLIP:{
                 BLRect r = readRect();
-                fGraphics->clip(r.x, r.y, r.w, r.h);
+                fGraphics->clip({ (float)r.x, (float)r.y, (float)r.w, (float)r.h });
             }
             break;
             case GCMD_NOCLIP: {
@@ -220,6 +449,14 @@ public:
                 fGraphics->line(xy1.x, xy1.y, xy2.x, xy2.y);
             }
             break;
+            case GCMD_ARC: {
+                BLPoint c = readCoord();
+                double r = readLength();
+                float start = readFloat();
+                float sweep = readFloat();
+                fGraphics->arc(c.x, c.y, r, start, sweep);
+            }
+            break;
             case GCMD_RECT: {
                 BLRect rr = readRect();
                 fGraphics->rect(rr.x,rr.y,rr.w,rr.h);
@@ -227,7 +464,7 @@ public:
             break;
             case GCMD_ROUNDRECT:{
                 BLRect rr = readRect();
-                BLPoint radii = readCoord();
+                BLPoint radii = readSize();
                 fGraphics->rect(rr.x,rr.y,rr.w,rr.h, radii.x, radii.y);
             }
             break;
@@ -239,7 +476,7 @@ public:
             break;
             case GCMD_CIRCLE: {
                 BLPoint ab = readCoord();
-                float dia = readFloat();
+                double dia = readLength();
                 fGraphics->circle(ab.x, ab.y, dia);
             }
             break;
@@ -259,23 +496,13 @@ public:
             }
             break;
             case GCMD_POLYLINE: {
-                uint32_t n = readUInt();
-                std::vector<BLPoint> pts;
-
-                for (size_t i=0; i<n; i++){
-                    pts.push_back(readCoord());
-                }
-                fGraphics->polyline(pts.data(), pts.size());
+                readPoints();
+                fGraphics->polyline(fPoints.data(), fPoints.size());
             }
             break;
             case GCMD_POLYGON: {
-                uint32_t n = readUInt();
-                std::vector<BLPoint> pts;
-
-                for (size_t i=0; i<n; i++){
-                    pts.push_back(readCoord());
-                }
-                fGraphics->polygon(pts.data(), pts.size());
+                readPoints();
+                fGraphics->polygon(fPoints.data(), fPoints.size());
             }
             break;
             case GCMD_QUAD: {
@@ -283,7 +510,27 @@ public:
                 BLPoint xy2 = readCoord();
                 BLPoint xy3 = readCoord();
                 BLPoint xy4 = readCoord();
-                fGraphics->bezier(xy1.x, xy1.y, xy2.x, xy2.y, xy3.x, xy3.y, xy4.x, xy4.y);
+                fGraphics->quad(xy1.x, xy1.y, xy2.x, xy2.y, xy3.x, xy3.y, xy4.x, xy4.y);
+            }
+            break;
+            case GCMD_PATH: {
+                // Only the compact encoding carries the path
+                if (!fCompact)
+                    break;
+
+                size_t n = readPoints();
+                if (fBS.remaining() < n)
+                    break;
+
+                BLPath path{};
+                uint8_t* cmdOut = nullptr;
+                BLPoint* vtxOut = nullptr;
+                if (path.modifyOp(BL_MODIFY_OP_ASSIGN_FIT, n, &cmdOut, &vtxOut) != BL_SUCCESS)
+                    break;
+
+                fBS.readBytes(cmdOut, n);
+                memcpy(vtxOut, fPoints.data(), n * sizeof(BLPoint));
+                fGraphics->path(path);
             }
             break;
 
@@ -326,6 +573,14 @@ public:
                 fGraphics->text(buff, xy.x, xy.y);
             }
             break;
+            case GCMD_TEXTBASELINE: {
+                char buff[1024];
+                size_t buffLen = 1024;
+                BLPoint xy = readCoord();
+                size_t nRead = readString(buff, buffLen);
+                fGraphics->textAtBaseline(buff, xy.x, xy.y);
+            }
+            break;
 
             case GCMD_BEGINSHAPE:{
                 uint32_t kind = readUInt();
@@ -347,8 +602,8 @@ public:
 
     void run()
     {
-        while (!fBS.isEOF()) {
+        while (fValid && !fBS.isEOF()) {
             readNextCommand();
         }
     }
-};
\ No newline at end of file
+};
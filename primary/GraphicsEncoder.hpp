@@ -3,15 +3,156 @@
 // Binding P5 graphics API to a  serializer
 // The binding takes all the Graphics calls and turns them
 // into writes to a binary stream
+//
+// There are two encodings (see GRENCODING in Graphics.h)
+//
+// The raw encoding is the original one.  Every command is a 16-bit
+// opcode, followed by its arguments as 32-bit values.
+//
+// The compact encoding is for when the stream is going somewhere, like
+// across the network to be rendered remotely.  Opcodes and enums are
+// varints, coordinates are quantized and written relative to the one
+// before, point lists go out in one block, and setting state that's already
+// set (the same fill color twice in a row for instance) isn't written at all.
+//
+//  GraphicsEncoder enc(bs, GRENCODING_COMPACT);
+//
 
 #include "Graphics.h"
 #include "binstream.hpp"
 
+#include <cmath>
+#include <vector>
+
 class GraphicsEncoder : public IGraphics
 {
     BinStream &fBS;
 
+    int fEncoding{ GRENCODING_RAW };
+    uint32_t fFeatures{ 0 };
+    int fFractionBits{ 4 };
+    double fQuantScale{ 16.0 };
+
+    // Last coordinate written, in quantized units
+    int64_t fPenX{ 0 };
+    int64_t fPenY{ 0 };
+
+    // The state the decoding side is in, as far as
+    // we know, so redundant changes can be skipped
+    enum STATEBITS : uint32_t {
+        ST_FILL = 0x0001,
+        ST_STROKE = 0x0002,
+        ST_WEIGHT = 0x0004,
+        ST_CAPS = 0x0008,
+        ST_JOIN = 0x0010,
+        ST_MITER = 0x0020,
+        ST_BLEND = 0x0040,
+        ST_GLOBALOPACITY = 0x0080,
+        ST_FILLOPACITY = 0x0100,
+        ST_FILLRULE = 0x0200,
+        ST_STROKEORDER = 0x0400,
+        ST_ANGLEMODE = 0x0800,
+        ST_ELLIPSEMODE = 0x1000,
+        ST_RECTMODE = 0x2000,
+        ST_TEXTSIZE = 0x4000,
+    };
+
+    // Colors are 32-bit, so this can't be one of them
+    static constexpr uint64_t kNoPaint = 0x100000000ull;
+
+    struct EncoderState {
+        uint32_t known{ 0 };
+        uint64_t fill{ 0 };
+        uint64_t stroke{ 0 };
+        float weight{ 0 };
+        float miter{ 0 };
+        float globalOpacity{ 0 };
+        float fillOpacity{ 0 };
+        float textSize{ 0 };
+        uint32_t caps{ 0 };
+        uint32_t join{ 0 };
+        uint32_t blend{ 0 };
+        uint32_t fillRule{ 0 };
+        uint32_t strokeOrder{ 0 };
+        uint32_t angleMode{ 0 };
+        uint32_t ellipseMode{ 0 };
+        uint32_t rectMode{ 0 };
+    };
+
+    EncoderState fState{};
+    std::vector<EncoderState> fStateStack{};
+    size_t fElided{ 0 };
+
+    std::vector<float> fScratch{};
+
 private:
+    bool isCompact() const { return fEncoding == GRENCODING_COMPACT; }
+    bool hasFeature(uint32_t f) const { return isCompact() && ((fFeatures & f) != 0); }
+
+    // Returns true if the value is different from what the
+    // other side already has, and remembers it
+    template <typename T>
+    bool stateChanged(uint32_t bit, T& slot, T value)
+    {
+        if (hasFeature(GCS_FEATURE_ELIDE_STATE) && ((fState.known & bit) != 0) && (slot == value))
+        {
+            fElided++;
+            return false;
+        }
+
+        fState.known |= bit;
+        slot = value;
+        return true;
+    }
+
+    void forgetState(uint32_t bit) { fState.known &= ~bit; }
+
+    // The state bits for which two states hold the same value
+    static uint32_t matchingState(const EncoderState& a, const EncoderState& b)
+    {
+        uint32_t same = 0;
+        if (a.fill == b.fill) same |= ST_FILL;
+        if (a.stroke == b.stroke) same |= ST_STROKE;
+        if (a.weight == b.weight) same |= ST_WEIGHT;
+        if (a.caps == b.caps) same |= ST_CAPS;
+        if (a.join == b.join) same |= ST_JOIN;
+        if (a.miter == b.miter) same |= ST_MITER;
+        if (a.blend == b.blend) same |= ST_BLEND;
+        if (a.globalOpacity == b.globalOpacity) same |= ST_GLOBALOPACITY;
+        if (a.fillOpacity == b.fillOpacity) same |= ST_FILLOPACITY;
+        if (a.fillRule == b.fillRule) same |= ST_FILLRULE;
+        if (a.strokeOrder == b.strokeOrder) same |= ST_STROKEORDER;
+        if (a.angleMode == b.angleMode) same |= ST_ANGLEMODE;
+        if (a.ellipseMode == b.ellipseMode) same |= ST_ELLIPSEMODE;
+        if (a.rectMode == b.rectMode) same |= ST_RECTMODE;
+        if (a.textSize == b.textSize) same |= ST_TEXTSIZE;
+
+        return same;
+    }
+
+    bool writeVarUInt(uint64_t value)
+    {
+        uint8_t buff[10];
+        size_t n = 0;
+        while (value >= 0x80)
+        {
+            buff[n++] = (uint8_t)(value | 0x80);
+            value >>= 7;
+        }
+        buff[n++] = (uint8_t)value;
+
+        return fBS.writeBytes(buff, n);
+    }
+
+    bool writeVarInt(int64_t value)
+    {
+        return writeVarUInt(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+    }
+
+    int64_t quantize(double value) const
+    {
+        return (int64_t)std::llround(value * fQuantScale);
+    }
 
     bool writeInt(int value)
     {
@@ -21,10 +162,13 @@ private:
 
     bool writeUInt(uint32_t value)
     {
+        if (isCompact())
+            return writeVarUInt(value);
+
         fBS.writeUInt32(value);
         return true;
     }
-    
+
     bool writeFloat(float value)
     {
         fBS.writeFloat(value);
@@ -39,6 +183,9 @@ private:
 
     bool writeCommand(uint16_t cmd)
     {
+        if (isCompact())
+            return writeVarUInt(cmd);
+
         fBS.writeUInt16(cmd);
         return true;
     }
@@ -50,123 +197,363 @@ private:
         return true;
     }
 
+    // A position
     bool writeCoord(double x, double y)
     {
+        if (hasFeature(GCS_FEATURE_DELTA_COORDS))
+        {
+            int64_t qx = quantize(x);
+            int64_t qy = quantize(y);
+            writeVarInt(qx - fPenX);
+            writeVarInt(qy - fPenY);
+            fPenX = qx;
+            fPenY = qy;
+            return true;
+        }
+
         writeFloat((float)x);
         writeFloat((float)y);
 
         return true;
     }
 
-    bool writeRect(double x, double y, double w, double h)
+    // A distance, like a width or a radius
+    bool writeSize(double w, double h)
     {
-        writeFloat((float)x);
-        writeFloat((float)y);
+        if (hasFeature(GCS_FEATURE_DELTA_COORDS))
+        {
+            writeVarInt(quantize(w));
+            writeVarInt(quantize(h));
+            return true;
+        }
+
         writeFloat((float)w);
         writeFloat((float)h);
 
         return true;
     }
-    
+
+    bool writeLength(double d)
+    {
+        if (hasFeature(GCS_FEATURE_DELTA_COORDS))
+            return writeVarInt(quantize(d));
+
+        return writeFloat((float)d);
+    }
+
+    bool writeRect(double x, double y, double w, double h)
+    {
+        writeCoord(x, y);
+        writeSize(w, h);
+
+        return true;
+    }
+
     bool writeColor(const Pixel &c)
     {
-        writeUInt(c.value);
+        fBS.writeUInt32(c.value);
 
         return true;
     }
 
+    // A count, followed by the points
+    bool writePoints(const BLPoint* pts, size_t n)
+    {
+        writeUInt((uint32_t)n);
+
+        if (hasFeature(GCS_FEATURE_BULK_POINTS))
+        {
+            fScratch.resize(n * 2);
+            for (size_t i = 0; i < n; i++) {
+                fScratch[i * 2] = (float)pts[i].x;
+                fScratch[i * 2 + 1] = (float)pts[i].y;
+            }
+            return writeFloats(fScratch.data(), fScratch.size());
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            writeCoord(pts[i].x, pts[i].y);
+        }
+
+        return true;
+    }
+
+    // Floats in bulk, little endian
+    bool writeFloats(const float* values, size_t n)
+    {
+        const uint16_t one = 1;
+        if (*(const uint8_t*)&one == 1)
+            return fBS.writeBytes(values, n * sizeof(float));
+
+        for (size_t i = 0; i < n; i++)
+            writeFloat(values[i]);
+
+        return true;
+    }
+
+    bool writeGradient(const BLGradient& g)
+    {
+        writeUInt((uint32_t)g.type());
+        writeUInt((uint32_t)g.extendMode());
+
+        for (size_t i = 0; i <= BL_GRADIENT_VALUE_MAX_VALUE; i++)
+            writeFloat((float)g.value(i));
+
+        const BLMatrix2D& m = g.transform();
+        for (size_t i = 0; i < 6; i++)
+            writeFloat((float)m.m[i]);
+
+        writeUInt((uint32_t)g.size());
+        for (size_t i = 0; i < g.size(); i++) {
+            writeFloat((float)g.stopAt(i).offset);
+            fBS.writeUInt64(g.stopAt(i).rgba.value);
+        }
+
+        return true;
+    }
+
+    // Paint in a BLVar, which is either a solid color,
+    // or a gradient.  Patterns are not sent.
+    void writeStyle(uint16_t colorCmd, uint16_t styleCmd, uint32_t bit, uint64_t& slot, const BLVarCore& s)
+    {
+        const BLVar& var = static_cast<const BLVar&>(s);
+
+        if (var.isRgba32() || var.isRgba64() || var.isRgba())
+        {
+            BLRgba32 c{};
+            var.toRgba32(&c);
+            if (stateChanged(bit, slot, (uint64_t)c.value))
+            {
+                writeCommand(colorCmd);
+                writeColor(c);
+            }
+            return;
+        }
+
+        forgetState(bit);
+        writeCommand(styleCmd);
+
+        if (isCompact() && var.isGradient())
+        {
+            writeUInt(1);
+            writeGradient(var.as<BLGradient>());
+        }
+        else if (isCompact())
+        {
+            writeUInt(0);
+        }
+    }
 
 public:
 
-    GraphicsEncoder(BinStream& bs)
+    GraphicsEncoder(BinStream& bs, GRENCODING encoding = GRENCODING_RAW, uint32_t features = GCS_FEATURE_ALL, int fractionBits = 4)
         : fBS(bs)
-    {
+        , fEncoding(encoding)
+        , fFeatures(features)
+        , fFractionBits(fractionBits)
+    {
+        fFractionBits = fractionBits < 0 ? 0 : (fractionBits > 16 ? 16 : fractionBits);
+        fQuantScale = (double)(1 << fFractionBits);
+
+        if (isCompact())
+        {
+            fBS.writeUInt8(GCS_MAGIC0);
+            fBS.writeUInt8(GCS_MAGIC1);
+            fBS.writeUInt8(GCS_VERSION);
+            writeVarUInt(fFeatures);
+            fBS.writeUInt8((uint8_t)fFractionBits);
+        }
     }
 
+    int encoding() const { return fEncoding; }
+    uint32_t features() const { return fFeatures; }
+
+    // How many state changes were not written because
+    // they would not have changed anything
+    size_t elidedCount() const { return fElided; }
+
+    void setDpiUnits(const int dpi, const float units) override {}
+
     // Various Modes
-     void angleMode(int mode) {writeEnum(GCMD_ANGLEMODE, mode);}
-     void ellipseMode(const ELLIPSEMODE mode) {writeEnum(GCMD_ELLIPSEMODE, (uint32_t)mode);}
-     void rectMode(const RECTMODE mode) {writeEnum(GCMD_RECTMODE, (uint32_t)mode);}
-     void blendMode(int op) {writeEnum(GCMD_BLENDMODE, (uint32_t)op);}
+    void strokeBeforeTransform(bool b) override
+    {
+        if (stateChanged(ST_STROKEORDER, fState.strokeOrder, (uint32_t)b))
+            writeEnum(GCMD_STROKEBEFORETRANSFORM, b ? 1 : 0);
+    }
+    void angleMode(const ANGLEMODE mode) override
+    {
+        if (stateChanged(ST_ANGLEMODE, fState.angleMode, (uint32_t)mode))
+            writeEnum(GCMD_ANGLEMODE, (uint32_t)mode);
+    }
+    void ellipseMode(const ELLIPSEMODE mode) override
+    {
+        if (stateChanged(ST_ELLIPSEMODE, fState.ellipseMode, (uint32_t)mode))
+            writeEnum(GCMD_ELLIPSEMODE, (uint32_t)mode);
+    }
+    void rectMode(const RECTMODE mode) override
+    {
+        if (stateChanged(ST_RECTMODE, fState.rectMode, (uint32_t)mode))
+            writeEnum(GCMD_RECTMODE, (uint32_t)mode);
+    }
+    void blendMode(int op) override
+    {
+        if (stateChanged(ST_BLEND, fState.blend, (uint32_t)op))
+            writeEnum(GCMD_BLENDMODE, (uint32_t)op);
+    }
+    void globalOpacity(double opacity) override
+    {
+        if (stateChanged(ST_GLOBALOPACITY, fState.globalOpacity, (float)opacity)) {
+            writeCommand(GCMD_GLOBALOPACITY);
+            writeFloat((float)opacity);
+        }
+    }
 
     // stroking attributes
-     void strokeCaps(int caps) {writeEnum(GCMD_STROKECAPS, caps);}
-     void strokeJoin(int style) { writeEnum(GCMD_STROKEJOIN, style); }
-     void strokeWeight(float weight) { 
-        writeCommand(GCMD_STROKEWEIGHT);
-        writeFloat(weight);
+    void strokeCaps(int caps) override
+    {
+        if (stateChanged(ST_CAPS, fState.caps, (uint32_t)caps))
+            writeEnum(GCMD_STROKECAPS, caps);
+    }
+    void strokeJoin(int style) override
+    {
+        if (stateChanged(ST_JOIN, fState.join, (uint32_t)style))
+            writeEnum(GCMD_STROKEJOIN, style);
+    }
+    void strokeMiterLimit(float limit) override
+    {
+        if (stateChanged(ST_MITER, fState.miter, limit)) {
+            writeCommand(GCMD_STROKEMITERLIMIT);
+            writeFloat(limit);
+        }
+    }
+    void strokeWeight(float weight) override
+    {
+        if (stateChanged(ST_WEIGHT, fState.weight, weight)) {
+            writeCommand(GCMD_STROKEWEIGHT);
+            writeFloat(weight);
+        }
     }
 
 
 
     // Attribute State Stack
-     void push() { writeCommand(GCMD_PUSH); }
-     void pop() { writeCommand(GCMD_POP); }
+    bool push() override
+    {
+        fStateStack.push_back(fState);
+        return writeCommand(GCMD_PUSH);
+    }
+
+    // Not every receiver puts everything back on pop().  BLGraphics for
+    // one keeps the modes and the text size outside of what its context
+    // saves.  So after a pop() the other side could have either the
+    // state from before the push(), or what was set since.  Only where
+    // those two agree do we still know what it has.
+    bool pop() override
+    {
+        if (!fStateStack.empty()) {
+            EncoderState inner = fState;
+            fState = fStateStack.back();
+            fStateStack.pop_back();
+            fState.known &= inner.known & matchingState(inner, fState);
+        }
+        else {
+            fState.known = 0;
+        }
 
+        return writeCommand(GCMD_POP);
+    }
 
 
-    //virtual void scale(double sxy) { scale(sxy, sxy); }
-    void rotate(double angle) { rotate(angle, 0, 0); }
 
     // Coordinate transformation
-    virtual void translate(double dx, double dy) 
-    { 
+    void transform(double* values) override
+    {
+        writeCommand(GCMD_TRANSFORM);
+        for (int i = 0; i < 6; i++)
+            writeFloat((float)values[i]);
+    }
+
+    void translate(double dx, double dy) override
+    {
         writeCommand(GCMD_TRANSLATE);
-        writeCoord(dx, dy);
+        writeFloat((float)dx);
+        writeFloat((float)dy);
     }
-    
-    virtual void scale(double sx, double sy) 
-    { 
+
+    void scale(double sx, double sy) override
+    {
         writeCommand(GCMD_SCALE);
-        writeCoord(sx, sy);
+        writeFloat((float)sx);
+        writeFloat((float)sy);
     }
-    
-    virtual void rotate(double angle, double cx, double cy) 
-    { 
+
+    void rotate(double angle, double cx, double cy) override
+    {
         writeCommand(GCMD_ROTATE);
         writeFloat((float)angle);
-        writeCoord(cx, cy); 
+        writeCoord(cx, cy);
     }
 
 
 
     // Pixel management
-    void fill(const BLStyle& s)
+    void fill(const BLVarCore& s) override
+    {
+        writeStyle(GCMD_FILL_COLOR, GCMD_FILL_STYLE, ST_FILL, fState.fill, s);
+    }
+
+    void fill(const Pixel& c) override
     {
-        writeCommand(GCMD_FILL_STYLE);
+        if (stateChanged(ST_FILL, fState.fill, (uint64_t)c.value)) {
+            writeCommand(GCMD_FILL_COLOR);
+            writeColor(c);
+        }
     }
-    virtual void fill(const BLGradient& g) 
-    { 
-        writeCommand(GCMD_FILL_GRADIENT);
-        // BUGBUG - serialize gradient
+
+    void noFill() override
+    {
+        if (stateChanged(ST_FILL, fState.fill, kNoPaint))
+            writeCommand(GCMD_FILL_NONE);
     }
-    virtual void fill(const Pixel& c) 
-    { 
-        writeCommand(GCMD_FILL_COLOR);
-        writeColor(c);
+
+    void fillOpacity(double opacity) override
+    {
+        if (stateChanged(ST_FILLOPACITY, fState.fillOpacity, (float)opacity)) {
+            writeCommand(GCMD_FILLOPACITY);
+            writeFloat((float)opacity);
+        }
     }
-    
-    virtual void noFill() { writeCommand(GCMD_FILL_NONE); }
 
-    virtual void stroke(const Pixel& c) 
+    void fillRule(int rule) override
     {
-        writeCommand(GCMD_STROKE_COLOR); 
-        writeColor(c);
+        if (stateChanged(ST_FILLRULE, fState.fillRule, (uint32_t)rule))
+            writeEnum(GCMD_FILLRULE, (uint32_t)rule);
     }
 
-    virtual void stroke(const BLStyle& s)
+    void stroke(const BLVarCore& s) override
     {
-        writeCommand(GCMD_STROKE_STYLE);
-        //writeColor(c);
+        writeStyle(GCMD_STROKE_COLOR, GCMD_STROKE_STYLE, ST_STROKE, fState.stroke, s);
+    }
+
+    void stroke(const Pixel& c) override
+    {
+        if (stateChanged(ST_STROKE, fState.stroke, (uint64_t)c.value)) {
+            writeCommand(GCMD_STROKE_COLOR);
+            writeColor(c);
+        }
+    }
+
+    void noStroke() override
+    {
+        if (stateChanged(ST_STROKE, fState.stroke, kNoPaint))
+            writeCommand(GCMD_STROKE_NONE);
     }
-    
-    virtual void noStroke() { writeCommand(GCMD_STROKE_NONE); }
 
 
     // Synchronization
-    virtual void flush()
+    bool flush() override
     {
-        writeCommand(GCMD_FLUSH);
+        return writeCommand(GCMD_FLUSH);
     }
 
     virtual void loadPixels()
@@ -180,89 +567,98 @@ public:
     }
 
     // Background management
-    virtual void clear() 
+    void clear() override
     {
         writeCommand(GCMD_CLEAR);
     }
 
-    virtual void clearRect(double x, double y, double w, double h)
+    void clearRect(double x, double y, double w, double h) override
     {
         writeCommand(GCMD_CLEARRECT);
-        writeRect(x, y, w, y);
+        writeRect(x, y, w, h);
     }
 
-    virtual void background(const Pixel& c)
+    void background(const Pixel& c) override
     {
         writeCommand(GCMD_BACKGROUND);
         writeColor(c);
     }
 
     // Clipping
-    virtual void clip(double x, double y, double w, double h) 
+    void clip(const maths::rectf& bb) override
     {
         writeCommand(GCMD_CLIP);
-        writeRect(x, y, w, y);
+        writeRect(bb.x, bb.y, bb.w, bb.h);
     }
-    virtual void noClip() { writeCommand(GCMD_NOCLIP); }
+    void noClip() override { writeCommand(GCMD_NOCLIP); }
 
     // Geometry
     // hard set a specfic pixel value
-    virtual void set(double x, double y, const Pixel& c)
+    void set(double x, double y, const Pixel& c) override
     {
         writeCommand(GCMD_SET);
         writeCoord(x, y);
         writeColor(c);
     }
-    
 
 
-    virtual void point(double x, double y) 
-    { 
+
+    void point(double x, double y) override
+    {
         writeCommand(GCMD_POINT);
         writeCoord(x, y);
     }
 
-    virtual void line(double x1, double y1, double x2, double y2) 
+    void line(double x1, double y1, double x2, double y2) override
     {
         writeCommand(GCMD_LINE);
         writeCoord(x1, y1);
         writeCoord(x2,y2);
     }
 
-    virtual void rect(double x, double y, double width, double height, double xradius, double yradius)
+    void arc(double cx, double cy, double r, double start, double sweep) override
+    {
+        writeCommand(GCMD_ARC);
+        writeCoord(cx, cy);
+        writeLength(r);
+        writeFloat((float)start);
+        writeFloat((float)sweep);
+    }
+
+    void rect(double x, double y, double width, double height, double xradius, double yradius) override
     {
         writeCommand(GCMD_ROUNDRECT);
         writeRect(x, y, width, height);
-        writeCoord(xradius, yradius);
+        writeSize(xradius, yradius);
     }
 
-    virtual void rect(double x, double y, double width, double height)
+    void rect(double x, double y, double width, double height) override
     {
         writeCommand(GCMD_RECT);
         writeRect(x, y, width, height);
     }
-    
+
     virtual void rect(const BLRect& arect)
     {
         writeCommand(GCMD_RECT);
         writeRect(arect.x, arect.y, arect.w, arect.h);
     }
 
-    virtual void ellipse(double a, double b, double c, double d) 
+    void ellipse(double a, double b, double c, double d) override
     {
         writeCommand(GCMD_ELLIPSE);
         writeCoord(a,b);
         writeCoord(c,d);
     }
 
-    virtual void circle(double cx, double cy, double diameter) 
-    { 
+    void circle(double cx, double cy, double diameter) override
+    {
         writeCommand(GCMD_CIRCLE);
         writeCoord(cx, cy);
-        writeFloat(diameter);
+        writeLength(diameter);
     }
 
-    virtual void triangle(double x1, double y1, double x2, double y2, double x3, double y3)
+    void triangle(double x1, double y1, double x2, double y2, double x3, double y3) override
     {
         writeCommand(GCMD_TRIANGLE);
         writeCoord(x1, y1);
@@ -270,7 +666,7 @@ public:
         writeCoord(x3, y3);
     }
 
-    virtual void bezier(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4)
+    void bezier(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4) override
     {
         writeCommand(GCMD_BEZIER);
         writeCoord(x1, y1);
@@ -278,26 +674,20 @@ public:
         writeCoord(x3, y3);
         writeCoord(x4, y4);
     }
-    
-    virtual void polyline(const BLPoint* pts, size_t n)
+
+    void polyline(const BLPoint* pts, size_t n) override
     {
         writeCommand(GCMD_POLYLINE);
-        writeUInt(n);
-        for (size_t i=0; i< n; i++) {
-            writeCoord(pts[i].x, pts[i].y);
-        }
+        writePoints(pts, n);
     }
-    
-    virtual void polygon(const BLPoint* pts, size_t n)
+
+    void polygon(const BLPoint* pts, size_t n) override
     {
         writeCommand(GCMD_POLYGON);
-        writeUInt(n);
-        for (size_t i=0; i< n; i++) {
-            writeCoord(pts[i].x, pts[i].y);
-        }
+        writePoints(pts, n);
     }
-    
-    virtual void quad(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4)
+
+    void quad(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4) override
     {
         writeCommand(GCMD_QUAD);
         writeCoord(x1, y1);
@@ -306,74 +696,97 @@ public:
         writeCoord(x4, y4);
     }
 
-    virtual void path(const BLPath& path)
+    // The raw encoding has never carried the path itself
+    // The compact one sends the commands, then the vertices
+    void path(const BLPath& path) override
     {
         writeCommand(GCMD_PATH);
+        if (!isCompact())
+            return;
+
+        size_t n = path.size();
+        writePoints(path.vertexData(), n);
+        fBS.writeBytes(path.commandData(), n);
     }
 
     // Bitmaps
-    virtual void image(const BLImage& img, int x, int y)
+    void image(const BLImage& img, int x, int y) override
     {
         writeCommand(GCMD_IMAGE);
         writeCoord(x, y);
         // BUGBUG - serialize image efficiently
         // maybe runlength encoding
     }
-    
-    virtual void scaleImage(const BLImage& src,
+
+    void scaleImage(const BLImage& src,
         double srcX, double srcY, double srcWidth, double srcHeight,
-        double dstX, double dstY, double dstWidth, double dstHeight)
+        double dstX, double dstY, double dstWidth, double dstHeight) override
     {
         writeCommand(GCMD_IMAGE_SCALE);
-        writeCoord(dstX, dstY);
-        writeCoord(dstWidth, dstHeight);
-        writeCoord(srcX, srcY);
-        writeCoord(srcWidth, srcHeight);
+        writeRect(dstX, dstY, dstWidth, dstHeight);
+        writeRect(srcX, srcY, srcWidth, srcHeight);
         // BUGBUG - serialize image efficiently
         // maybe runlength encoding
     }
 
-    virtual void textAlign(ALIGNMENT horizontal, ALIGNMENT vertical)
+    void textAlign(ALIGNMENT horizontal, ALIGNMENT vertical) override
     {
         writeCommand(GCMD_TEXTALIGN);
         writeUInt((uint32_t)horizontal);
         writeUInt((uint32_t)vertical);
     }
 
-    virtual void textFont(const char* fontfile)
+    // Font faces can't be sent, only names
+    void textFace(const BLFontFace& face) override {}
+
+    void textFont(const char* fontfile) override
     {
         writeCommand(GCMD_TEXTFONT);
         writeString(fontfile);
     }
-    
-    virtual void textSize(float size)
+
+    void textSize(float size) override
     {
-        writeCommand(GCMD_TEXTSIZE);
-        writeFloat((float)size);
+        if (stateChanged(ST_TEXTSIZE, fState.textSize, size)) {
+            writeCommand(GCMD_TEXTSIZE);
+            writeFloat((float)size);
+        }
     }
 
-    void text(const char* txt, double x, double y)
+    void text(const char* txt, float x, float y, float x2 = 0, float y2 = 0) override
     {
         writeCommand(GCMD_TEXT);
         writeCoord(x, y);
         writeString(txt);
     }
 
+    void textAtBaseline(const char* txt, float x, float y, float x2 = 0, float y2 = 0) override
+    {
+        writeCommand(GCMD_TEXTBASELINE);
+        writeCoord(x, y);
+        writeString(txt);
+    }
+
+    // There's nothing on this side to measure with
+    maths::vec2f textMeasure(const char* txt) override { return { 0, 0 }; }
+    float textAscent() override { return 0; }
+    float textDescent() override { return 0; }
+
     // Vertex shaping
-    void beginShape(SHAPEMODE shapeKind = SHAPEMODE::OPEN)
+    void beginShape(SHAPEMODE shapeKind = SHAPEMODE::OPEN) override
     {
         writeCommand(GCMD_BEGINSHAPE);
         writeUInt((uint32_t)shapeKind);
     }
 
-    void vertex(double x, double y)
+    void vertex(double x, double y) override
     {
         writeCommand(GCMD_VERTEX);
         writeCoord(x, y);
     }
 
     // endKind - SHAPEEND
-    void endShape(SHAPEEND endKind)
+    void endShape(SHAPEEND endKind) override
     {
         writeCommand(GCMD_ENDSHAPE);
         writeUInt((uint32_t)endKind);
@@ -134,11 +134,13 @@ public:
     // from the beginning of the data
     // if desired position is out of range, do not
     // reposition, and return false
+    // Seeking to exactly the end is allowed, that's
+    // where skipping over the last byte leaves you
     bool seek(const size_t pos)
     {
         // if position specified outside of range
         // just set it past end of stream
-        if (pos >= fsize) {
+        if (pos > fsize) {
             //fcursor = fsize;
             return false;
         }
@@ -29,8 +29,22 @@ namespace ndt {
 
 
 	struct charset {
+		// The most members we keep in the literal list.  Sets
+		// larger than this are only represented by the bitset.
+		static constexpr int kMaxLiterals = 16;
+
+	private:
 		std::bitset<256> fBits{};
 
+		// Alongside the bitset, keep a short list of the member bytes.
+		// The vectorized scanners (chunkscan.h) compare a whole block 
+		// of bytes against each of these at once.  fLiteralCount is -1
+		// when the set has grown too large to be listed.
+		// Both are private so they can not drift apart.
+		uint8_t fLiterals[kMaxLiterals]{};
+		int fLiteralCount{ 0 };
+
+	public:
 		charset() = default;
 		charset(const char achar){addChar(achar);}
 		charset(const char* chars){addChars(chars);}
@@ -38,7 +52,12 @@ namespace ndt {
 		// Add a single character to the set
 		charset& addChar(const unsigned char achar)
 		{
+			if (fBits[achar])
+				return *this;
+
 			fBits.set(achar);
+			addLiteral(achar);
+
 			return *this;
 		}
 		
@@ -47,7 +66,7 @@ namespace ndt {
 		{
 			size_t len = strlen(chars);
 			for (size_t i = 0; i < len; i++)
-				fBits.set(chars[i]);
+				addChar((unsigned char)chars[i]);
 
 			return *this;
 		}
@@ -56,8 +75,64 @@ namespace ndt {
 		charset& operator-=(const unsigned char achar)
 		{
 			fBits.reset(achar);
+			rebuildLiterals();
 			return *this;
 		}
+
+		// Number of members in the literal list, or -1 if
+		// the set is too big to be listed
+		int literalCount() const { return fLiteralCount; }
+		const uint8_t* literals() const { return fLiterals; }
+
+		// Set theoretic operations in place
+		charset& operator|=(const charset& other)
+		{
+			fBits |= other.fBits;
+			rebuildLiterals();
+			return *this;
+		}
+
+		charset& operator&=(const charset& other)
+		{
+			fBits &= other.fBits;
+			rebuildLiterals();
+			return *this;
+		}
+
+		charset& operator^=(const charset& other)
+		{
+			fBits ^= other.fBits;
+			rebuildLiterals();
+			return *this;
+		}
+
+	private:
+		// Reconstruct the literal list from the bitset, after
+		// a change that could have removed members
+		void rebuildLiterals()
+		{
+			fLiteralCount = 0;
+			for (size_t i = 0; i < 256; i++)
+			{
+				if (fBits[i])
+					addLiteral((uint8_t)i);
+			}
+		}
+
+		void addLiteral(const uint8_t achar)
+		{
+			if (fLiteralCount < 0)
+				return;
+
+			if (fLiteralCount >= kMaxLiterals) {
+				fLiteralCount = -1;
+				return;
+			}
+
+			fLiterals[fLiteralCount++] = achar;
+		}
+
+	public:
 		
 		// add a single character to the set
 		charset& operator+=(const char achar)
@@ -100,24 +175,24 @@ namespace ndt {
 	// bitwise OR, the union of two charsets
 	INLINE charset operator|(const charset& lhs, const charset& rhs) noexcept 
 	{
-		charset result{};
-		result.fBits = lhs.fBits | rhs.fBits;
+		charset result(lhs);
+		result |= rhs;
 		return result;
 	}
 
 	// bitwise AND, the intersection of two charsets
 	INLINE charset operator&(const charset& lhs, const charset& rhs) noexcept 
 	{
-		charset result{};
-		result.fBits = lhs.fBits & rhs.fBits;
+		charset result(lhs);
+		result &= rhs;
 		return result;
 	}
 	
 	// bitwise exclusive OR, the difference between the two sets
 	INLINE charset operator^(const charset& lhs, const charset& rhs) noexcept 
 	{
-		charset result{};
-		result.fBits = lhs.fBits ^ rhs.fBits;
+		charset result(lhs);
+		result ^= rhs;
 		return result;
 	}
 
@@ -0,0 +1,401 @@
+#pragma once
+
+//
+// Vectorized scanning primitives over spans of bytes
+//
+// Most of the parsers in here (xml, css, svg path data, postscript) spend
+// the bulk of their time answering one of a few questions:
+//   Where is the next '>' ?
+//   Where is the next byte that belongs to this set of delimiters?
+//   Where is the first byte that is NOT whitespace?
+//
+// Answering these a byte at a time is simple, but slow.  The routines here
+// answer the same questions 16 (SSE2) or 32 (AVX2) bytes at a time, and fall
+// back to a plain scalar loop when the CPU, the compiler, or the charset
+// itself (more than charset::kMaxLiterals members) does not allow otherwise.
+//
+// Which kernel is used is decided once, at runtime, by looking at the CPU.
+//
+// All routines take a [start, end) range, and return a pointer within that
+// range, or 'end' if nothing was found.  They never read outside the range.
+//
+// The chunk_xxx routines in chunkutil.h are built on these, so typically
+// you would use those rather than calling these directly.
+//
+
+#include "definitions.h"
+#include "charset.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NDT_SCAN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(NDT_SCAN_X86) && defined(__GNUC__) && !defined(__clang__)
+#define NDT_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(NDT_SCAN_X86) && defined(__clang__)
+#define NDT_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define NDT_TARGET_AVX2
+#endif
+
+namespace ndt
+{
+	enum SCAN_LEVEL {
+		SCAN_LEVEL_SCALAR = 0
+		, SCAN_LEVEL_SSE2
+		, SCAN_LEVEL_AVX2
+	};
+
+	// Figure out once which kernels this CPU can run
+	static INLINE int scan_detect_level() noexcept
+	{
+#if defined(NDT_SCAN_X86)
+#if defined(_MSC_VER)
+		int info[4]{};
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+
+		int level = SCAN_LEVEL_SSE2;		// SSE2 is part of the x64 baseline
+
+		if (maxLeaf >= 7)
+		{
+			__cpuid(info, 1);
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+
+			// The OS must be saving the ymm registers for us
+			bool ymmEnabled = osxsave && avx && ((_xgetbv(0) & 0x6) == 0x6);
+
+			__cpuidex(info, 7, 0);
+			bool avx2 = (info[1] & (1 << 5)) != 0;
+
+			if (ymmEnabled && avx2)
+				level = SCAN_LEVEL_AVX2;
+		}
+
+		return level;
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return SCAN_LEVEL_AVX2;
+		if (__builtin_cpu_supports("sse2"))
+			return SCAN_LEVEL_SSE2;
+		return SCAN_LEVEL_SCALAR;
+#endif
+#else
+		return SCAN_LEVEL_SCALAR;
+#endif
+	}
+
+	// The level that will be used for the life of the process
+	static INLINE int scan_level() noexcept
+	{
+		static const int level = scan_detect_level();
+		return level;
+	}
+
+	// Below this many bytes, setting up the vectors costs more than
+	// it saves, so just go with the scalar loop
+	static constexpr ptrdiff_t kScanMinVectorBytes = 16;
+
+	// Index of the lowest set bit of a non-zero mask
+	static INLINE int scan_ctz(uint32_t mask) noexcept
+	{
+#if defined(_MSC_VER)
+		unsigned long idx;
+		_BitScanForward(&idx, mask);
+		return (int)idx;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	// Index of the highest set bit of a non-zero mask
+	static INLINE int scan_clz_index(uint32_t mask) noexcept
+	{
+#if defined(_MSC_VER)
+		unsigned long idx;
+		_BitScanReverse(&idx, mask);
+		return (int)idx;
+#else
+		return 31 - __builtin_clz(mask);
+#endif
+	}
+}
+
+//
+// Scalar kernels
+// These are the reference for what the vector kernels must produce
+//
+namespace ndt
+{
+	static INLINE const uint8_t* scan_find_byte_scalar(const uint8_t* s, const uint8_t* e, const uint8_t c) noexcept
+	{
+		while (s < e && *s != c)
+			++s;
+		return s;
+	}
+
+	static INLINE const uint8_t* scan_find_in_set_scalar(const uint8_t* s, const uint8_t* e, const charset& cs) noexcept
+	{
+		while (s < e && !cs.contains(*s))
+			++s;
+		return s;
+	}
+
+	static INLINE const uint8_t* scan_find_not_in_set_scalar(const uint8_t* s, const uint8_t* e, const charset& cs) noexcept
+	{
+		while (s < e && cs.contains(*s))
+			++s;
+		return s;
+	}
+
+	// Searching backward, return a pointer just past the last byte
+	// that is NOT in the set, or 's' if they all are
+	static INLINE const uint8_t* scan_rfind_not_in_set_scalar(const uint8_t* s, const uint8_t* e, const charset& cs) noexcept
+	{
+		while (s < e && cs.contains(*(e - 1)))
+			--e;
+		return e;
+	}
+}
+
+#if defined(NDT_SCAN_X86)
+//
+// SSE2 kernels - 16 bytes at a time
+//
+namespace ndt
+{
+	// A mask with a bit set for every byte in the block that is in the set
+	static INLINE uint32_t scan_set_mask_sse2(const __m128i block, const charset& cs) noexcept
+	{
+		const uint8_t* lits = cs.literals();
+		const int count = cs.literalCount();
+
+		__m128i hits = _mm_cmpeq_epi8(block, _mm_set1_epi8((char)lits[0]));
+		for (int i = 1; i < count; i++)
+			hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8((char)lits[i])));
+
+		return (uint32_t)_mm_movemask_epi8(hits);
+	}
+
+	static INLINE const uint8_t* scan_find_byte_sse2(const uint8_t* s, const uint8_t* e, const uint8_t c) noexcept
+	{
+		const __m128i needle = _mm_set1_epi8((char)c);
+
+		while (e - s >= 16)
+		{
+			__m128i block = _mm_loadu_si128((const __m128i*)s);
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+			if (mask)
+				return s + scan_ctz(mask);
+			s += 16;
+		}
+
+		return scan_find_byte_scalar(s, e, c);
+	}
+
+	// 'invert' selects between 'find first in set' and 'find first not in set'
+	static INLINE const uint8_t* scan_find_set_sse2(const uint8_t* s, const uint8_t* e, const charset& cs, const bool invert) noexcept
+	{
+		while (e - s >= 16)
+		{
+			__m128i block = _mm_loadu_si128((const __m128i*)s);
+			uint32_t mask = scan_set_mask_sse2(block, cs);
+			if (invert)
+				mask = ~mask & 0xffff;
+
+			if (mask)
+				return s + scan_ctz(mask);
+			s += 16;
+		}
+
+		return invert ? scan_find_not_in_set_scalar(s, e, cs) : scan_find_in_set_scalar(s, e, cs);
+	}
+
+	static INLINE const uint8_t* scan_rfind_not_in_set_sse2(const uint8_t* s, const uint8_t* e, const charset& cs) noexcept
+	{
+		while (e - s >= 16)
+		{
+			__m128i block = _mm_loadu_si128((const __m128i*)(e - 16));
+			uint32_t mask = ~scan_set_mask_sse2(block, cs) & 0xffff;
+			if (mask)
+				return e - 16 + scan_clz_index(mask) + 1;
+			e -= 16;
+		}
+
+		return scan_rfind_not_in_set_scalar(s, e, cs);
+	}
+}
+
+//
+// AVX2 kernels - 32 bytes at a time
+// These are compiled for AVX2 regardless of the global compiler
+// flags, and only ever called when scan_level() says it is safe.
+//
+namespace ndt
+{
+	NDT_TARGET_AVX2
+	static inline uint32_t scan_set_mask_avx2(const __m256i block, const charset& cs) noexcept
+	{
+		const uint8_t* lits = cs.literals();
+		const int count = cs.literalCount();
+
+		__m256i hits = _mm256_cmpeq_epi8(block, _mm256_set1_epi8((char)lits[0]));
+		for (int i = 1; i < count; i++)
+			hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, _mm256_set1_epi8((char)lits[i])));
+
+		return (uint32_t)_mm256_movemask_epi8(hits);
+	}
+
+	NDT_TARGET_AVX2
+	static inline const uint8_t* scan_find_byte_avx2(const uint8_t* s, const uint8_t* e, const uint8_t c) noexcept
+	{
+		const __m256i needle = _mm256_set1_epi8((char)c);
+
+		while (e - s >= 32)
+		{
+			__m256i block = _mm256_loadu_si256((const __m256i*)s);
+			uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+			if (mask)
+				return s + scan_ctz(mask);
+			s += 32;
+		}
+
+		return scan_find_byte_sse2(s, e, c);
+	}
+
+	NDT_TARGET_AVX2
+	static inline const uint8_t* scan_find_set_avx2(const uint8_t* s, const uint8_t* e, const charset& cs, const bool invert) noexcept
+	{
+		while (e - s >= 32)
+		{
+			__m256i block = _mm256_loadu_si256((const __m256i*)s);
+			uint32_t mask = scan_set_mask_avx2(block, cs);
+			if (invert)
+				mask = ~mask;
+
+			if (mask)
+				return s + scan_ctz(mask);
+			s += 32;
+		}
+
+		return scan_find_set_sse2(s, e, cs, invert);
+	}
+
+	NDT_TARGET_AVX2
+	static inline const uint8_t* scan_rfind_not_in_set_avx2(const uint8_t* s, const uint8_t* e, const charset& cs) noexcept
+	{
+		while (e - s >= 32)
+		{
+			__m256i block = _mm256_loadu_si256((const __m256i*)(e - 32));
+			uint32_t mask = ~scan_set_mask_avx2(block, cs);
+			if (mask)
+				return e - 32 + scan_clz_index(mask) + 1;
+			e -= 32;
+		}
+
+		return scan_rfind_not_in_set_sse2(s, e, cs);
+	}
+}
+#endif	// NDT_SCAN_X86
+
+//
+// Dispatching entry points
+// These are what the rest of the code should call
+//
+namespace ndt
+{
+	// Find the first occurence of byte 'c'
+	static INLINE const uint8_t* scan_find_byte(const uint8_t* s, const uint8_t* e, const uint8_t c) noexcept
+	{
+		if (e - s < kScanMinVectorBytes)
+			return scan_find_byte_scalar(s, e, c);
+
+#if defined(NDT_SCAN_X86)
+		switch (scan_level())
+		{
+		case SCAN_LEVEL_AVX2:
+			return scan_find_byte_avx2(s, e, c);
+		case SCAN_LEVEL_SSE2:
+			return scan_find_byte_sse2(s, e, c);
+		}
+#endif
+		const uint8_t* found = (const uint8_t*)memchr(s, c, e - s);
+		return found ? found : e;
+	}
+
+	// Find the first byte that is a member of the set
+	static INLINE const uint8_t* scan_find_in_set(const uint8_t* s, const uint8_t* e, const charset& cs) noexcept
+	{
+		if (cs.literalCount() == 1)
+			return scan_find_byte(s, e, cs.literals()[0]);
+
+		if ((e - s < kScanMinVectorBytes) || (cs.literalCount() < 1))
+			return scan_find_in_set_scalar(s, e, cs);
+
+#if defined(NDT_SCAN_X86)
+		switch (scan_level())
+		{
+		case SCAN_LEVEL_AVX2:
+			return scan_find_set_avx2(s, e, cs, false);
+		case SCAN_LEVEL_SSE2:
+			return scan_find_set_sse2(s, e, cs, false);
+		}
+#endif
+		return scan_find_in_set_scalar(s, e, cs);
+	}
+
+	// Find the first byte that is NOT a member of the set
+	// This is 'skip over', as in skipping whitespace
+	static INLINE const uint8_t* scan_find_not_in_set(const uint8_t* s, const uint8_t* e, const charset& cs) noexcept
+	{
+		// Very commonly, there's only a single space to be skipped
+		// so don't bother with the vectors unless we're past that
+		if (s < e && !cs.contains(*s))
+			return s;
+
+		if ((e - s < kScanMinVectorBytes) || (cs.literalCount() < 1))
+			return scan_find_not_in_set_scalar(s, e, cs);
+
+#if defined(NDT_SCAN_X86)
+		switch (scan_level())
+		{
+		case SCAN_LEVEL_AVX2:
+			return scan_find_set_avx2(s, e, cs, true);
+		case SCAN_LEVEL_SSE2:
+			return scan_find_set_sse2(s, e, cs, true);
+		}
+#endif
+		return scan_find_not_in_set_scalar(s, e, cs);
+	}
+
+	// Searching backward from 'e', return a pointer just past the last
+	// byte that is NOT a member of the set, or 's' if they all are
+	static INLINE const uint8_t* scan_rfind_not_in_set(const uint8_t* s, const uint8_t* e, const charset& cs) noexcept
+	{
+		if (s < e && !cs.contains(*(e - 1)))
+			return e;
+
+		if ((e - s < kScanMinVectorBytes) || (cs.literalCount() < 1))
+			return scan_rfind_not_in_set_scalar(s, e, cs);
+
+#if defined(NDT_SCAN_X86)
+		switch (scan_level())
+		{
+		case SCAN_LEVEL_AVX2:
+			return scan_rfind_not_in_set_avx2(s, e, cs);
+		case SCAN_LEVEL_SSE2:
+			return scan_rfind_not_in_set_sse2(s, e, cs);
+		}
+#endif
+		return scan_rfind_not_in_set_scalar(s, e, cs);
+	}
+}
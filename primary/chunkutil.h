@@ -2,6 +2,7 @@
 
 #include "datachunk.h"
 #include "charset.h"
+#include "chunkscan.h"
 
 namespace ndt
 {
@@ -51,43 +52,26 @@ namespace ndt
 		// Trim the left side of skippable characters
 		static INLINE DataChunk chunk_ltrim(const DataChunk& a, const charset& skippable) noexcept
 		{
-			const uint8_t* start = a.fStart;
-			const uint8_t* end = a.fEnd;
-			while (start < end && skippable(*start))
-				++start;
-			return { start, end };
+			return { scan_find_not_in_set(a.fStart, a.fEnd, skippable), a.fEnd };
 		}
 
 		// trim the right side of skippable characters
 		static INLINE DataChunk chunk_rtrim(const DataChunk& a, const charset& skippable) noexcept
 		{
-			const uint8_t* starting = a.fStart;
-			const uint8_t* ending = a.fEnd;
-			while ((starting < ending) && skippable.contains(*(ending - 1)))
-				--ending;
-
-			return { starting, ending };
+			return { a.fStart, scan_rfind_not_in_set(a.fStart, a.fEnd, skippable) };
 		}
 
 		// trim the left and right side of skippable characters
 		static INLINE DataChunk chunk_trim(const DataChunk& a, const charset& skippable) noexcept
 		{
-			const uint8_t* start = a.fStart;
-			const uint8_t* end = a.fEnd;
-			while (start < end && skippable(*start))
-				++start;
-			while (start < end && skippable(*(end - 1)))
-				--end;
+			const uint8_t* start = scan_find_not_in_set(a.fStart, a.fEnd, skippable);
+			const uint8_t* end = scan_rfind_not_in_set(start, a.fEnd, skippable);
 			return { start, end };
 		}
 		
 		static INLINE DataChunk chunk_skip_wsp(const DataChunk& a) noexcept
 		{
-			const uint8_t* start = a.fStart;
-			const uint8_t* end = a.fEnd;
-			while (start < end && wspChars(*start))
-				++start;
-			return { start, end };
+			return { scan_find_not_in_set(a.fStart, a.fEnd, wspChars), a.fEnd };
 		}
 		
 		static INLINE DataChunk chunk_subchunk(const DataChunk& a, const size_t startAt, const size_t sz) noexcept
@@ -149,11 +133,9 @@ namespace ndt
 		{
 			const uint8_t* start = a.fStart;
 			const uint8_t* end = a.fEnd;
-			const uint8_t* tokenEnd = start;
-			while (tokenEnd < end && !delims(*tokenEnd))
-				++tokenEnd;
+			const uint8_t* tokenEnd = scan_find_in_set(start, end, delims);
 
-			if (delims(*tokenEnd))
+			if (tokenEnd < end)
 			{
 				a.fStart = tokenEnd + 1;
 			}
@@ -172,12 +154,7 @@ namespace ndt
 		// or or the whole chunk of the character is not found
 		static INLINE DataChunk chunk_find_char(const DataChunk& a, char c) noexcept
 		{
-			const uint8_t* start = a.fStart;
-			const uint8_t* end = a.fEnd;
-			while (start < end && *start != c)
-				++start;
-
-			return { start, end };
+			return { scan_find_byte(a.fStart, a.fEnd, (uint8_t)c), a.fEnd };
 		}
 		
 		// Take a chunk containing a series of digits and turn
@@ -186,7 +186,7 @@ namespace ndt
 		return dc;
 	}
 	
-	static INLINE DataChunk& chunk_skip_to_end(DataChunk& dc) noexcept { dc.fStart = dc.fEnd; }
+	static INLINE DataChunk& chunk_skip_to_end(DataChunk& dc) noexcept { dc.fStart = dc.fEnd; return dc; }
 
 	
 
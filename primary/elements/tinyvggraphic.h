@@ -9,6 +9,56 @@
 
 using namespace tinyvg;
 
+// The baked commands are the BLPath commands, plus the arc
+static_assert(bakedMove == BL_PATH_CMD_MOVE && bakedOn == BL_PATH_CMD_ON &&
+	bakedQuad == BL_PATH_CMD_QUAD && bakedCubic == BL_PATH_CMD_CUBIC &&
+	bakedClose == BL_PATH_CMD_CLOSE, "baked commands must match BLPath commands");
+
+// Append the vertices of a baked figure to a path
+// Runs of regular vertices are written straight into the 
+// path's own command and vertex arrays.  Arcs are handed to
+// the path, so it can turn them into curves.
+static inline void appendBakedPath(BLPath& path, const uint8_t* cmds, const tvg_point* vtx, size_t count)
+{
+	path.reserve(path.size() + count);
+
+	size_t i = 0;
+	while (i < count)
+	{
+		if (cmds[i] == bakedArc)
+		{
+			if (i + 2 >= count)
+				break;
+
+			uint32_t flags = (uint32_t)vtx[i + 1].y;
+			path.ellipticArcTo(BLPoint(vtx[i].x, vtx[i].y), vtx[i + 1].x,
+				(flags & bakedArcLarge) != 0, (flags & bakedArcSweep) != 0,
+				BLPoint(vtx[i + 2].x, vtx[i + 2].y));
+			i += 3;
+			continue;
+		}
+
+		size_t runEnd = i + 1;
+		while ((runEnd < count) && (cmds[runEnd] < bakedArc))
+			runEnd++;
+
+		size_t n = runEnd - i;
+		uint8_t* cmdOut = nullptr;
+		BLPoint* vtxOut = nullptr;
+		if (path.modifyOp(BL_MODIFY_OP_APPEND_GROW, n, &cmdOut, &vtxOut) != BL_SUCCESS)
+			return;
+
+		memcpy(cmdOut, cmds + i, n);
+		for (size_t j = 0; j < n; j++)
+		{
+			vtxOut[j].x = vtx[i + j].x;
+			vtxOut[j].y = vtx[i + j].y;
+		}
+
+		i = runEnd;
+	}
+}
+
 struct VGCommandPath
 {
 	int fCommand;
@@ -21,7 +71,7 @@ struct VGCommandPath
 
 private:
 	// convert a tinyvg_style_t to a BLStyle
-	bool initStyle(BLVar& s, tvg_style_t& tvgs)
+	bool initStyle(BLVar& s, const tvg_style_t& tvgs)
 	{
 
 		switch (tvgs.kind) {
@@ -157,6 +207,22 @@ public:
 		}
 	}
 
+	// Construct from one draw of a baked image
+	// The path is built straight from the baked vertices
+	VGCommandPath(const tvg_baked_t& baked, const tvg_baked_draw_t& draw)
+	{
+		fCommand = draw.command;
+		fLineWidth = draw.lineWidth;
+
+		if (draw.lineStyle != kTvgNoStyle)
+			initStyle(fLineStyle, baked.styles[draw.lineStyle]);
+		if (draw.fillStyle != kTvgNoStyle)
+			initStyle(fFillStyle, baked.styles[draw.fillStyle]);
+
+		appendBakedPath(fPath, baked.commands.data() + draw.firstVertex,
+			baked.vertices.data() + draw.firstVertex, draw.vertexCount);
+	}
+
 	void draw(IGraphics & ctx)
 	{
 		switch (fCommand) {
@@ -208,34 +274,49 @@ public:
 	}
 };
 
+//
+// TinyVGGraphic
+// The file is decoded with tvg_bake(), and the figures are built
+// from the baked form.  The baked form is kept, and can be handed
+// to another TinyVGGraphic, so drawing the same image many times 
+// over (a set of icons for instance) only decodes the file once.
+//
 class TinyVGGraphic : public GraphicElement
 {
-	BinStream& fStream;
+	std::shared_ptr<const tvg_baked_t> fBaked{};
 	std::vector<VGCommandPath> fFigures;
 
-public:
-	TinyVGGraphic(BinStream& bs)
-		:fStream(bs)
+	void buildFigures()
 	{
-		tvgparser parser(bs);
+		if (fBaked == nullptr)
+			return;
 
-		// Assuming the parse was ok
-		// BUGBUG - should check isValid()
-		setBounds(maths::rectf{ 0, 0, (float)parser.header.width, (float)parser.header.height });
+		// BUGBUG - should check fBaked->isValid
+		setBounds(maths::rectf{ 0, 0, (float)fBaked->header.width, (float)fBaked->header.height });
 		setFrame(bounds());
 
 		// Construct our graphic commands
-		while (true)
-		{
-			tvg_command_t cmd;
-			if (!parser.next(cmd))
-				break;
+		fFigures.reserve(fBaked->draws.size());
+		for (const auto& d : fBaked->draws)
+			fFigures.emplace_back(*fBaked, d);
+	}
 
-			VGCommandPath fig(cmd);
-			fFigures.push_back(fig);
-		}
+public:
+	TinyVGGraphic(BinStream& bs)
+		: fBaked(tvg_bake(bs))
+	{
+		buildFigures();
 	}
 
+	TinyVGGraphic(std::shared_ptr<const tvg_baked_t> baked)
+		: fBaked(baked)
+	{
+		buildFigures();
+	}
+
+	// The decoded form of the image, to be shared with other graphics
+	const std::shared_ptr<const tvg_baked_t>& baked() const { return fBaked; }
+
 	void drawSelf(IGraphics & ctx) override
 	{
 		for (int i = 0; i < fFigures.size(); i++)
@@ -251,6 +332,13 @@ public:
 		return g;
 	}
 
+	static std::shared_ptr<TinyVGGraphic> createFromBaked(std::shared_ptr<const tvg_baked_t> baked)
+	{
+		auto g = std::make_shared<TinyVGGraphic>(baked);
+
+		return g;
+	}
+
 	static std::shared_ptr<TinyVGGraphic> createFromFilename(const char *filename)
 	{
 		ndt::FileStream fs(filename);
@@ -23,9 +23,16 @@
 //
 
 #include <cstdint>
+#include <cstring>
+#include <limits>
 #include <memory>
 #include <vector>
 
+#if defined(_M_X64) || defined(__SSE2__)
+#define TVG_SSE2 1
+#include <emmintrin.h>
+#endif
+
 #include "binstream.hpp"
 //#include "bstream.h"
 #include "bitbang.h"
@@ -256,7 +263,7 @@ namespace tinyvg
 		size_t commandStart = 0;
 
 		tvgparser(BinStream& abs)
-			:bs(bs)
+			:bs(abs)
 		{
 			init(0);
 			commandStart = bs.tell();
@@ -661,10 +668,24 @@ namespace tinyvg
 		}
 
 		// Read a fixed value and turn it into floating point
+		// Units are signed, so sign extend from whatever size
+		// the coordinate range says they are
 		float readUnit()
 		{
 			uint32_t value = readRangeInt();
-			return (float)value / (float)(1 << header.fracscale);
+			int32_t svalue = (int32_t)value;
+
+			switch (header.coordinateRange)
+			{
+			case CoordinateRange::Default:
+				svalue = (int16_t)value;
+				break;
+			case CoordinateRange::Reduced:
+				svalue = (int8_t)value;
+				break;
+			}
+
+			return (float)svalue / (float)(1 << header.fracscale);
 		}
 
 		// Read an x,y pair of Units
@@ -895,4 +916,700 @@ namespace tinyvg
 		}
 	};
 
-}
\ No newline at end of file
+
+	//
+	// Fast path
+	//
+	// tvgparser::next() is handy for poking through a file one command at a
+	// time, but it reads a byte at a time through the stream, and builds a 
+	// contour object for every path element, which then has to be walked again
+	// to turn it into something that can be drawn.
+	//
+	// tvg_bake() does the whole file in one pass, straight from memory.  The 
+	// coordinate range and scale are looked up once, runs of coordinates are 
+	// converted to floats in bulk, and all the geometry goes into a single flat
+	// list of vertices, with one command per vertex.  The command values are 
+	// the same ones BLPath uses (move, on, quad, cubic, close), so the vertices
+	// of a figure can be copied straight into a path.  The only thing that 
+	// does not fit that model is the arc, which takes 3 vertices:
+	//   [radius x, radius y] [rotation, flags] [target x, target y]
+	//
+	// The baked form holds no references to the file it came from, so it can 
+	// be kept around, shared, and drawn any number of times.
+	//
+
+	// Per vertex commands of a baked figure
+	enum BakedCommands : uint8_t {
+		bakedMove = 0,
+		bakedOn = 1,
+		bakedQuad = 2,
+		bakedCubic = 3,
+		bakedClose = 4,
+		bakedArc = 5,		// followed by 2 bakedArcData vertices
+		bakedArcData = 6,
+	};
+
+	enum BakedArcFlags {
+		bakedArcLarge = 1,
+		bakedArcSweep = 2,
+	};
+
+	static constexpr uint32_t kTvgNoStyle = 0xffffffff;
+
+	// One top level command, and the range of vertices that make up its figure
+	struct tvg_baked_draw_t {
+		uint32_t command{ 0 };
+		uint32_t fillStyle{ kTvgNoStyle };	// index into tvg_baked_t::styles
+		uint32_t lineStyle{ kTvgNoStyle };
+		float lineWidth{ 0 };
+		uint32_t firstVertex{ 0 };
+		uint32_t vertexCount{ 0 };
+	};
+
+	struct tvg_baked_t {
+		tvg_header_t header{};
+		std::vector<tinyvg_rgba8888_t> colorTable{};
+		std::vector<tvg_style_t> styles{};
+		std::vector<tvg_baked_draw_t> draws{};
+		std::vector<uint8_t> commands{};
+		std::vector<tvg_point> vertices{};
+
+		// The whole file was read, right up to the EndOfDocument
+		bool isValid{ false };
+
+		size_t memoryUsed() const
+		{
+			return sizeof(tvg_baked_t)
+				+ colorTable.capacity() * sizeof(tinyvg_rgba8888_t)
+				+ styles.capacity() * sizeof(tvg_style_t)
+				+ draws.capacity() * sizeof(tvg_baked_draw_t)
+				+ commands.capacity()
+				+ vertices.capacity() * sizeof(tvg_point);
+		}
+	};
+
+	static_assert(sizeof(tvg_point) == 2 * sizeof(float), "tvg_point must be a pair of floats");
+
+	// Decode 'count' units, of the given coordinate range, 
+	// from 'src', multiplying each by 'scale'
+	// The caller makes sure there are enough bytes
+	static inline void tvg_decode_units(const uint8_t* src, size_t count, int range, float scale, float* dst)
+	{
+		size_t i = 0;
+
+#if defined(TVG_SSE2)
+		__m128 vscale = _mm_set1_ps(scale);
+#endif
+
+		switch (range)
+		{
+		case CoordinateRange::Default:
+#if defined(TVG_SSE2)
+			// 8 16-bit units at a time, sign extended by unpacking each
+			// into the high half of a 32-bit lane and shifting back down
+			for (; i + 8 <= count; i += 8)
+			{
+				__m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+				__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+				__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+				_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+				_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+			}
+#endif
+			for (; i < count; i++)
+				dst[i] = (float)(int16_t)(src[i * 2] | (src[i * 2 + 1] << 8)) * scale;
+			break;
+
+		case CoordinateRange::Reduced:
+#if defined(TVG_SSE2)
+			for (; i + 8 <= count; i += 8)
+			{
+				__m128i v = _mm_loadl_epi64((const __m128i*)(src + i));
+				__m128i w = _mm_unpacklo_epi8(v, v);
+				__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(w, w), 24);
+				__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(w, w), 24);
+				_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+				_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+			}
+#endif
+			for (; i < count; i++)
+				dst[i] = (float)(int8_t)src[i] * scale;
+			break;
+
+		case CoordinateRange::Enhanced:
+#if defined(TVG_SSE2)
+			// x86 is little-endian, same as the file
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i v = _mm_loadu_si128((const __m128i*)(src + i * 4));
+				_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), vscale));
+			}
+#endif
+			for (; i < count; i++)
+			{
+				const uint8_t* p = src + i * 4;
+				int32_t v = (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+				dst[i] = (float)v * scale;
+			}
+			break;
+
+		default:
+			memset(dst, 0, count * sizeof(float));
+			break;
+		}
+	}
+
+	//
+	// tvgbaker
+	// Does the work of tvg_bake()
+	// Everything is read from a plain pointer, with a check that 
+	// the bytes are there before each read.  Running off the end of the
+	// data, or anything else unexpected, stops the bake, and the 
+	// result is marked as invalid.
+	//
+	struct tvgbaker
+	{
+		// Number of units taken by each path instruction, indexed by
+		// ContourCommands, not counting the flags byte of the arcs
+		static constexpr int kPathInstructionUnits[8] = { 2, 1, 1, 6, 3, 5, 0, 4 };
+		static constexpr int kUnitBytes[4] = { 2, 1, 4, 0 };
+
+		tvg_baked_t& fBaked;
+		const uint8_t* fCursor{ nullptr };
+		const uint8_t* fEnd{ nullptr };
+		bool fError{ false };
+
+		int fRange{ 0 };
+		size_t fUnitBytes{ 2 };
+		float fScale{ 1.0f };
+
+		tvg_point fCurrent{};
+		tvg_point fFigureStart{};
+
+		std::vector<uint32_t> fSegmentLengths{};
+		std::vector<float> fScratch{};
+
+		tvgbaker(tvg_baked_t& baked, const uint8_t* data, size_t size)
+			: fBaked(baked)
+			, fCursor(data)
+			, fEnd(data + size)
+		{
+		}
+
+		bool need(size_t n)
+		{
+			if (fError || ((size_t)(fEnd - fCursor) < n))
+			{
+				fError = true;
+				return false;
+			}
+
+			return true;
+		}
+
+		uint8_t readOctet()
+		{
+			if (!need(1))
+				return 0;
+
+			return *fCursor++;
+		}
+
+		uint32_t readUInt()
+		{
+			uint32_t result = 0;
+
+			for (int count = 0; count < 5; count++)
+			{
+				uint8_t abyte = readOctet();
+				result |= (uint32_t)(abyte & 0x7f) << (7 * count);
+
+				if ((abyte & 0x80) == 0)
+					break;
+			}
+
+			return result;
+		}
+
+		// Width and height are unsigned, unlike all other units
+		uint32_t readRangeInt()
+		{
+			if (!need(fUnitBytes))
+				return 0;
+
+			uint32_t value = 0;
+			for (size_t i = 0; i < fUnitBytes; i++)
+				value |= (uint32_t)fCursor[i] << (8 * i);
+			fCursor += fUnitBytes;
+
+			return value;
+		}
+
+		bool readUnits(float* dst, size_t count)
+		{
+			if (!need(count * fUnitBytes))
+			{
+				memset(dst, 0, count * sizeof(float));
+				return false;
+			}
+
+			tvg_decode_units(fCursor, count, fRange, fScale, dst);
+			fCursor += count * fUnitBytes;
+
+			return true;
+		}
+
+		float readUnit()
+		{
+			float value = 0;
+			readUnits(&value, 1);
+			return value;
+		}
+
+		float readFloat()
+		{
+			if (!need(4))
+				return 0;
+
+			float value;
+			memcpy(&value, fCursor, 4);
+			fCursor += 4;
+
+			return value;
+		}
+
+		bool readHeader()
+		{
+			if (!need(4))
+				return false;
+
+			tvg_header_t& header = fBaked.header;
+			header.magic[0] = fCursor[0];
+			header.magic[1] = fCursor[1];
+			header.version = fCursor[2];
+
+			uint8_t bits = fCursor[3];
+			fCursor += 4;
+
+			if ((header.magic[0] != 0x72) || (header.magic[1] != 0x56) || (header.version != 1))
+				return false;
+
+			header.fracscale = binops::BITSVALUE(bits, 0, 3);
+			header.colorEncoding = binops::BITSVALUE(bits, 4, 5);
+			header.coordinateRange = binops::BITSVALUE(bits, 6, 7);
+
+			// Look up the decoding parameters once, 
+			// rather than for every unit
+			fRange = header.coordinateRange;
+			fUnitBytes = kUnitBytes[fRange];
+			fScale = 1.0f / (float)(1 << header.fracscale);
+			if (fUnitBytes == 0)
+				return false;
+
+			header.width = readRangeInt();
+			header.height = readRangeInt();
+			header.colorCount = readUInt();
+
+			return !fError;
+		}
+
+		bool readColorTable()
+		{
+			size_t count = fBaked.header.colorCount;
+			static constexpr size_t kColorBytes[4] = { 4, 2, 16, 0 };
+
+			// Custom color encodings aren't supported, and with no size
+			// per color, the count can't be checked against the input
+			if (kColorBytes[fBaked.header.colorEncoding] == 0)
+				return false;
+
+			if (!need(count * kColorBytes[fBaked.header.colorEncoding]))
+				return false;
+
+			auto& colors = fBaked.colorTable;
+			colors.resize(count);
+
+			switch (fBaked.header.colorEncoding)
+			{
+			case ColorEncoding::RGBA8888:
+				for (size_t i = 0; i < count; i++, fCursor += 4)
+					colors[i] = tinyvg_rgba8888_t(fCursor[0], fCursor[1], fCursor[2], fCursor[3]);
+				break;
+
+			case ColorEncoding::RGB565:
+				for (size_t i = 0; i < count; i++, fCursor += 2)
+				{
+					tinyvg_rgb565_t c;
+					c.v = (uint16_t)(fCursor[0] | (fCursor[1] << 8));
+					colors[i] = tinyvg_rgba8888_t(c.r, c.g, c.b);
+				}
+				break;
+
+			case ColorEncoding::RGBAF32:
+				for (size_t i = 0; i < count; i++)
+				{
+					float r = readFloat();
+					float g = readFloat();
+					float b = readFloat();
+					float a = readFloat();
+					colors[i] = tinyvg_rgba8888_t((int)(r * 255), (int)(g * 255), (int)(b * 255), (int)(a * 255));
+				}
+				break;
+
+			default:
+				return false;
+			}
+
+			return true;
+		}
+
+		// Read a style, and return its index in the style table
+		uint32_t readStyle(int kind)
+		{
+			tvg_style_t s;
+			s.kind = kind;
+
+			uint32_t index0 = 0;
+			uint32_t index1 = 0;
+
+			switch (kind)
+			{
+			case DrawingStyle::FlatColored:
+				index0 = readUInt();
+				break;
+
+			case DrawingStyle::LinearGradient:
+			case DrawingStyle::RadialGradient:
+			{
+				float pts[4];
+				readUnits(pts, 4);
+				s.point_0 = { pts[0], pts[1] };
+				s.point_1 = { pts[2], pts[3] };
+				index0 = readUInt();
+				index1 = readUInt();
+			}
+			break;
+
+			default:
+				fError = true;
+				break;
+			}
+
+			if (fError || (index0 >= fBaked.colorTable.size()) || (index1 >= fBaked.colorTable.size()))
+			{
+				fError = true;
+				return kTvgNoStyle;
+			}
+
+			s.color_0 = fBaked.colorTable[index0];
+			s.color_1 = fBaked.colorTable[index1];
+
+			fBaked.styles.push_back(s);
+
+			return (uint32_t)fBaked.styles.size() - 1;
+		}
+
+		void addVertex(uint8_t cmd, float x, float y)
+		{
+			fBaked.commands.push_back(cmd);
+			fBaked.vertices.push_back({ x, y });
+		}
+
+		void addClose()
+		{
+			addVertex(bakedClose, std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN());
+			fCurrent = fFigureStart;
+		}
+
+		// Make room for 'count' vertices, and return where they start
+		size_t growVertices(size_t count, uint8_t cmd)
+		{
+			size_t first = fBaked.vertices.size();
+			fBaked.vertices.resize(first + count);
+			fBaked.commands.resize(first + count, cmd);
+
+			return first;
+		}
+
+		// A run of connected points, read in one shot
+		// straight into the vertex list
+		// FillPolygon, DrawLineLoop, DrawLineStrip, OutlineFillPolygon
+		void readPolygon(uint32_t count, bool close)
+		{
+			if (!need((size_t)count * 2 * fUnitBytes))
+				return;
+
+			size_t first = growVertices(count, bakedOn);
+			readUnits(&fBaked.vertices[first].x, (size_t)count * 2);
+			fBaked.commands[first] = bakedMove;
+
+			fFigureStart = fBaked.vertices[first];
+			fCurrent = fBaked.vertices.back();
+
+			if (close)
+				addClose();
+		}
+
+		// Independent lines, each one its own figure
+		void readLines(uint32_t count)
+		{
+			if (!need((size_t)count * 4 * fUnitBytes))
+				return;
+
+			size_t first = growVertices((size_t)count * 2, bakedOn);
+			readUnits(&fBaked.vertices[first].x, (size_t)count * 4);
+
+			uint8_t* cmds = fBaked.commands.data() + first;
+			for (size_t i = 0; i < count; i++)
+				cmds[i * 2] = bakedMove;
+		}
+
+		// Rectangles are turned into closed figures, the same
+		// way BLPath::addRect() does it
+		void readRectangles(uint32_t count)
+		{
+			if (!need((size_t)count * 4 * fUnitBytes))
+				return;
+
+			fScratch.resize((size_t)count * 4);
+			readUnits(fScratch.data(), fScratch.size());
+
+			size_t first = growVertices((size_t)count * 5, bakedOn);
+			uint8_t* cmds = fBaked.commands.data() + first;
+			tvg_point* vtx = fBaked.vertices.data() + first;
+			float nan = std::numeric_limits<float>::quiet_NaN();
+
+			for (size_t i = 0; i < count; i++, cmds += 5, vtx += 5)
+			{
+				float x0 = fScratch[i * 4 + 0];
+				float y0 = fScratch[i * 4 + 1];
+				float x1 = x0 + fScratch[i * 4 + 2];
+				float y1 = y0 + fScratch[i * 4 + 3];
+
+				cmds[0] = bakedMove;
+				cmds[4] = bakedClose;
+				vtx[0] = { x0, y0 };
+				vtx[1] = { x1, y0 };
+				vtx[2] = { x1, y1 };
+				vtx[3] = { x0, y1 };
+				vtx[4] = { nan, nan };
+			}
+		}
+
+		// FillPath, DrawLinePath, OutlineFillPath
+		void readPath(uint32_t segmentCount)
+		{
+			// the lengths of all the segments come first, at least
+			// a byte each, so a count bigger than what's left is corrupt
+			if (!need(segmentCount))
+				return;
+
+			fSegmentLengths.resize(segmentCount);
+			for (uint32_t i = 0; i < segmentCount && !fError; i++)
+				fSegmentLengths[i] = readUInt() + 1;
+
+			for (uint32_t seg = 0; seg < segmentCount && !fError; seg++)
+			{
+				float v[6];
+				readUnits(v, 2);
+				addVertex(bakedMove, v[0], v[1]);
+				fFigureStart = { v[0], v[1] };
+				fCurrent = fFigureStart;
+
+				for (uint32_t ins = 0; ins < fSegmentLengths[seg] && !fError; ins++)
+				{
+					uint8_t insBits = readOctet();
+					int kind = binops::BITSVALUE(insBits, 0, 2);
+
+					// A line width change within a path is not 
+					// something we can draw, so skip it
+					if (binops::BITSVALUE(insBits, 4, 4))
+						readUnit();
+
+					uint8_t flags = 0;
+					if ((kind == ContourCommands::arcCircleTo) || (kind == ContourCommands::arcEllipseTo))
+					{
+						uint8_t arcBits = readOctet();
+						if (arcBits & 1)
+							flags |= bakedArcLarge;
+						if (!binops::BITSVALUE(arcBits, 1, 1))
+							flags |= bakedArcSweep;
+					}
+
+					if (!readUnits(v, kPathInstructionUnits[kind]))
+						break;
+
+					switch (kind)
+					{
+					case ContourCommands::lineTo:
+						addVertex(bakedOn, v[0], v[1]);
+						break;
+
+					case ContourCommands::hlineTo:
+						addVertex(bakedOn, v[0], fCurrent.y);
+						break;
+
+					case ContourCommands::vlineTo:
+						addVertex(bakedOn, fCurrent.x, v[0]);
+						break;
+
+					case ContourCommands::cubicBezierTo:
+						addVertex(bakedCubic, v[0], v[1]);
+						addVertex(bakedCubic, v[2], v[3]);
+						addVertex(bakedOn, v[4], v[5]);
+						break;
+
+					case ContourCommands::arcCircleTo:
+						addVertex(bakedArc, v[0], v[0]);
+						addVertex(bakedArcData, 0, (float)flags);
+						addVertex(bakedArcData, v[1], v[2]);
+						break;
+
+					case ContourCommands::arcEllipseTo:
+						addVertex(bakedArc, v[0], v[1]);
+						addVertex(bakedArcData, v[2], (float)flags);
+						addVertex(bakedArcData, v[3], v[4]);
+						break;
+
+					case ContourCommands::closePath:
+						addClose();
+						continue;
+
+					case ContourCommands::quadraticBezierTo:
+						addVertex(bakedQuad, v[0], v[1]);
+						addVertex(bakedOn, v[2], v[3]);
+						break;
+					}
+
+					fCurrent = fBaked.vertices.back();
+				}
+			}
+		}
+
+		// Read one top level command
+		// returns false at the end of the document, or on error
+		bool readCommand()
+		{
+			uint8_t cmdBits = readOctet();
+			if (fError)
+				return false;
+
+			tvg_baked_draw_t draw;
+			draw.command = binops::BITSVALUE(cmdBits, 0, 5);
+			int primaryStyle = binops::BITSVALUE(cmdBits, 6, 7);
+			draw.firstVertex = (uint32_t)fBaked.vertices.size();
+
+			uint32_t count = 0;
+
+			switch (draw.command)
+			{
+			case Commands::EndOfDocument:
+				fBaked.isValid = true;
+				return false;
+
+			// fill commands
+			case Commands::FillPolygon:
+			case Commands::FillRectangles:
+			case Commands::FillPath:
+				count = readUInt() + 1;
+				draw.fillStyle = readStyle(primaryStyle);
+				break;
+
+			// line commands
+			case Commands::DrawLines:
+			case Commands::DrawLineLoop:
+			case Commands::DrawLineStrip:
+			case Commands::DrawLinePath:
+				count = readUInt() + 1;
+				draw.lineStyle = readStyle(primaryStyle);
+				draw.lineWidth = readUnit();
+				break;
+
+			// outline and fill commands
+			case Commands::OutlineFillPolygon:
+			case Commands::OutlineFillRectangles:
+			case Commands::OutlineFillPath:
+			{
+				uint8_t bits = readOctet();
+				count = binops::BITSVALUE(bits, 0, 5) + 1;
+				draw.fillStyle = readStyle(primaryStyle);
+				draw.lineStyle = readStyle(binops::BITSVALUE(bits, 6, 7));
+				draw.lineWidth = readUnit();
+			}
+			break;
+
+			default:
+				fError = true;
+				return false;
+			}
+
+			switch (draw.command)
+			{
+			case Commands::FillPolygon:
+			case Commands::DrawLineLoop:
+			case Commands::OutlineFillPolygon:
+				readPolygon(count, true);
+				break;
+
+			case Commands::DrawLineStrip:
+				readPolygon(count, false);
+				break;
+
+			case Commands::DrawLines:
+				readLines(count);
+				break;
+
+			case Commands::FillRectangles:
+			case Commands::OutlineFillRectangles:
+				readRectangles(count);
+				break;
+
+			case Commands::FillPath:
+			case Commands::DrawLinePath:
+			case Commands::OutlineFillPath:
+				readPath(count);
+				break;
+			}
+
+			if (fError)
+				return false;
+
+			draw.vertexCount = (uint32_t)fBaked.vertices.size() - draw.firstVertex;
+			fBaked.draws.push_back(draw);
+
+			return true;
+		}
+
+		bool bake()
+		{
+			if (!readHeader() || !readColorTable())
+				return false;
+
+			// Most files take at least a couple of bytes per vertex
+			size_t remaining = fEnd - fCursor;
+			fBaked.vertices.reserve(remaining / 4);
+			fBaked.commands.reserve(remaining / 4);
+
+			while (readCommand())
+				;
+
+			return fBaked.isValid;
+		}
+	};
+
+	// Decode a whole tinyvg image from memory
+	static inline std::shared_ptr<tvg_baked_t> tvg_bake(const uint8_t* data, size_t size)
+	{
+		auto baked = std::make_shared<tvg_baked_t>();
+		tvgbaker baker(*baked, data, size);
+		baker.bake();
+
+		return baked;
+	}
+
+	// Decode from the current position of a stream
+	static inline std::shared_ptr<tvg_baked_t> tvg_bake(BinStream& bs)
+	{
+		return tvg_bake((const uint8_t*)bs.getPositionPointer(), bs.remaining());
+	}
+}
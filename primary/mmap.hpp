@@ -2,18 +2,40 @@
 
 /*
 	mmap is the rough equivalent of the mmap() function on Linux
-	This basically allows you to memory map a file, which means you 
-	can access a pointer to the file's contents without having to 
+	This basically allows you to memory map a file, which means you
+	can access a pointer to the file's contents without having to
 	go through IO routines.
 
+	On Windows this is built on CreateFileMapping/MapViewOfFile,
+	everywhere else it's open/mmap/madvise.  Either way, what you
+	get back is the same; a pointer and a size, or a DataChunk.
+
 	Usage:
-	local m = mmap(filename)
+	auto m = mmap::create_shared(filename);
+	DataChunk s = m->getChunk();
+
+	For more control, hand in some options
+	mmap_options opts{};
+	opts.access = MMAP_ACCESS_SEQUENTIAL;	// going to read it front to back
+	opts.prefault = true;					// fault the whole thing in now
+	auto m = mmap::create_shared(filename, opts);
 
-	local bs = binstream(m:getPointer(), #m)
+	Anonymous mappings, backed by nothing but memory, are
+	good for large scratch buffers
+	auto scratch = mmap::create_anonymous(64 * 1024 * 1024);
 */
+
+#if defined(_WIN32)
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <cstdio>
 #include <string>
 #include <cstdint>
@@ -23,19 +45,51 @@
 
 namespace ndt
 {
+    // How the mapping is going to be read, so the OS can
+    // do the right thing with read-ahead
+    enum MMAP_ACCESS {
+        MMAP_ACCESS_NORMAL = 0,
+        MMAP_ACCESS_SEQUENTIAL,		// front to back, read-ahead aggressively
+        MMAP_ACCESS_RANDOM,			// all over the place, don't bother reading ahead
+    };
+
+    struct mmap_options {
+        int access{ MMAP_ACCESS_NORMAL };
+
+        // Fault all the pages in when the mapping is created, rather
+        // than one at a time as they're touched.
+        bool prefault{ false };
+
+        // Changes made through the mapping go back to the file.
+        // The file is created if it does not exist.
+        bool writable{ false };
+
+        // For writable mappings, make the file exactly this big, growing
+        // or cutting short whatever is already there, so nothing stale
+        // is left past the end.  0 means use the size the file already is.
+        size_t size{ 0 };
+    };
+
     class mmap
     {
         void* fData{};
         size_t fSize{};
         bool fIsValid{};
+        bool fIsWritable{};
 
+#if defined(_WIN32)
         HANDLE fFileHandle{};
         HANDLE fMapHandle{};
+#else
+        int fFileDescriptor{ -1 };
+#endif
 
     public:
-        mmap(HANDLE filehandle, HANDLE maphandle, void* data, size_t length)
+#if defined(_WIN32)
+        mmap(HANDLE filehandle, HANDLE maphandle, void* data, size_t length, bool writable = false)
             :fData(data)
             , fSize(length)
+            , fIsWritable(writable)
             , fFileHandle(filehandle)
             , fMapHandle(maphandle)
         {
@@ -50,13 +104,32 @@ namespace ndt
             , fFileHandle(nullptr)
             , fMapHandle(nullptr)
         {}
+#else
+        mmap(int fd, void* data, size_t length, bool writable = false)
+            :fData(data)
+            , fSize(length)
+            , fIsWritable(writable)
+            , fFileDescriptor(fd)
+        {
+            fIsValid = true;
+        }
+
+        mmap() = default;
+#endif
+
+        mmap(const mmap&) = delete;
+        mmap& operator=(const mmap&) = delete;
 
         virtual ~mmap() { close(); }
 
         bool isValid() { return fIsValid; }
+        bool isWritable() { return fIsWritable; }
         void* data() { return fData; }
         size_t size() { return fSize; }
 
+        DataChunk getChunk() { return chunk_from_data_size(fData, fSize); }
+
+#if defined(_WIN32)
         bool close()
         {
             if (fData != nullptr) {
@@ -74,10 +147,65 @@ namespace ndt
                 fFileHandle = INVALID_HANDLE_VALUE;
             }
 
+            fIsValid = false;
+
             return true;
         }
-		DataChunk getChunk() { return chunk_from_data_size(fData, fSize); }
 
+        // Write any changes back to the file
+        bool flush()
+        {
+            if (!fIsWritable || (fData == nullptr))
+                return false;
+
+            return FlushViewOfFile(fData, 0) != 0;
+        }
+
+        // Tell the OS we'll be wanting this range soon, so it can
+        // start reading it in.  Offsets outside the mapping are ignored.
+        bool prefetch(size_t offset = 0, size_t length = SIZE_MAX)
+        {
+            if ((fData == nullptr) || (offset >= fSize))
+                return false;
+
+            if (length > fSize - offset)
+                length = fSize - offset;
+
+#if (_WIN32_WINNT >= 0x0602)
+            WIN32_MEMORY_RANGE_ENTRY range{};
+            range.VirtualAddress = (uint8_t*)fData + offset;
+            range.NumberOfBytes = length;
+
+            return PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0) != 0;
+#else
+            return false;
+#endif
+        }
+
+        // There is no way to change the access pattern of a view once it's
+        // made.  The hint given in the options goes on the file handle instead.
+        bool advise(int access)
+        {
+            return false;
+        }
+
+        // Done with this range for now; take its pages out of the
+        // working set, so a long pass over a big file doesn't keep
+        // all of it resident.  The data stays, and comes back when
+        // it's touched again.
+        bool release(size_t offset, size_t length)
+        {
+            if ((fData == nullptr) || (offset >= fSize))
+                return false;
+
+            if (length > fSize - offset)
+                length = fSize - offset;
+
+            // Unlocking pages that aren't locked drops them from the working set
+            VirtualUnlock((uint8_t*)fData + offset, length);
+
+            return true;
+        }
 
         // factory method
         // desiredAccess - GENERIC_READ, GENERIC_WRITE, GENERIC_EXECUTE
@@ -108,7 +236,7 @@ namespace ndt
 
             // BUGBUG
             // Need to check whether we're opening for writing or not
-            // if we're opening for writing, then we don't want to 
+            // if we're opening for writing, then we don't want to
             // limit the size in CreateFileMappingA
             LARGE_INTEGER psize;
             BOOL bResult = GetFileSizeEx(filehandle, &psize);
@@ -143,5 +271,271 @@ namespace ndt
 
             return std::make_shared<mmap>(filehandle, maphandle, data, size);
         }
+
+        // Map a file, with the access hint, prefaulting, and
+        // writability given in the options
+        static std::shared_ptr<mmap> create_shared(const std::string& filename, const mmap_options& opts)
+        {
+            uint32_t flagsAndAttributes = FILE_ATTRIBUTE_NORMAL;
+            if (opts.access == MMAP_ACCESS_SEQUENTIAL)
+                flagsAndAttributes |= FILE_FLAG_SEQUENTIAL_SCAN;
+            else if (opts.access == MMAP_ACCESS_RANDOM)
+                flagsAndAttributes |= FILE_FLAG_RANDOM_ACCESS;
+
+            HANDLE filehandle = CreateFileA(filename.c_str(),
+                opts.writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+                FILE_SHARE_READ,
+                nullptr,
+                opts.writable ? OPEN_ALWAYS : OPEN_EXISTING,
+                flagsAndAttributes,
+                nullptr);
+
+            if (filehandle == INVALID_HANDLE_VALUE)
+                return {};
+
+            LARGE_INTEGER psize;
+            GetFileSizeEx(filehandle, &psize);
+            uint64_t size = psize.QuadPart;
+
+            // A writable mapping with a size sets the size of the file
+            if (opts.writable && (opts.size > 0) && (opts.size != size))
+            {
+                LARGE_INTEGER newSize;
+                newSize.QuadPart = (LONGLONG)opts.size;
+                if (!SetFilePointerEx(filehandle, newSize, nullptr, FILE_BEGIN) || !SetEndOfFile(filehandle))
+                {
+                    CloseHandle(filehandle);
+                    return {};
+                }
+                size = opts.size;
+            }
+
+            if (size == 0)
+            {
+                CloseHandle(filehandle);
+                return {};
+            }
+
+            HANDLE maphandle = CreateFileMappingA(filehandle, nullptr,
+                opts.writable ? PAGE_READWRITE : PAGE_READONLY,
+                (DWORD)(size >> 32), (DWORD)(size & 0xffffffff), nullptr);
+
+            if (maphandle == nullptr)
+            {
+                CloseHandle(filehandle);
+                return {};
+            }
+
+            void* data = MapViewOfFile(maphandle, opts.writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+            if (data == nullptr)
+            {
+                CloseHandle(maphandle);
+                CloseHandle(filehandle);
+                return {};
+            }
+
+            auto m = std::make_shared<mmap>(filehandle, maphandle, data, (size_t)size, opts.writable);
+            if (opts.prefault)
+                m->prefetch();
+
+            return m;
+        }
+
+        // A mapping with no file behind it
+        // The memory starts out as zeros
+        static std::shared_ptr<mmap> create_anonymous(size_t size, bool prefault = false)
+        {
+            if (size == 0)
+                return {};
+
+            HANDLE maphandle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                (DWORD)((uint64_t)size >> 32), (DWORD)((uint64_t)size & 0xffffffff), nullptr);
+
+            if (maphandle == nullptr)
+                return {};
+
+            void* data = MapViewOfFile(maphandle, FILE_MAP_WRITE, 0, 0, 0);
+            if (data == nullptr)
+            {
+                CloseHandle(maphandle);
+                return {};
+            }
+
+            auto m = std::make_shared<mmap>(INVALID_HANDLE_VALUE, maphandle, data, size, true);
+            if (prefault)
+                m->prefetch();
+
+            return m;
+        }
+#else
+        bool close()
+        {
+            if (fData != nullptr) {
+                ::munmap(fData, fSize);
+                fData = nullptr;
+            }
+
+            if (fFileDescriptor >= 0) {
+                ::close(fFileDescriptor);
+                fFileDescriptor = -1;
+            }
+
+            fIsValid = false;
+
+            return true;
+        }
+
+        // Write any changes back to the file
+        bool flush()
+        {
+            if (!fIsWritable || (fData == nullptr) || (fFileDescriptor < 0))
+                return false;
+
+            return ::msync(fData, fSize, MS_SYNC) == 0;
+        }
+
+        // Tell the OS we'll be wanting this range soon, so it can
+        // start reading it in.  Offsets outside the mapping are ignored.
+        bool prefetch(size_t offset = 0, size_t length = SIZE_MAX)
+        {
+            if ((fData == nullptr) || (offset >= fSize))
+                return false;
+
+            if (length > fSize - offset)
+                length = fSize - offset;
+
+            // madvise wants a page aligned address
+            size_t pageSize = (size_t)::sysconf(_SC_PAGESIZE);
+            size_t aligned = offset & ~(pageSize - 1);
+
+            return ::madvise((uint8_t*)fData + aligned, length + (offset - aligned), MADV_WILLNEED) == 0;
+        }
+
+        // Change the access pattern hint for the whole mapping
+        bool advise(int access)
+        {
+            if (fData == nullptr)
+                return false;
+
+            int advice = MADV_NORMAL;
+            if (access == MMAP_ACCESS_SEQUENTIAL)
+                advice = MADV_SEQUENTIAL;
+            else if (access == MMAP_ACCESS_RANDOM)
+                advice = MADV_RANDOM;
+
+            return ::madvise(fData, fSize, advice) == 0;
+        }
+
+        // Done with this range for now; drop its pages, so a long
+        // pass over a big file doesn't keep all of it resident.
+        // Only whole pages inside the range go.  A file backed
+        // mapping reads them back in when they're touched again,
+        // an anonymous one would lose them, so those are left alone.
+        bool release(size_t offset, size_t length)
+        {
+            if ((fData == nullptr) || (fFileDescriptor < 0) || (offset >= fSize))
+                return false;
+
+            if (length > fSize - offset)
+                length = fSize - offset;
+
+            size_t pageSize = (size_t)::sysconf(_SC_PAGESIZE);
+            size_t first = (offset + pageSize - 1) & ~(pageSize - 1);
+            size_t last = (offset + length) & ~(pageSize - 1);
+            if (last <= first)
+                return true;
+
+            return ::madvise((uint8_t*)fData + first, last - first, MADV_DONTNEED) == 0;
+        }
+
+        // factory method
+        // Open an existing file for reading
+        static std::shared_ptr<mmap> create_shared(const std::string& filename)
+        {
+            return create_shared(filename, mmap_options{});
+        }
+
+        // Map a file, with the access hint, prefaulting, and
+        // writability given in the options
+        static std::shared_ptr<mmap> create_shared(const std::string& filename, const mmap_options& opts)
+        {
+            int fd = opts.writable ? ::open(filename.c_str(), O_RDWR | O_CREAT, 0644) : ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+                return {};
+
+            struct stat st {};
+            if (::fstat(fd, &st) != 0)
+            {
+                ::close(fd);
+                return {};
+            }
+
+            size_t size = (size_t)st.st_size;
+
+            // A writable mapping with a size sets the size of the file
+            if (opts.writable && (opts.size > 0) && (opts.size != size))
+            {
+                if (::ftruncate(fd, (off_t)opts.size) != 0)
+                {
+                    ::close(fd);
+                    return {};
+                }
+                size = opts.size;
+            }
+
+            // Can't map nothing
+            if (size == 0)
+            {
+                ::close(fd);
+                return {};
+            }
+
+            int prot = opts.writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+            int flags = opts.writable ? MAP_SHARED : MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+            if (opts.prefault)
+                flags |= MAP_POPULATE;
+#endif
+
+            void* data = ::mmap(nullptr, size, prot, flags, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                ::close(fd);
+                return {};
+            }
+
+            auto m = std::make_shared<mmap>(fd, data, size, opts.writable);
+
+            if (opts.access != MMAP_ACCESS_NORMAL)
+                m->advise(opts.access);
+
+#if !defined(MAP_POPULATE)
+            if (opts.prefault)
+                m->prefetch();
+#endif
+
+            return m;
+        }
+
+        // A mapping with no file behind it
+        // The memory starts out as zeros
+        static std::shared_ptr<mmap> create_anonymous(size_t size, bool prefault = false)
+        {
+            if (size == 0)
+                return {};
+
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_POPULATE)
+            if (prefault)
+                flags |= MAP_POPULATE;
+#endif
+
+            void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if (data == MAP_FAILED)
+                return {};
+
+            return std::make_shared<mmap>(-1, data, size, true);
+        }
+#endif
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,477 @@
+#pragma once
+
+/*
+	objloader
+
+	Loads Wavefront OBJ files, in place, out of a DataChunk; typically
+	a memory mapped file.
+
+	The file is cut into blocks at line boundaries, and read twice,
+	each block on its own thread.  The first pass just counts the
+	v/vt/vn lines, and the triangles, in each block, so the arrays
+	can be made exactly the right size, and each block knows where
+	its part of them starts.  The second pass fills them in.  Numbers
+	are converted with std::from_chars, without copying the text.
+
+	Polygons are split into fans of triangles.  Indices come out
+	0 based, with relative (negative) ones made absolute, and -1 where
+	a corner has no texture coordinate or normal, or its index is out
+	of range.  Positive indices may refer to vertices defined further
+	down the file.
+
+	What you get is the file's own arrays, with three position, texture,
+	and normal indices per triangle, and optionally a de-duplicated
+	vertex buffer, one ObjVertex for each distinct combination the
+	faces use, with three indices per triangle into it.
+
+	Usage:
+	ndt::ObjMesh mesh;
+	if (ndt::obj_load_file("african_head.obj", mesh))
+		draw(mesh.vertices, mesh.indices);
+
+	References:
+	http://www.martinreddy.net/gfx/3d/OBJ.spec
+*/
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "datachunk.h"
+#include "chunkscan.h"
+#include "mmap.hpp"
+
+namespace ndt
+{
+	struct ObjVertex {
+		float position[3];
+		float texcoord[2];
+		float normal[3];
+	};
+
+	struct ObjMesh {
+		std::vector<float> positions;		// 3 per 'v'
+		std::vector<float> texcoords;		// 2 per 'vt'
+		std::vector<float> normals;			// 3 per 'vn'
+
+		// 3 per triangle, into the arrays above
+		std::vector<int> facePositions;
+		std::vector<int> faceTexcoords;
+		std::vector<int> faceNormals;
+
+		// Filled in if ObjLoadOptions::buildVertices
+		std::vector<ObjVertex> vertices;
+		std::vector<uint32_t> indices;
+
+		size_t npositions() const { return positions.size() / 3; }
+		size_t ntexcoords() const { return texcoords.size() / 2; }
+		size_t nnormals() const { return normals.size() / 3; }
+		size_t ntriangles() const { return facePositions.size() / 3; }
+	};
+
+	struct ObjLoadOptions {
+		unsigned threads{ 0 };			// 0 is one per hardware thread
+		bool buildVertices{ true };		// make the de-duplicated vertex buffer
+	};
+
+
+	namespace objdetail {
+		static constexpr size_t kMinBlockBytes = 256 * 1024;
+
+		struct BlockCounts {
+			size_t positions{};
+			size_t texcoords{};
+			size_t normals{};
+			size_t triangles{};
+		};
+
+		inline bool isSpace(uint8_t c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+		inline const uint8_t* skipSpace(const uint8_t* p, const uint8_t* e)
+		{
+			while (p < e && isSpace(*p))
+				p++;
+			return p;
+		}
+
+		// The end of the line starting at p, not including the '\n'
+		inline const uint8_t* lineEnd(const uint8_t* p, const uint8_t* e)
+		{
+			return scan_find_byte(p, e, '\n');
+		}
+
+		enum LineKind { LINE_OTHER, LINE_V, LINE_VT, LINE_VN, LINE_F };
+
+		// What the line is, and p moved past the keyword
+		inline LineKind lineKind(const uint8_t*& p, const uint8_t* e)
+		{
+			p = skipSpace(p, e);
+			if (e - p < 2)
+				return LINE_OTHER;
+
+			if (p[0] == 'v') {
+				if (isSpace(p[1])) { p += 2; return LINE_V; }
+				if (e - p >= 3 && isSpace(p[2])) {
+					if (p[1] == 't') { p += 3; return LINE_VT; }
+					if (p[1] == 'n') { p += 3; return LINE_VN; }
+				}
+			}
+			else if (p[0] == 'f' && isSpace(p[1])) {
+				p += 2;
+				return LINE_F;
+			}
+
+			return LINE_OTHER;
+		}
+
+		inline int countCorners(const uint8_t* p, const uint8_t* e)
+		{
+			int corners = 0;
+			while (true) {
+				p = skipSpace(p, e);
+				if (p >= e || *p == '#')
+					break;
+				corners++;
+				while (p < e && !isSpace(*p))
+					p++;
+			}
+			return corners;
+		}
+
+		inline BlockCounts countBlock(const uint8_t* p, const uint8_t* e)
+		{
+			BlockCounts counts;
+			while (p < e)
+			{
+				const uint8_t* le = lineEnd(p, e);
+				switch (lineKind(p, le))
+				{
+				case LINE_V: counts.positions++; break;
+				case LINE_VT: counts.texcoords++; break;
+				case LINE_VN: counts.normals++; break;
+				case LINE_F: counts.triangles += std::max(0, countCorners(p, le) - 2); break;
+				default: break;
+				}
+				p = le + 1;
+			}
+			return counts;
+		}
+
+		// Up to n numbers; missing ones are left alone
+		inline int parseFloats(const uint8_t* p, const uint8_t* e, float* values, int n)
+		{
+			int got = 0;
+			while (got < n)
+			{
+				p = skipSpace(p, e);
+				if (p < e && *p == '+')
+					p++;
+				auto res = std::from_chars((const char*)p, (const char*)e, values[got]);
+				if (res.ec != std::errc())
+					break;
+				p = (const uint8_t*)res.ptr;
+				got++;
+			}
+			return got;
+		}
+
+		inline bool parseInt(const uint8_t*& p, const uint8_t* e, int& value)
+		{
+			bool negative = false;
+			if (p < e && (*p == '-' || *p == '+'))
+				negative = (*p++ == '-');
+
+			if (p >= e || *p < '0' || *p > '9')
+				return false;
+
+			int v = 0;
+			while (p < e && *p >= '0' && *p <= '9')
+				v = v * 10 + (*p++ - '0');
+
+			value = negative ? -v : v;
+			return true;
+		}
+
+		// 1 based, or relative to the count so far if negative, to 0 based.
+		// Positive indices may refer to a vertex further down the file,
+		// so they're checked against the whole file's count, which the
+		// first pass already knows.  -1 if it's missing or out of range.
+		inline int resolveIndex(int index, size_t countSoFar, size_t total, bool& ok)
+		{
+			long long i = index > 0 ? (long long)index - 1 : (long long)countSoFar + index;
+			long long limit = index > 0 ? (long long)total : (long long)countSoFar;
+			if (index == 0 || i < 0 || i >= limit) {
+				ok = false;
+				return -1;
+			}
+			return (int)i;
+		}
+
+		struct Corner { int v, t, n; };
+
+		// v, v/t, v//n, v/t/n
+		inline bool parseCorner(const uint8_t*& p, const uint8_t* e, Corner& c)
+		{
+			c.t = 0;
+			c.n = 0;
+			if (!parseInt(p, e, c.v))
+				return false;
+
+			if (p < e && *p == '/') {
+				p++;
+				if (p < e && *p != '/')
+					parseInt(p, e, c.t);
+				if (p < e && *p == '/') {
+					p++;
+					parseInt(p, e, c.n);
+				}
+			}
+
+			// anything else stuck to the corner is skipped
+			while (p < e && !isSpace(*p))
+				p++;
+
+			return true;
+		}
+
+		// Fill in this block's part of the arrays, starting at base.
+		// base holds counts from the blocks before this one, which is
+		// what relative indices are counted from; total is the count
+		// for the whole file.
+		inline bool parseBlock(const uint8_t* p, const uint8_t* e, const BlockCounts& base, const BlockCounts& total, ObjMesh& mesh)
+		{
+			size_t nv = base.positions;
+			size_t nt = base.texcoords;
+			size_t nn = base.normals;
+			size_t tri = base.triangles;
+			bool ok = true;
+
+			while (p < e)
+			{
+				const uint8_t* le = lineEnd(p, e);
+				switch (lineKind(p, le))
+				{
+				case LINE_V: {
+					float v[3]{};
+					parseFloats(p, le, v, 3);
+					memcpy(&mesh.positions[nv++ * 3], v, sizeof(v));
+				}
+				break;
+
+				case LINE_VT: {
+					float v[2]{};
+					parseFloats(p, le, v, 2);
+					memcpy(&mesh.texcoords[nt++ * 2], v, sizeof(v));
+				}
+				break;
+
+				case LINE_VN: {
+					float v[3]{};
+					parseFloats(p, le, v, 3);
+					memcpy(&mesh.normals[nn++ * 3], v, sizeof(v));
+				}
+				break;
+
+				case LINE_F: {
+					// a fan around the first corner
+					Corner first{}, prev{}, c{};
+					int corners = 0;
+					while (true)
+					{
+						p = skipSpace(p, le);
+						if (p >= le || *p == '#')
+							break;
+
+						if (!parseCorner(p, le, c)) {
+							// counted as a corner in the first pass, so
+							// it still has to take up its place
+							ok = false;
+							c = Corner{ 0, 0, 0 };
+							while (p < le && !isSpace(*p))
+								p++;
+						}
+
+						c.v = resolveIndex(c.v, nv, total.positions, ok);
+						c.t = c.t ? resolveIndex(c.t, nt, total.texcoords, ok) : -1;
+						c.n = c.n ? resolveIndex(c.n, nn, total.normals, ok) : -1;
+
+						if (corners == 0)
+							first = c;
+						else if (corners >= 2) {
+							const Corner tri3[3] = { first, prev, c };
+							for (int k = 0; k < 3; k++) {
+								mesh.facePositions[tri * 3 + k] = tri3[k].v;
+								mesh.faceTexcoords[tri * 3 + k] = tri3[k].t;
+								mesh.faceNormals[tri * 3 + k] = tri3[k].n;
+							}
+							tri++;
+						}
+						prev = c;
+						corners++;
+					}
+				}
+				break;
+
+				default:
+					break;
+				}
+				p = le + 1;
+			}
+
+			return ok;
+		}
+
+		inline uint32_t hashCorner(int v, int t, int n)
+		{
+			uint32_t h = (uint32_t)v * 0x9E3779B1u;
+			h ^= (uint32_t)t * 0x85EBCA77u + (h << 6) + (h >> 2);
+			h ^= (uint32_t)n * 0xC2B2AE3Du + (h << 6) + (h >> 2);
+			return h ^ (h >> 15);
+		}
+	}
+
+	// One ObjVertex per distinct (position, texcoord, normal) the
+	// faces use, and three indices per triangle into them.  Corners
+	// without a texcoord or normal get zeros.
+	inline void obj_build_vertices(ObjMesh& mesh)
+	{
+		const size_t corners = mesh.facePositions.size();
+		mesh.indices.resize(corners);
+		mesh.vertices.clear();
+
+		// Usually there are about as many vertices as positions
+		size_t capacity = 1024;
+		while (capacity < mesh.npositions() * 2)
+			capacity <<= 1;
+
+		std::vector<uint32_t> table(capacity, UINT32_MAX);
+		std::vector<objdetail::Corner> keys;
+		keys.reserve(capacity / 2);
+		mesh.vertices.reserve(capacity / 2);
+
+		for (size_t i = 0; i < corners; i++)
+		{
+			const objdetail::Corner c{ mesh.facePositions[i], mesh.faceTexcoords[i], mesh.faceNormals[i] };
+
+			// keep the table at most half full
+			if (keys.size() * 2 >= capacity)
+			{
+				capacity <<= 1;
+				table.assign(capacity, UINT32_MAX);
+				for (uint32_t k = 0; k < (uint32_t)keys.size(); k++) {
+					size_t slot = objdetail::hashCorner(keys[k].v, keys[k].t, keys[k].n) & (capacity - 1);
+					while (table[slot] != UINT32_MAX)
+						slot = (slot + 1) & (capacity - 1);
+					table[slot] = k;
+				}
+			}
+
+			size_t slot = objdetail::hashCorner(c.v, c.t, c.n) & (capacity - 1);
+			while (table[slot] != UINT32_MAX) {
+				const objdetail::Corner& k = keys[table[slot]];
+				if (k.v == c.v && k.t == c.t && k.n == c.n)
+					break;
+				slot = (slot + 1) & (capacity - 1);
+			}
+
+			if (table[slot] == UINT32_MAX)
+			{
+				table[slot] = (uint32_t)keys.size();
+				keys.push_back(c);
+
+				ObjVertex vert{};
+				if (c.v >= 0)
+					memcpy(vert.position, &mesh.positions[c.v * 3], sizeof(vert.position));
+				if (c.t >= 0)
+					memcpy(vert.texcoord, &mesh.texcoords[c.t * 2], sizeof(vert.texcoord));
+				if (c.n >= 0)
+					memcpy(vert.normal, &mesh.normals[c.n * 3], sizeof(vert.normal));
+				mesh.vertices.push_back(vert);
+			}
+
+			mesh.indices[i] = table[slot];
+		}
+	}
+
+	// Returns false if anything could not be read, or an index was
+	// out of range; those indices are -1, and everything else is loaded.
+	inline bool obj_load(const DataChunk& chunk, ObjMesh& mesh, const ObjLoadOptions& opts = {})
+	{
+		mesh = ObjMesh{};
+
+		const uint8_t* begin = chunk.fStart;
+		const uint8_t* end = chunk.fEnd;
+		const size_t size = chunk_size(chunk);
+
+		unsigned threads = opts.threads ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+		size_t nblocks = std::max<size_t>(1, std::min<size_t>(threads, size / objdetail::kMinBlockBytes));
+
+		// Blocks start at the beginning of a line
+		std::vector<const uint8_t*> starts(nblocks + 1);
+		starts[0] = begin;
+		starts[nblocks] = end;
+		for (size_t b = 1; b < nblocks; b++)
+		{
+			const uint8_t* p = std::max(starts[b - 1], begin + size / nblocks * b);
+			const uint8_t* nl = scan_find_byte(p, end, '\n');
+			starts[b] = nl < end ? nl + 1 : end;
+		}
+
+		auto forEachBlock = [&](auto&& fn) {
+			std::vector<std::thread> workers;
+			workers.reserve(nblocks - 1);
+			for (size_t b = 1; b < nblocks; b++)
+				workers.emplace_back(fn, b);
+			fn(0);
+			for (auto& w : workers)
+				w.join();
+		};
+
+		// Count, then turn the counts into where each block starts
+		std::vector<objdetail::BlockCounts> counts(nblocks);
+		forEachBlock([&](size_t b) { counts[b] = objdetail::countBlock(starts[b], starts[b + 1]); });
+
+		std::vector<objdetail::BlockCounts> bases(nblocks);
+		objdetail::BlockCounts total;
+		for (size_t b = 0; b < nblocks; b++)
+		{
+			bases[b] = total;
+			total.positions += counts[b].positions;
+			total.texcoords += counts[b].texcoords;
+			total.normals += counts[b].normals;
+			total.triangles += counts[b].triangles;
+		}
+
+		mesh.positions.resize(total.positions * 3);
+		mesh.texcoords.resize(total.texcoords * 2);
+		mesh.normals.resize(total.normals * 3);
+		mesh.facePositions.resize(total.triangles * 3);
+		mesh.faceTexcoords.resize(total.triangles * 3);
+		mesh.faceNormals.resize(total.triangles * 3);
+
+		std::vector<char> results(nblocks, 1);
+		forEachBlock([&](size_t b) { results[b] = objdetail::parseBlock(starts[b], starts[b + 1], bases[b], total, mesh); });
+
+		if (opts.buildVertices)
+			obj_build_vertices(mesh);
+
+		return std::all_of(results.begin(), results.end(), [](char r) { return r != 0; });
+	}
+
+	inline bool obj_load_file(const char* filename, ObjMesh& mesh, const ObjLoadOptions& opts = {})
+	{
+		mmap_options mopts{};
+		mopts.access = MMAP_ACCESS_SEQUENTIAL;
+
+		auto m = mmap::create_shared(filename, mopts);
+		if (m == nullptr || !m->isValid()) {
+			mesh = ObjMesh{};
+			return false;
+		}
+
+		return obj_load(m->getChunk(), mesh, opts);
+	}
+}
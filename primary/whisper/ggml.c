@@ -1291,6 +1291,7 @@ struct ggml_context {
     size_t mem_size;
     void * mem_buffer;
     bool   mem_buffer_owned;
+    bool   no_alloc;
 
     int n_objects;
 
@@ -1528,6 +1529,7 @@ struct ggml_context * ggml_init(struct ggml_init_params params) {
         .mem_size         = params.mem_size,
         .mem_buffer       = params.mem_buffer ? params.mem_buffer : malloc(params.mem_size),
         .mem_buffer_owned = params.mem_buffer ? false : true,
+        .no_alloc         = params.no_alloc,
         .n_objects        = 0,
         .objects_begin    = NULL,
         .objects_end      = NULL,
@@ -1597,7 +1599,7 @@ struct ggml_tensor * ggml_new_tensor_impl(
 
     size_t size_needed = 0;
 
-    if (data == NULL) {
+    if (data == NULL && !ctx->no_alloc) {
         size_needed += GGML_TYPE_SIZE[type];
         for (int i = 0; i < n_dims; i++) {
             size_needed *= ne[i];
@@ -1654,11 +1656,15 @@ struct ggml_tensor * ggml_new_tensor_impl(
         /*.perf_runs    =*/ 0,
         /*.perf_cycles  =*/ 0,
         /*.perf_time_us =*/ 0,
-        /*.data         =*/ data == NULL ? (void *)(result + 1) : data,
+        /*.data         =*/ (data == NULL && !ctx->no_alloc) ? (void *)(result + 1) : data,
         /*.pad          =*/ { 0 },
     };
 
-    ggml_assert_aligned(result->data);
+    // data that didn't come from the pool (views, or weights mapped from a
+    // file) is only aligned to its element size, and nothing needs more
+    if (data == NULL && !ctx->no_alloc) {
+        ggml_assert_aligned(result->data);
+    }
 
     for (int i = 0; i < n_dims; i++) {
         result->ne[i] = ne[i];
@@ -305,6 +305,7 @@ struct ggml_init_params {
     // memory pool
     size_t mem_size;   // bytes
     void * mem_buffer; // if NULL, memory will be allocated internally
+    bool   no_alloc;   // don't allocate memory for the tensor data, the caller points it somewhere
 };
 
 void    ggml_time_init(void); // call this once at the beginning of the program
@@ -11,10 +11,14 @@
 #include <cstring>
 #include <fstream>
 #include <map>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "mmap.hpp"
+#include "whisper_mel.h"
+
 #define USE_FLASH_ATTN
 //#define USE_FLASH_FF
 
@@ -407,6 +411,11 @@ struct whisper_context {
     std::vector<uint8_t>   buf_compute;
     std::vector<uint8_t>   buf_compute_layer;
 
+    // when loaded with whisper_init_mmap(), the model file, and copies
+    // of the tensors that couldn't be used from it in place
+    std::shared_ptr<ndt::mmap>        model_map;
+    std::vector<std::vector<uint8_t>> buf_model_copies;
+
     whisper_model model;
     whisper_vocab vocab;
 
@@ -440,7 +449,10 @@ struct whisper_context {
 //
 // see the convert-pt-to-ggml.py script for details
 //
-static bool whisper_model_load(const std::string & fname, whisper_context & wctx) {
+// with use_mmap, the file is mapped, and tensor data is used straight from
+// the mapping when it's aligned to its element size.  The rest is copied.
+//
+static bool whisper_model_load(const std::string & fname, whisper_context & wctx, bool use_mmap = false) {
     fprintf(stderr, "%s: loading model from '%s'\n", __func__, fname.c_str());
 
     auto & model = wctx.model;
@@ -452,6 +464,14 @@ static bool whisper_model_load(const std::string & fname, whisper_context & wctx
         return false;
     }
 
+    if (use_mmap) {
+        wctx.model_map = ndt::mmap::create_shared(fname);
+        if (!wctx.model_map || !wctx.model_map->isValid()) {
+            fprintf(stderr, "%s: failed to map '%s'\n", __func__, fname.c_str());
+            return false;
+        }
+    }
+
     // verify magic
     {
         uint32_t magic;
@@ -513,8 +533,11 @@ static bool whisper_model_load(const std::string & fname, whisper_context & wctx
         fprintf(stderr, "%s: f16           = %d\n", __func__, hparams.f16);
         fprintf(stderr, "%s: type          = %d\n", __func__, model.type);
 
+        // when mapped, the weights don't live in here, it's sized for the tensor objects later
         wctx.buf_model = new std::vector<uint8_t>();
-        wctx.buf_model->resize(MEM_REQ_MODEL.at(model.type));
+        if (!wctx.model_map) {
+            wctx.buf_model->resize(MEM_REQ_MODEL.at(model.type));
+        }
         wctx.buf_memory.resize(MEM_REQ_MEMORY.at(model.type));
         wctx.buf_compute.resize(std::max(MEM_REQ_ENCODE.at(model.type), MEM_REQ_DECODE.at(model.type)));
         wctx.buf_compute_layer.resize(std::max(MEM_REQ_ENCODE_LAYER.at(model.type), MEM_REQ_DECODE_LAYER.at(model.type)));
@@ -721,7 +744,13 @@ static bool whisper_model_load(const std::string & fname, whisper_context & wctx
         ctx_mem_size += n_text_layer*n_audio_ctx*n_text_state*ggml_type_size(GGML_TYPE_F16); // memory_cross_k
         ctx_mem_size += n_text_layer*n_audio_ctx*n_text_state*ggml_type_size(GGML_TYPE_F16); // memory_cross_v
 
-        ctx_size += (15 + 15*n_audio_layer + 24*n_text_layer)*256; // object overhead
+        const size_t ctx_overhead = (15 + 15*n_audio_layer + 24*n_text_layer)*256; // object overhead
+
+        ctx_size += ctx_overhead;
+
+        if (wctx.model_map) {
+            wctx.buf_model->resize(ctx_overhead);
+        }
 
         fprintf(stderr, "%s: ggml ctx size = %7.2f MB\n", __func__, ctx_size/(1024.0*1024.0));
     }
@@ -731,6 +760,7 @@ static bool whisper_model_load(const std::string & fname, whisper_context & wctx
         struct ggml_init_params params = {
             .mem_size   = wctx.buf_model->size(),
             .mem_buffer = wctx.buf_model->data(),
+            .no_alloc   = wctx.model_map != nullptr,
         };
 
         model.ctx = ggml_init(params);
@@ -941,6 +971,7 @@ static bool whisper_model_load(const std::string & fname, whisper_context & wctx
         struct ggml_init_params params = {
             .mem_size   = wctx.buf_memory.size(),
             .mem_buffer = wctx.buf_memory.data(),
+            .no_alloc   = false,
         };
 
         model.ctx_mem = ggml_init(params);
@@ -990,6 +1021,7 @@ static bool whisper_model_load(const std::string & fname, whisper_context & wctx
     // load weights
     {
         size_t total_size = 0;
+        size_t copied_size = 0;
 
         model.n_loaded = 0;
 
@@ -1041,7 +1073,28 @@ static bool whisper_model_load(const std::string & fname, whisper_context & wctx
                 return false;
             }
 
-            fin.read(reinterpret_cast<char *>(tensor->data), ggml_nbytes(tensor));
+            if (wctx.model_map) {
+                const size_t offset = fin.tellg();
+                if (offset + ggml_nbytes(tensor) > wctx.model_map->size()) {
+                    fprintf(stderr, "%s: tensor '%s' is cut short in model file\n", __func__, name.data());
+                    return false;
+                }
+
+                // the file doesn't pad tensors, so whether one lands on a
+                // suitable boundary is down to the lengths of the names before it
+                uint8_t * src = (uint8_t *) wctx.model_map->data() + offset;
+                if ((uintptr_t) src % ggml_type_size(tensor->type) == 0) {
+                    tensor->data = src;
+                } else {
+                    wctx.buf_model_copies.emplace_back(src, src + ggml_nbytes(tensor));
+                    tensor->data = wctx.buf_model_copies.back().data();
+                    copied_size += ggml_nbytes(tensor);
+                }
+
+                fin.seekg(ggml_nbytes(tensor), std::ios::cur);
+            } else {
+                fin.read(reinterpret_cast<char *>(tensor->data), ggml_nbytes(tensor));
+            }
 
             //printf("%48s - [%5d, %5d, %5d], type = %6s, %6.2f MB\n", name.data(), ne[0], ne[1], ne[2], ftype == 0 ? "float" : "f16", ggml_nbytes(tensor)/1024.0/1024.0);
             total_size += ggml_nbytes(tensor);
@@ -1049,8 +1102,14 @@ static bool whisper_model_load(const std::string & fname, whisper_context & wctx
         }
 
         fprintf(stderr, "%s: model size    = %7.2f MB\n", __func__, total_size/1024.0/1024.0);
+        if (wctx.model_map) {
+            fprintf(stderr, "%s: mapped        = %7.2f MB, copied %7.2f MB\n", __func__, (total_size - copied_size)/1024.0/1024.0, copied_size/1024.0/1024.0);
+        }
 
-        if (model.n_loaded == 0) {
+        if (model.n_loaded == 0 && wctx.model_map) {
+            fprintf(stderr, "%s: ERROR no tensors in model file, and nothing to use for them\n", __func__);
+            return false;
+        } else if (model.n_loaded == 0) {
             fprintf(stderr, "%s: WARN no tensors loaded from model file - assuming empty model for testing\n", __func__);
         } else if (model.n_loaded != (int) model.tensors.size()) {
             fprintf(stderr, "%s: ERROR not all tensors loaded from model file - expected %zu, got %d\n", __func__, model.tensors.size(), model.n_loaded);
@@ -1091,6 +1150,7 @@ static bool whisper_encode(
     struct ggml_init_params params = {
         .mem_size   = wctx.buf_compute.size(),
         .mem_buffer = wctx.buf_compute.data(),
+        .no_alloc   = false,
     };
 
     struct ggml_context * ctx0 = ggml_init(params);
@@ -1169,6 +1229,7 @@ static bool whisper_encode(
         struct ggml_init_params paramsL = {
             .mem_size   = wctx.buf_compute_layer.size(),
             .mem_buffer = wctx.buf_compute_layer.data(),
+            .no_alloc   = false,
         };
 
         struct ggml_context * ctxL = ggml_init(paramsL);
@@ -1506,6 +1567,7 @@ static bool whisper_decode(
     struct ggml_init_params params = {
             .mem_size   = wctx.buf_compute.size(),
             .mem_buffer = wctx.buf_compute.data(),
+            .no_alloc   = false,
         };
 
     struct ggml_context * ctx0 = ggml_init(params);
@@ -1532,6 +1594,7 @@ static bool whisper_decode(
         struct ggml_init_params paramsL = {
             .mem_size   = wctx.buf_compute_layer.size(),
             .mem_buffer = wctx.buf_compute_layer.data(),
+            .no_alloc   = false,
         };
 
         struct ggml_context * ctxL = ggml_init(paramsL);
@@ -1951,83 +2014,6 @@ static std::string to_timestamp(int64_t t, bool comma = false) {
     return std::string(buf);
 }
 
-// naive Discrete Fourier Transform
-// input is real-valued
-// output is complex-valued
-static void dft(const std::vector<float> & in, std::vector<float> & out) {
-    int N = in.size();
-
-    out.resize(N*2);
-
-    for (int k = 0; k < N; k++) {
-        float re = 0;
-        float im = 0;
-
-        for (int n = 0; n < N; n++) {
-            float angle = 2*M_PI*k*n/N;
-            re += in[n]*cos(angle);
-            im -= in[n]*sin(angle);
-        }
-
-        out[k*2 + 0] = re;
-        out[k*2 + 1] = im;
-    }
-}
-
-// Cooley-Tukey FFT
-// poor man's implementation - use something better
-// input is real-valued
-// output is complex-valued
-static void fft(const std::vector<float> & in, std::vector<float> & out) {
-    out.resize(in.size()*2);
-
-    int N = in.size();
-
-    if (N == 1) {
-        out[0] = in[0];
-        out[1] = 0;
-        return;
-    }
-
-    if (N%2 == 1) {
-        dft(in, out);
-        return;
-    }
-
-    std::vector<float> even;
-    std::vector<float> odd;
-
-    for (int i = 0; i < N; i++) {
-        if (i % 2 == 0) {
-            even.push_back(in[i]);
-        } else {
-            odd.push_back(in[i]);
-        }
-    }
-
-    std::vector<float> even_fft;
-    std::vector<float> odd_fft;
-
-    fft(even, even_fft);
-    fft(odd, odd_fft);
-
-    for (int k = 0; k < N/2; k++) {
-        float theta = 2*M_PI*k/N;
-
-        float re = cos(theta);
-        float im = -sin(theta);
-
-        float re_odd = odd_fft[2*k + 0];
-        float im_odd = odd_fft[2*k + 1];
-
-        out[2*k + 0] = even_fft[2*k + 0] + re*re_odd - im*im_odd;
-        out[2*k + 1] = even_fft[2*k + 1] + re*im_odd + im*re_odd;
-
-        out[2*(k + N/2) + 0] = even_fft[2*k + 0] - re*re_odd + im*im_odd;
-        out[2*(k + N/2) + 1] = even_fft[2*k + 1] - re*im_odd - im*re_odd;
-    }
-}
-
 // ref: https://github.com/openai/whisper/blob/main/whisper/audio.py#L92-L124
 static bool log_mel_spectrogram(
     const float * samples,
@@ -2042,11 +2028,7 @@ static bool log_mel_spectrogram(
     whisper_mel & mel) {
 
     // Hanning window
-    std::vector<float> hann;
-    hann.resize(fft_size);
-    for (int i = 0; i < fft_size; i++) {
-        hann[i] = 0.5*(1.0 - cos((2.0*M_PI*i)/(fft_size)));
-    }
+    const std::vector<float> hann = whisper_hann(fft_size);
 
     mel.n_mel = n_mel;
     mel.n_len = (n_samples)/fft_step;
@@ -2057,70 +2039,18 @@ static bool log_mel_spectrogram(
     //printf("%s: n_samples = %d, n_len = %d\n", __func__, n_samples, mel.n_len);
     //printf("%s: recording length: %f s\n", __func__, (float) n_samples/sample_rate);
 
+    // twiddles and filters worked out once, shared by the threads
+    const whisper_fft_plan plan(fft_size);
+    const whisper_mel_filterbank bank(filters.data.data(), mel.n_mel, n_fft);
+
     std::vector<std::thread> workers(n_threads);
     for (int iw = 0; iw < n_threads; ++iw) {
         workers[iw] = std::thread([&](int ith) {
-            std::vector<float> fft_in;
-            fft_in.resize(fft_size);
-            for (int i = 0; i < fft_size; i++) {
-                fft_in[i] = 0.0;
-            }
-
-            std::vector<float> fft_out;
-            fft_out.resize(2*fft_size);
+            whisper_mel_scratch scratch;
+            scratch.init(plan, bank);
 
             for (int i = ith; i < mel.n_len; i += n_threads) {
-                const int offset = i*fft_step;
-
-                // apply Hanning window
-                for (int j = 0; j < fft_size; j++) {
-                    if (offset + j < n_samples) {
-                        fft_in[j] = hann[j]*samples[offset + j];
-                    } else {
-                        fft_in[j] = 0.0;
-                    }
-                }
-
-                // FFT -> mag^2
-                fft(fft_in, fft_out);
-
-                for (int j = 0; j < fft_size; j++) {
-                    fft_out[j] = (fft_out[2*j + 0]*fft_out[2*j + 0] + fft_out[2*j + 1]*fft_out[2*j + 1]);
-                }
-                for (int j = 1; j < fft_size/2; j++) {
-                    //if (i == 0) {
-                    //    printf("%d: %f %f\n", j, fft_out[j], fft_out[fft_size - j]);
-                    //}
-                    fft_out[j] += fft_out[fft_size - j];
-                }
-                if (i == 0) {
-                    //for (int j = 0; j < fft_size; j++) {
-                    //    printf("%d: %e\n", j, fft_out[j]);
-                    //}
-                }
-
-                if (speed_up) {
-                    // scale down in the frequency domain results in a speed up in the time domain
-                    for (int j = 0; j < n_fft; j++) {
-                        fft_out[j] = 0.5*(fft_out[2*j] + fft_out[2*j + 1]);
-                    }
-                }
-
-                // mel spectrogram
-                for (int j = 0; j < mel.n_mel; j++) {
-                    double sum = 0.0;
-
-                    for (int k = 0; k < n_fft; k++) {
-                        sum += fft_out[k]*filters.data[j*n_fft + k];
-                    }
-                    if (sum < 1e-10) {
-                        sum = 1e-10;
-                    }
-
-                    sum = log10(sum);
-
-                    mel.data[j*mel.n_len + i] = sum;
-                }
+                whisper_mel_frame(plan, bank, hann.data(), samples, n_samples, i*fft_step, speed_up, scratch, mel.data.data() + i, mel.n_len);
             }
         }, iw);
     }
@@ -2155,7 +2085,7 @@ static bool log_mel_spectrogram(
 // interface implementation
 //
 
-struct whisper_context * whisper_init(const char * path_model) {
+static struct whisper_context * whisper_init_impl(const char * path_model, bool use_mmap) {
     ggml_time_init();
 
     whisper_context * ctx = new whisper_context;
@@ -2164,7 +2094,7 @@ struct whisper_context * whisper_init(const char * path_model) {
 
     ctx->t_start_us = t_start_us;
 
-    if (!whisper_model_load(path_model, *ctx)) {
+    if (!whisper_model_load(path_model, *ctx, use_mmap)) {
         fprintf(stderr, "%s: failed to load model from '%s'\n", __func__, path_model);
         return NULL;
     }
@@ -2174,6 +2104,14 @@ struct whisper_context * whisper_init(const char * path_model) {
     return ctx;
 }
 
+struct whisper_context * whisper_init(const char * path_model) {
+    return whisper_init_impl(path_model, false);
+}
+
+struct whisper_context * whisper_init_mmap(const char * path_model) {
+    return whisper_init_impl(path_model, true);
+}
+
 void whisper_free(struct whisper_context * ctx) {
     if (ctx) {
         if (ctx->model.ctx) {
@@ -2905,6 +2843,7 @@ int whisper_full_parallel(
             struct ggml_init_params params = {
                 .mem_size   = ctxs[i].buf_memory.size(),
                 .mem_buffer = ctxs[i].buf_memory.data(),
+                .no_alloc   = false,
             };
 
             model.ctx_mem = ggml_init(params);
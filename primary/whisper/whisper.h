@@ -88,6 +88,13 @@ extern "C" {
     // Returns NULL on failure.
     WHISPER_API struct whisper_context * whisper_init(const char * path_model);
 
+    // Same as whisper_init(), but maps the model file instead of reading it.
+    // Tensors are used straight from the mapping where their alignment allows,
+    // the rest are copied. Mapped pages are shared by every process using the
+    // same file, and loading from a warm page cache is close to free.
+    // The file must not change while the context is in use.
+    WHISPER_API struct whisper_context * whisper_init_mmap(const char * path_model);
+
     // Frees all memory allocated by the model.
     WHISPER_API void whisper_free(struct whisper_context * ctx);
 
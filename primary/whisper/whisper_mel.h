@@ -0,0 +1,361 @@
+#pragma once
+
+//
+// The signal processing half of log_mel_spectrogram(): the FFT, and
+// the mel filterbank.
+//
+// Both do the same float operations, in the same order, as the
+// recursive fft() and the scalar filter loop they replace, so the
+// spectrogram comes out bit for bit the same.  What's gone is the
+// allocating at every level of the recursion, and the cos() and sin()
+// in the inner loops; the plan works those out once.
+//
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WHISPER_MEL_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define WHISPER_MEL_NEON
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Hann window, as whisper has always made it
+inline std::vector<float> whisper_hann(int n) {
+    std::vector<float> hann(n);
+    for (int i = 0; i < n; i++) {
+        hann[i] = 0.5*(1.0 - cos((2.0*M_PI*i)/(n)));
+    }
+    return hann;
+}
+
+// FFT of n real samples, n = 2^n_stages * n_leaf, with n_leaf odd (25 for
+// whisper's 400 and 800).
+//
+// This is the recursive even/odd split turned inside out.  The samples
+// are picked up in bit reversed order into 2^n_stages interleaved leaves,
+// each of which gets a plain DFT, then radix-2 butterflies join them in
+// place, one stage at a time.
+struct whisper_fft_plan {
+    // the type the original DFT multiplied by, cos() of a float
+    using trig_t = decltype(cos(0.0f));
+
+    // the leaves are plain O(n^2) DFTs, so anything with a bigger odd
+    // factor than this wants a different FFT anyway
+    static constexpr int k_max_leaf = 64;
+
+    int n        = 0;
+    int n_leaf   = 1;
+    int n_stages = 0;
+
+    std::vector<int>    leaf_offset; // first sample of each leaf, bit reversed
+    std::vector<trig_t> leaf_cos;    // [sample*n_leaf + bin]
+    std::vector<trig_t> leaf_sin;
+    std::vector<float>  twiddle;     // (re, im) pairs, len/2 of them for each stage of length len
+
+    whisper_fft_plan() = default;
+    explicit whisper_fft_plan(int n_samples) { init(n_samples); }
+
+    void init(int n_samples) {
+        n        = n_samples;
+        n_leaf   = n_samples;
+        n_stages = 0;
+        while (n_leaf > 1 && n_leaf % 2 == 0) {
+            n_leaf /= 2;
+            n_stages++;
+        }
+        assert(n_leaf <= k_max_leaf);
+
+        const int n_leaves = 1 << n_stages;
+        leaf_offset.resize(n_leaves);
+        for (int b = 0; b < n_leaves; b++) {
+            int r = 0;
+            for (int i = 0; i < n_stages; i++) {
+                r |= ((b >> i) & 1) << (n_stages - 1 - i);
+            }
+            leaf_offset[b] = r;
+        }
+
+        // same expressions as the DFT and butterflies used to work out as they went
+        const int N = n_leaf;
+        leaf_cos.resize(N*N);
+        leaf_sin.resize(N*N);
+        for (int k = 0; k < N; k++) {
+            for (int j = 0; j < N; j++) {
+                float angle = 2*M_PI*k*j/N;
+                leaf_cos[j*N + k] = cos(angle);
+                leaf_sin[j*N + k] = sin(angle);
+            }
+        }
+
+        twiddle.clear();
+        for (int len = 2*n_leaf; len <= n; len *= 2) {
+            for (int k = 0; k < len/2; k++) {
+                float theta = 2*M_PI*k/len;
+
+                float re = cos(theta);
+                float im = -sin(theta);
+
+                twiddle.push_back(re);
+                twiddle.push_back(im);
+            }
+        }
+    }
+
+    // in: n real samples
+    // out: n complex values, 2*n floats
+    void forward(const float * in, float * out) const {
+        const int n_leaves = 1 << n_stages;
+
+        for (int b = 0; b < n_leaves; b++) {
+            const float * x = in + leaf_offset[b];
+            float * y = out + 2*b*n_leaf;
+
+            if (n_leaf == 1) {
+                y[0] = x[0];
+                y[1] = 0;
+                continue;
+            }
+
+            // each bin still sums over the samples in order, just all bins
+            // at once, kept apart so the compiler can vectorize across them
+            float re[k_max_leaf];
+            float im[k_max_leaf];
+            for (int k = 0; k < n_leaf; k++) {
+                re[k] = 0;
+                im[k] = 0;
+            }
+            for (int j = 0; j < n_leaf; j++) {
+                const float xj = x[j*n_leaves];
+                const trig_t * c = leaf_cos.data() + j*n_leaf;
+                const trig_t * s = leaf_sin.data() + j*n_leaf;
+                for (int k = 0; k < n_leaf; k++) {
+                    re[k] += xj*c[k];
+                    im[k] -= xj*s[k];
+                }
+            }
+            for (int k = 0; k < n_leaf; k++) {
+                y[2*k + 0] = re[k];
+                y[2*k + 1] = im[k];
+            }
+        }
+
+        const float * w = twiddle.data();
+        for (int len = 2*n_leaf; len <= n; len *= 2) {
+            const int half = len/2;
+            for (int o = 0; o < n; o += len) {
+                float * even = out + 2*o;
+                float * odd  = even + 2*half;
+                for (int k = 0; k < half; k++) {
+                    const float re = w[2*k + 0];
+                    const float im = w[2*k + 1];
+
+                    const float re_even = even[2*k + 0];
+                    const float im_even = even[2*k + 1];
+                    const float re_odd  = odd[2*k + 0];
+                    const float im_odd  = odd[2*k + 1];
+
+                    even[2*k + 0] = re_even + re*re_odd - im*im_odd;
+                    even[2*k + 1] = im_even + re*im_odd + im*re_odd;
+
+                    odd[2*k + 0] = re_even - re*re_odd + im*im_odd;
+                    odd[2*k + 1] = im_even - re*im_odd - im*re_odd;
+                }
+            }
+            w += 2*half;
+        }
+    }
+};
+
+// The mel filters, regrouped to run four bands at a time.  Each band is a
+// triangle a few bins wide, so a group only visits the bins where one of
+// its bands is non-zero.  Skipping zero weights leaves the sums exactly as
+// they were, since the power spectrum is never negative.  Each lane still
+// adds up its band in bin order, in double, so vectorizing across bands
+// doesn't change them either.
+struct whisper_mel_filterbank {
+    struct group {
+        int k0;      // first bin
+        int k1;      // one past the last bin
+        int weights; // where the group's weights start, 4 per bin
+    };
+
+    int n_mel = 0;
+    int n_fft = 0;
+
+    std::vector<group> groups;
+    std::vector<float> weights;
+
+    whisper_mel_filterbank() = default;
+    whisper_mel_filterbank(const float * filters, int mel, int fft) { init(filters, mel, fft); }
+
+    // filters: n_mel rows of n_fft weights
+    void init(const float * filters, int mel, int fft) {
+        n_mel = mel;
+        n_fft = fft;
+
+        groups.clear();
+        weights.clear();
+        for (int j0 = 0; j0 < n_mel; j0 += 4) {
+            int k0 = n_fft;
+            int k1 = 0;
+            for (int j = j0; j < j0 + 4 && j < n_mel; j++) {
+                for (int k = 0; k < n_fft; k++) {
+                    if (filters[j*n_fft + k] != 0.0f) {
+                        k0 = std::min(k0, k);
+                        k1 = std::max(k1, k + 1);
+                    }
+                }
+            }
+            if (k1 < k0) {
+                k0 = k1 = 0;
+            }
+
+            groups.push_back({ k0, k1, (int) weights.size() });
+            for (int k = k0; k < k1; k++) {
+                for (int j = j0; j < j0 + 4; j++) {
+                    weights.push_back(j < n_mel ? filters[j*n_fft + k] : 0.0f);
+                }
+            }
+        }
+    }
+
+    // Number of sums apply() writes, n_mel rounded up to a whole group
+    int n_sums() const { return 4*(int) groups.size(); }
+
+    // sums[j] = the dot product of power with band j
+    void apply(const float * power, double * sums) const {
+        for (size_t g = 0; g < groups.size(); g++) {
+            const group & gr = groups[g];
+            const float * w = weights.data() + gr.weights;
+            double * s = sums + 4*g;
+
+#if defined(WHISPER_MEL_SSE2)
+            __m128d s01 = _mm_setzero_pd();
+            __m128d s23 = _mm_setzero_pd();
+            for (int k = gr.k0; k < gr.k1; k++, w += 4) {
+                const __m128 p = _mm_mul_ps(_mm_set1_ps(power[k]), _mm_loadu_ps(w));
+                s01 = _mm_add_pd(s01, _mm_cvtps_pd(p));
+                s23 = _mm_add_pd(s23, _mm_cvtps_pd(_mm_movehl_ps(p, p)));
+            }
+            _mm_storeu_pd(s + 0, s01);
+            _mm_storeu_pd(s + 2, s23);
+#elif defined(WHISPER_MEL_NEON)
+            float64x2_t s01 = vdupq_n_f64(0.0);
+            float64x2_t s23 = vdupq_n_f64(0.0);
+            for (int k = gr.k0; k < gr.k1; k++, w += 4) {
+                const float32x4_t p = vmulq_f32(vdupq_n_f32(power[k]), vld1q_f32(w));
+                s01 = vaddq_f64(s01, vcvt_f64_f32(vget_low_f32(p)));
+                s23 = vaddq_f64(s23, vcvt_high_f64_f32(p));
+            }
+            vst1q_f64(s + 0, s01);
+            vst1q_f64(s + 2, s23);
+#else
+            s[0] = s[1] = s[2] = s[3] = 0.0;
+            for (int k = gr.k0; k < gr.k1; k++, w += 4) {
+                for (int l = 0; l < 4; l++) {
+                    s[l] += power[k]*w[l];
+                }
+            }
+#endif
+        }
+    }
+};
+
+// What one thread needs to work on frames, so nothing is
+// allocated per frame
+struct whisper_mel_scratch {
+    std::vector<float>  fft_in;
+    std::vector<float>  fft_out;
+    std::vector<float>  power;
+    std::vector<double> sums;
+
+    void init(const whisper_fft_plan & plan, const whisper_mel_filterbank & bank) {
+        fft_in.assign(plan.n, 0.0f);
+        fft_out.assign(2*plan.n, 0.0f);
+        power.assign(plan.n, 0.0f);
+        sums.assign(bank.n_sums(), 0.0);
+    }
+};
+
+// One column of the log mel spectrogram, for the frame starting at
+// samples[offset]: window, FFT, power spectrum, filterbank, log10.
+// Band j goes to out[j*out_stride].
+inline void whisper_mel_frame(
+    const whisper_fft_plan & plan,
+    const whisper_mel_filterbank & bank,
+    const float * hann,
+    const float * samples,
+    const int n_samples,
+    const int offset,
+    const bool speed_up,
+    whisper_mel_scratch & scratch,
+    float * out,
+    const int out_stride) {
+
+    const int fft_size = plan.n;
+
+    float * fft_in  = scratch.fft_in.data();
+    float * fft_out = scratch.fft_out.data();
+    float * power   = scratch.power.data();
+    double * sums   = scratch.sums.data();
+
+    // apply Hanning window
+    for (int j = 0; j < fft_size; j++) {
+        if (offset + j < n_samples) {
+            fft_in[j] = hann[j]*samples[offset + j];
+        } else {
+            fft_in[j] = 0.0;
+        }
+    }
+
+    // FFT -> mag^2
+    plan.forward(fft_in, fft_out);
+
+    int j = 0;
+#if defined(WHISPER_MEL_SSE2)
+    for (; j + 4 <= fft_size; j += 4) {
+        const __m128 a = _mm_loadu_ps(fft_out + 2*j);
+        const __m128 b = _mm_loadu_ps(fft_out + 2*j + 4);
+        const __m128 a2 = _mm_mul_ps(a, a);
+        const __m128 b2 = _mm_mul_ps(b, b);
+        _mm_storeu_ps(power + j, _mm_add_ps(_mm_shuffle_ps(a2, b2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a2, b2, _MM_SHUFFLE(3, 1, 3, 1))));
+    }
+#endif
+    for (; j < fft_size; j++) {
+        power[j] = (fft_out[2*j + 0]*fft_out[2*j + 0] + fft_out[2*j + 1]*fft_out[2*j + 1]);
+    }
+    for (int j = 1; j < fft_size/2; j++) {
+        power[j] += power[fft_size - j];
+    }
+
+    if (speed_up) {
+        // scale down in the frequency domain results in a speed up in the time domain
+        for (int j = 0; j < bank.n_fft; j++) {
+            power[j] = 0.5*(power[2*j] + power[2*j + 1]);
+        }
+    }
+
+    // mel spectrogram
+    bank.apply(power, sums);
+
+    for (int j = 0; j < bank.n_mel; j++) {
+        double sum = sums[j];
+        if (sum < 1e-10) {
+            sum = 1e-10;
+        }
+
+        sum = log10(sum);
+
+        out[j*out_stride] = sum;
+    }
+}
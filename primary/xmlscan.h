@@ -4,6 +4,9 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <deque>
+#include <functional>
 
 //
 // This file represents a very small, fast, simple XML scanner
@@ -222,8 +225,7 @@ namespace ndt {
             DataChunk tagName = s;
             tagName.fEnd = s.fStart;
 
-            while (s && !wspChars[*s])
-                s++;
+            s.fStart = scan_find_in_set(s.fStart, s.fEnd, wspChars);
 
             tagName.fEnd = s.fStart;
             setTagName(tagName);
@@ -279,8 +281,8 @@ namespace ndt {
 
 
                 // Skip stuff past '=' until the beginning of the value.
-                while (s && (*s != '\"') && (*s != '\''))
-                    s++;
+                static charset quoteChars("\"'");
+                s.fStart = scan_find_in_set(s.fStart, s.fEnd, quoteChars);
 
                 if (!s)
                     break;
@@ -293,8 +295,7 @@ namespace ndt {
                 beginattrValue = (uint8_t*)s.fStart;
 
                 // Skip until end of the value.
-                while (s && *s != quote)
-                    s++;
+                s.fStart = scan_find_byte(s.fStart, s.fEnd, quote);
 
                 if (s)
                 {
@@ -303,6 +304,10 @@ namespace ndt {
                 }
 
                 // Store only well formed attributes
+                // A value with no closing quote is not one
+                if (endattrValue == nullptr)
+                    break;
+
                 DataChunk attrValue = { beginattrValue, endattrValue };
                 //printf("    VALUE :");
                 //printChunk(attrValue);
@@ -317,6 +322,231 @@ namespace ndt {
     };
 
 
+    //
+    // XmlPushParser
+    // An incremental (push) scanner for XML that arrives a piece at a time,
+    // over a socket or a pipe for example.
+    //
+    // Hand it successive buffers with feed(), and it will produce the same
+    // XmlElements the XmlElementIterator produces for the whole document.  The
+    // elements are either handed to a callback as they are found, or queued up
+    // to be pulled off with next().
+    //
+    // Anything that is not yet a complete element (a tag that is split across
+    // buffers, content waiting for the next '<') is kept in an internal buffer
+    // and picked up again on the next feed(), where the search for its end
+    // left off, so a large element arriving in small pieces is only looked
+    // through once.  What has already been turned into elements is dropped once
+    // it is at least half the buffer, so memory use is bounded by about twice the
+    // largest single element, plus the size of the buffers being fed, no matter
+    // how large the document is.
+    //
+    // The DataChunks within an element point into that internal buffer, so
+    // they are only valid until the next call to feed() or finish().
+    //
+    // Usage:
+    //   XmlPushParser parser([](const XmlElement& elem) { processElement(elem); });
+    //   while (readSomeBytes(buff, &len))
+    //      parser.feed(chunk_from_data_size(buff, len));
+    //   parser.finish();
+    //
+    struct XmlPushParser {
+    private:
+        std::vector<uint8_t> fBuffer{};
+        size_t fScanned{ 0 };           // offset of the first byte not yet made into elements
+        size_t fSearched{ 0 };          // offset the search for the next '<' or '>' carries on from
+        bool fFinished{ false };
+
+        std::function<void(const XmlElement&)> fHandler{};
+        std::deque<XmlElement> fQueue{};
+        XmlElement fScratch{};
+
+    public:
+        XmlPushParser() = default;
+        XmlPushParser(std::function<void(const XmlElement&)> handler) : fHandler(handler) {}
+
+        // Set the routine that receives elements as they are found
+        // If there is none, elements are queued up for next()
+        void setHandler(std::function<void(const XmlElement&)> handler) { fHandler = handler; }
+
+        bool finished() const { return fFinished; }
+        
+        // How many elements are waiting to be pulled with next()
+        size_t pending() const { return fQueue.size(); }
+        
+        // How many bytes are being held over, waiting for more input
+        size_t bufferedBytes() const { return fBuffer.size() - fScanned; }
+        
+        // Add the next piece of the document
+        bool feed(const DataChunk& inChunk)
+        {
+            if (fFinished)
+                return false;
+
+            compact();
+            fBuffer.insert(fBuffer.end(), inChunk.fStart, inChunk.fEnd);
+            scan();
+
+            return true;
+        }
+
+        // No more input is coming
+        // Whatever is left over is dealt with the same as the
+        // XmlElementIterator would at the end of a chunk
+        void finish()
+        {
+            if (fFinished)
+                return;
+
+            scan();
+            scanTail();
+            fFinished = true;
+        }
+
+        // Pull the next queued element, if there is one
+        bool next(XmlElement& elem)
+        {
+            if (fQueue.empty())
+                return false;
+
+            elem = std::move(fQueue.front());
+            fQueue.pop_front();
+
+            return true;
+        }
+
+    private:
+        // Get rid of the bytes that have already been scanned
+        // Only done once they are at least half of the buffer, so the
+        // bytes moved are never more than the bytes dropped
+        void compact()
+        {
+            if (fScanned == 0 || fScanned < fBuffer.size() - fScanned)
+                return;
+
+            size_t remaining = fBuffer.size() - fScanned;
+            if (remaining > 0)
+                memmove(fBuffer.data(), fBuffer.data() + fScanned, remaining);
+            fBuffer.resize(remaining);
+            fSearched -= fScanned;
+            fScanned = 0;
+        }
+
+        void emit(int kind, const DataChunk& data)
+        {
+            fScratch.reset(kind, data, kind != XML_ELEMENT_TYPE_CONTENT);
+            deliver(fScratch);
+        }
+
+        void deliver(const XmlElement& elem)
+        {
+            if (fHandler)
+                fHandler(elem);
+            else
+                fQueue.push_back(elem);
+        }
+
+        // Deal with whatever is left over once the input has ended
+        void scanTail();
+
+        // Turn as much of the buffer into elements as we can
+        // The rules are the same as XmlElementIterator::next()
+        void scan()
+        {
+            const uint8_t* base = fBuffer.data();
+            const uint8_t* s = base + fScanned;
+            const uint8_t* e = base + fBuffer.size();
+
+            // Whatever was searched on the last pass, without finding
+            // what it was looking for, doesn't need to be searched again
+            const uint8_t* searched = base + fSearched;
+
+            while (s < e)
+            {
+                const uint8_t* lt = (*s == '<') ? s : scan_find_byte(std::max(s, searched), e, '<');
+                if (lt == e)
+                {
+                    fSearched = e - base;
+                    break;
+                }
+
+                // Content before the tag is complete now
+                // collapse it, and if it's only whitespace, skip it
+                if (lt != s)
+                {
+                    DataChunk content = chunk_trim(DataChunk(s, lt), wspChars);
+                    if (content)
+                        emit(XML_ELEMENT_TYPE_CONTENT, content);
+
+                    s = lt;
+                    fScanned = s - base;
+                }
+
+                // See if we have the whole tag yet
+                const uint8_t* tagStart = s + 1;
+                const uint8_t* gt = scan_find_byte(std::max(tagStart, searched), e, '>');
+                if (gt == e)
+                {
+                    fSearched = e - base;
+                    break;
+                }
+
+                DataChunk rest(tagStart, e);
+                int kind = XML_ELEMENT_TYPE_START_TAG;
+
+                if (chunk_starts_with_cstr(rest, "?xml"))
+                    kind = XML_ELEMENT_TYPE_XMLDECL;
+                else if (chunk_starts_with_cstr(rest, "?"))
+                    kind = XML_ELEMENT_TYPE_PROCESSING_INSTRUCTION;
+                else if (chunk_starts_with_cstr(rest, "!DOCTYPE"))
+                {
+                    kind = XML_ELEMENT_TYPE_DOCTYPE;
+
+                    // A DOCTYPE with an internal subset '[...]' ends
+                    // at the first '>' after the closing ']'
+                    // These are rare, and small, so it's searched from
+                    // the start each time
+                    const uint8_t* bracket = scan_find_byte(tagStart, gt, '[');
+                    if (bracket < gt)
+                    {
+                        const uint8_t* closing = scan_find_byte(bracket, e, ']');
+                        if (closing == e)
+                        {
+                            fSearched = fScanned;
+                            break;
+                        }
+                        gt = scan_find_byte(closing, e, '>');
+                        if (gt == e)
+                        {
+                            fSearched = fScanned;
+                            break;
+                        }
+                    }
+                }
+                else if (chunk_starts_with_cstr(rest, "!--"))
+                    kind = XML_ELEMENT_TYPE_COMMENT;
+                else if (chunk_starts_with_cstr(rest, "![CDATA["))
+                    kind = XML_ELEMENT_TYPE_CDATA;
+                else if (chunk_starts_with_cstr(rest, "/"))
+                    kind = XML_ELEMENT_TYPE_END_TAG;
+
+                DataChunk elementChunk = chunk_rtrim(DataChunk(tagStart, gt), wspChars);
+                if ((kind == XML_ELEMENT_TYPE_START_TAG) && chunk_ends_with_char(elementChunk, '/'))
+                    kind = XML_ELEMENT_TYPE_SELF_CLOSING;
+
+                emit(kind, elementChunk);
+
+                s = gt + 1;
+                fScanned = s - base;
+                searched = s;
+            }
+
+            if (fSearched < fScanned)
+                fSearched = fScanned;
+        }
+    };
+
+
     
 
 
@@ -349,6 +579,12 @@ namespace ndt {
         ndt::DataChunk mark{};
 
         XmlElement fCurrentElement{};
+
+        // When iterating over a stream, elements come from 
+        // the push parser, and fRefill is called to feed it
+        // more data whenever it runs dry.
+        XmlPushParser* fStream{ nullptr };
+        std::function<bool(XmlPushParser&)> fRefill{};
         
     public:
         XmlElementIterator(const ndt::DataChunk& inChunk)
@@ -361,6 +597,16 @@ namespace ndt {
             next();
         }
 
+        // Iterate over a document that arrives a piece at a time
+        // 'refill' should feed() the parser the next piece of the
+        // document, and return false when there is no more.
+        XmlElementIterator(XmlPushParser& parser, std::function<bool(XmlPushParser&)> refill)
+            : fStream(&parser)
+            , fRefill(refill)
+        {
+            next();
+        }
+
 		explicit operator bool() { return !fCurrentElement.empty(); }
         
         // These operators make it operate like an iterator
@@ -384,8 +630,7 @@ namespace ndt {
             DataChunk elementChunk = fSource;
             elementChunk.fEnd = fSource.fStart;
             
-            while (fSource && *fSource != '>')
-                fSource++;
+            fSource.fStart = scan_find_byte(fSource.fStart, fSource.fEnd, '>');
 
             elementChunk.fEnd = fSource.fStart;
             elementChunk = chunk_rtrim(elementChunk, wspChars);
@@ -405,25 +650,21 @@ namespace ndt {
         {
             DataChunk elementChunk = fSource;
             elementChunk.fEnd = fSource.fStart;
-            //auto endingTag = chunk_find_cstr(fSource, "]>");
             
-            if (chunk_find_char(fSource, '['))
+            // Only a '[' before the first '>' starts an internal subset.
+            // The subset can have '>' in it, so then the tag ends at the
+            // first '>' after the closing ']'
+            const uint8_t* gt = scan_find_byte(fSource.fStart, fSource.fEnd, '>');
+            const uint8_t* bracket = scan_find_byte(fSource.fStart, gt, '[');
+            if (bracket < gt)
             {
-                // Read until we see ]>
-                while (fSource && (*fSource != ']'))
-                    fSource++;
-
-                // We want the closing ']' as part of the element
-                if (*fSource == ']')
-                    fSource++;
-            }
-            else {
-                // skip ahead to '>'
-                while (fSource && (*fSource != '>'))
-                    fSource++;
+                const uint8_t* closing = scan_find_byte(bracket, fSource.fEnd, ']');
+                gt = scan_find_byte(closing, fSource.fEnd, '>');
             }
 
-            if (*fSource == '>')
+            fSource.fStart = gt;
+
+            if (fSource)
             {
                 elementChunk.fEnd = fSource.fStart;
                 elementChunk = chunk_rtrim(elementChunk, wspChars);
@@ -442,6 +683,9 @@ namespace ndt {
         // it left off.
         bool next()
         {
+            if (fStream != nullptr)
+                return nextFromStream();
+
             while (fSource)
             {
                 switch (fState)
@@ -478,7 +722,8 @@ namespace ndt {
                         mark = fSource;
                     }
                     else {
-                        fSource++;
+                        // Jump straight to the next tag opening
+                        fSource.fStart = scan_find_byte(fSource.fStart, fSource.fEnd, '<');
                     }
 
                 }
@@ -547,7 +792,48 @@ namespace ndt {
             fCurrentElement.clear();
             return false;
         } // end of next()
+
+        // Get the next element from the push parser, 
+        // feeding it as needed
+        bool nextFromStream()
+        {
+            while (true)
+            {
+                if (fStream->next(fCurrentElement))
+                    return true;
+
+                if (fStream->finished())
+                    break;
+
+                if (!fRefill || !fRefill(*fStream))
+                    fStream->finish();
+            }
+
+            fCurrentElement.clear();
+            return false;
+        }
     };
+
+    // Once the input has ended, whatever is left over is either
+    // content with no tag after it, or a tag that was never closed.
+    // Rather than trying to mimic what the iterator makes of those,
+    // just have the iterator do it.
+    inline void XmlPushParser::scanTail()
+    {
+        const uint8_t* base = fBuffer.data();
+        DataChunk rest(base + fScanned, base + fBuffer.size());
+        fScanned = fBuffer.size();
+
+        if (!rest)
+            return;
+
+        XmlElementIterator iter(rest);
+        while (iter)
+        {
+            deliver(*iter);
+            iter++;
+        }
+    }
 }
 
 
@@ -8,7 +8,9 @@
 #include <binstream.hpp>
 
 #include <cstdint>
+#include <cstring>
 #include <functional>
+#include <string>
 
 
 
@@ -80,11 +82,18 @@ namespace lc3
 
 	struct Lc3VM {
 		// Storage
-		uint16_t memory[UINT16_MAX];		// Storage for general memory
-		uint16_t reg[R_COUNT];				// Storage for registers
+		uint16_t memory[UINT16_MAX + 1]{};	// Storage for general memory
+		uint16_t reg[R_COUNT]{};			// Storage for registers
 
 		bool running = true;				// Running state
 
+		// Console
+		// GETC and IN take characters from input, and the
+		// output traps append to output
+		std::string input;
+		size_t inputPos = 0;
+		std::string output;
+
 
 		// Operator table
 		op_func op_table[16]{
@@ -166,7 +175,7 @@ namespace lc3
 			// AND
 			if (0x0020 & opbit) {
 				if (imm_flag) {
-					vm.reg[r0] = vm.reg[r1] + imm5;
+					vm.reg[r0] = vm.reg[r1] & imm5;
 				}
 				else {
 					vm.reg[r0] = vm.reg[r1] & vm.reg[r2];
@@ -182,13 +191,14 @@ namespace lc3
 			// JSR
 			if (0x0010 & opbit) {
 				uint16_t long_flag = (instr >> 11) & 1;
+				uint16_t base = vm.reg[r1];		// before R7 changes, JSRR R7 is allowed
 				vm.reg[R_R7] = vm.reg[R_PC];
 				if (long_flag) {
 					pc_plus_off = vm.reg[R_PC] + sign_extend(instr & 0x7FF, 11);
 					vm.reg[R_PC] = pc_plus_off;
 				}
 				else {
-					vm.reg[R_PC] = vm.reg[r1];
+					vm.reg[R_PC] = base;
 				}
 			}
 
@@ -215,7 +225,8 @@ namespace lc3
 
 			// TRAP
 			if (0x8000 & opbit) {
-				// BUGBUG - fill this out
+				vm.reg[R_R7] = vm.reg[R_PC];
+				vm.trap(instr & 0xFF);
 			}
 
 			// RTI
@@ -228,6 +239,8 @@ namespace lc3
 		// The stream is assumed to be in the appropriate format
 		Lc3VM(BinStream& bs)
 		{
+			reg[R_COND] = FL_ZRO;
+
 			//enum {PC_START = 0x3000};
 			// read origin from stream
 			uint16_t origin = bs.readUInt16();
@@ -245,6 +258,35 @@ namespace lc3
 			reg[R_PC] = origin;
 		}
 
+		// An image in memory, the origin followed by the words
+		// to load there, as they are in an .obj file, but already
+		// in host byte order
+		Lc3VM(const uint16_t* image, size_t count)
+		{
+			load(image, count);
+		}
+
+		// Start over with a new image; memory and registers are
+		// cleared, and so is the console
+		void load(const uint16_t* image, size_t count)
+		{
+			memset(memory, 0, sizeof(memory));
+			memset(reg, 0, sizeof(reg));
+			reg[R_COND] = FL_ZRO;
+			running = true;
+			inputPos = 0;
+			output.clear();
+
+			if (count == 0)
+				return;
+
+			uint16_t origin = image[0];
+			for (size_t i = 1; i < count && (origin + i - 1) <= UINT16_MAX; i++)
+				memory[origin + i - 1] = image[i];
+
+			reg[R_PC] = origin;
+		}
+
 		// Instance methods
 		// decode and execute a single instruction
 		void step()
@@ -253,6 +295,12 @@ namespace lc3
 			uint16_t instr = mem_read(reg[R_PC]++);
 			uint16_t op = instr >> 12;
 
+			// RTI and the reserved opcode stop the machine
+			if (!op_table[op]) {
+				running = false;
+				return;
+			}
+
 			op_table[op](*this, instr);
 		}
 
@@ -261,8 +309,6 @@ namespace lc3
 		void run()
 		{
 			// main loop, run until error, or end of program
-			bool running = true;
-
 			while (running)
 			{
 				step();
@@ -285,19 +331,70 @@ namespace lc3
 			}
 		}
 
+		// The trap routines, done here rather than in LC-3 code
+		// R7 has already been given the return address
+		void trap(uint16_t vector)
+		{
+			switch (vector)
+			{
+			case TRAP_GETC:
+				reg[R_R0] = getchar();
+				update_flags(R_R0);
+				break;
+
+			case TRAP_OUT:
+				output.push_back((char)reg[R_R0]);
+				break;
+
+			case TRAP_PUTS: {
+				// one character per word, up to a 0, or once around memory
+				uint16_t a = reg[R_R0];
+				for (size_t n = 0; n <= UINT16_MAX && memory[a] != 0; n++, a++)
+					output.push_back((char)memory[a]);
+			}
+			break;
+
+			case TRAP_IN:
+				output += "Enter a character: ";
+				reg[R_R0] = getchar();
+				output.push_back((char)reg[R_R0]);
+				update_flags(R_R0);
+				break;
+
+			case TRAP_PUTSP: {
+				// two characters per word, low byte first
+				uint16_t a = reg[R_R0];
+				for (size_t n = 0; n <= UINT16_MAX && memory[a] != 0; n++, a++) {
+					output.push_back((char)(memory[a] & 0xFF));
+					if (memory[a] >> 8)
+						output.push_back((char)(memory[a] >> 8));
+				}
+			}
+			break;
+
+			case TRAP_HALT:
+			default:
+				running = false;
+				break;
+			}
+		}
+
 		// System Specific
 		// check for a key
 		// check to see if there's a key available
 
 		uint16_t check_key()
 		{
-			return 0;
+			return inputPos < input.size();
 		}
 
-		// Get a single character from stdio
+		// Get a single character from the input, 0 if there are none left
 		uint16_t getchar()
 		{
-			return 0;
+			if (inputPos >= input.size())
+				return 0;
+
+			return (uint8_t)input[inputPos++];
 		}
 
 		// Memory Access
@@ -0,0 +1,78 @@
+#pragma once
+
+// Running lots of LC-3 programs at once
+//
+// Each job is a program image, the input to give it, and a limit on
+// how many instructions it may run.  run_batch() hands the jobs out to
+// a set of threads; each thread has its own Lc3VM and Lc3Fast, which
+// are reloaded for each job it takes, and the results are written back
+// into the job.  Jobs don't share anything, so the order they're run
+// in makes no difference.
+//
+// Usage:
+//	std::vector<lc3::Lc3Job> jobs(n);
+//	for (auto& job : jobs) { job.image = ...; job.input = ...; }
+//	lc3::run_batch(jobs);
+//
+
+#include "lc3fast.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace lc3
+{
+	struct Lc3Job {
+		// what to run
+		std::vector<uint16_t> image;		// origin, then the words to load there
+		std::string input;
+		uint64_t maxInstructions = UINT64_MAX;
+
+		// what happened
+		std::string output;
+		uint64_t instructions = 0;
+		bool halted = false;				// stopped by itself, rather than at the limit
+		uint16_t reg[R_COUNT]{};
+	};
+
+	// threads - 0 is one per hardware thread
+	// The calling thread takes jobs too
+	inline void run_batch(std::vector<Lc3Job>& jobs, unsigned threads = 0)
+	{
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		threads = (unsigned)std::min<size_t>(threads, std::max<size_t>(1, jobs.size()));
+
+		std::atomic<size_t> next{ 0 };
+
+		auto worker = [&]() {
+			// 128K of memory, and a cache entry per word; too big for the stack
+			auto vm = std::make_unique<Lc3VM>(nullptr, 0);
+			Lc3Fast fast(*vm);
+
+			for (size_t i = next++; i < jobs.size(); i = next++)
+			{
+				Lc3Job& job = jobs[i];
+
+				vm->load(job.image.data(), job.image.size());
+				vm->input = job.input;
+				fast.invalidate();
+
+				job.instructions = fast.run(job.maxInstructions);
+				job.halted = !vm->running;
+				job.output = std::move(vm->output);
+				memcpy(job.reg, vm->reg, sizeof(job.reg));
+			}
+		};
+
+		std::vector<std::thread> workers;
+		workers.reserve(threads - 1);
+		for (unsigned t = 1; t < threads; t++)
+			workers.emplace_back(worker);
+		worker();
+
+		for (auto& w : workers)
+			w.join();
+	}
+}
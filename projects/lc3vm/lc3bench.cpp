@@ -0,0 +1,478 @@
+//
+// lc3bench
+// Runs LC-3 programs with Lc3VM::step(), and with Lc3Fast, reports
+// how many instructions a second each manages, and checks that they
+// finish in the same state.  Then runs a batch of copies of each
+// program on a pool of threads, with run_batch().  Also checks that
+// stopping at an instruction limit, and carrying on, matches step().
+//
+//   lc3bench [-loops 2000] [-batch 64] [-threads 0] [program.obj ...]
+//
+// Without any .obj files, a few programs built in here are run.
+// .obj files are big-endian, the origin followed by the program.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "lc3batch.h"
+#include "filestream.h"
+
+using namespace lc3;
+
+// Just enough of an assembler to write the test programs
+namespace as {
+	static uint16_t reg3(int op, int dr, int sr1, int sr2) { return (uint16_t)((op << 12) | (dr << 9) | (sr1 << 6) | sr2); }
+	static uint16_t imm5(int op, int dr, int sr1, int imm) { return (uint16_t)((op << 12) | (dr << 9) | (sr1 << 6) | 0x20 | (imm & 0x1F)); }
+
+	static uint16_t ADD(int dr, int sr1, int sr2) { return reg3(OP_ADD, dr, sr1, sr2); }
+	static uint16_t ADDi(int dr, int sr1, int imm) { return imm5(OP_ADD, dr, sr1, imm); }
+	static uint16_t AND(int dr, int sr1, int sr2) { return reg3(OP_AND, dr, sr1, sr2); }
+	static uint16_t ANDi(int dr, int sr1, int imm) { return imm5(OP_AND, dr, sr1, imm); }
+	static uint16_t NOT(int dr, int sr) { return (uint16_t)((OP_NOT << 12) | (dr << 9) | (sr << 6) | 0x3F); }
+	static uint16_t BR(int nzp, int off9) { return (uint16_t)((OP_BR << 12) | (nzp << 9) | (off9 & 0x1FF)); }
+	static uint16_t LD(int dr, int off9) { return (uint16_t)((OP_LD << 12) | (dr << 9) | (off9 & 0x1FF)); }
+	static uint16_t LDI(int dr, int off9) { return (uint16_t)((OP_LDI << 12) | (dr << 9) | (off9 & 0x1FF)); }
+	static uint16_t LDR(int dr, int base, int off6) { return (uint16_t)((OP_LDR << 12) | (dr << 9) | (base << 6) | (off6 & 0x3F)); }
+	static uint16_t LEA(int dr, int off9) { return (uint16_t)((OP_LEA << 12) | (dr << 9) | (off9 & 0x1FF)); }
+	static uint16_t ST(int sr, int off9) { return (uint16_t)((OP_ST << 12) | (sr << 9) | (off9 & 0x1FF)); }
+	static uint16_t STI(int sr, int off9) { return (uint16_t)((OP_STI << 12) | (sr << 9) | (off9 & 0x1FF)); }
+	static uint16_t STR(int sr, int base, int off6) { return (uint16_t)((OP_STR << 12) | (sr << 9) | (base << 6) | (off6 & 0x3F)); }
+	static uint16_t JSR(int off11) { return (uint16_t)((OP_JSR << 12) | 0x800 | (off11 & 0x7FF)); }
+	static uint16_t RET() { return (uint16_t)((OP_JMP << 12) | (7 << 6)); }
+	static uint16_t TRAP(int vec) { return (uint16_t)((OP_TRAP << 12) | vec); }
+
+	enum { n = 4, z = 2, p = 1 };
+
+	// The words of a program, with labels resolved as it's written
+	struct Program {
+		std::vector<uint16_t> words;
+		uint16_t origin = 0x3000;
+
+		int here() const { return (int)words.size(); }
+		void emit(uint16_t w) { words.push_back(w); }
+
+		// offset from the instruction about to be written, to target
+		int to(int target) const { return target - (here() + 1); }
+
+		std::vector<uint16_t> image() const
+		{
+			std::vector<uint16_t> img{ origin };
+			img.insert(img.end(), words.begin(), words.end());
+			return img;
+		}
+	};
+}
+
+struct TestProgram {
+	std::string name;
+	std::vector<uint16_t> image;
+	std::string input;
+};
+
+// Nested counting loops of arithmetic, the bulk of most programs
+static TestProgram arithmetic(int loops)
+{
+	using namespace as;
+	Program pr;
+	pr.emit(LD(5, 0)); int outerCount = pr.here() - 1;		// R5 = outer count, patched below
+	int outer = pr.here();
+	pr.emit(LD(0, 0)); int innerCount = pr.here() - 1;		// R0 = inner count
+	pr.emit(ANDi(1, 1, 0));
+	int inner = pr.here();
+	pr.emit(ADD(1, 1, 0));
+	pr.emit(ADDi(2, 1, 3));
+	pr.emit(AND(3, 2, 0));
+	pr.emit(NOT(4, 3));
+	pr.emit(ADDi(0, 0, -1));
+	pr.emit(BR(p, pr.to(inner)));
+	pr.emit(ADDi(5, 5, -1));
+	pr.emit(BR(p, pr.to(outer)));
+	pr.emit(TRAP(TRAP_HALT));
+
+	pr.words[outerCount] = LD(5, pr.here() - (outerCount + 1));
+	pr.emit((uint16_t)loops);
+	pr.words[innerCount] = LD(0, pr.here() - (innerCount + 1));
+	pr.emit(1000);
+
+	return { "arithmetic", pr.image(), "" };
+}
+
+// Fills an array, then sums it, through LDR/STR, and calls a
+// subroutine for each element
+static TestProgram memory(int loops)
+{
+	using namespace as;
+	const int kSize = 200;
+	Program pr;
+
+	pr.emit(LD(5, 0)); int countAt = pr.here() - 1;
+	int outer = pr.here();
+	pr.emit(LEA(6, 0)); int leaAt = pr.here() - 1;		// R6 = array
+	pr.emit(LD(0, 0)); int sizeAt = pr.here() - 1;		// R0 = size
+	int fill = pr.here();
+	pr.emit(STR(0, 6, 0));
+	pr.emit(ADDi(6, 6, 1));
+	pr.emit(ADDi(0, 0, -1));
+	pr.emit(BR(p, pr.to(fill)));
+
+	pr.emit(LEA(6, 0)); int lea2At = pr.here() - 1;
+	pr.emit(LD(0, 0)); int size2At = pr.here() - 1;
+	pr.emit(ANDi(1, 1, 0));
+	int sum = pr.here();
+	pr.emit(LDR(2, 6, 0));
+	pr.emit(JSR(0)); int jsrAt = pr.here() - 1;
+	pr.emit(ADDi(6, 6, 1));
+	pr.emit(ADDi(0, 0, -1));
+	pr.emit(BR(p, pr.to(sum)));
+	pr.emit(ST(1, 0)); int stAt = pr.here() - 1;
+	pr.emit(ADDi(5, 5, -1));
+	pr.emit(BR(p, pr.to(outer)));
+	pr.emit(TRAP(TRAP_HALT));
+
+	// R1 += R2
+	int sub = pr.here();
+	pr.emit(ADD(1, 1, 2));
+	pr.emit(RET());
+
+	int result = pr.here();
+	pr.emit(0);
+	int count = pr.here();
+	pr.emit((uint16_t)std::max(1, loops / 4));
+	int size = pr.here();
+	pr.emit(kSize);
+	int array = pr.here();
+	for (int i = 0; i < kSize; i++)
+		pr.emit(0);
+
+	auto fix = [&](int at, uint16_t (*make)(int, int), int r, int target) { pr.words[at] = make(r, target - (at + 1)); };
+	fix(countAt, LD, 5, count);
+	fix(leaAt, LEA, 6, array);
+	fix(sizeAt, LD, 0, size);
+	fix(lea2At, LEA, 6, array);
+	fix(size2At, LD, 0, size);
+	fix(stAt, ST, 1, result);
+	pr.words[jsrAt] = JSR(sub - (jsrAt + 1));
+
+	return { "memory", pr.image(), "" };
+}
+
+// Walks an array through a pointer kept in memory, reading
+// and writing each element with LDI and STI
+static TestProgram indirect(int loops)
+{
+	using namespace as;
+	const int kSize = 200;
+	Program pr;
+
+	pr.emit(LD(5, 0)); int countAt = pr.here() - 1;
+	int outer = pr.here();
+	pr.emit(LEA(3, 0)); int leaAt = pr.here() - 1;		// ptr = array
+	pr.emit(ST(3, 0)); int resetAt = pr.here() - 1;
+	pr.emit(LD(0, 0)); int sizeAt = pr.here() - 1;		// R0 = size
+	int loop = pr.here();
+	pr.emit(LDI(2, 0)); int ldiAt = pr.here() - 1;		// R2 = *ptr
+	pr.emit(ADDi(2, 2, 3));
+	pr.emit(STI(2, 0)); int stiAt = pr.here() - 1;		// *ptr = R2
+	pr.emit(LD(3, 0)); int loadPtrAt = pr.here() - 1;	// ptr++
+	pr.emit(ADDi(3, 3, 1));
+	pr.emit(ST(3, 0)); int storePtrAt = pr.here() - 1;
+	pr.emit(ADDi(0, 0, -1));
+	pr.emit(BR(p, pr.to(loop)));
+	pr.emit(ADDi(5, 5, -1));
+	pr.emit(BR(p, pr.to(outer)));
+	pr.emit(TRAP(TRAP_HALT));
+
+	int ptr = pr.here();
+	pr.emit(0);
+	int count = pr.here();
+	pr.emit((uint16_t)std::max(1, loops / 4));
+	int size = pr.here();
+	pr.emit(kSize);
+	int array = pr.here();
+	for (int i = 0; i < kSize; i++)
+		pr.emit(0);
+
+	auto fix = [&](int at, uint16_t (*make)(int, int), int r, int target) { pr.words[at] = make(r, target - (at + 1)); };
+	fix(countAt, LD, 5, count);
+	fix(leaAt, LEA, 3, array);
+	fix(resetAt, ST, 3, ptr);
+	fix(sizeAt, LD, 0, size);
+	fix(ldiAt, LDI, 2, ptr);
+	fix(stiAt, STI, 2, ptr);
+	fix(loadPtrAt, LD, 3, ptr);
+	fix(storePtrAt, ST, 3, ptr);
+
+	return { "indirect", pr.image(), "" };
+}
+
+// Rewrites one of its own instructions each time around the loop,
+// so the decoded copy has to be thrown out
+static TestProgram selfModifying(int loops)
+{
+	using namespace as;
+	Program pr;
+
+	pr.emit(LD(5, 0)); int countAt = pr.here() - 1;
+	pr.emit(ANDi(1, 1, 0));
+	int loop = pr.here();
+	pr.emit(LD(2, 0)); int addOneAt = pr.here() - 1;		// R2 = "ADD R1, R1, #1"
+	pr.emit(ANDi(3, 5, 1));
+	pr.emit(BR(z, 1));									// every other time around
+	pr.emit(LD(2, 0)); int addTwoAt = pr.here() - 1;		// R2 = "ADD R1, R1, #2"
+	pr.emit(ST(2, 0)); int patchAt = pr.here() - 1;
+	int target = pr.here();
+	pr.emit(ADDi(1, 1, 1));								// this is the one that's rewritten
+	pr.emit(ADDi(5, 5, -1));
+	pr.emit(BR(p, pr.to(loop)));
+	pr.emit(LEA(0, 0)); int msgAt = pr.here() - 1;
+	pr.emit(TRAP(TRAP_PUTS));
+	pr.emit(TRAP(TRAP_HALT));
+
+	int count = pr.here();
+	pr.emit((uint16_t)std::min(loops * 10, 30000));		// has to stay positive
+	int addOne = pr.here();
+	pr.emit(ADDi(1, 1, 1));
+	int addTwo = pr.here();
+	pr.emit(ADDi(1, 1, 2));
+	int msg = pr.here();
+	for (const char* c = "done\n"; *c; c++)
+		pr.emit((uint16_t)*c);
+	pr.emit(0);
+
+	pr.words[countAt] = LD(5, count - (countAt + 1));
+	pr.words[addOneAt] = LD(2, addOne - (addOneAt + 1));
+	pr.words[addTwoAt] = LD(2, addTwo - (addTwoAt + 1));
+	pr.words[patchAt] = ST(2, target - (patchAt + 1));
+	pr.words[msgAt] = LEA(0, msg - (msgAt + 1));
+
+	return { "selfmodifying", pr.image(), "" };
+}
+
+// Reads its input a character at a time, and echoes it in upper case
+static TestProgram echo()
+{
+	using namespace as;
+	Program pr;
+
+	int loop = pr.here();
+	pr.emit(TRAP(TRAP_GETC));
+	pr.emit(BR(z, 0)); int doneAt = pr.here() - 1;
+	pr.emit(LD(1, 0)); int maskAt = pr.here() - 1;
+	pr.emit(AND(0, 0, 1));
+	pr.emit(TRAP(TRAP_OUT));
+	pr.emit(BR(n | z | p, pr.to(loop)));
+	int done = pr.here();
+	pr.emit(TRAP(TRAP_HALT));
+	int mask = pr.here();
+	pr.emit(0xDF);
+
+	pr.words[doneAt] = BR(z, done - (doneAt + 1));
+	pr.words[maskAt] = LD(1, mask - (maskAt + 1));
+
+	std::string input;
+	for (int i = 0; i < 200; i++)
+		input += "the quick brown fox ";
+
+	return { "echo", pr.image(), input };
+}
+
+static bool loadObj(const char* filename, TestProgram& prog)
+{
+	// .obj files are big-endian
+	auto fs = ndt::FileStream(filename, false);
+	if (!fs.isValid())
+		return false;
+
+	prog.name = filename;
+	prog.image.clear();
+	while (!fs.isEOF())
+		prog.image.push_back(fs.readUInt16());
+
+	return !prog.image.empty();
+}
+
+static bool sameState(const Lc3VM& a, const Lc3VM& b)
+{
+	return memcmp(a.reg, b.reg, sizeof(a.reg)) == 0
+		&& memcmp(a.memory, b.memory, sizeof(a.memory)) == 0
+		&& a.output == b.output
+		&& a.running == b.running;
+}
+
+// Stopping at a limit has to leave the machine where step() would,
+// so running again carries on from there.  Checks run(0), a few
+// limits from a fresh start, and running to the end in small pieces.
+static bool checkLimits(const TestProgram& prog)
+{
+	bool ok = true;
+
+	{
+		auto ref = std::make_unique<Lc3VM>(prog.image.data(), prog.image.size());
+		auto vm = std::make_unique<Lc3VM>(prog.image.data(), prog.image.size());
+		Lc3Fast fast(*vm);
+		if (fast.run(0) != 0 || !sameState(*ref, *vm)) {
+			printf("%s: run(0) ran something\n", prog.name.c_str());
+			ok = false;
+		}
+	}
+
+	for (uint64_t limit : { 1, 2, 3, 7, 100, 1001 })
+	{
+		auto ref = std::make_unique<Lc3VM>(prog.image.data(), prog.image.size());
+		ref->input = prog.input;
+		uint64_t refCount = 0;
+		while (ref->running && refCount < limit) {
+			ref->step();
+			refCount++;
+		}
+
+		auto vm = std::make_unique<Lc3VM>(prog.image.data(), prog.image.size());
+		vm->input = prog.input;
+		Lc3Fast fast(*vm);
+		uint64_t fastCount = fast.run(limit);
+
+		if (fastCount != refCount || !sameState(*ref, *vm)) {
+			printf("%s: limit %llu: fast pc %04x after %llu, step pc %04x after %llu\n", prog.name.c_str(), (unsigned long long)limit,
+				vm->reg[R_PC], (unsigned long long)fastCount, ref->reg[R_PC], (unsigned long long)refCount);
+			ok = false;
+		}
+	}
+
+	for (uint64_t piece : { 1, 5, 64 })
+	{
+		auto ref = std::make_unique<Lc3VM>(prog.image.data(), prog.image.size());
+		ref->input = prog.input;
+		uint64_t refCount = 0;
+		while (ref->running && refCount < 1000000) {
+			ref->step();
+			refCount++;
+		}
+
+		auto vm = std::make_unique<Lc3VM>(prog.image.data(), prog.image.size());
+		vm->input = prog.input;
+		Lc3Fast fast(*vm);
+		uint64_t fastCount = 0;
+		while (vm->running && fastCount < refCount)
+			fastCount += fast.run(std::min(piece, refCount - fastCount));
+
+		if (fastCount != refCount || !sameState(*ref, *vm)) {
+			printf("%s: resumed every %llu: %llu instructions, expected %llu\n", prog.name.c_str(), (unsigned long long)piece,
+				(unsigned long long)fastCount, (unsigned long long)refCount);
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void usage()
+{
+	printf("lc3bench [-loops 2000] [-batch 64] [-threads 0] [program.obj ...]\n");
+}
+
+int main(int argc, char** argv)
+{
+	int loops = 2000;
+	int batch = 64;
+	unsigned threads = 0;
+	std::vector<TestProgram> programs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = (i + 1 < argc);
+
+		if ((strcmp(argv[i], "-loops") == 0) && hasValue) loops = std::max(1, atoi(argv[++i]));
+		else if ((strcmp(argv[i], "-batch") == 0) && hasValue) batch = std::max(1, atoi(argv[++i]));
+		else if ((strcmp(argv[i], "-threads") == 0) && hasValue) threads = (unsigned)std::max(0, atoi(argv[++i]));
+		else if (argv[i][0] == '-') { usage(); return 1; }
+		else {
+			TestProgram prog;
+			if (!loadObj(argv[i], prog)) {
+				printf("could not load: %s\n", argv[i]);
+				return 1;
+			}
+			programs.push_back(prog);
+		}
+	}
+
+	if (programs.empty()) {
+		programs.push_back(arithmetic(loops));
+		programs.push_back(memory(loops));
+		programs.push_back(indirect(loops));
+		programs.push_back(selfModifying(loops));
+		programs.push_back(echo());
+	}
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	// Programs that don't stop by themselves are cut off here
+	const uint64_t kLimit = 2000000000ull;
+
+	printf("%-16s %14s %12s %12s %8s %6s\n", "program", "instructions", "step MIPS", "fast MIPS", "speedup", "same");
+
+	int failures = 0;
+	for (auto& prog : programs)
+	{
+		auto ref = std::make_unique<Lc3VM>(prog.image.data(), prog.image.size());
+		ref->input = prog.input;
+
+		auto start = std::chrono::steady_clock::now();
+		uint64_t refCount = 0;
+		while (ref->running && refCount < kLimit) {
+			ref->step();
+			refCount++;
+		}
+		double refSeconds = seconds(start);
+
+		auto vm = std::make_unique<Lc3VM>(prog.image.data(), prog.image.size());
+		vm->input = prog.input;
+		Lc3Fast fast(*vm);
+
+		start = std::chrono::steady_clock::now();
+		uint64_t fastCount = fast.run(kLimit);
+		double fastSeconds = seconds(start);
+
+		bool same = (refCount == fastCount) && sameState(*ref, *vm);
+		failures += !same;
+
+		printf("%-16s %14llu %12.1f %12.1f %7.1fx %6s\n", prog.name.c_str(), (unsigned long long)fastCount,
+			refCount / refSeconds / 1e6, fastCount / fastSeconds / 1e6, refSeconds / fastSeconds, same ? "yes" : "NO");
+	}
+
+	for (auto& prog : programs)
+		failures += !checkLimits(prog);
+
+	// The same programs, many copies of each, on a pool of threads
+	std::vector<Lc3Job> jobs;
+	for (int i = 0; i < batch; i++)
+		for (auto& prog : programs) {
+			Lc3Job job;
+			job.image = prog.image;
+			job.input = prog.input;
+			job.maxInstructions = kLimit;
+			jobs.push_back(std::move(job));
+		}
+
+	auto start = std::chrono::steady_clock::now();
+	run_batch(jobs, threads);
+	double batchSeconds = seconds(start);
+
+	uint64_t total = 0;
+	for (auto& job : jobs)
+		total += job.instructions;
+
+	printf("\nbatch: %zu programs, %u threads, %llu instructions, %.2f s, %.1f MIPS\n",
+		jobs.size(), threads, (unsigned long long)total, batchSeconds, total / batchSeconds / 1e6);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+// A faster way to run an Lc3VM
+//
+// Lc3VM::step() fetches, then works out what an instruction means,
+// every time it's run, and calls through a std::function.  Lc3Fast
+// works out what each word of memory means once, the first time it's
+// run, and keeps that in a cache with an entry per address; which
+// form of the instruction it is (ADD with an immediate, a branch that's
+// always taken, ...), the registers involved, the immediate value, and
+// for PC relative instructions, the address itself.
+//
+// run() keeps the registers in locals while it goes, and jumps straight
+// from one instruction's code to the next.  With gcc and clang that's
+// a computed goto at the end of each one (direct threading), so each
+// has its own indirect jump for the branch predictor to learn; with
+// other compilers, or with LC3_NO_COMPUTED_GOTO defined, it's a switch.
+//
+// Storing to an address points its entry back at the decoder, so code
+// that writes over itself runs the new instructions.  Anything else
+// that writes memory (loading a program, poking a value) should call
+// invalidate().
+//
+// Loads below the memory mapped registers go straight to memory,
+// only the rest go through Lc3VM::mem_read().
+//
+// Traps are still run by Lc3VM::trap(), with the registers written
+// back before, and read again after, so a program that spends most of
+// its time in traps (the echo program in lc3bench) runs at about the
+// same speed either way.
+//
+// The VM state is the Lc3VM's own, so the two ways of running it
+// can be mixed, and give the same results.
+//
+// Usage:
+//	lc3::Lc3VM vm(image, count);
+//	lc3::Lc3Fast fast(vm);
+//	uint64_t executed = fast.run();
+//
+
+#include "lc3.h"
+
+#include <memory>
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(LC3_NO_COMPUTED_GOTO)
+#define LC3_COMPUTED_GOTO 1
+#endif
+
+namespace lc3
+{
+	// The forms an instruction is decoded to
+	enum : uint8_t {
+		FX_DECODE = 0,		// not decoded yet, or written over since
+		FX_NOP,				// branch that's never taken
+		FX_JUMP,			// branch that's always taken
+		FX_BR,
+		FX_ADD,
+		FX_ADD_IMM,
+		FX_AND,
+		FX_AND_IMM,
+		FX_NOT,
+		FX_LD,
+		FX_LDI,
+		FX_LDR,
+		FX_LEA,
+		FX_ST,
+		FX_STI,
+		FX_STR,
+		FX_JMP,
+		FX_JSR,
+		FX_JSRR,
+		FX_TRAP,
+		FX_ILLEGAL,			// RTI and the reserved opcode
+		FX_COUNT,
+	};
+
+	struct Decoded {
+		uint8_t op;
+		uint8_t a;		// destination/source register, or condition mask
+		uint8_t b;		// base/source register
+		uint16_t c;		// second source register, immediate, or address
+	};
+
+	struct Lc3Fast {
+		Lc3VM& vm;
+		std::unique_ptr<Decoded[]> fCache;
+
+		Lc3Fast(Lc3VM& machine)
+			: vm(machine)
+			, fCache(new Decoded[UINT16_MAX + 1])
+		{
+			invalidate();
+		}
+
+		// Forget everything decoded so far
+		void invalidate()
+		{
+			for (size_t i = 0; i <= UINT16_MAX; i++)
+				fCache[i] = Decoded{ FX_DECODE, 0, 0, 0 };
+		}
+
+		void invalidate(uint16_t address) { fCache[address].op = FX_DECODE; }
+
+		// Work out what the word at address means
+		static Decoded decode(uint16_t address, uint16_t instr)
+		{
+			const uint16_t next = address + 1;
+			const uint8_t dr = (instr >> 9) & 0x7;
+			const uint8_t sr = (instr >> 6) & 0x7;
+			const uint16_t pcoff9 = next + Lc3VM::sign_extend(instr & 0x1FF, 9);
+
+			switch (instr >> 12)
+			{
+			case OP_BR:
+				if (dr == 0)
+					return { FX_NOP, 0, 0, 0 };
+				if (dr == 0x7)
+					return { FX_JUMP, 0, 0, pcoff9 };
+				return { FX_BR, dr, 0, pcoff9 };
+
+			case OP_ADD:
+				if (instr & 0x20)
+					return { FX_ADD_IMM, dr, sr, Lc3VM::sign_extend(instr & 0x1F, 5) };
+				return { FX_ADD, dr, sr, (uint16_t)(instr & 0x7) };
+
+			case OP_AND:
+				if (instr & 0x20)
+					return { FX_AND_IMM, dr, sr, Lc3VM::sign_extend(instr & 0x1F, 5) };
+				return { FX_AND, dr, sr, (uint16_t)(instr & 0x7) };
+
+			case OP_NOT: return { FX_NOT, dr, sr, 0 };
+			case OP_LD: return { FX_LD, dr, 0, pcoff9 };
+			case OP_LDI: return { FX_LDI, dr, 0, pcoff9 };
+			case OP_LDR: return { FX_LDR, dr, sr, Lc3VM::sign_extend(instr & 0x3F, 6) };
+			case OP_LEA: return { FX_LEA, dr, 0, pcoff9 };
+			case OP_ST: return { FX_ST, dr, 0, pcoff9 };
+			case OP_STI: return { FX_STI, dr, 0, pcoff9 };
+			case OP_STR: return { FX_STR, dr, sr, Lc3VM::sign_extend(instr & 0x3F, 6) };
+			case OP_JMP: return { FX_JMP, 0, sr, 0 };
+
+			case OP_JSR:
+				if (instr & 0x800)
+					return { FX_JSR, 0, 0, (uint16_t)(next + Lc3VM::sign_extend(instr & 0x7FF, 11)) };
+				return { FX_JSRR, 0, sr, 0 };
+
+			case OP_TRAP: return { FX_TRAP, 0, 0, (uint16_t)(instr & 0xFF) };
+
+			default:
+				return { FX_ILLEGAL, 0, 0, 0 };
+			}
+		}
+
+		// Run until the machine stops, or maxInstructions have run
+		// Returns how many instructions were run.  Stopping at the limit
+		// leaves pc at the next instruction, as step() does, so run()
+		// can be called again to carry on.
+		uint64_t run(uint64_t maxInstructions = UINT64_MAX)
+		{
+			if (!vm.running || maxInstructions == 0)
+				return 0;
+
+			Decoded* const cache = fCache.get();
+			uint16_t* const mem = vm.memory;
+
+			uint16_t r[8];
+			memcpy(r, vm.reg, sizeof(r));
+			uint16_t pc = vm.reg[R_PC];
+			uint16_t cond = vm.reg[R_COND];
+
+			uint64_t n = 0;
+			const Decoded* d = nullptr;
+
+			auto setcc = [&cond](uint16_t v) { cond = v == 0 ? FL_ZRO : ((v >> 15) ? FL_NEG : FL_POS); };
+
+			// Ordinary memory directly, the memory mapped registers through the VM.
+			// Reading the keyboard status writes both of them.
+			auto load = [&](uint16_t address) -> uint16_t {
+				if (address < MR_KBSR)
+					return mem[address];
+				uint16_t val = vm.mem_read(address);
+				cache[MR_KBSR].op = FX_DECODE;
+				cache[MR_KBDR].op = FX_DECODE;
+				return val;
+			};
+
+			auto store = [&](uint16_t address, uint16_t val) {
+				mem[address] = val;
+				cache[address].op = FX_DECODE;
+			};
+
+			auto syncOut = [&]() {
+				memcpy(vm.reg, r, sizeof(r));
+				vm.reg[R_PC] = pc;
+				vm.reg[R_COND] = cond;
+			};
+
+#if defined(LC3_COMPUTED_GOTO)
+			static void* const labels[FX_COUNT] = {
+				&&L_FX_DECODE, &&L_FX_NOP, &&L_FX_JUMP, &&L_FX_BR,
+				&&L_FX_ADD, &&L_FX_ADD_IMM, &&L_FX_AND, &&L_FX_AND_IMM, &&L_FX_NOT,
+				&&L_FX_LD, &&L_FX_LDI, &&L_FX_LDR, &&L_FX_LEA,
+				&&L_FX_ST, &&L_FX_STI, &&L_FX_STR,
+				&&L_FX_JMP, &&L_FX_JSR, &&L_FX_JSRR, &&L_FX_TRAP, &&L_FX_ILLEGAL,
+			};
+#define LC3_CASE(x) L_##x:
+#define LC3_DISPATCH() { d = &cache[pc]; goto *labels[d->op]; }
+#define LC3_NEXT() { pc++; if (++n >= maxInstructions) goto done; LC3_DISPATCH(); }
+			LC3_DISPATCH();
+#else
+#define LC3_CASE(x) case x:
+#define LC3_DISPATCH() continue
+#define LC3_NEXT() { pc++; if (++n >= maxInstructions) goto done; continue; }
+			for (;;) {
+			d = &cache[pc];
+			switch (d->op) {
+#endif
+			// pc is still the address of the instruction being run,
+			// it's moved past it in LC3_NEXT, or set by a jump
+			LC3_CASE(FX_DECODE) {
+				cache[pc] = decode(pc, load(pc));
+				LC3_DISPATCH();
+			}
+
+			LC3_CASE(FX_NOP) LC3_NEXT();
+			LC3_CASE(FX_JUMP) { pc = d->c - 1; LC3_NEXT(); }
+			LC3_CASE(FX_BR) { if (cond & d->a) pc = d->c - 1; LC3_NEXT(); }
+
+			LC3_CASE(FX_ADD) { r[d->a] = r[d->b] + r[d->c]; setcc(r[d->a]); LC3_NEXT(); }
+			LC3_CASE(FX_ADD_IMM) { r[d->a] = r[d->b] + d->c; setcc(r[d->a]); LC3_NEXT(); }
+			LC3_CASE(FX_AND) { r[d->a] = r[d->b] & r[d->c]; setcc(r[d->a]); LC3_NEXT(); }
+			LC3_CASE(FX_AND_IMM) { r[d->a] = r[d->b] & d->c; setcc(r[d->a]); LC3_NEXT(); }
+			LC3_CASE(FX_NOT) { r[d->a] = ~r[d->b]; setcc(r[d->a]); LC3_NEXT(); }
+
+			LC3_CASE(FX_LD) { r[d->a] = load(d->c); setcc(r[d->a]); LC3_NEXT(); }
+			LC3_CASE(FX_LDI) { r[d->a] = load(load(d->c)); setcc(r[d->a]); LC3_NEXT(); }
+			LC3_CASE(FX_LDR) { r[d->a] = load(r[d->b] + d->c); setcc(r[d->a]); LC3_NEXT(); }
+			LC3_CASE(FX_LEA) { r[d->a] = d->c; setcc(r[d->a]); LC3_NEXT(); }
+
+			LC3_CASE(FX_ST) { store(d->c, r[d->a]); LC3_NEXT(); }
+			LC3_CASE(FX_STI) { store(load(d->c), r[d->a]); LC3_NEXT(); }
+			LC3_CASE(FX_STR) { store(r[d->b] + d->c, r[d->a]); LC3_NEXT(); }
+
+			LC3_CASE(FX_JMP) { pc = r[d->b] - 1; LC3_NEXT(); }
+			LC3_CASE(FX_JSR) { r[R_R7] = pc + 1; pc = d->c - 1; LC3_NEXT(); }
+			LC3_CASE(FX_JSRR) { uint16_t base = r[d->b]; r[R_R7] = pc + 1; pc = base - 1; LC3_NEXT(); }
+
+			LC3_CASE(FX_TRAP) {
+				// The trap routines work on the VM's own registers
+				r[R_R7] = pc + 1;
+				syncOut();
+				vm.reg[R_PC] = pc + 1;
+				vm.trap(d->c);
+				memcpy(r, vm.reg, sizeof(r));
+				cond = vm.reg[R_COND];
+				if (!vm.running) {
+					n++;
+					pc++;
+					goto done;
+				}
+				LC3_NEXT();
+			}
+
+			LC3_CASE(FX_ILLEGAL) {
+				vm.running = false;
+				pc++;
+				n++;
+				goto done;
+			}
+#if !defined(LC3_COMPUTED_GOTO)
+			}
+			}
+#endif
+#undef LC3_CASE
+#undef LC3_DISPATCH
+#undef LC3_NEXT
+
+		done:
+			syncOut();
+			return n;
+		}
+	};
+}
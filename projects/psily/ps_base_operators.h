@@ -8,6 +8,25 @@
 #include <random>
 #include <iostream>
 
+// Numbers are equal by value, strings by their contents,
+// everything else if it's the same object
+static bool psEqual(PSVM& vm, const PSObject& a, const PSObject& b)
+{
+	if (a.isNumber() && b.isNumber())
+		return a.asDouble() == b.asDouble();
+
+	if (a.fType == PSTokenType::LITERAL_STRING && b.fType == PSTokenType::LITERAL_STRING)
+		return vm.memory().str(a) == vm.memory().str(b);
+
+	if (a.isName() && b.isName())
+		return a.fAtom == b.fAtom;
+
+	if (a.fType == PSTokenType::BOOLEAN && b.fType == PSTokenType::BOOLEAN)
+		return a.fBool == b.fBool;
+
+	return a.fType == b.fType && a.fBits == b.fBits && a.fAux == b.fAux;
+}
+
 // Setup a table to contain the base operators
 // These should be copied into a dictionary
 // as OPERATOR tokens
@@ -20,19 +39,19 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 
 	{"copy", [](PSVM& vm) {
 		auto tok = vm.operandStack().pop();
-		auto n = tok->asDouble();
+		auto n = tok.asDouble();
 		vm.operandStack().copy((size_t)n);
 	}},
 
 	{"count", [](PSVM& vm) {
 		auto len = vm.operandStack().length();
-		auto tok = make_shared<PSToken>((double)len);
+		auto tok = PSObject((double)len);
 		vm.pushOperand(tok);
 	}},
 
 	{"counttomark", [](PSVM& vm) {
 		auto n = vm.operandStack().countToMark();
-		auto tok = make_shared<PSToken>((double)n);
+		auto tok = PSObject((double)n);
 
 		vm.pushOperand(tok);
 	}},
@@ -42,7 +61,7 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 	{"exch", [](PSVM& vm) {vm.operandStack().exch(); }},
 
 	{"index", [](PSVM& vm) {
-		auto n = vm.popOperand()->asDouble();
+		auto n = vm.popOperand().asDouble();
 		auto tok = vm.operandStack().nth((size_t)n);
 		vm.pushOperand(tok);
 	}},
@@ -52,8 +71,8 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 	{"pop", [](PSVM& vm) {vm.operandStack().pop(); }},
 
 	{"roll", [](PSVM& vm) {
-		auto j = vm.popOperand()->asDouble();
-		auto n = vm.popOperand()->asDouble();
+		auto j = vm.popOperand().asDouble();
+		auto n = vm.popOperand().asDouble();
 		vm.operandStack().roll((int)n, (int)j);
 	}},
 
@@ -65,27 +84,27 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 	// Arithmetic and Mathematical Operators
 	// Pop two arguments off stack, put result back on stack
 	{"add", [](PSVM& vm) {
-			auto num2 = vm.popOperand()->asDouble();
-			auto num1 = vm.popOperand()->asDouble();
-			auto tok = make_shared<PSToken>(num1 + num2);
+			auto num2 = vm.popOperand().asDouble();
+			auto num1 = vm.popOperand().asDouble();
+			auto tok = PSObject(num1 + num2);
 
 			vm.pushOperand(tok);
 	}},
 
 	// atan
 	{ "atan", [](PSVM& vm) {
-		auto den = vm.popOperand()->asDouble();
-		auto num = vm.popOperand()->asDouble();
+		auto den = vm.popOperand().asDouble();
+		auto num = vm.popOperand().asDouble();
 		auto value = maths::degrees(std::atan(num / den));
-		vm.pushOperand(make_shared<PSToken>(value));
+		vm.pushOperand(PSObject(value));
 	} },
 	
 	// sub
 	// subtraction
 	{"sub", [](PSVM& vm) {
-			auto num2 = vm.popOperand()->asDouble();
-			auto num1 = vm.popOperand()->asDouble();
-			auto tok = make_shared<PSToken>(num1 - num2);
+			auto num2 = vm.popOperand().asDouble();
+			auto num1 = vm.popOperand().asDouble();
+			auto tok = PSObject(num1 - num2);
 
 			vm.pushOperand(tok);
 	}},
@@ -94,34 +113,34 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 	// multiplication
 	// pop two, push one
 	{"mul", [](PSVM& vm) {
-			auto num2 = vm.popOperand()->asDouble();
-			auto num1 = vm.popOperand()->asDouble();
-			auto tok = make_shared<PSToken>(num1 * num2);
+			auto num2 = vm.popOperand().asDouble();
+			auto num1 = vm.popOperand().asDouble();
+			auto tok = PSObject(num1 * num2);
 
 			vm.pushOperand(tok);
 	}},
 
 
 	{"div", [](PSVM& vm) {
-			auto num2 = vm.popOperand()->asDouble();
-			auto num1 = vm.popOperand()->asDouble();
-			auto tok = make_shared<PSToken>(num1 / num2);
+			auto num2 = vm.popOperand().asDouble();
+			auto num1 = vm.popOperand().asDouble();
+			auto tok = PSObject(num1 / num2);
 
 			vm.pushOperand(tok);
 	}},
 	
 	// exp
 	{"exp", [](PSVM& vm) {
-			auto base = vm.popOperand()->asDouble();
-			auto exponent = vm.popOperand()->asDouble();
-			auto tok = make_shared<PSToken>(std::pow(base ,exponent));
+			auto base = vm.popOperand().asDouble();
+			auto exponent = vm.popOperand().asDouble();
+			auto tok = PSObject(std::pow(base ,exponent));
 
 			vm.pushOperand(tok);
 	}},
 
 	{"idiv", [](PSVM& vm) {
-			auto b = vm.popOperand()->asDouble();
-			auto a = vm.popOperand()->asDouble();
+			auto b = vm.popOperand().asDouble();
+			auto a = vm.popOperand().asDouble();
 			auto q = a / b;
 			if (q >= 0) {
 				q = floor(q);
@@ -129,37 +148,37 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 			else {
 				q = ceil(q);
 			}
-			auto tok = make_shared<PSToken>(q);
+			auto tok = PSObject(q);
 
 			vm.pushOperand(tok);
 	}},
 
 	{"mod", [](PSVM& vm) {
-			auto b = vm.popOperand()->asDouble();
-			auto a = vm.popOperand()->asDouble();
+			auto b = vm.popOperand().asDouble();
+			auto a = vm.popOperand().asDouble();
 			auto value = fmod(a, b);
 
-			auto tok = make_shared<PSToken>(value);
+			auto tok = PSObject(value);
 
 			vm.pushOperand(tok);
 	}},
 
 	{ "maximum", [](PSVM& vm) {
-			auto b = vm.popOperand()->asDouble();
-			auto a = vm.popOperand()->asDouble();
+			auto b = vm.popOperand().asDouble();
+			auto a = vm.popOperand().asDouble();
 			auto value = std::max(a, b);
 
-			auto tok = make_shared<PSToken>(value);
+			auto tok = PSObject(value);
 
 			vm.pushOperand(tok);
 	}},
 
 	{ "minimum", [](PSVM& vm) {
-			auto b = vm.popOperand()->asDouble();
-			auto a = vm.popOperand()->asDouble();
+			auto b = vm.popOperand().asDouble();
+			auto a = vm.popOperand().asDouble();
 			auto value = std::min(a, b);
 
-			auto tok = make_shared<PSToken>(value);
+			auto tok = PSObject(value);
 
 			vm.pushOperand(tok);
 	}},
@@ -167,8 +186,8 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 	// Single argument arithmetic operators
 	// abs
 	{ "abs", [](PSVM& vm) {
-		auto a = vm.popOperand()->asDouble();
-		auto tok = make_shared<PSToken>(std::abs(a));
+		auto a = vm.popOperand().asDouble();
+		auto tok = PSObject(std::abs(a));
 
 		vm.pushOperand(tok);
 
@@ -176,76 +195,76 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 
 	// ceiling
 	{ "ceiling", [](PSVM& vm) {
-		auto a = vm.popOperand()->asDouble();
-		vm.pushOperand(make_shared<PSToken>(std::ceil(a)));
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(std::ceil(a)));
 	} },
 
 	// floor
 	{ "floor", [](PSVM& vm) {
-		auto a = vm.popOperand()->asDouble();
-		vm.pushOperand(make_shared<PSToken>(std::floor(a)));
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(std::floor(a)));
 	} },
 
 	// neg
 	{ "neg", [](PSVM& vm) {
-		auto a = vm.popOperand()->asDouble();
-		vm.pushOperand(make_shared<PSToken>(-(a)));
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(-(a)));
 	} },
 	
 	// round
 	{ "round", [](PSVM& vm) {
-		auto a = vm.popOperand()->asDouble();
-		vm.pushOperand(make_shared<PSToken>(std::round(a)));
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(std::round(a)));
 	} },
 	
 	// truncate
 	{ "truncate", [](PSVM& vm) {
-		auto a = vm.popOperand()->asDouble();
-		vm.pushOperand(make_shared<PSToken>(std::trunc(a)));
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(std::trunc(a)));
 	} },
 
 	// sqrt
 	{ "sqrt", [](PSVM& vm) {
-		auto a = vm.popOperand()->asDouble();
-		vm.pushOperand(make_shared<PSToken>(std::sqrt(a)));
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(std::sqrt(a)));
 	} },
 
 
 	
 	// ln
 	{ "ln", [](PSVM& vm) {
-		auto a = vm.popOperand()->asDouble();
-		vm.pushOperand(make_shared<PSToken>(std::log(a)));
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(std::log(a)));
 	} },
 	
 	// log
 	{ "log", [](PSVM& vm) {
-		auto a = vm.popOperand()->asDouble();
-		vm.pushOperand(make_shared<PSToken>(std::log10(a)));
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(std::log10(a)));
 	} },
 
 	// sin
 	{ "sin", [](PSVM& vm) {
-		auto a = vm.popOperand()->asDouble();
-		vm.pushOperand(make_shared<PSToken>(std::sin(a)));
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(std::sin(a)));
 	} },
 	
 	// cos
 	{ "cos", [](PSVM& vm) {
-		auto a = vm.popOperand()->asDouble();
-		vm.pushOperand(make_shared<PSToken>(std::sin(a)));
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(std::sin(a)));
 	} },
 	
 
 
 	// rand
 	{ "rand", [](PSVM& vm) {
-		vm.pushOperand(make_shared<PSToken>((double)vm.randomInt()));
+		vm.pushOperand(PSObject((double)vm.randomInt()));
 	} },
 	
 	// srand
 	{ "srand", [](PSVM& vm) {
-		auto seed = vm.popOperand()->asDouble();
+		auto seed = vm.popOperand().asDouble();
 		vm.seedRandomInt((unsigned int)seed);
 	} },
 
@@ -256,11 +275,13 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 	//
 	// get
 	{ "get", [](PSVM& vm) {
-		auto idx = (size_t)vm.popOperand()->asDouble();
-		auto arr = vm.popOperand()->asArray();
-		auto value = arr->operator[](idx);
-		// BUGBUG - check for range and stick a nil token if nothing
-		vm.pushOperand(value);
+		auto idx = (size_t)vm.popOperand().asDouble();
+		auto arr = vm.popOperand();
+		if (idx >= arr.length()) {
+			vm.pushOperand(PSObject());
+			return;
+		}
+		vm.pushOperand(vm.memory().element(arr, idx));
 	} },
 
 			// put
@@ -273,16 +294,15 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 	// def
 	{ "def", [](PSVM& vm) {
 		auto value = vm.popOperand();
-		auto key = vm.popOperand();
-		auto keyName = key->asString();
+		auto key = vm.memory().keyOf(vm.popOperand());
 
-		vm.dictionaryStack().def(keyName, value);
+		vm.dictionaryStack().def(key, value);
 	} },
 	
 	// load
 	{ "load", [](PSVM& vm) {
-		auto keyName = vm.popOperand()->asString();
-		auto value = vm.dictionaryStack().load(keyName);
+		auto key = vm.memory().keyOf(vm.popOperand());
+		auto value = vm.dictionaryStack().load(key);
 
 		if (nullptr == value) {
 			// print undefined key
@@ -290,33 +310,32 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 			return;
 		}
 
-		vm.pushOperand(value);
+		vm.pushOperand(*value);
 	} },
 
 	// store
 	{ "store", [](PSVM& vm) {
 		auto value = vm.popOperand();
-		auto keyName = vm.popOperand()->asString();
+		auto key = vm.memory().keyOf(vm.popOperand());
 
-		vm.dictionaryStack().store(keyName, value);
+		vm.dictionaryStack().store(key, value);
 	} },
 
 	{ "string", [](PSVM& vm) {
-		auto n = vm.popOperand()->asInt();
-		auto str = PSString(n);
-		vm.pushOperand(make_shared<PSToken>(str));
+		auto n = vm.popOperand().asInt();
+		vm.pushOperand(vm.memory().newString((size_t)n));
 	} },
 
 	// where
 	{ "where", [](PSVM& vm) {
-		auto key = vm.popOperand()->asString();
+		auto key = vm.memory().keyOf(vm.popOperand());
 		auto d = vm.dictionaryStack().where(key);
 
-		if (nullptr == d) {
-			vm.pushOperand(make_shared<PSToken>(false));
+		if (d.isNull()) {
+			vm.pushOperand(PSObject(false));
 		} else {
-			vm.pushOperand(make_shared<PSToken>(d));
-			vm.pushOperand(make_shared<PSToken>(true));
+			vm.pushOperand(d);
+			vm.pushOperand(PSObject(true));
 		}
 	} },
 
@@ -328,15 +347,15 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 	// astore
 	{ "astore", [](PSVM& vm) {
 		auto arrtok = vm.popOperand();
-		auto arr = arrtok->asArray();
 
-		auto size = arr->size();
+		auto size = arrtok.length();
 
 		for (size_t i = 0; i < size; i++) {
 			auto value = vm.popOperand();
-			arr->operator[](size - i-1) = value;
+			vm.memory().element(arrtok, size - i-1) = value;
 		}
 
+		vm.forgetCode(arrtok);
 		vm.pushOperand(arrtok);
 	} },
 
@@ -348,9 +367,10 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 	// by placing it atop the dictionary stack
 	{ "begin", [](PSVM& vm) {
 		auto tok = vm.popOperand();
-		auto d = tok->asDictionary();
+		if (tok.fType != PSTokenType::DICTIONARY)
+			return;
 
-		vm.dictionaryStack().pushDictionary(d);
+		vm.dictionaryStack().pushDictionary(tok);
 	} },
 
 	// end
@@ -369,13 +389,168 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 	// packedarray
 	
 	// dict
-	
+	{ "dict", [](PSVM& vm) {
+		auto n = vm.popOperand().asInt();
+		vm.pushOperand(vm.memory().newDictionary((size_t)std::max(n, 1)));
+	} },
+
 	// string
 	
 	// search
 	
 	// anchorsearch
 	
+	//
+	// Relational, boolean and bitwise operators
+	//
+
+	// eq
+	{ "eq", [](PSVM& vm) {
+		auto b = vm.popOperand();
+		auto a = vm.popOperand();
+		vm.pushOperand(PSObject(psEqual(vm, a, b)));
+	} },
+
+	// ne
+	{ "ne", [](PSVM& vm) {
+		auto b = vm.popOperand();
+		auto a = vm.popOperand();
+		vm.pushOperand(PSObject(!psEqual(vm, a, b)));
+	} },
+
+	// gt
+	{ "gt", [](PSVM& vm) {
+		auto b = vm.popOperand().asDouble();
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(a > b));
+	} },
+
+	// ge
+	{ "ge", [](PSVM& vm) {
+		auto b = vm.popOperand().asDouble();
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(a >= b));
+	} },
+
+	// lt
+	{ "lt", [](PSVM& vm) {
+		auto b = vm.popOperand().asDouble();
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(a < b));
+	} },
+
+	// le
+	{ "le", [](PSVM& vm) {
+		auto b = vm.popOperand().asDouble();
+		auto a = vm.popOperand().asDouble();
+		vm.pushOperand(PSObject(a <= b));
+	} },
+
+	//
+	// Control operators
+	// Procedures run as compiled code (see psbytecode.h),
+	// compiled once for the whole of a loop
+	//
+
+	// exec
+	{ "exec", [](PSVM& vm) {
+		vm.exec(vm.popOperand());
+	} },
+
+	// if
+	// bool proc if
+	{ "if", [](PSVM& vm) {
+		auto proc = vm.popOperand();
+		auto cond = vm.popOperand();
+		if (cond.asBool())
+			vm.exec(proc);
+	} },
+
+	// ifelse
+	// bool proc1 proc2 ifelse
+	{ "ifelse", [](PSVM& vm) {
+		auto proc2 = vm.popOperand();
+		auto proc1 = vm.popOperand();
+		auto cond = vm.popOperand();
+		vm.exec(cond.asBool() ? proc1 : proc2);
+	} },
+
+	// for
+	// initial increment limit proc for
+	{ "for", [](PSVM& vm) {
+		auto proc = vm.popOperand();
+		auto limit = vm.popOperand();
+		auto increment = vm.popOperand();
+		auto initial = vm.popOperand();
+
+		if (proc.fType != PSTokenType::PROCEDURE)
+			return;
+
+		auto& code = vm.code(proc);
+
+		// Counts in integers when all three are integers, otherwise in reals
+		if (initial.fType == PSTokenType::NUMBER_INT && increment.fType == PSTokenType::NUMBER_INT && limit.fType == PSTokenType::NUMBER_INT)
+		{
+			const int64_t inc = increment.fInt;
+			const int64_t lim = limit.fInt;
+			for (int64_t i = initial.fInt; inc >= 0 ? i <= lim : i >= lim; i += inc)
+			{
+				vm.pushOperand(PSObject((int)i));
+				vm.run(code);
+				if (vm.takeExit())
+					break;
+			}
+			return;
+		}
+
+		const double inc = increment.asDouble();
+		const double lim = limit.asDouble();
+		for (double i = initial.asDouble(); inc >= 0 ? i <= lim : i >= lim; i += inc)
+		{
+			vm.pushOperand(PSObject(i));
+			vm.run(code);
+			if (vm.takeExit())
+				break;
+		}
+	} },
+
+	// repeat
+	// int proc repeat
+	{ "repeat", [](PSVM& vm) {
+		auto proc = vm.popOperand();
+		auto n = vm.popOperand().asInt();
+
+		if (proc.fType != PSTokenType::PROCEDURE)
+			return;
+
+		auto& code = vm.code(proc);
+		for (int i = 0; i < n; i++)
+		{
+			vm.run(code);
+			if (vm.takeExit())
+				break;
+		}
+	} },
+
+	// loop
+	// proc loop
+	{ "loop", [](PSVM& vm) {
+		auto proc = vm.popOperand();
+
+		if (proc.fType != PSTokenType::PROCEDURE)
+			return;
+
+		auto& code = vm.code(proc);
+		do {
+			vm.run(code);
+		} while (!vm.takeExit());
+	} },
+
+	// exit
+	{ "exit", [](PSVM& vm) {
+		vm.exitLoop();
+	} },
+
 	//
 	// Type, Attribute and conversion operators
 	//
@@ -384,9 +559,9 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 	// print the type of the operand on the top of the stack
 	{ "type", [](PSVM& vm) {
 		auto a = vm.operandStack().top();
-		auto tok = make_shared<PSToken>("");
+		auto tok = vm.memory().newString(0);
 	
-		switch (a->fType) {
+		switch (a.fType) {
 			case PSTokenType::LITERAL_ARRAY:
 			break;
 
@@ -406,18 +581,18 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 		}
 		
 		
-		tok->setExecutable(true);
+		tok.setExecutable(true);
 		vm.pushOperand(tok);
 	} },
 
 	// xcheck
 	{ "xcheck", [](PSVM& vm) {
 		auto a = vm.operandStack().top();
-		if (a->isExecutable()) {
-			vm.pushOperand(make_shared<PSToken>(true));
+		if (a.isExecutable()) {
+			vm.pushOperand(PSObject(true));
 		}
 		else {
-			vm.pushOperand(make_shared<PSToken>(false));
+			vm.pushOperand(PSObject(false));
 		}
 	} },
 
@@ -429,7 +604,7 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 	// convert to executable
 	{ "cvx", [](PSVM& vm) {
 			auto a = vm.popOperand();
-			a->setExecutable(true);
+			a.setExecutable(true);
 			vm.pushOperand(a);
 	} },
 	
@@ -437,21 +612,21 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 	{ "print" , [](PSVM& vm) {
 			//std::cout << "PRINT OPERATOR" << std::endl;
 			auto a = vm.popOperand();
-			a->printValue(std::cout);
+			vm.memory().printValue(std::cout, a);
 	} },
 
 	// Print out the contents of the current operand stack
 	// without disturbing stack contents
 	{ "stack", [](PSVM& vm) {
 		for (auto& it : vm.operandStack().fContainer) {
-			it->printValue(std::cout);
+			vm.memory().printValue(std::cout, it);
 		}
 	} },
 	
 	// Print detail info on items
 	{ "pstack", [](PSVM& vm) {
 		for (auto& it : vm.operandStack().fContainer) {
-			it->printValue(std::cout) << std::endl;
+			vm.memory().printValue(std::cout, it) << std::endl;
 		}
 	} },
 	
@@ -469,18 +644,17 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 
 	// bind
 	{ "bind", [](PSVM& vm) {
-		std::cout << "NYI: bind" << std::endl;
-		//vm.bind();
+		vm.bind(vm.operandStack().top());
 	} },
 
 	// null
 	{ "null", [](PSVM& vm) {
-		vm.pushOperand(make_shared<PSToken>(PSTokenType::NIL));
+		vm.pushOperand(PSObject(PSTokenType::NIL));
 	} },
 
 	// version
 	{ "version", [](PSVM& vm) {
-		vm.pushOperand(make_shared<PSToken>(PSString("3.0"), PSTokenType::LITERAL_STRING));
+		vm.pushOperand(vm.memory().newString("3.0", 3));
 	} },
 
 	// realtime
@@ -491,12 +665,12 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 
 	// revision
 	{ "revision", [](PSVM& vm) {
-		vm.pushOperand(make_shared<PSToken>((double)1.0));
+		vm.pushOperand(PSObject((double)1.0));
 	} },
 	
 	// serialnumber
 	{ "serialnumber", [](PSVM& vm) {
-		vm.pushOperand(make_shared<PSToken>((double)1.0));
+		vm.pushOperand(PSObject((double)1.0));
 	} },
 
 	// Executive
@@ -505,12 +679,12 @@ std::unordered_map < std::string, PS_Operator > PSBaseOperators
 
 	{ "=" , [](PSVM& vm) {
 		auto a = vm.popOperand();
-		a->printValue(std::cout) << std::endl;
+		vm.memory().printValue(std::cout, a) << std::endl;
 	} },
 
 	{ "==" , [](PSVM& vm) {
 		auto a = vm.popOperand();
-		a->printFullValue(std::cout) << std::endl;
+		vm.memory().printFullValue(std::cout, a) << std::endl;
 	}},
 
 	// save
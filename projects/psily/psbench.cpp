@@ -0,0 +1,152 @@
+//
+// psbench
+// Times the psily interpreter, in PostScript operations per second.
+//
+//   psbench [-t seconds] [file.ps ...]
+//
+// With no files, every script in testy, and built in workloads
+// of arithmetic, definitions, lookups, arrays and procedure calls,
+// straight line and in loops, are each run over and over, in a
+// fresh PSVM each time, for -t seconds (1 by default).  What the
+// scripts print is thrown away.
+//
+// An operation is one object executed, at the top level or
+// inside a procedure.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "psvm.h"
+
+struct BenchScript {
+	std::string name;
+	std::string source;
+};
+
+// Something like the inner loop of a plot; number crunching,
+// updating a variable, indexing an array, calling a procedure
+static std::string synthetic()
+{
+	std::string s = "/sq { dup mul } def\n/acc 0 def\n";
+	for (int i = 0; i < 2000; i++)
+	{
+		auto n = std::to_string(i);
+		s += n + " 2 add 3 mul sqrt pop /x " + n + " def x x mul acc add /acc exch def\n";
+		s += "[ 1 2 3 " + n + " ] 3 get pop (label " + n + ") pop 7 sq pop\n";
+	}
+	s += "acc =\n";
+	return s;
+}
+
+// The same sort of thing, in loops, where most of the time
+// goes on running procedures rather than scanning
+static std::string loops()
+{
+	return
+		"/sq { dup mul } def\n"
+		"/acc 0 def\n"
+		"0 1 20000 {\n"
+		"  dup 2 add 3 mul sqrt pop\n"
+		"  dup sq acc add /acc exch def\n"
+		"  2 mod 0 eq { acc 1 add } { acc 1 sub } ifelse /acc exch def\n"
+		"} for\n"
+		"5000 { [ 1 2 3 4 ] 3 get 7 sq add pop } repeat\n"
+		"0 { 1 add dup 10000 ge { exit } if } loop pop\n"
+		"acc =\n";
+}
+
+static bool readFile(const std::string& filename, std::string& data)
+{
+	std::ifstream f(filename, std::ios::binary);
+	if (!f)
+		return false;
+	data.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	return !f.bad();
+}
+
+// Swallows whatever the scripts print
+struct NullBuffer : std::streambuf {
+	int overflow(int c) override { return c; }
+};
+
+int main(int argc, char** argv)
+{
+	double seconds = 1.0;
+	std::vector<BenchScript> scripts;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-t") == 0) && (i + 1 < argc)) {
+			seconds = atof(argv[++i]);
+			continue;
+		}
+
+		BenchScript script{ argv[i] };
+		if (!readFile(script.name, script.source)) {
+			printf("%s: could not load\n", argv[i]);
+			return 1;
+		}
+		scripts.push_back(script);
+	}
+
+	if (scripts.empty())
+	{
+		std::error_code ec;
+		for (auto& entry : std::filesystem::directory_iterator("testy", ec))
+		{
+			if (entry.path().extension() != ".ps")
+				continue;
+			BenchScript script{ entry.path().string() };
+			if (readFile(script.name, script.source))
+				scripts.push_back(script);
+		}
+		scripts.push_back({ "synthetic", synthetic() });
+		scripts.push_back({ "loops", loops() });
+	}
+
+	NullBuffer nullBuffer;
+	auto coutBuffer = std::cout.rdbuf(&nullBuffer);
+
+	printf("%-24s %8s %10s %10s %12s\n", "script", "runs", "ops/run", "Mops/s", "us/run");
+
+	uint64_t totalOps = 0;
+	double totalTime = 0;
+
+	for (auto& script : scripts)
+	{
+		uint64_t runs = 0;
+		uint64_t ops = 0;
+		double elapsed = 0;
+		auto start = std::chrono::steady_clock::now();
+
+		do {
+			PSVM vm;
+			vm.evalStream(std::make_shared<BinStream>((void*)script.source.data(), script.source.size()));
+			ops += vm.fOperations;
+			runs++;
+			elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		} while (elapsed < seconds);
+
+		totalOps += ops;
+		totalTime += elapsed;
+
+		printf("%-24s %8llu %10llu %10.2f %12.2f\n", std::filesystem::path(script.name).filename().string().c_str(),
+			(unsigned long long)runs, (unsigned long long)(ops / runs), ops / elapsed / 1e6, elapsed * 1e6 / runs);
+	}
+
+	std::cout.rdbuf(coutBuffer);
+
+	if (totalTime > 0)
+		printf("%-24s %8s %10s %10.2f\n", "total", "", "", totalOps / totalTime / 1e6);
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "pstypes.h"
+
+/*
+	Procedures are compiled, the first time they run, into a list
+	of PSInstructions, which the VM runs in place of the array.
+
+	A name that is an operator when the procedure is compiled is
+	bound to it, the way 'bind' would, so running it needs no
+	lookup.  Unlike bind, this isn't permanent.  The dictionary
+	stack has a version, which moves on when a name that has been
+	bound is defined again, or a dictionary holding one is begun
+	or ended.  Code compiled under an older version looks its
+	bound names up instead, and is compiled again the next time
+	it is started.
+*/
+enum struct PSOpCode : uint8_t
+{
+	PUSH,			// push fObject
+	CALL,			// call fOperator, the procedure held the operator itself
+	BOUND,			// call fOperator, which the name in fObject was bound to
+	NAME,			// look up the name in fObject, and execute what's found
+};
+
+struct PSInstruction
+{
+	PSOpCode fOp = PSOpCode::PUSH;
+	PS_Operator fOperator = nullptr;
+	PSObject fObject;
+};
+
+struct PSCode
+{
+	uint64_t fVersion = 0;			// of the dictionary stack, when compiled
+	uint32_t fLength = 0;			// of the procedure
+	mutable uint32_t fRunning = 0;	// run()s that are part way through it
+	std::vector<PSInstruction> fInstructions;
+};
@@ -1,112 +1,120 @@
 #pragma once
 
-#include <string>
-#include <unordered_map>
-#include <memory>
-
 #include "pstypes.h"
 #include "psstack.h"
 
-using std::make_shared;
-using std::shared_ptr;
 
 class PSVM;
 
 
-
+// The dictionary stack holds dictionary objects; the
+// dictionaries themselves live in PSMemory.
+// Keys are names (see PSMemory::keyOf for strings and other values)
+//
+// The version moves on whenever what a bound name refers to
+// might have changed (see psbytecode.h)
 class PSDictionaryStack : public PSStack
 {
+	PSMemory& fMemory;
+	uint64_t fVersion = 0;
+
+	// Does the dictionary have a name compiled code is bound to
+	bool hasBoundKeys(const PSObject& d) { return fMemory.dictionary(d).hasBoundKeys(); }
+
 public:
-	void pushDictionary(shared_ptr<PSDictionary> d)
+	PSDictionaryStack(PSMemory& mem) : fMemory(mem) {}
+
+	uint64_t version() const { return fVersion; }
+
+	void pushDictionary(const PSObject& d)
 	{
-		auto tok = make_shared<PSToken>(d);
-		push(tok);
+		if (hasBoundKeys(d))
+			fVersion++;
+		push(d);
 	}
 
 
 	// BUGBUG - need some error checking here
-	shared_ptr<PSDictionary> popDictionary()
+	PSObject popDictionary()
 	{
 		auto tok = pop();
-		if (nullptr == tok)
-			return nullptr;
+		if (tok.fType != PSTokenType::DICTIONARY)
+			return PSObject();
 
-		if (tok->fType != PSTokenType::DICTIONARY)
-			return nullptr;
+		if (hasBoundKeys(tok))
+			fVersion++;
 
-		return std::get<shared_ptr<PSDictionary> >(tok->fData);
+		return tok;
 	}
 
-	shared_ptr<PSDictionary> currentdict()
+	PSDictionary* currentdict()
 	{
-		auto topItem = top();
-		if (nullptr == topItem)
+		if (fContainer.empty())
 			return nullptr;
 
-		if (top()->fType == PSTokenType::MARK) {
-			auto tok = nth(1);
-			if (nullptr == tok)
-				return nullptr;
-
-			return std::get<shared_ptr<PSDictionary> >(tok->fData);
-		}
-
-		return std::get<shared_ptr<PSDictionary> >(top()->fData);
+		return &fMemory.dictionary(fContainer.back());
 	}
 
 	// Associate key and value in current dictionary
-	bool def(std::string key, shared_ptr<PSToken> value)
+	bool def(const PSObject& key, const PSObject& value)
 	{
 		auto current = currentdict();
-		
+
 		if (nullptr == current)
 			return false;
 
 		current->insert_or_assign(key, value);
 
+		if (fMemory.names().isBound(key.fAtom)) {
+			current->setHasBoundKeys();
+			fVersion++;
+		}
+
 		return true;
 	}
 
-	shared_ptr<PSDictionary> where(std::string key)
+	// The dictionary the key is found in, or a null object
+	PSObject where(const PSObject& key)
 	{
-		for (size_t idx = 0; idx < length(); idx++)
+		for (size_t idx = fContainer.size(); idx > 0; idx--)
 		{
-			auto tok = nth(idx);
-			if (tok->fType == PSTokenType::DICTIONARY) {
-				if (std::get<shared_ptr<PSDictionary> >(tok->fData)->operator[](key) != nullptr)
-					return std::get<shared_ptr<PSDictionary> >(tok->fData);
-			}
+			auto& d = fContainer[idx - 1];
+			if (fMemory.dictionary(d).find(key) != nullptr)
+				return d;
 		}
 
-		return nullptr;
+		return PSObject();
 	}
 
-	// Search for a key, traversing dictionaries 
+	// Search for a key, traversing dictionaries
 	// in stack order
-	shared_ptr<PSToken> load(std::string key)
+	PSObject* load(const PSObject& key)
 	{
-		auto d = where(key);
-
-		if (nullptr == d)
-			return nullptr;
-
-		// We found a dictionary, so retrieve the
-		// value.  Kind of duplicative of 'where'
+		for (size_t idx = fContainer.size(); idx > 0; idx--)
+		{
+			auto value = fMemory.dictionary(fContainer[idx - 1]).find(key);
+			if (value != nullptr)
+				return value;
+		}
 
-		return d->operator[](key);
+		return nullptr;
 	}
 
-	void store(std::string key, shared_ptr<PSToken> value)
+	void store(const PSObject& key, const PSObject& value)
 	{
-		auto d = where(key);
+		auto slot = load(key);
 
-		// If we didn't find an entry in an 
+		// If we didn't find an entry in an
 		// existing dictionary, then stick the value
 		// in the current dictionary
-		if (nullptr == d) {
-			d = currentdict();
+		if (nullptr == slot) {
+			def(key, value);
+			return;
 		}
 
-		d->operator[](key) = value;
+		if (fMemory.names().isBound(key.fAtom))
+			fVersion++;
+
+		*slot = value;
 	}
 };
@@ -0,0 +1,371 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "pstypes.h"
+
+/*
+	PSNameTable
+
+	Interns names.  Each distinct name gets an atom (its index
+	here) and a hash, both worked out once, when the scanner
+	first sees it.  From then on a name is a PSObject carrying
+	the two, and comparing or looking one up never touches the
+	text again.
+
+	A name is marked bound once compiled code has been bound to the
+	operator it named (see psbytecode.h).
+
+	Dictionary keys that aren't names or strings (numbers, booleans,
+	arrays, ...) get atoms here too, from valueKey(), keyed on their
+	type and value rather than any text, so they never match a name,
+	or each other.
+*/
+class PSNameTable
+{
+	std::vector<std::string> fNames{ std::string() };		// atom 0 is no name
+	std::vector<uint32_t> fHashes{ 0 };
+	std::vector<uint8_t> fBound{ 0 };
+	std::vector<uint8_t> fValueKey{ 0 };			// atom is from valueKey(), not a name
+	std::vector<uint32_t> fSlots = std::vector<uint32_t>(1024, 0);		// open addressed, atoms
+	std::unordered_map<uint64_t, uint32_t> fValueAtoms[(int)PSTokenType::FILESTREAM + 1];		// per type, value to atom
+
+public:
+	// FNV-1a
+	static uint32_t hashOf(const char* s, const size_t len)
+	{
+		uint32_t h = 2166136261u;
+		for (size_t i = 0; i < len; i++)
+		{
+			h ^= (uint8_t)s[i];
+			h *= 16777619u;
+		}
+		return h;
+	}
+
+	size_t size() const { return fNames.size() - 1; }
+
+	const std::string& str(const uint32_t atom) const { return fNames[atom]; }
+
+	bool isBound(const uint32_t atom) const { return fBound[atom] != 0; }
+	void setBound(const uint32_t atom) { fBound[atom] = 1; }
+
+	PSObject name(const char* s, const size_t len, const bool executable = false)
+	{
+		const uint32_t hash = hashOf(s, len);
+		size_t mask = fSlots.size() - 1;
+		size_t idx = hash & mask;
+
+		while (fSlots[idx] != 0)
+		{
+			const uint32_t atom = fSlots[idx];
+			if (fHashes[atom] == hash && fNames[atom].size() == len && memcmp(fNames[atom].data(), s, len) == 0)
+				return PSObject::name(atom, hash, executable);
+			idx = (idx + 1) & mask;
+		}
+
+		const uint32_t atom = (uint32_t)fNames.size();
+		fNames.emplace_back(s, len);
+		fHashes.push_back(hash);
+		fBound.push_back(0);
+		fValueKey.push_back(0);
+
+		if (fNames.size() * 2 > fSlots.size())
+		{
+			fSlots.assign(fSlots.size() * 2, 0);
+			mask = fSlots.size() - 1;
+			for (uint32_t a = 1; a < (uint32_t)fNames.size(); a++)
+			{
+				if (fValueKey[a])
+					continue;
+				size_t i = fHashes[a] & mask;
+				while (fSlots[i] != 0)
+					i = (i + 1) & mask;
+				fSlots[i] = a;
+			}
+		}
+		else
+			fSlots[idx] = atom;
+
+		return PSObject::name(atom, hash, executable);
+	}
+
+	PSObject name(const std::string& s, const bool executable = false) { return name(s.data(), s.size(), executable); }
+
+	// The atom for a key that isn't a name.  Integers and reals that
+	// are equal are the same key, as are two references to the same
+	// composite object.
+	PSObject valueKey(const PSObject& o)
+	{
+		PSTokenType type = o.fType;
+		uint64_t bits = o.fBits;
+
+		switch (type)
+		{
+		case PSTokenType::NUMBER:
+			if (o.fReal >= INT32_MIN && o.fReal <= INT32_MAX && o.fReal == (double)(int32_t)o.fReal) {
+				type = PSTokenType::NUMBER_INT;
+				bits = (uint32_t)(int32_t)o.fReal;
+			}
+			break;
+		case PSTokenType::NUMBER_INT: bits = (uint32_t)o.fInt; break;
+		case PSTokenType::BOOLEAN: bits = o.fBool ? 1 : 0; break;
+		case PSTokenType::OPERATOR: break;
+		default: bits = ((uint64_t)o.fAux << 32) | o.fHandle; break;
+		}
+
+		auto& atoms = fValueAtoms[(int)type];
+		auto it = atoms.find(bits);
+		if (it != atoms.end())
+			return PSObject::name(it->second, fHashes[it->second], false);
+
+		// splitmix64, so nearby numbers spread over the table
+		uint64_t h = bits + 0x9e3779b97f4a7c15ull * ((uint64_t)type + 1);
+		h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+		h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+		const uint32_t hash = (uint32_t)(h ^ (h >> 31));
+
+		const uint32_t atom = (uint32_t)fNames.size();
+		fNames.emplace_back();
+		fHashes.push_back(hash);
+		fBound.push_back(0);
+		fValueKey.push_back(1);
+		atoms.emplace(bits, atom);
+
+		return PSObject::name(atom, hash, false);
+	}
+};
+
+/*
+	PSMemory
+
+	Owns the contents of every composite object the VM makes.
+
+	String bytes and array elements are each kept in one pool,
+	and a string or array is a slice of it, so making one is
+	an append, not an allocation.  The pools can move as they
+	grow, so hold on to handles rather than pointers into them.
+	Dictionaries and files live in deques, which don't move.
+
+	Nothing is given back until the VM goes away, so a program
+	that keeps scanning strings or arrays (or procedures) keeps
+	growing, however it's fed in; see PSVM::evalFile.  PostScript's
+	own answer to that is save and restore, which isn't done yet.
+*/
+class PSMemory
+{
+	PSNameTable fNames;
+	std::vector<char> fChars;
+	std::vector<PSObject> fElements;
+	std::deque<PSDictionary> fDictionaries;
+	std::deque<std::shared_ptr<ndt::FileStream>> fFiles;
+
+public:
+	PSNameTable& names() { return fNames; }
+	PSObject name(const char* s, const size_t len, const bool executable = false) { return fNames.name(s, len, executable); }
+	PSObject name(const std::string& s, const bool executable = false) { return fNames.name(s, executable); }
+
+	//
+	// Strings
+	//
+	PSObject newString(const size_t capacity)
+	{
+		const uint32_t at = (uint32_t)fChars.size();
+		fChars.resize(fChars.size() + capacity, 0);
+		return PSObject::composite(PSTokenType::LITERAL_STRING, at, (uint32_t)capacity);
+	}
+
+	PSObject newString(const char* s, const size_t len)
+	{
+		const uint32_t at = (uint32_t)fChars.size();
+		fChars.insert(fChars.end(), s, s + len);
+		return PSObject::composite(PSTokenType::LITERAL_STRING, at, (uint32_t)len);
+	}
+
+	PSObject newString(const std::string& s) { return newString(s.data(), s.size()); }
+
+	char* chars(const PSObject& str) { return fChars.data() + str.fHandle; }
+
+	// The text of a string, or of a name
+	std::string str(const PSObject& o) const
+	{
+		if (o.isName())
+			return fNames.str(o.fAtom);
+		if (o.fType == PSTokenType::LITERAL_STRING || o.fType == PSTokenType::HEXSTRING)
+			return std::string(fChars.data() + o.fHandle, o.fAux);
+		return std::string();
+	}
+
+	// Strings can be used as keys, as names; anything else is
+	// keyed on its type and value
+	PSObject keyOf(const PSObject& o)
+	{
+		if (o.isName())
+			return o;
+		if (o.fType == PSTokenType::LITERAL_STRING || o.fType == PSTokenType::HEXSTRING)
+			return fNames.name(str(o));
+		return fNames.valueKey(o);
+	}
+
+	//
+	// Arrays and procedures
+	//
+	PSObject newArray(const size_t length)
+	{
+		const uint32_t at = (uint32_t)fElements.size();
+		fElements.resize(fElements.size() + length);
+		return PSObject::composite(PSTokenType::LITERAL_ARRAY, at, (uint32_t)length);
+	}
+
+	PSObject newArray(const PSObject* items, const size_t length)
+	{
+		const uint32_t at = (uint32_t)fElements.size();
+		fElements.insert(fElements.end(), items, items + length);
+		return PSObject::composite(PSTokenType::LITERAL_ARRAY, at, (uint32_t)length);
+	}
+
+	// Not range checked
+	PSObject& element(const PSObject& arr, const size_t idx) { return fElements[arr.fHandle + idx]; }
+
+	//
+	// Dictionaries
+	//
+	PSObject newDictionary(const size_t capacity = 16)
+	{
+		fDictionaries.emplace_back(capacity);
+		return PSObject::composite(PSTokenType::DICTIONARY, (uint32_t)fDictionaries.size() - 1);
+	}
+
+	PSDictionary& dictionary(const PSObject& d) { return fDictionaries[d.fHandle]; }
+
+	void addOperators(const PSObject& d, const std::unordered_map<std::string, PS_Operator>& ops)
+	{
+		auto& dict = dictionary(d);
+		for (auto& it : ops)
+		{
+			auto key = name(it.first);
+			dict.insert_or_assign(key, PSObject(it.second));
+			if (fNames.isBound(key.fAtom))
+				dict.setHasBoundKeys();
+		}
+	}
+
+	// Compiled code has been bound to what this name refers to.  The
+	// first time, every dictionary that already has it as a key is
+	// marked, so begin and end don't have to look through them.
+	void markBound(const PSObject& key)
+	{
+		if (fNames.isBound(key.fAtom))
+			return;
+
+		fNames.setBound(key.fAtom);
+		for (auto& dict : fDictionaries)
+		{
+			if (dict.find(key) != nullptr)
+				dict.setHasBoundKeys();
+		}
+	}
+
+	//
+	// Files
+	//
+	PSObject newFile(std::shared_ptr<ndt::FileStream> f)
+	{
+		fFiles.push_back(std::move(f));
+		return PSObject::composite(PSTokenType::FILESTREAM, (uint32_t)fFiles.size() - 1);
+	}
+
+	std::shared_ptr<ndt::FileStream> file(const PSObject& f) { return fFiles[f.fHandle]; }
+
+	//
+	// Printing
+	//
+	std::ostream& printValue(std::ostream& os, const PSObject& o)
+	{
+		switch (o.fType) {
+		case PSTokenType::MARK:
+			os << "MARK";
+			break;
+
+		case PSTokenType::NUMBER_INT:
+			os << o.fInt;
+			break;
+
+		case PSTokenType::NUMBER:
+			os << o.fReal;
+			break;
+
+		case PSTokenType::BOOLEAN:
+			os << (o.fBool ? "true" : "false");
+			break;
+
+		case PSTokenType::EXECUTABLE_NAME:
+		case PSTokenType::LITERAL_NAME:
+		case PSTokenType::LITERAL_STRING:
+		case PSTokenType::HEXSTRING:
+			os << str(o);
+			break;
+
+		case PSTokenType::LITERAL_ARRAY:
+			os << "ARRAY";
+			break;
+
+		case PSTokenType::DICTIONARY:
+			os << "DICTIONARY";
+			break;
+
+		case PSTokenType::PROCEDURE:
+			os << "PROCEDURE";
+			break;
+
+		case PSTokenType::OPERATOR:
+			os << "OPERATOR";
+			break;
+
+		case PSTokenType::FILESTREAM:
+			os << "FILESTREAM";
+			break;
+
+		default:
+			os << "UNKNOWN";
+			break;
+		}
+
+		return os;
+	}
+
+	std::ostream& printFullValue(std::ostream& os, const PSObject& o)
+	{
+		switch (o.fType)
+		{
+		case PSTokenType::LITERAL_ARRAY:
+			os << "ARRAY: " << std::to_string(o.length()) << std::endl;
+			for (uint32_t i = 0; i < o.length(); i++)
+				printValue(os, element(o, i)) << std::endl;
+			break;
+
+		case PSTokenType::PROCEDURE:
+			os << "PROCEDURE: " << std::to_string(o.length()) << std::endl;
+			for (uint32_t i = 0; i < o.length(); i++)
+				printFullValue(os, element(o, i)) << std::endl;
+			break;
+
+		case PSTokenType::FILESTREAM:
+			os << "FILESTREAM" << std::endl;
+			break;
+
+		default:
+			printValue(os, o) << std::endl;
+			break;
+		}
+
+		return os;
+	}
+};
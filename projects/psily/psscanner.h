@@ -1,8 +1,356 @@
 #pragma once
 
-#include "binstream.hpp"
-#include "pstoken.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 
-#include <memory>
+#include "datachunk.h"
 
+/*
+	PSLexer
 
+	Splits PostScript source into lexemes.  It works directly on
+	the bytes it's given, typically a memory mapped file, and a
+	lexeme is a DataChunk over them, so nothing is copied or
+	allocated along the way.  Numbers are parsed in place.
+
+	Characters are sorted by one lookup in a 256 entry table,
+	rather than searching sets.
+
+	Input can be given a piece at a time.  If the input runs out
+	partway through something that might carry on (a name, a
+	number, a string, a comment), and more has been promised, the
+	lexer says MORE, and position() is where the unfinished piece
+	starts.  Feed it again from there, with more after it.  Names,
+	strings and so on are turned into objects as they're scanned,
+	so once a piece has been scanned, what came before position()
+	is never looked at again, and can be let go.
+*/
+
+enum struct PSLexemeType : uint8_t
+{
+	END,				// no more input
+	MORE,				// need more input to go on
+	NAME,				// name
+	LITERAL_NAME,		// /name
+	IMMEDIATE_NAME,		// //name
+	NUMBER,				// 12, -3.5, 1e10, 16#FF
+	STRING,				// (string), fText is between the parens, escapes and all
+	HEXSTRING,			// <hex>, fText is between the brackets
+	BEGIN_ARRAY,		// [
+	END_ARRAY,			// ]
+	BEGIN_PROC,			// {
+	END_PROC,			// }
+	COMMENT,			// % to end of line, fText is after the %
+};
+
+struct PSLexeme
+{
+	PSLexemeType fType = PSLexemeType::END;
+	ndt::DataChunk fText;
+	double fNumber = 0;
+};
+
+// Character classes
+enum PSCharClass : uint8_t
+{
+	PSC_REGULAR = 0,
+	PSC_WHITE = 1,
+	PSC_DELIMITER = 2,
+};
+
+struct PSCharClasses
+{
+	uint8_t fClass[256]{};
+
+	constexpr PSCharClasses()
+	{
+		for (auto c : "\t\n\f\r ")
+			fClass[(uint8_t)c] = PSC_WHITE;		// includes the terminating null, which is also white space
+		for (auto c : "()<>[]{}/%")
+			if (c) fClass[(uint8_t)c] = PSC_DELIMITER;
+	}
+
+	constexpr uint8_t operator[](const uint8_t c) const { return fClass[c]; }
+};
+
+inline constexpr PSCharClasses kPSCharClass{};
+
+class PSLexer
+{
+	ndt::DataChunk fInput;
+	bool fFinal = true;
+
+	PSLexeme emit(PSLexemeType t, const uint8_t* textStart, const uint8_t* textEnd, const uint8_t* next)
+	{
+		fInput.fStart = next;
+		PSLexeme lex;
+		lex.fType = t;
+		lex.fText = ndt::DataChunk(textStart, textEnd);
+		return lex;
+	}
+
+	// Ran out partway through something.  Wait for more, unless there isn't
+	// going to be any, in which case it ends where the input does.
+	bool waitForMore(const uint8_t* start)
+	{
+		if (fFinal)
+			return false;
+
+		fInput.fStart = start;
+		return true;
+	}
+
+	static const uint8_t* skipRegular(const uint8_t* p, const uint8_t* end)
+	{
+		while (p < end && kPSCharClass[*p] == PSC_REGULAR)
+			p++;
+		return p;
+	}
+
+public:
+	PSLexer() = default;
+	PSLexer(const ndt::DataChunk& input, bool final = true) : fInput(input), fFinal(final) {}
+
+	// Carry on with new input.  It should start from position(),
+	// if the last lexeme was MORE.
+	void feed(const ndt::DataChunk& input, bool final)
+	{
+		fInput = input;
+		fFinal = final;
+	}
+
+	// Where the part that hasn't been scanned starts
+	const uint8_t* position() const { return fInput.fStart; }
+
+	PSLexeme next()
+	{
+		const uint8_t* p = fInput.fStart;
+		const uint8_t* end = fInput.fEnd;
+
+		while (p < end && kPSCharClass[*p] == PSC_WHITE)
+			p++;
+		fInput.fStart = p;
+
+		if (p >= end) {
+			PSLexeme lex;
+			lex.fType = fFinal ? PSLexemeType::END : PSLexemeType::MORE;
+			return lex;
+		}
+
+		const uint8_t* start = p;
+		const uint8_t c = *p++;
+
+		switch (c)
+		{
+		case '[': return emit(PSLexemeType::BEGIN_ARRAY, start, p, p);
+		case ']': return emit(PSLexemeType::END_ARRAY, start, p, p);
+		case '{': return emit(PSLexemeType::BEGIN_PROC, start, p, p);
+		case '}': return emit(PSLexemeType::END_PROC, start, p, p);
+
+		case '(':
+		{
+			int depth = 1;
+			while (p < end)
+			{
+				const uint8_t ch = *p++;
+				if (ch == '\\') {
+					if (p >= end)
+						break;
+					p++;
+				}
+				else if (ch == '(')
+					depth++;
+				else if (ch == ')' && --depth == 0)
+					return emit(PSLexemeType::STRING, start + 1, p - 1, p);
+			}
+			if (waitForMore(start))
+				return { PSLexemeType::MORE };
+			return emit(PSLexemeType::STRING, start + 1, end, end);
+		}
+
+		case '<':
+		{
+			if (p >= end) {
+				if (waitForMore(start))
+					return { PSLexemeType::MORE };
+				return emit(PSLexemeType::HEXSTRING, p, p, p);
+			}
+			if (*p == '<')
+				return emit(PSLexemeType::NAME, start, p + 1, p + 1);
+
+			auto close = (const uint8_t*)memchr(p, '>', (size_t)(end - p));
+			if (close != nullptr)
+				return emit(PSLexemeType::HEXSTRING, p, close, close + 1);
+			if (waitForMore(start))
+				return { PSLexemeType::MORE };
+			return emit(PSLexemeType::HEXSTRING, p, end, end);
+		}
+
+		case '>':
+			if (p >= end && waitForMore(start))
+				return { PSLexemeType::MORE };
+			if (p < end && *p == '>')
+				return emit(PSLexemeType::NAME, start, p + 1, p + 1);
+			return emit(PSLexemeType::NAME, start, p, p);
+
+		case ')':
+			// a stray close, it becomes a name, which won't be found
+			return emit(PSLexemeType::NAME, start, p, p);
+
+		case '%':
+		{
+			const uint8_t* q = p;
+			while (q < end && *q != '\n' && *q != '\r')
+				q++;
+			if (q >= end && waitForMore(start))
+				return { PSLexemeType::MORE };
+			return emit(PSLexemeType::COMMENT, p, q, q);
+		}
+
+		case '/':
+		{
+			auto type = PSLexemeType::LITERAL_NAME;
+			if (p < end && *p == '/') {
+				type = PSLexemeType::IMMEDIATE_NAME;
+				p++;
+			}
+			const uint8_t* q = skipRegular(p, end);
+			if (q >= end && waitForMore(start))
+				return { PSLexemeType::MORE };
+			return emit(type, p, q, q);
+		}
+
+		default:
+		{
+			const uint8_t* q = skipRegular(p, end);
+			if (q >= end && waitForMore(start))
+				return { PSLexemeType::MORE };
+
+			PSLexeme lex = emit(PSLexemeType::NAME, start, q, q);
+			if (parseNumber(start, q, lex.fNumber))
+				lex.fType = PSLexemeType::NUMBER;
+			return lex;
+		}
+		}
+	}
+
+	// Parse a PostScript number; integer, real, or radix (16#FF).
+	// False if the text isn't one, in which case it's a name.
+	// Decimals with up to 15 or so digits, and a small exponent, which
+	// is most of them, are worked out here; anything else goes to strtod.
+	static bool parseNumber(const uint8_t* s, const uint8_t* e, double& value)
+	{
+		static constexpr double kPow10[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+			1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		const uint8_t* p = s;
+		bool negative = false;
+		if (p < e && (*p == '+' || *p == '-')) {
+			negative = (*p == '-');
+			p++;
+		}
+
+		uint64_t mantissa = 0;
+		int scale = 0;
+		int digits = 0;
+		bool exact = true;
+
+		auto digit = [&](const uint8_t ch) {
+			if (mantissa < (1ull << 53) / 10)
+				mantissa = mantissa * 10 + (ch - '0');
+			else
+				exact = false;
+			digits++;
+		};
+
+		while (p < e && *p >= '0' && *p <= '9')
+			digit(*p++);
+
+		// radix number, base#digits
+		if (p < e && *p == '#' && *s >= '0' && *s <= '9' && mantissa >= 2 && mantissa <= 36 && exact)
+		{
+			const uint64_t base = mantissa;
+			uint64_t n = 0;
+			const uint8_t* q = ++p;
+			for (; p < e; p++)
+			{
+				uint64_t d = 36;
+				if (*p >= '0' && *p <= '9') d = *p - '0';
+				else if (*p >= 'a' && *p <= 'z') d = *p - 'a' + 10;
+				else if (*p >= 'A' && *p <= 'Z') d = *p - 'A' + 10;
+				if (d >= base)
+					return false;
+				n = n * base + d;
+			}
+			if (q == e)
+				return false;
+			value = (double)n;
+			return true;
+		}
+
+		if (p < e && *p == '.')
+		{
+			p++;
+			while (p < e && *p >= '0' && *p <= '9') {
+				digit(*p++);
+				if (exact)
+					scale--;
+			}
+		}
+
+		if (digits == 0)
+			return false;
+
+		int exponent = 0;
+		if (p < e && (*p == 'e' || *p == 'E'))
+		{
+			p++;
+			bool negExp = false;
+			if (p < e && (*p == '+' || *p == '-')) {
+				negExp = (*p == '-');
+				p++;
+			}
+			if (p >= e)
+				return false;
+			while (p < e && *p >= '0' && *p <= '9') {
+				if (exponent < 10000)
+					exponent = exponent * 10 + (*p - '0');
+				p++;
+			}
+			if (negExp)
+				exponent = -exponent;
+		}
+
+		if (p != e)
+			return false;
+
+		const int total = scale + exponent;
+		if (exact && total >= -22 && total <= 22)
+		{
+			// both exact doubles, so one rounding, same as strtod
+			value = (total < 0) ? (double)mantissa / kPow10[-total] : (double)mantissa * kPow10[total];
+		}
+		else
+		{
+			char buff[64];
+			size_t len = e - s;
+			if (len < sizeof(buff)) {
+				memcpy(buff, s, len);
+				buff[len] = 0;
+				value = std::strtod(buff, nullptr);
+			}
+			else {
+				value = std::strtod(std::string((const char*)s, len).c_str(), nullptr);
+			}
+			return true;
+		}
+
+		if (negative)
+			value = -value;
+
+		return true;
+	}
+};
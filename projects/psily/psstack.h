@@ -1,13 +1,13 @@
 #pragma once
 
-#include <memory>
-#include <deque>
+#include <vector>
 
 #include "pstypes.h"
 
 
 // An unbounded stack
-//teamplate <typename T>
+// Objects are held by value, so pushing and popping
+// never allocates once the stack has grown to size
 class PSStack
 {
 
@@ -15,9 +15,14 @@ class PSStack
 public:
 	// BUGBUG - this should not be public
 	// but, it is for now
-	std::deque<std::shared_ptr<PSToken> > fContainer;
+	std::vector<PSObject> fContainer;
 
-	// Return the number of items that are currently 
+	PSStack()
+	{
+		fContainer.reserve(256);
+	}
+
+	// Return the number of items that are currently
 	// on the stack
 	size_t length() const
 	{
@@ -34,13 +39,12 @@ public:
 
 	// Count the number of items from the top of the
 	// stack down to a mark, or end of the stack
-	size_t countToMark()
+	size_t countToMark() const
 	{
 		size_t pos = fContainer.size();
 		while (pos > 0)
 		{
-			auto t = fContainer.at(pos - 1);
-			if (t->fType == PSTokenType::MARK)
+			if (fContainer[pos - 1].fType == PSTokenType::MARK)
 				return fContainer.size()-pos;
 			pos--;
 		}
@@ -52,7 +56,7 @@ public:
 	{
 		while (length() > 0) {
 			auto item = pop();
-			if (item->fType == PSTokenType::MARK)
+			if (item.fType == PSTokenType::MARK)
 				break;
 		}
 
@@ -97,12 +101,12 @@ public:
 	// Place a marker on the stack
 	PSStack& mark()
 	{
-		fContainer.push_back(std::make_shared<PSToken>(PSTokenType::MARK));
+		fContainer.emplace_back(PSTokenType::MARK);
 		return *this;
 	}
 
 	// Push a token onto the stack
-	PSStack& push(std::shared_ptr<PSToken> a)
+	PSStack& push(const PSObject& a)
 	{
 		fContainer.push_back(a);
 		return *this;
@@ -110,9 +114,12 @@ public:
 
 	// Pop a token off the stack.
 	// if the stack is empty, then return
-	// a nullptr
-	std::shared_ptr<PSToken> pop()
+	// a null object
+	PSObject pop()
 	{
+		if (fContainer.empty())
+			return PSObject();
+
 		auto a = fContainer.back();
 		fContainer.pop_back();
 
@@ -127,15 +134,15 @@ public:
 	// new position of each element and use swaps to put
 	// them in place
 	PSStack & roll(int n, int j)
-	{	
+	{
 		if (j > 0){
 			// Roll the stack 'up' counter clockwise
-			for (size_t outer = 1; outer <= j; outer++)
+			for (int outer = 1; outer <= j; outer++)
 			{
 				auto tmp = top();
 
-				for (size_t inner = 1; inner < n; inner++) {
-					
+				for (int inner = 1; inner < n; inner++) {
+
 				}
 			}
 		}
@@ -147,10 +154,10 @@ public:
 
 	// Peek the top of the stack
 	// do NOT take the item off the stack
-	std::shared_ptr<PSToken> top()
+	PSObject top() const
 	{
 		if (fContainer.size() < 1)
-			return nullptr;
+			return PSObject();
 
 		return fContainer.back();
 	}
@@ -158,14 +165,12 @@ public:
 	// get an item 'n' positions from the top
 	// The item at the 'top' of the stack is item '0'
 	// the item at the bottom of the stack is item 'n'
-	std::shared_ptr<PSToken> nth(const size_t n)
+	PSObject nth(const size_t n) const
 	{
-		auto last = fContainer.size()-1;
-		auto idx = last - n;
-		if (idx < 0)
-			return nullptr;
+		if (n >= fContainer.size())
+			return PSObject();
 
-		return fContainer.at(idx);
+		return fContainer[fContainer.size() - 1 - n];
 	}
-	
-};
\ No newline at end of file
+
+};
@@ -2,23 +2,19 @@
 
 
 
-#include <array>
+#include <cstdint>
 #include <string>
-#include <variant>
-#include <functional>
-#include <iostream>
-#include <deque>
+#include <vector>
 #include <memory>
 
 #include "filestream.h"
 #include "maths.hpp"
 
 class PSVM;
-struct PSToken;
 
 // Enumerate the kinds of tokens that we will see
 // This is used everywhere from the scanner to interpreter and VM
-enum struct PSTokenType : uint32_t
+enum struct PSTokenType : uint8_t
 {
 	NIL,				// a null
 	MARK,				// a noop
@@ -43,84 +39,13 @@ enum struct PSTokenType : uint32_t
 	FILESTREAM,				// a file stream
 };
 
-class PSArray : public std::deque<std::shared_ptr<PSToken> >
-{
-public:
-	PSArray() {}
-};
-
-using PS_Operator = std::function< void (PSVM& vm) >;
+using PS_Operator = void (*)(PSVM& vm);
 
 struct PSPoint {
 	double x;
 	double y;
 };
 
-struct PSString : public std::string
-{
-	size_t fCapacity;
-
-	PSString(const char* s)
-		:std::string(s)
-	{
-		fCapacity = strlen(s);
-	}
-
-	PSString(const size_t s)
-		: fCapacity(s)
-	{
-	}
-	/*
-	// returning a value based on index
-	char operator[](const size_t idx) const
-	{
-		return fStorage[idx];
-	}
-
-	// setting a value based on index
-	char& operator[](const size_t idx)
-	{
-		return fStorage[idx];
-	}
-	*/
-	void put(int idx, int c)
-	{
-		this->operator[](idx) = c;
-	}
-
-	int get(int idx) const
-	{
-		return this->operator[](idx);
-	}
-
-	size_t length()
-	{
-		return fCapacity;
-	}
-
-	PSString getInterval(const int idx, const size_t count)
-	{
-		int actual = (int)maths::min(float(count), float((int)length() - idx));
-		if (actual < 0) {
-			return PSString((size_t)0);
-		}
-
-		// Create a new array with capacity == count
-		PSString arr(count);
-		if (actual == 0) {
-			return arr;
-		}
-
-		for (int nidx = 0; nidx < actual; nidx++)
-		{
-			arr[nidx] = this->operator[](idx + nidx);
-		}
-
-		return arr;
-	}
-
-};
-
 /*
 	A PSMatrix object with Postscript transformation
 	behavior and representation.  It is essentially
@@ -344,174 +269,180 @@ struct PSMatrix {
 	}
 };
 
+/*
+	PSObject
 
+	Everything the interpreter handles is a PSObject; 16 bytes,
+	copied by value, never allocated on its own.
 
+	Simple objects (numbers, booleans, names, operators, marks)
+	hold their value directly.  A name holds its atom in the
+	name table, and the hash of its text, worked out once when
+	the name was interned.
 
+	Composite objects (strings, arrays, procedures, dictionaries,
+	files) hold a handle into the PSMemory that owns their
+	contents, so copies of one share it, as PostScript expects.
+	Strings and arrays are a slice of one of PSMemory's pools;
+	fHandle is where the slice starts, fAux how long it is.
+*/
+struct PSObject
+{
+	static constexpr uint8_t kExecutable = 0x01;
 
+	PSTokenType fType = PSTokenType::NIL;
+	uint8_t fFlags = 0;
+	uint16_t fReserved = 0;
+	uint32_t fAux = 0;				// names: hash, strings and arrays: length
 
-class PSDictionary : public std::unordered_map<std::string, std::shared_ptr<PSToken> >
-{
+	union {
+		uint64_t fBits = 0;
+		bool fBool;
+		int32_t fInt;
+		double fReal;
+		uint32_t fAtom;				// names
+		uint32_t fHandle;			// composites
+		PS_Operator fOperator;
+	};
 
-public:
-	PSDictionary() {}
+	PSObject() = default;
+	explicit PSObject(const PSTokenType t) : fType(t) {}
+	PSObject(const bool value) : fType(PSTokenType::BOOLEAN) { fBool = value; }
+	PSObject(const int value) : fType(PSTokenType::NUMBER_INT) { fInt = value; }
+	PSObject(const double value) : fType(PSTokenType::NUMBER) { fReal = value; }
+	PSObject(PS_Operator value) : fType(PSTokenType::OPERATOR), fFlags(kExecutable) { fOperator = value; }
 
-	PSDictionary(std::unordered_map < std::string, std::function<void(PSVM& vm)> > ops)
+	static PSObject name(const uint32_t atom, const uint32_t hash, const bool executable)
 	{
-		addOperators(ops);
+		PSObject o(executable ? PSTokenType::EXECUTABLE_NAME : PSTokenType::LITERAL_NAME);
+		o.fAux = hash;
+		o.fAtom = atom;
+		return o;
 	}
 
-	void addOperators(std::unordered_map < std::string, std::function<void(PSVM& vm)> > ops)
+	static PSObject composite(const PSTokenType t, const uint32_t handle, const uint32_t length = 0)
 	{
-		for (auto& it : ops)
-		{
-			insert({ it.first, std::make_shared<PSToken>(it.second) });
-		}
+		PSObject o(t);
+		o.fHandle = handle;
+		o.fAux = length;
+		return o;
 	}
-};
 
-using PSTokenData = std::variant<
-	int,
-	bool,
-
-	double,
-	PSString,
-	PS_Operator,
-	std::shared_ptr<PSArray>,
-	std::shared_ptr<PSDictionary>,
-	std::shared_ptr<FileStream> > ;
-
-struct PSToken {
-	PSTokenData fData; 
-	PSTokenType fType;
-	bool fIsExecutable = false;
-
-
-	// Constructing a token
-	PSToken(const PSTokenType t) :fData(true), fType(t) {}
-	PSToken(const bool value) : fData(value), fType(PSTokenType::BOOLEAN) {}
-	PSToken(const int value) : fData(value), fType(PSTokenType::NUMBER_INT) {}
-	PSToken(const double value) : fData(value), fType(PSTokenType::NUMBER) {}
-	PSToken(const PSString value, const PSTokenType kind = PSTokenType::LITERAL_STRING) : fData(value), fType(kind) {}
-	PSToken(PS_Operator value) : fData(value), fType(PSTokenType::OPERATOR), fIsExecutable(true) {}
-	PSToken(std::shared_ptr<PSArray> value) : fData(value), fType(PSTokenType::LITERAL_ARRAY) {}
-	PSToken(std::shared_ptr<PSDictionary> value) : fData(value), fType(PSTokenType::DICTIONARY) {}
-	PSToken(std::shared_ptr<FileStream> value) : fData(value), fType(PSTokenType::FILESTREAM) {}
-
-	void setExecutable(const bool value){fIsExecutable = value;}
-	bool isExecutable() { return fIsExecutable; }
+	void setExecutable(const bool value) { fFlags = value ? (fFlags | kExecutable) : (fFlags & ~kExecutable); }
+	bool isExecutable() const { return (fFlags & kExecutable) != 0; }
 
 	void setType(const PSTokenType value) { fType = value; }
 
-	PSToken& operator =(const bool value) { fData = value; return *this; }
-	PSToken& operator =(const double value) { fData = value; return *this; }
-	PSToken& operator =(const PSString& value) { fData = value; return *this; }
-	PSToken& operator =(PS_Operator value) { fData = value; return *this; }
-	PSToken& operator =(std::shared_ptr<PSArray> value) { fData = value; return *this; }
-	PSToken& operator =(std::shared_ptr<PSDictionary> value) { fData = value; return *this; }
-
-	
-	bool asBool() const { return std::get<bool>(fData); }
-	bool asInt() const { return std::get<int>(fData); }
-	double asDouble() const { return std::get<double>(fData); }
-	const PSString& asString() const { return std::get<PSString>(fData); }
-	PS_Operator asFunction() const { return std::get<PS_Operator>(fData); }
-	std::shared_ptr<PSArray> asArray() const { return std::get<std::shared_ptr<PSArray>>(fData); }
-	std::shared_ptr<PSDictionary> asDictionary() const { return std::get<std::shared_ptr<PSDictionary>>(fData); }
-	std::shared_ptr<FileStream> asFile() const { return std::get<std::shared_ptr<FileStream>>(fData); }
-
-	std::ostream& printValue(std::ostream& os)
-	{
-		switch (fType) {
-			case PSTokenType::MARK:
-				os << "MARK";
-			break;
-			
-			case PSTokenType::NUMBER_INT:
-				os << std::get<int>(fData);
-				break;
-
-			case PSTokenType::NUMBER:
-				os << std::get<double>(fData);
-			break;
-
-			case PSTokenType::COMMENT:
-			case PSTokenType::EXECUTABLE_NAME:
-			case PSTokenType::LITERAL_NAME:
-			case PSTokenType::LITERAL_STRING:
-				os << std::get<PSString>(fData);
-			break;
-
-
-			case PSTokenType::LITERAL_ARRAY: 
-			{
-				os << "ARRAY";
-			}
-			break;
-		
-			case PSTokenType::DICTIONARY:
-				os << "DICTIONARY";
-			break;
-
-			case PSTokenType::PROCEDURE:
-				os << "PROCEDURE";
-			break;
-
-			case PSTokenType::OPERATOR:
-				os << "OPERATOR";
-			break;
-
-			case PSTokenType::FILESTREAM:
-				os << "FILESTREAM";
-			break;
-
-			default:
-				os << "UNKNOWN";
-				break;
-		}
+	bool isNull() const { return fType == PSTokenType::NIL; }
+	bool isName() const { return fType == PSTokenType::LITERAL_NAME || fType == PSTokenType::EXECUTABLE_NAME; }
+	bool isNumber() const { return fType == PSTokenType::NUMBER || fType == PSTokenType::NUMBER_INT || fType == PSTokenType::NUMBER_FLOAT; }
+
+	bool asBool() const { return fBool; }
+	int asInt() const { return fType == PSTokenType::NUMBER ? (int)fReal : fInt; }
+	double asDouble() const { return fType == PSTokenType::NUMBER ? fReal : (double)fInt; }
+	PS_Operator asFunction() const { return fOperator; }
+	uint32_t length() const { return fAux; }
+};
+
+static_assert(sizeof(PSObject) == 16, "PSObject is meant to be 16 bytes");
+
+/*
+	PSDictionary
+
+	Keyed by name.  Names are interned, so a key is only its atom,
+	and its hash comes along in the name object; a lookup is a
+	probe or two into an open addressed table, with no hashing
+	and no string compares.  Atom 0 marks an empty slot.
+*/
+class PSDictionary
+{
+	struct Entry {
+		uint32_t fAtom = 0;
+		uint32_t fHash = 0;
+		PSObject fValue;
+	};
 
-		return os;
+	std::vector<Entry> fEntries;
+	size_t fCount = 0;
+	bool fHasBoundKeys = false;		// a key is a name compiled code is bound to
+
+	size_t slotFor(const uint32_t atom, const uint32_t hash) const
+	{
+		const size_t mask = fEntries.size() - 1;
+		size_t idx = hash & mask;
+		while (fEntries[idx].fAtom != 0 && fEntries[idx].fAtom != atom)
+			idx = (idx + 1) & mask;
+		return idx;
 	}
 
-	std::ostream& printFullValue(std::ostream& os)
+	void grow()
 	{
-		switch (fType) 
+		std::vector<Entry> old(fEntries.size() * 2);
+		old.swap(fEntries);
+		for (auto& e : old)
 		{
+			if (e.fAtom != 0)
+				fEntries[slotFor(e.fAtom, e.fHash)] = e;
+		}
+	}
 
-			case PSTokenType::LITERAL_ARRAY:
-			{
-				auto arr = *asArray();
-			
-				os << "ARRAY: " << std::to_string(arr.size()) << std::endl;
-				for (auto& it : arr) {
-					it->printValue(os) << std::endl;
-				}
-			}
-			break;
+public:
+	PSDictionary(const size_t capacity = 16)
+	{
+		size_t n = 8;
+		while (n < capacity * 2)
+			n *= 2;
+		fEntries.resize(n);
+	}
 
-			case PSTokenType::PROCEDURE:
-			{
-				auto arr = *asArray();
+	size_t size() const { return fCount; }
 
-				os << "PROCEDURE: " << std::to_string(arr.size()) << std::endl;
-				for (auto& it : arr) {
-					it->printFullValue(os) << std::endl;
-				}
-			}
-			break;
+	// Kept up to date by whoever inserts keys, or binds names
+	// (PSDictionaryStack::def, PSMemory::markBound)
+	bool hasBoundKeys() const { return fHasBoundKeys; }
+	void setHasBoundKeys() { fHasBoundKeys = true; }
 
-			case PSTokenType::FILESTREAM:
-				os << "FILESTREAM" << std::endl;
-			break;
+	// key must be a name
+	const PSObject* find(const PSObject& key) const
+	{
+		const Entry& e = fEntries[slotFor(key.fAtom, key.fAux)];
+		return e.fAtom != 0 ? &e.fValue : nullptr;
+	}
 
-			default:
-				printValue(os) << std::endl;
-			break;
+	PSObject* find(const PSObject& key)
+	{
+		Entry& e = fEntries[slotFor(key.fAtom, key.fAux)];
+		return e.fAtom != 0 ? &e.fValue : nullptr;
+	}
 
+	void insert_or_assign(const PSObject& key, const PSObject& value)
+	{
+		Entry* e = &fEntries[slotFor(key.fAtom, key.fAux)];
+		if (e->fAtom == 0)
+		{
+			if ((fCount + 1) * 4 > fEntries.size() * 3) {
+				grow();
+				e = &fEntries[slotFor(key.fAtom, key.fAux)];
+			}
+			e->fAtom = key.fAtom;
+			e->fHash = key.fAux;
+			fCount++;
 		}
+		e->fValue = value;
+	}
 
-		return os;
+	// f(atom, value) for each entry
+	template <typename F>
+	void forEach(F&& f) const
+	{
+		for (auto& e : fEntries)
+		{
+			if (e.fAtom != 0)
+				f(e.fAtom, e.fValue);
+		}
 	}
 };
 
+#include "psmemory.h"
 #include "psstack.h"
 #include "psdictionary.h"
@@ -2,392 +2,239 @@
 #include <chrono>
 #include <unordered_map>
 #include <string>
-#include <functional>
 #include <algorithm>
 #include <memory>
 #include <iostream>
-#include <variant>
 
 #include "psvm.h"
 #include "ps_base_operators.h"
-
-#include "textscan.h"
+#include "mmap.hpp"
 
 
 using std::shared_ptr;
-using std::make_shared;
 
 using namespace ndt;
 
-// These are a convenient way of putting characters together
-// in an easily searchable set.
-// This does not work for unicode sequences, but rather the
-// stuff you'll typically see while tokenizing a programming language
-charset escapeChars("/\\\"bfnrtu");
-charset delimeterChars("()<>[]{}/%");
-charset isWhitespace("\t\n\f\r ");
-//charset hexChars("0123456789abcdefABCDEF");
-//charset digitChars("0123456789");
-charset numBeginChars("+-.0123456789");
-
-
-// There is an 'isgraph' function in the <ctype> file.
-// This one here is specific to ASCII processing
-static bool isGraph(int c)
-{
-	return (c > 0x20) && (c < 0x7f);
-}
-
 
-// Skip leading whitespaces in a binstream
-bool skipspaces(std::shared_ptr<BinStream> bs)
+// The bytes of a string, with its escapes worked out
+static void decodeString(const DataChunk& text, std::string& out)
 {
-	while (!bs->isEOF()) {
-		auto c = bs->peekOctet();
-		if (!isWhitespace(c))
-			break;
-		if (isWhitespace(bs->peekOctet()))
-		{
-			bs->skip(1);
-		}
-		else {
-			return true;
-		}
-	}
+	out.clear();
 
-	return !bs->isEOF();
-}
-
-
-//scan identifiers
-std::shared_ptr<PSToken> lex_name(PSScanner& scnr, shared_ptr<BinStream> bs)
-{
-	auto starting = bs->tell();
-	auto startPtr = bs->getPositionPointer();
+	const uint8_t* p = text.fStart;
+	const uint8_t* e = text.fEnd;
+	while (p < e)
+	{
+		uint8_t c = *p++;
+		if (c != '\\' || p >= e) {
+			out.push_back((char)c);
+			continue;
+		}
 
+		c = *p++;
+		switch (c)
+		{
+		case 'n': out.push_back('\n'); break;
+		case 'r': out.push_back('\r'); break;
+		case 't': out.push_back('\t'); break;
+		case 'b': out.push_back('\b'); break;
+		case 'f': out.push_back('\f'); break;
+
+		// a backslash at the end of a line continues the string on the next
+		case '\r':
+			if (p < e && *p == '\n')
+				p++;
+			break;
+		case '\n':
+			break;
 
-	// read to end of stream, or until delimeter
-	while (!bs->isEOF()) {
-		auto c = bs->peekOctet();
-		if (delimeterChars[c] || isWhitespace(c)) {
+		default:
+			// \ddd, octal
+			if (c >= '0' && c <= '7') {
+				int value = c - '0';
+				for (int i = 0; i < 2 && p < e && *p >= '0' && *p <= '7'; i++)
+					value = value * 8 + (*p++ - '0');
+				out.push_back((char)value);
+			}
+			else {
+				// \\, \(, \), and anything else is just itself
+				out.push_back((char)c);
+			}
 			break;
 		}
-
-		bs->skip(1);
 	}
+}
 
-	auto ending = bs->tell();
-	auto len = ending - starting;
-	std::string value((char*)startPtr, len);
-
-	auto tok = std::make_shared<PSToken>(value, PSTokenType::EXECUTABLE_NAME);
+// The bytes of a hex string; white space is ignored, and
+// a missing last digit is a 0
+static void decodeHexString(const DataChunk& text, std::string& out)
+{
+	out.clear();
 
-	if (value == "true" || (value == "false")) {
-		tok->setType(PSTokenType::BOOLEAN);
-		if (value == "true") {
-			*tok = true;
-		} else {
-			*tok = false;
+	int value = 0;
+	int count = 0;
+	for (const uint8_t* p = text.fStart; p < text.fEnd; p++)
+	{
+		int d;
+		if (*p >= '0' && *p <= '9') d = *p - '0';
+		else if (*p >= 'a' && *p <= 'f') d = *p - 'a' + 10;
+		else if (*p >= 'A' && *p <= 'F') d = *p - 'A' + 10;
+		else continue;
+
+		value = value * 16 + d;
+		if (++count == 2) {
+			out.push_back((char)value);
+			value = 0;
+			count = 0;
 		}
 	}
 
-	return tok;
+	if (count == 1)
+		out.push_back((char)(value * 16));
 }
 
 
-// Dispatch table for individual lexeme processing
-// really this could just be a switch statement within the scanner
-// but this way is more informative coding wise
-std::unordered_map < int, std::function<shared_ptr<PSToken> (PSScanner& scnr, shared_ptr<BinStream> bs)> > lexemeMap
+PSScanner::PSScanner(PSVM& vm)
+	:fVM(vm),
+	fBuildProcDepth(0)
 {
-	// [ - beginArray
-	{'[',[](PSScanner& scnr, shared_ptr<BinStream> bs) {
-		return scnr.beginArray();
-	}},
-	
-	// ] - endArray
-	{']',[](PSScanner& scnr, shared_ptr<BinStream> bs) {
-		return scnr.endArray();
-	}},
-
-	// ( - literal string
-	{'(',[](PSScanner& scnr, shared_ptr<BinStream> bs) {
-		auto starting = bs->tell();
-		auto startPtr = bs->getPositionPointer();
-
-		while (!bs->isEOF()) {
-			auto c = bs->peekOctet();
-			if (c == ')') {
-				break;
-			}
-
-			// deal with embedded chars
-			if (c == '\\') {
-				// BUGBUG
-			}
-
-			bs->skip(1);
-		}
-
-		auto ending = bs->tell();
-		auto len = ending - starting;
-		std::string value((char*)startPtr, len);
-
-		// Skip over closing delimeter
-		bs->skip(1);
-
-		auto tok = std::make_shared<PSToken>(value, PSTokenType::LITERAL_STRING);
+}
 
-		return tok;
-	}},
-		/*
-// <
-std::shared_ptr<PSToken> beginHexString(PSScanner&, std::shared_ptr<BinStream> bs)
+PSScanner::PSScanner(PSVM &vm, const DataChunk& input, bool final)
+	:fVM(vm),
+	fLexer(input, final),
+	fBuildProcDepth(0)
 {
-	auto starting = bs->tell();
-	auto startPtr = bs->getPositionPointer();
-
-	while (!bs->isEOF()) {
-		auto c = bs->peekOctet();
-		if (c == '>') {
-			break;
-		}
-
-		// deal with embedded chars
-		if (c == '\\') {
-			// BUGBUG
-		}
-
-		bs->skip(1);
-	}
-
-	auto ending = bs->tell();
-	auto len = ending - starting;
-
-	// Skip over closing delimeter
-	bs->skip(1);
-
-	// make a string
-	// then do substitutions to convert hex numbers
-	// into actual bytes
-	auto tok = std::make_shared<PSToken>((char*)startPtr, len, PSTokenType::HEXSTRING);
-
-	return tok;
 }
-*/
-	// { - beginProcedure
-	{ '{',[](PSScanner& scnr, shared_ptr<BinStream> bs) {
-		scnr.fBuildProcDepth += 1;
-		
-		return scnr.markOperandStack();
-	}},
-
-	// } - endProcedure
-	{ '}',[](PSScanner& scnr, shared_ptr<BinStream> bs) {
-		auto tok = scnr.endArray();
-		tok->setType(PSTokenType::PROCEDURE);
-		tok->setExecutable(true);
-		scnr.fBuildProcDepth -= 1;
-
-		return tok;
-	}},
-
-	// % - begin comment
-	{ '%',[](PSScanner& scnr, shared_ptr<BinStream> bs) {
-		auto starting = bs->tell();
-		auto startPtr = bs->getPositionPointer();
-
-		while ((bs->peekOctet() != '\n') && !bs->isEOF()) {
-			bs->skip(1);
-		}
-
-		auto ending = bs->tell();
-		auto len = ending - starting;
-		std::string value((char*)startPtr, len);
-
-		auto tok = std::make_shared<PSToken>(value, PSTokenType::COMMENT);
-
-		return tok;
-	} },
-	
-	// '/' - literal name
-	{ '/', [](PSScanner& scnr, shared_ptr<BinStream> bs) {
-		auto tok = lex_name(scnr, bs);
-		tok->fType = PSTokenType::LITERAL_NAME;
-
-		return tok;
-	} },
 
-};
-
-
-
-shared_ptr<PSToken> PSScanner::markOperandStack()
+PSObject PSScanner::markOperandStack()
 {
 	vm().operandStack().mark();
-	return nullptr;
+	return PSObject();
 }
 
-std::shared_ptr<PSToken> PSScanner::beginArray()
+PSObject PSScanner::beginArray()
 {
 	return markOperandStack();
 }
 
-std::shared_ptr<PSToken> PSScanner::endArray()
+// Everything above the mark becomes the array, in one
+// slice of the array pool
+PSObject PSScanner::endArray()
 {
+	auto& stk = vm().operandStack().fContainer;
 	auto n = vm().operandStack().countToMark();
-	auto arr = make_shared<PSArray>();
 
-	for (size_t i = 0; i < n; i++) {
-		auto tok = vm().popOperand();
-		//arr->push_back(tok);
-		arr->push_front(tok);
-	}
+	auto scannedTok = vm().memory().newArray(stk.data() + stk.size() - n, n);
 
-	// pop the marker itself
-	auto op = vm().popOperand();
-
-	auto scannedTok = make_shared<PSToken>(arr);
+	// pop the items, and the marker itself
+	stk.resize(stk.size() - std::min(n + 1, stk.size()));
 
 	return scannedTok;
 }
 
 
-
-
-
-// scan a number
-// something got us here, it was something in numBeginChars
-// valid: 8.35928e-09
-// numBeginChars["+-.[digit]"]
-// If not valid number, return nil
-std::shared_ptr<PSToken> lex_number(PSScanner &scnr, shared_ptr<BinStream> bs)
+// Generate a single token
+// Inside a procedure, tokens are collected on the operand
+// stack, above the mark, until the closing brace
+PSObject PSScanner::nextToken()
 {
-	auto starting = bs->tell();
-	auto startPtr = bs->getPositionPointer();
-	//print("lex_number: ", starting)
-	//First, let's look for a valid starting character
-	// - , +, ., digit
-	if (numBeginChars[bs->peekOctet()])
-	{
-		//print("  SKIP 1")
-		bs->skip(1);
-	}
-	else {
-		//print("INVALID START of NUMBER: ", string.char(bs:peekOctet()))
-		return nullptr;
-	}
+	auto& mem = vm().memory();
 
-	// scan until a delimeter found
 	while (true) {
-		if (bs->isEOF())
+		auto lex = fLexer.next();
+		PSObject tok;
+
+		switch (lex.fType)
 		{
-			break;
+		case PSLexemeType::END:
+		case PSLexemeType::MORE:
+			// a null object indicates there are no further
+			// tokens to be scanned, for now
+			fNeedMore = (lex.fType == PSLexemeType::MORE);
+			return PSObject();
+
+		case PSLexemeType::NAME:
+		{
+			auto text = (const char*)lex.fText.fStart;
+			auto len = chunk_size(lex.fText);
+			if (len == 4 && memcmp(text, "true", 4) == 0)
+				tok = PSObject(true);
+			else if (len == 5 && memcmp(text, "false", 5) == 0)
+				tok = PSObject(false);
+			else
+				tok = mem.name(text, len, true);
 		}
+		break;
 
-		auto c = bs->peekOctet();
-
-		if (isWhitespace(c)) {
+		case PSLexemeType::LITERAL_NAME:
+			tok = mem.name((const char*)lex.fText.fStart, chunk_size(lex.fText), false);
 			break;
-		}
 
-		if (delimeterChars[c]) {
-			break;
+		// //name is replaced by its value, now
+		case PSLexemeType::IMMEDIATE_NAME:
+		{
+			tok = mem.name((const char*)lex.fText.fStart, chunk_size(lex.fText), true);
+			auto value = vm().dictionaryStack().load(tok);
+			if (value != nullptr)
+				tok = *value;
 		}
+		break;
 
-		bs->skip(1);
-	}
-
-
-	auto ending = bs->tell();
-	auto len = ending - starting;
-	std::string value((char*)startPtr, len);
-	double nValue = std::strtod(value.c_str(), nullptr);
+		case PSLexemeType::NUMBER:
+			tok = PSObject(lex.fNumber);
+			break;
 
-	auto tok = make_shared<PSToken>(nValue);
-	
-	return tok;
-}
+		case PSLexemeType::STRING:
+			if (memchr(lex.fText.fStart, '\\', chunk_size(lex.fText)) == nullptr) {
+				tok = mem.newString((const char*)lex.fText.fStart, chunk_size(lex.fText));
+			}
+			else {
+				decodeString(lex.fText, fScratch);
+				tok = mem.newString(fScratch);
+			}
+			break;
 
+		case PSLexemeType::HEXSTRING:
+			decodeHexString(lex.fText, fScratch);
+			tok = mem.newString(fScratch);
+			tok.setType(PSTokenType::HEXSTRING);
+			break;
 
+		case PSLexemeType::BEGIN_ARRAY:
+			beginArray();
+			continue;
 
-PSScanner::PSScanner(PSVM &vm, std::shared_ptr<BinStream> bs)
-	:fVM(vm),
-	fStream(bs),
-	fBuildProcDepth(0)
-{
-}
+		case PSLexemeType::END_ARRAY:
+			tok = endArray();
+			break;
 
+		case PSLexemeType::BEGIN_PROC:
+			incrementProcDepth();
+			markOperandStack();
+			continue;
 
+		case PSLexemeType::END_PROC:
+			tok = endArray();
+			tok.setType(PSTokenType::PROCEDURE);
+			tok.setExecutable(true);
+			decrementProcDepth();
+			break;
 
-// Generate a single token
-std::shared_ptr<PSToken> PSScanner::nextToken()
-{
-	while (!fStream->isEOF()) {
-		skipspaces(fStream);
-		
-		if (fStream->isEOF())
-		{
-			return nullptr;
+		case PSLexemeType::COMMENT:
+			// The text isn't kept, nothing looks at it yet
+			tok = PSObject(PSTokenType::COMMENT);
+			break;
 		}
 
-		auto c = fStream->readOctet();
-
-		if (lexemeMap[c]) {
-			auto tok = lexemeMap[c](*this, fStream);
-			if (tok != nullptr) {
-				if (isBuildingProc()) {
-					vm().pushOperand(tok);
-				} else {
-					return tok;
-				}
-			}
-			else {
-				// do nothing
-				// look for next token
-			}
-		}
-		else {
-			// handle the case of numbers
-			// and names that begin with a number
-			if (numBeginChars[c])
-			{
-				fStream->skip(-1);
-				auto sentinel = fStream->tell();
-				auto tok = lex_number(*this, fStream);
-				if (tok == nullptr) {
-					fStream->seek(sentinel);
-					tok = lex_name(*this, fStream);
-				}
-
-				if (tok != nullptr) {
-					if (isBuildingProc()) {
-					
-					} else {
-						return tok;
-					}
-				}
-			}
-			else if (isGraph(c))
-			{
-				fStream->skip(-1);
-				auto tok = lex_name(*this, fStream);
-				if (isBuildingProc()) 
-				{
-					vm().pushOperand(tok);
-				} else {
-					return tok;
-				}
-			}
-			else {
-				printf("SCANNER UNKNOWN: %c\n", c);
-			}
+		if (isBuildingProc()) {
+			// comments don't belong in the procedure body
+			if (tok.fType != PSTokenType::COMMENT)
+				vm().pushOperand(tok);
+		} else {
+			return tok;
 		}
 	}
-
-	// returning a nullptr indicates there are no further
-	// tokens to be scanned
-	return nullptr;
 }
 
 
@@ -398,7 +245,8 @@ std::shared_ptr<PSToken> PSScanner::nextToken()
 //
 
 PSVM::PSVM()
-//	: fSurface(816, 1056)
+	: fDictionaryStack(fMemory)
+//	, fSurface(816, 1056)
 {
 	// seed random number generator with system time
 	fRandomGen.seed((unsigned int)(std::chrono::system_clock::now().time_since_epoch().count()));
@@ -406,84 +254,223 @@ PSVM::PSVM()
 	// Setup dictionary stack
 	// Base operators, graphics, file all go into 
 	// initial userdict
-	auto d = make_shared<PSDictionary>();
-	d->addOperators(PSBaseOperators);
+	auto d = fMemory.newDictionary(256);
+	fMemory.addOperators(d, PSBaseOperators);
 
 
 	fDictionaryStack.pushDictionary(d);
 }
 
 
-void PSVM::execArray(shared_ptr<PSToken> tok)
+// Execute any object, as 'exec' would
+void PSVM::exec(const PSObject& tok)
 {
-	auto arr = tok->asArray();
+	switch (tok.fType) {
+	case PSTokenType::OPERATOR:
+		tok.asFunction()(*this);
+		break;
 
-	for (size_t idx = 0; idx < arr->size(); idx++)
-	{
-		auto &item = arr->at(idx);
-
-		switch (item->fType) {
-		case PSTokenType::BOOLEAN:
-		case PSTokenType::NUMBER:
-		case PSTokenType::LITERAL_ARRAY:
-		case PSTokenType::LITERAL_STRING:
-		case PSTokenType::LITERAL_NAME:
-		case PSTokenType::HEXSTRING:
-		case PSTokenType::PROCEDURE:
-			pushOperand(item);
+	case PSTokenType::EXECUTABLE_NAME:
+		execName(tok);
+		break;
+
+	case PSTokenType::PROCEDURE:
+	case PSTokenType::LITERAL_ARRAY:
+		if (tok.isExecutable()) {
+			execArray(tok);
 			break;
+		}
+		pushOperand(tok);
+		break;
 
+	default:
+		pushOperand(tok);
+		break;
+	}
+}
+
+void PSVM::execArray(const PSObject& tok)
+{
+	run(code(tok));
+}
+
+// The compiled form of a procedure, compiling it if it
+// hasn't been, or if the names it was bound to might have
+// changed since
+const PSCode& PSVM::code(const PSObject& proc)
+{
+	if (proc.fHandle < fCodeIndex.size())
+	{
+		auto idx = fCodeIndex[proc.fHandle];
+		if (idx != 0) {
+			auto& c = fCode[idx - 1];
+			if (c.fVersion == fDictionaryStack.version() && c.fLength == proc.length())
+				return c;
+		}
+	}
+
+	return compile(proc);
+}
+
+// Bind the names that are operators now, and leave the rest
+// to be looked up as they're run
+const PSCode& PSVM::compile(const PSObject& proc)
+{
+	const uint32_t old = proc.fHandle < fCodeIndex.size() ? fCodeIndex[proc.fHandle] : 0;
+	const bool reuse = (old != 0) && (fCode[old - 1].fRunning == 0);
+
+	auto& c = reuse ? fCode[old - 1] : fCode.emplace_back();
+	c.fVersion = fDictionaryStack.version();
+	c.fLength = proc.length();
+	c.fInstructions.assign(proc.length(), PSInstruction());
+
+	for (size_t idx = 0; idx < proc.length(); idx++)
+	{
+		auto& item = fMemory.element(proc, idx);
+		auto& ins = c.fInstructions[idx];
+		ins.fObject = item;
+
+		switch (item.fType) {
 		case PSTokenType::OPERATOR:
-			item->asFunction()(*this);
+			ins.fOp = PSOpCode::CALL;
+			ins.fOperator = item.asFunction();
 			break;
 
-
 		case PSTokenType::EXECUTABLE_NAME:
-			execName(item);
-			break;
+		{
+			auto found = fDictionaryStack.load(item);
+			if (found != nullptr && found->fType == PSTokenType::OPERATOR) {
+				ins.fOp = PSOpCode::BOUND;
+				ins.fOperator = found->asFunction();
+				fMemory.markBound(item);
+			}
+			else {
+				ins.fOp = PSOpCode::NAME;
+			}
+		}
+		break;
 
 		default:
-			// do nothing
-			printf("execArray: %d\n", item->fType); 
+			// procedures inside procedures are pushed,
+			// along with all the literals
+			ins.fOp = PSOpCode::PUSH;
 			break;
 		}
+	}
+
+	if (!reuse)
+	{
+		if (fCodeIndex.size() <= proc.fHandle)
+			fCodeIndex.resize((size_t)proc.fHandle + 1, 0);
+		fCodeIndex[proc.fHandle] = (uint32_t)fCode.size();
+	}
+
+	return c;
+}
+
+// The array has been changed, compile it again when it's next run
+void PSVM::forgetCode(const PSObject& arr)
+{
+	// No procedure is that long, so it never matches, but the
+	// entry is still there to be reused
+	if (arr.fHandle < fCodeIndex.size() && fCodeIndex[arr.fHandle] != 0)
+		fCode[fCodeIndex[arr.fHandle] - 1].fLength = UINT32_MAX;
+}
+
+// 'bind', replace names that are operators with the operators
+// themselves, in the procedure and the ones inside it, for good
+void PSVM::bind(const PSObject& proc)
+{
+	if (proc.fType != PSTokenType::PROCEDURE)
+		return;
+
+	for (size_t idx = 0; idx < proc.length(); idx++)
+	{
+		auto& item = fMemory.element(proc, idx);
+		if (item.fType == PSTokenType::EXECUTABLE_NAME) {
+			auto found = fDictionaryStack.load(item);
+			if (found != nullptr && found->fType == PSTokenType::OPERATOR)
+				item = *found;
+		}
+		else if (item.fType == PSTokenType::PROCEDURE) {
+			bind(item);
+		}
+	}
+
+	forgetCode(proc);
+}
 
+// The dispatch loop
+void PSVM::run(const PSCode& code)
+{
+	code.fRunning++;
+
+	for (auto& ins : code.fInstructions)
+	{
+		fOperations++;
 
+		switch (ins.fOp) {
+		case PSOpCode::PUSH:
+			pushOperand(ins.fObject);
+			continue;
+
+		case PSOpCode::CALL:
+			ins.fOperator(*this);
+			break;
+
+		case PSOpCode::BOUND:
+			if (code.fVersion == fDictionaryStack.version())
+				ins.fOperator(*this);
+			else
+				execName(ins.fObject);
+			break;
+
+		case PSOpCode::NAME:
+			execName(ins.fObject);
+			break;
+		}
+
+		if (fExit)
+			break;
 	}
+
+	code.fRunning--;
 }
 
-void PSVM::execName(shared_ptr<PSToken> tok)
+void PSVM::execName(const PSObject& tok)
 {
 	// lookup the name in the dictionary stack
-	auto key = tok->asString();
-	auto op = fDictionaryStack.load(key);
+	// copy what's found, executing it might change the dictionary
+	auto found = fDictionaryStack.load(tok);
 	
 	// if the name is not found, report error and continue
-	if (op == nullptr) {
-		std::cout << "UNKNOWN EXECUTABLE NAME: " << key << std::endl;
+	if (found == nullptr) {
+		std::cout << "UNKNOWN EXECUTABLE NAME: " << fMemory.str(tok) << std::endl;
 		return;
 	}
+	auto op = *found;
 
 	//std::cout << "execName: ";
-	// tok->printValue(std::cout) << std::endl;
+	// fMemory.printValue(std::cout, tok) << std::endl;
 
 	// We found an object associated with the name.  
 	// Take action based on the type of the found object
-	switch (op->fType)
+	switch (op.fType)
 	{
 	case PSTokenType::BOOLEAN:
 	case PSTokenType::NUMBER:
+	case PSTokenType::NUMBER_INT:
 	case PSTokenType::LITERAL_STRING:
 		pushOperand(op);
 		break;
 
 	case PSTokenType::OPERATOR:
-		op->asFunction()(*this);
+		op.asFunction()(*this);
 		break;
 
 	case PSTokenType::PROCEDURE:
 	case PSTokenType::LITERAL_ARRAY:
-		if (op->isExecutable()) {
+		if (op.isExecutable()) {
 			execArray(op);
 		}
 		else {
@@ -491,29 +478,34 @@ void PSVM::execName(shared_ptr<PSToken> tok)
 		}
 		break;
 	default:
-		std::cout << "UKNOWN EXECUTABLE TYPE: " << (int)op->fType << std::endl;
+		std::cout << "UKNOWN EXECUTABLE TYPE: " << (int)op.fType << std::endl;
 		break;
 	}
 }
 
-void PSVM::evalStream(std::shared_ptr<BinStream> bs)
+// Run everything the scanner has, until it runs out
+// If the scanner's input came in pieces, scnr.needsMore()
+// says whether it stopped partway, waiting for the next
+void PSVM::eval(PSScanner& scnr)
 {
-	PSScanner scnr(*this, bs);
-
 	// Alternate between grabbing a token
 	// and executing something
-	while (!bs->isEOF()) {
+	while (true) {
 		auto tok = scnr.nextToken();
-		if (nullptr == tok)
+		if (tok.isNull())
 			break;
 
-		//std::cout << "eval: " << tok->fData << std::endl;
 		//std::cout << "eval: ";
-		//tok->printValue(std::cout) << std::endl;
+		//fMemory.printValue(std::cout, tok) << std::endl;
 
-		if (tok->fType == PSTokenType::EXECUTABLE_NAME) {
+		fOperations++;
+
+		if (tok.fType == PSTokenType::EXECUTABLE_NAME) {
 			execName(tok);
-		} else if (tok->fType == PSTokenType::COMMENT) {
+
+			// 'exit' with no loop to leave
+			fExit = false;
+		} else if (tok.fType == PSTokenType::COMMENT) {
 			// throw comments away, or do document processing
 		} else {
 			// by default, just place the token on the operand stack
@@ -522,9 +514,67 @@ void PSVM::evalStream(std::shared_ptr<BinStream> bs)
 	}
 }
 
-void PSVM::runFilename(std::string filename)
+void PSVM::evalStream(std::shared_ptr<BinStream> bs)
 {
-	auto fs = std::make_shared<FileStream>(filename);
-	evalStream(fs);
+	auto start = (const uint8_t*)bs->getPositionPointer();
+	PSScanner scnr(*this, DataChunk(start, start + bs->remaining()), true);
+
+	eval(scnr);
+
+	bs->skip(scnr.position() - start);
+}
+
+// Map the file and scan it a window at a time, letting go of
+// each window's pages once it's been scanned, so however big the
+// file is, not much more than a window of it is ever in memory.
+// That's the file; what the program makes is another matter.
+// Every string, array and procedure it scans stays in PSMemory
+// until the VM goes away, so only a stream of numbers, names
+// and operators on them runs in bounded memory.
+bool PSVM::evalFile(const std::string& filename, const size_t window)
+{
+	mmap_options opts{};
+	opts.access = MMAP_ACCESS_SEQUENTIAL;
+
+	auto m = mmap::create_shared(filename, opts);
+	if ((m == nullptr) || !m->isValid())
+		return false;
+
+	auto all = m->getChunk();
+	const size_t size = chunk_size(all);
+
+	PSScanner scnr(*this);
+	size_t pos = 0;
+	size_t span = std::max(window, (size_t)4096);
+
+	while (true)
+	{
+		const size_t end = std::min(size, pos + span);
+		scnr.feed(DataChunk(all.fStart + pos, all.fStart + end), end == size);
+
+		eval(scnr);
+
+		if (!scnr.needsMore())
+			break;
+
+		size_t next = scnr.position() - all.fStart;
+
+		// A single token bigger than the window, make room for it
+		if (next == pos)
+			span *= 2;
+		else
+			span = std::max(window, (size_t)4096);
+
+		m->release(pos, next - pos);
+		pos = next;
+	}
+
+	return true;
 }
 
+void PSVM::runFilename(std::string filename)
+{
+	if (!evalFile(filename)) {
+		std::cout << "runFilename, could not open: " << filename << std::endl;
+	}
+}
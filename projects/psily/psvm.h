@@ -5,59 +5,93 @@
 #include "binstream.hpp"
 #include "p5.hpp"
 #include "pstypes.h"
+#include "psbytecode.h"
+#include "psscanner.h"
 
 #include <memory>
 #include <algorithm>
+#include <deque>
 #include <random>
-
-using std::shared_ptr;
-using std::make_shared;
+#include <string>
+#include <vector>
 
 class PSVM;
 
+// Turns what the lexer finds into objects
+// Input can come all at once, or in pieces (see PSLexer)
 class PSScanner
 {
 	PSVM& fVM;
-	std::shared_ptr<BinStream> fStream;
+	PSLexer fLexer;
+	std::string fScratch;		// strings with escapes are decoded here
+	bool fNeedMore = false;
 
 
 public:
 	int fBuildProcDepth = 0;
 
 public:
-	PSScanner(PSVM& vm, std::shared_ptr<BinStream> bs);
+	PSScanner(PSVM& vm);
+	PSScanner(PSVM& vm, const ndt::DataChunk& input, bool final = true);
 
 	PSVM& vm() { return fVM; }
 
+	// Hand over the next piece of input, starting from position()
+	void feed(const ndt::DataChunk& input, bool final) { fLexer.feed(input, final); fNeedMore = false; }
+	const uint8_t* position() const { return fLexer.position(); }
+	bool needsMore() const { return fNeedMore; }
+
 	void incrementProcDepth() { fBuildProcDepth += 1; }
 	void decrementProcDepth() { fBuildProcDepth -= 1; }
 	bool isBuildingProc() { return fBuildProcDepth > 0; }
 
-	shared_ptr<PSToken> beginArray();
-	shared_ptr<PSToken> endArray();
-	shared_ptr<PSToken> markOperandStack();
-	shared_ptr<PSToken> nextToken();
+	PSObject beginArray();
+	PSObject endArray();
+	PSObject markOperandStack();
+
+	// A null object when there is nothing more to scan
+	PSObject nextToken();
 };
 
 
 class PSVM
 {
+	PSMemory fMemory;
 	PSStack fOperandStack;
 	PSDictionaryStack fDictionaryStack;
 	std::mt19937 fRandomGen;
 	Surface fSurface;
 
+	// Compiled procedures, and which one each array handle
+	// was last compiled to (+1, 0 is none).  A procedure
+	// compiled again reuses its entry, unless the old code
+	// is still running, when it gets a new one.
+	std::deque<PSCode> fCode;
+	std::vector<uint32_t> fCodeIndex;
+
+	// Set by 'exit', until the enclosing loop sees it
+	bool fExit = false;
+
+	const PSCode& compile(const PSObject& proc);
+
+public:
+	// Objects executed so far, for benchmarking
+	uint64_t fOperations = 0;
+
 public:
 	PSVM();
 
+	// Where strings, arrays and dictionaries live
+	PSMemory& memory() { return fMemory; }
+
 	// Random number generation
 	inline unsigned int randomInt() { return fRandomGen(); }
 	inline void seedRandomInt(unsigned int seed) { fRandomGen.seed(seed); }
 
 	// Operand stack
 	PSStack& operandStack() { return fOperandStack; }
-	shared_ptr<PSToken> popOperand() { return fOperandStack.pop(); }
-	void pushOperand(shared_ptr<PSToken> tok) { fOperandStack.push(tok); }
+	PSObject popOperand() { return fOperandStack.pop(); }
+	void pushOperand(const PSObject& tok) { fOperandStack.push(tok); }
 
 	// Dictionary Stack
 	PSDictionaryStack& dictionaryStack() { return fDictionaryStack; }
@@ -66,11 +100,24 @@ public:
 	Surface& surface() { return fSurface; }
 
 	// Executing things
-	void execArray(shared_ptr<PSToken> tok);
-	void execName(shared_ptr<PSToken> tok);
+	void exec(const PSObject& tok);
+	void execArray(const PSObject& tok);
+	void execName(const PSObject& tok);
+
+	// Compiled procedures
+	const PSCode& code(const PSObject& proc);
+	void forgetCode(const PSObject& arr);
+	void run(const PSCode& code);
+	void bind(const PSObject& proc);
+
+	// Loops
+	void exitLoop() { fExit = true; }
+	bool takeExit() { bool e = fExit; fExit = false; return e; }
 
 	// Evaluating commands
-	void evalStream(shared_ptr<BinStream> bs);
+	void eval(PSScanner& scnr);
+	void evalStream(std::shared_ptr<BinStream> bs);
+	bool evalFile(const std::string& filename, const size_t window = 4 * 1024 * 1024);
 	void runFilename(std::string filename);
 
-};
\ No newline at end of file
+};
@@ -69,7 +69,7 @@ public:
         return Ray(
             origin + offset,
             lower_left_corner + s * horizontal + t * vertical - origin - offset,
-            random_double_range(time0, time1)
+            random_double(time0, time1)
         );
     }
 
@@ -0,0 +1,1032 @@
+#pragma once
+
+/*
+    flat_bvh
+
+    A bounding volume hierarchy that's built for speed of traversal,
+    rather than ease of construction, as bvh_node is.
+
+    - The hierarchy is built with the surface area heuristic, using
+      binned centroids.  Big subtrees are built in parallel.
+    - Nodes live in one array, in depth first order.  Each one is 32 bytes;
+      a box in floats (rounded outward), and where to go next.  The first
+      child of an interior node is the very next node.
+    - Traversal is a loop with a small stack, nearest child first.
+    - The shapes themselves are pulled out of their shared_ptrs into an
+      array for each kind; spheres, moving spheres, and the three
+      kinds of rectangle.  Lists, boxes, bvh_nodes and flip_face are
+      looked through, so what they hold gets flattened too.  Anything
+      else (translate, rotate_y, constant_medium) is kept as is, and
+      hit with a virtual call.
+    - The hit_record is only filled in for the closest hit, so the
+      material's shared_ptr is copied once per ray, not once per shape.
+    - hitPacket() traces four rays at once (see packet.h).  Boxes are
+      tested for all four lanes together, and a node is visited if any
+      lane hits it.
+
+    The intersection math is the same as the hittables it replaces, so
+    a scene renders the same either way, just faster.
+*/
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "aarect.h"
+#include "box.h"
+#include "bvh.h"
+#include "moving_sphere.h"
+#include "sphere.h"
+#include "packet.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <future>
+#include <map>
+#include <thread>
+#include <vector>
+
+
+class flat_bvh : public hittable {
+public:
+    struct Node {
+        float bmin[3];
+        uint32_t offset;    // interior: index of second child, leaf: first primitive
+        float bmax[3];
+        uint16_t count;     // number of primitives, 0 for interior nodes
+        uint16_t axis;      // split axis of interior nodes
+    };
+    static_assert(sizeof(Node) == 32, "flat_bvh::Node should be 32 bytes");
+
+private:
+    enum PrimKind : uint32_t {
+        PRIM_SPHERE = 0,
+        PRIM_MOVING_SPHERE,
+        PRIM_RECT,
+        PRIM_OTHER,
+    };
+
+    static constexpr uint32_t kKindShift = 28;
+    static constexpr uint32_t kIndexMask = (1u << kKindShift) - 1;
+    static constexpr uint32_t kNoHit = 0xffffffff;
+
+    static constexpr int kBinCount = 16;
+    static constexpr size_t kMinLeafSize = 2;
+    static constexpr size_t kMaxLeafSize = 8;
+    static constexpr size_t kParallelBuildSize = 4096;
+
+    // Subtrees are only built on a thread of their own this far down,
+    // enough to keep every core busy without a thread per subtree
+    static int parallelBuildDepth()
+    {
+        static const int depth = []() {
+            int d = 1;
+            for (unsigned n = std::thread::hardware_concurrency(); n > 1; n >>= 1)
+                d++;
+            return d;
+        }();
+        return depth;
+    }
+
+    // Past this depth, splits are made at the median, so the depth
+    // of the tree, and so the traversal stack, stays bounded
+    static constexpr int kMedianSplitDepth = 48;
+    static constexpr int kStackSize = 128;
+
+    struct SphereData {
+        double center[3];
+        double radius;
+        uint32_t material;
+        uint32_t flip;
+    };
+
+    struct MovingSphereData {
+        double center0[3];
+        double center1[3];
+        double time0, time1;
+        double radius;
+        uint32_t material;
+        uint32_t flip;
+    };
+
+    // plane 0 is xy_rect (a=x, b=y, k on z)
+    // plane 1 is xz_rect (a=x, b=z, k on y)
+    // plane 2 is yz_rect (a=y, b=z, k on x)
+    struct RectData {
+        double a0, a1, b0, b1, k;
+        uint32_t material;
+        uint16_t plane;
+        uint16_t flip;
+    };
+
+    struct OtherData {
+        shared_ptr<hittable> object;
+        bool flip;
+    };
+
+    struct BuildPrim {
+        float bmin[3];
+        float bmax[3];
+        float centroid[3];
+        uint32_t ref;
+    };
+
+    struct Bounds {
+        float bmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float bmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+        void grow(const float* lo, const float* hi)
+        {
+            for (int a = 0; a < 3; a++) {
+                bmin[a] = std::min(bmin[a], lo[a]);
+                bmax[a] = std::max(bmax[a], hi[a]);
+            }
+        }
+
+        void grow(const float* p) { grow(p, p); }
+
+        float area() const
+        {
+            float dx = bmax[0] - bmin[0];
+            float dy = bmax[1] - bmin[1];
+            float dz = bmax[2] - bmin[2];
+            if (dx < 0 || dy < 0 || dz < 0)
+                return 0;
+            return 2.0f * (dx * dy + dy * dz + dz * dx);
+        }
+    };
+
+    std::vector<Node> fNodes;
+    std::vector<uint32_t> fPrimRefs;
+
+    std::vector<SphereData> fSpheres;
+    std::vector<MovingSphereData> fMovingSpheres;
+    std::vector<RectData> fRects;
+    std::vector<OtherData> fOthers;
+    std::vector<shared_ptr<material>> fMaterials;
+    std::map<const material*, uint32_t> fMaterialIndex;
+
+    aabb fBounds;
+    double fTime0 = 0;
+    double fTime1 = 1;
+
+public:
+    flat_bvh(const hittable_list& list, double time0, double time1)
+        : fTime0(time0), fTime1(time1)
+    {
+        for (const auto& object : list.objects)
+            gather(object, false);
+
+        build();
+    }
+
+    flat_bvh(shared_ptr<hittable> object, double time0, double time1)
+        : fTime0(time0), fTime1(time1)
+    {
+        gather(object, false);
+        build();
+    }
+
+    size_t nodeCount() const { return fNodes.size(); }
+    size_t primitiveCount() const { return fPrimRefs.size(); }
+
+    virtual bool bounding_box(double t0, double t1, aabb& output_box) const
+    {
+        output_box = fBounds;
+        return !fNodes.empty();
+    }
+
+    virtual bool hit(const Ray& r, double t_min, double t_max, hit_record& rec) const
+    {
+        if (fNodes.empty())
+            return false;
+
+        const point3 orig = r.origin();
+        const vec3 dir = r.direction();
+
+        const float o[3] = { (float)orig.x, (float)orig.y, (float)orig.z };
+        const float inv[3] = { 1.0f / (float)dir.x, 1.0f / (float)dir.y, 1.0f / (float)dir.z };
+        const bool negative[3] = { inv[0] < 0, inv[1] < 0, inv[2] < 0 };
+
+        double closest = t_max;
+        uint32_t closestRef = kNoHit;
+        hit_record otherRec;
+
+        uint32_t stack[kStackSize];
+        int sp = 0;
+        uint32_t idx = 0;
+
+        while (true)
+        {
+            const Node& node = fNodes[idx];
+
+            if (slabHit(node, o, inv, (float)t_min, (float)closest))
+            {
+                if (node.count > 0)
+                {
+                    for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+                    {
+                        uint32_t ref = fPrimRefs[i];
+                        if ((ref >> kKindShift) == PRIM_OTHER)
+                        {
+                            const OtherData& other = fOthers[ref & kIndexMask];
+                            if (other.object->hit(r, t_min, closest, otherRec)) {
+                                closest = otherRec.t;
+                                closestRef = ref;
+                                rec = otherRec;
+                                if (other.flip)
+                                    rec.front_face = !rec.front_face;
+                            }
+                        }
+                        else
+                        {
+                            double t;
+                            if (intersect(ref, r, t_min, closest, t)) {
+                                closest = t;
+                                closestRef = ref;
+                            }
+                        }
+                    }
+                }
+                else
+                {
+                    // Nearest child first
+                    uint32_t first = idx + 1;
+                    uint32_t second = node.offset;
+                    if (negative[node.axis])
+                        std::swap(first, second);
+
+                    stack[sp++] = second;
+                    idx = first;
+                    continue;
+                }
+            }
+
+            if (sp == 0)
+                break;
+            idx = stack[--sp];
+        }
+
+        if (closestRef == kNoHit)
+            return false;
+
+        if ((closestRef >> kKindShift) != PRIM_OTHER)
+            fillRecord(closestRef, r, closest, rec);
+
+        return true;
+    }
+
+    // Trace a packet of rays.  hits gets a bit for each lane that hit
+    // something, and recs the details.  If laneRandom is given, a lane's
+    // generator is used when hitting things that use random numbers
+    // (constant_medium), so each lane gets the numbers it would alone.
+    int hitPacket(const RayPacket& packet, double t_min, double t_max, hit_record* recs,
+        PacketPrecision precision = PacketPrecision::DOUBLE, rtrandom* laneRandom = nullptr) const
+    {
+        const int lanes = packet.laneMask;
+        if (fNodes.empty() || lanes == 0)
+            return 0;
+
+        const float4 ox = float4::load(packet.ox), oy = float4::load(packet.oy), oz = float4::load(packet.oz);
+        const float4 ix = float4::load(packet.ix), iy = float4::load(packet.iy), iz = float4::load(packet.iz);
+        const float4 tmin4((float)t_min);
+
+        double closest[RayPacket::kWidth];
+        uint32_t closestRef[RayPacket::kWidth];
+        float closestf[RayPacket::kWidth];
+        for (int k = 0; k < RayPacket::kWidth; k++) {
+            closest[k] = t_max;
+            closestf[k] = (float)t_max;
+            closestRef[k] = kNoHit;
+        }
+
+        hit_record otherRec;
+
+        uint32_t stack[kStackSize];
+        int sp = 0;
+        uint32_t idx = 0;
+
+        while (true)
+        {
+            const Node& node = fNodes[idx];
+
+            int active = slabHit4(node, ox, oy, oz, ix, iy, iz, tmin4, float4::load(closestf)) & lanes;
+            if (active)
+            {
+                if (node.count > 0)
+                {
+                    for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+                    {
+                        uint32_t ref = fPrimRefs[i];
+                        uint32_t kind = ref >> kKindShift;
+
+                        if (precision == PacketPrecision::FLOAT && (kind == PRIM_SPHERE || kind == PRIM_RECT))
+                        {
+                            float4 t;
+                            int hitLanes = (kind == PRIM_SPHERE)
+                                ? intersectSphere4(fSpheres[ref & kIndexMask], packet, tmin4, float4::load(closestf), t)
+                                : intersectRect4(fRects[ref & kIndexMask], packet, tmin4, float4::load(closestf), t);
+                            hitLanes &= active;
+
+                            if (hitLanes) {
+                                float tf[RayPacket::kWidth];
+                                t.store(tf);
+                                for (int k = 0; k < RayPacket::kWidth; k++) {
+                                    if (hitLanes & (1 << k)) {
+                                        closest[k] = tf[k];
+                                        closestf[k] = tf[k];
+                                        closestRef[k] = ref;
+                                    }
+                                }
+                            }
+                            continue;
+                        }
+
+                        for (int k = 0; k < RayPacket::kWidth; k++)
+                        {
+                            if (!(active & (1 << k)))
+                                continue;
+
+                            const Ray& r = packet.rays[k];
+                            if (kind == PRIM_OTHER)
+                            {
+                                const OtherData& other = fOthers[ref & kIndexMask];
+                                bool hit;
+                                if (laneRandom) {
+                                    LaneRandom lr(laneRandom[k]);
+                                    hit = other.object->hit(r, t_min, closest[k], otherRec);
+                                }
+                                else {
+                                    hit = other.object->hit(r, t_min, closest[k], otherRec);
+                                }
+
+                                if (hit) {
+                                    closest[k] = otherRec.t;
+                                    closestf[k] = (float)otherRec.t;
+                                    closestRef[k] = ref;
+                                    recs[k] = otherRec;
+                                    if (other.flip)
+                                        recs[k].front_face = !recs[k].front_face;
+                                }
+                            }
+                            else
+                            {
+                                double t;
+                                if (intersect(ref, r, t_min, closest[k], t)) {
+                                    closest[k] = t;
+                                    closestf[k] = (float)t;
+                                    closestRef[k] = ref;
+                                }
+                            }
+                        }
+                    }
+                }
+                else
+                {
+                    // Nearest child first, as the first active lane sees it
+                    int lead = 0;
+                    while (!(active & (1 << lead)))
+                        lead++;
+
+                    const float* dir = node.axis == 0 ? packet.dx : node.axis == 1 ? packet.dy : packet.dz;
+
+                    uint32_t first = idx + 1;
+                    uint32_t second = node.offset;
+                    if (dir[lead] < 0)
+                        std::swap(first, second);
+
+                    stack[sp++] = second;
+                    idx = first;
+                    continue;
+                }
+            }
+
+            if (sp == 0)
+                break;
+            idx = stack[--sp];
+        }
+
+        int hits = 0;
+        for (int k = 0; k < RayPacket::kWidth; k++)
+        {
+            if (closestRef[k] == kNoHit)
+                continue;
+
+            hits |= 1 << k;
+            if ((closestRef[k] >> kKindShift) != PRIM_OTHER)
+                fillRecord(closestRef[k], packet.rays[k], closest[k], recs[k]);
+        }
+
+        return hits;
+    }
+
+private:
+    //
+    // Traversal
+    //
+    static inline bool slabHit(const Node& node, const float* o, const float* inv, float tmin, float tmax)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            float t0 = (node.bmin[a] - o[a]) * inv[a];
+            float t1 = (node.bmax[a] - o[a]) * inv[a];
+            if (inv[a] < 0)
+                std::swap(t0, t1);
+
+            // written so a NaN (a ray in the plane of a face) leaves the range alone
+            tmin = t0 > tmin ? t0 : tmin;
+            tmax = t1 < tmax ? t1 : tmax;
+        }
+
+        // A little slack for the float rounding of the slab distances
+        return tmin <= tmax * 1.0000004f;
+    }
+
+    // Same as slabHit, for four rays, giving a bit for each lane that hits
+    static inline int slabHit4(const Node& node, const float4& ox, const float4& oy, const float4& oz,
+        const float4& ix, const float4& iy, const float4& iz, float4 tmin, float4 tmax)
+    {
+        const float4* o[3] = { &ox, &oy, &oz };
+        const float4* inv[3] = { &ix, &iy, &iz };
+
+        for (int a = 0; a < 3; a++)
+        {
+            float4 t0 = (float4(node.bmin[a]) - *o[a]) * *inv[a];
+            float4 t1 = (float4(node.bmax[a]) - *o[a]) * *inv[a];
+
+            // min and max of the pair, then into the range.  The range
+            // goes second, so a NaN leaves it alone, as in slabHit.
+            float4 lo = min4(t0, t1);
+            float4 hi = max4(t0, t1);
+            tmin = max4(lo, tmin);
+            tmax = min4(hi, tmax);
+        }
+
+        return lessEqualMask(tmin, tmax * float4(1.0000004f));
+    }
+
+    // A sphere against four rays at once, in float
+    static inline int intersectSphere4(const SphereData& s, const RayPacket& packet,
+        const float4& t_min, const float4& t_max, float4& t)
+    {
+        const float4 dx = float4::load(packet.dx), dy = float4::load(packet.dy), dz = float4::load(packet.dz);
+        const float4 ocx = float4::load(packet.ox) - float4((float)s.center[0]);
+        const float4 ocy = float4::load(packet.oy) - float4((float)s.center[1]);
+        const float4 ocz = float4::load(packet.oz) - float4((float)s.center[2]);
+        const float4 radius((float)s.radius);
+
+        float4 a = dx * dx + dy * dy + dz * dz;
+        float4 half_b = ocx * dx + ocy * dy + ocz * dz;
+        float4 c = ocx * ocx + ocy * ocy + ocz * ocz - radius * radius;
+        float4 discriminant = half_b * half_b - a * c;
+
+        const float4 zero(0.0f);
+        int positive = lessMask(zero, discriminant);
+        if (!positive)
+            return 0;
+
+        float4 root = sqrt4(max4(discriminant, zero));
+        float4 nearT = (zero - half_b - root) / a;
+        float4 farT = (zero - half_b + root) / a;
+
+        int nearHit = positive & lessMask(nearT, t_max) & lessMask(t_min, nearT);
+        int farHit = positive & ~nearHit & lessMask(farT, t_max) & lessMask(t_min, farT);
+
+        t = select4(nearHit, nearT, farT);
+        return nearHit | farHit;
+    }
+
+    // A rectangle against four rays at once, in float
+    static inline int intersectRect4(const RectData& q, const RayPacket& packet,
+        const float4& t_min, const float4& t_max, float4& t)
+    {
+        float4 ok, dk, oa, da, ob, db;
+        switch (q.plane) {
+        case 0:
+            ok = float4::load(packet.oz); dk = float4::load(packet.dz);
+            oa = float4::load(packet.ox); da = float4::load(packet.dx);
+            ob = float4::load(packet.oy); db = float4::load(packet.dy);
+            break;
+        case 1:
+            ok = float4::load(packet.oy); dk = float4::load(packet.dy);
+            oa = float4::load(packet.ox); da = float4::load(packet.dx);
+            ob = float4::load(packet.oz); db = float4::load(packet.dz);
+            break;
+        default:
+            ok = float4::load(packet.ox); dk = float4::load(packet.dx);
+            oa = float4::load(packet.oy); da = float4::load(packet.dy);
+            ob = float4::load(packet.oz); db = float4::load(packet.dz);
+            break;
+        }
+
+        t = (float4((float)q.k) - ok) / dk;
+        int inRange = lessEqualMask(t_min, t) & lessEqualMask(t, t_max);
+        if (!inRange)
+            return 0;
+
+        float4 a = oa + t * da;
+        float4 b = ob + t * db;
+
+        return inRange
+            & lessEqualMask(float4((float)q.a0), a) & lessEqualMask(a, float4((float)q.a1))
+            & lessEqualMask(float4((float)q.b0), b) & lessEqualMask(b, float4((float)q.b1));
+    }
+
+    uint32_t materialOf(uint32_t ref) const
+    {
+        uint32_t index = ref & kIndexMask;
+        switch (ref >> kKindShift) {
+        case PRIM_SPHERE: return fSpheres[index].material;
+        case PRIM_MOVING_SPHERE: return fMovingSpheres[index].material;
+        default: return fRects[index].material;
+        }
+    }
+
+    static inline bool sphereRoot(const vec3& oc, const vec3& dir, double radius, double t_min, double t_max, double& t)
+    {
+        auto a = dir.lengthSquared();
+        auto half_b = dot(oc, dir);
+        auto c = oc.lengthSquared() - radius * radius;
+
+        auto discriminant = half_b * half_b - a * c;
+        if (discriminant <= 0)
+            return false;
+
+        auto root = sqrt(discriminant);
+
+        auto temp = (-half_b - root) / a;
+        if (temp < t_max && temp > t_min) {
+            t = temp;
+            return true;
+        }
+
+        temp = (-half_b + root) / a;
+        if (temp < t_max && temp > t_min) {
+            t = temp;
+            return true;
+        }
+
+        return false;
+    }
+
+    static inline point3 movingCenter(const MovingSphereData& s, double time)
+    {
+        double f = (time - s.time0) / (s.time1 - s.time0);
+        return point3(s.center0[0] + f * (s.center1[0] - s.center0[0]),
+            s.center0[1] + f * (s.center1[1] - s.center0[1]),
+            s.center0[2] + f * (s.center1[2] - s.center0[2]));
+    }
+
+    // Distance along the ray to a primitive, if it's in range
+    bool intersect(uint32_t ref, const Ray& r, double t_min, double t_max, double& t) const
+    {
+        uint32_t index = ref & kIndexMask;
+
+        switch (ref >> kKindShift)
+        {
+        case PRIM_SPHERE: {
+            const SphereData& s = fSpheres[index];
+            vec3 oc = r.origin() - point3(s.center[0], s.center[1], s.center[2]);
+            return sphereRoot(oc, r.direction(), s.radius, t_min, t_max, t);
+        }
+
+        case PRIM_MOVING_SPHERE: {
+            const MovingSphereData& s = fMovingSpheres[index];
+            vec3 oc = r.origin() - movingCenter(s, r.time());
+            return sphereRoot(oc, r.direction(), s.radius, t_min, t_max, t);
+        }
+
+        case PRIM_RECT: {
+            const RectData& q = fRects[index];
+            const point3 o = r.origin();
+            const vec3 d = r.direction();
+
+            double ok, dk, oa, da, ob, db;
+            switch (q.plane) {
+            case 0: ok = o.z; dk = d.z; oa = o.x; da = d.x; ob = o.y; db = d.y; break;
+            case 1: ok = o.y; dk = d.y; oa = o.x; da = d.x; ob = o.z; db = d.z; break;
+            default: ok = o.x; dk = d.x; oa = o.y; da = d.y; ob = o.z; db = d.z; break;
+            }
+
+            auto tk = (q.k - ok) / dk;
+            if (tk < t_min || tk > t_max)
+                return false;
+
+            auto a = oa + tk * da;
+            auto b = ob + tk * db;
+            if (a < q.a0 || a > q.a1 || b < q.b0 || b > q.b1)
+                return false;
+
+            t = tk;
+            return true;
+        }
+        }
+
+        return false;
+    }
+
+    // Everything else about the closest hit, once it's known
+    void fillRecord(uint32_t ref, const Ray& r, double t, hit_record& rec) const
+    {
+        uint32_t index = ref & kIndexMask;
+        bool flip = false;
+
+        rec.t = t;
+        rec.p = r.at(t);
+
+        switch (ref >> kKindShift)
+        {
+        case PRIM_SPHERE: {
+            const SphereData& s = fSpheres[index];
+            point3 center(s.center[0], s.center[1], s.center[2]);
+            vec3 outward_normal = (rec.p - center) / s.radius;
+            rec.set_face_normal(r, outward_normal);
+            sphere::get_sphere_uv((rec.p - center) / s.radius, rec.u, rec.v);
+            flip = s.flip != 0;
+        }
+        break;
+
+        case PRIM_MOVING_SPHERE: {
+            const MovingSphereData& s = fMovingSpheres[index];
+            vec3 outward_normal = (rec.p - movingCenter(s, r.time())) / s.radius;
+            rec.set_face_normal(r, outward_normal);
+            flip = s.flip != 0;
+        }
+        break;
+
+        case PRIM_RECT: {
+            const RectData& q = fRects[index];
+            double a, b;
+            vec3 outward_normal;
+            switch (q.plane) {
+            case 0: a = rec.p.x; b = rec.p.y; outward_normal = vec3(0, 0, 1); break;
+            case 1: a = rec.p.x; b = rec.p.z; outward_normal = vec3(0, 1, 0); break;
+            default: a = rec.p.y; b = rec.p.z; outward_normal = vec3(1, 0, 0); break;
+            }
+
+            rec.u = (a - q.a0) / (q.a1 - q.a0);
+            rec.v = (b - q.b0) / (q.b1 - q.b0);
+            rec.set_face_normal(r, outward_normal);
+            flip = q.flip != 0;
+        }
+        break;
+        }
+
+        rec.mat_ptr = fMaterials[materialOf(ref)];
+
+        if (flip)
+            rec.front_face = !rec.front_face;
+    }
+
+    //
+    // Gathering the shapes
+    //
+    uint32_t addMaterial(const shared_ptr<material>& m)
+    {
+        auto it = fMaterialIndex.find(m.get());
+        if (it != fMaterialIndex.end())
+            return it->second;
+
+        uint32_t index = (uint32_t)fMaterials.size();
+        fMaterials.push_back(m);
+        fMaterialIndex[m.get()] = index;
+        return index;
+    }
+
+    void gather(const shared_ptr<hittable>& object, bool flip)
+    {
+        if (!object)
+            return;
+
+        if (auto list = std::dynamic_pointer_cast<hittable_list>(object)) {
+            for (const auto& o : list->objects)
+                gather(o, flip);
+        }
+        else if (auto b = std::dynamic_pointer_cast<box>(object)) {
+            for (const auto& o : b->sides.objects)
+                gather(o, flip);
+        }
+        else if (auto node = std::dynamic_pointer_cast<bvh_node>(object)) {
+            gather(node->left, flip);
+            if (node->right != node->left)
+                gather(node->right, flip);
+        }
+        else if (auto ff = std::dynamic_pointer_cast<flip_face>(object)) {
+            gather(ff->ptr, !flip);
+        }
+        else if (auto s = std::dynamic_pointer_cast<sphere>(object)) {
+            const point3& c = s->getCenter();
+            fSpheres.push_back({ { c.x, c.y, c.z }, s->getRadius(), addMaterial(s->getMaterial()), flip ? 1u : 0u });
+        }
+        else if (auto ms = std::dynamic_pointer_cast<moving_sphere>(object)) {
+            fMovingSpheres.push_back({
+                { ms->center0.x, ms->center0.y, ms->center0.z },
+                { ms->center1.x, ms->center1.y, ms->center1.z },
+                ms->time0, ms->time1, ms->radius,
+                addMaterial(ms->mat_ptr), flip ? 1u : 0u });
+        }
+        else if (auto q = std::dynamic_pointer_cast<xy_rect>(object)) {
+            fRects.push_back({ q->x0, q->x1, q->y0, q->y1, q->k, addMaterial(q->mp), 0, (uint16_t)flip });
+        }
+        else if (auto q = std::dynamic_pointer_cast<xz_rect>(object)) {
+            fRects.push_back({ q->x0, q->x1, q->z0, q->z1, q->k, addMaterial(q->mp), 1, (uint16_t)flip });
+        }
+        else if (auto q = std::dynamic_pointer_cast<yz_rect>(object)) {
+            fRects.push_back({ q->y0, q->y1, q->z0, q->z1, q->k, addMaterial(q->mp), 2, (uint16_t)flip });
+        }
+        else {
+            fOthers.push_back({ object, flip });
+        }
+    }
+
+    //
+    // Building the hierarchy
+    //
+    static void setBounds(BuildPrim& p, const aabb& box)
+    {
+        const point3 lo = box.Min();
+        const point3 hi = box.Max();
+        const double l[3] = { lo.x, lo.y, lo.z };
+        const double h[3] = { hi.x, hi.y, hi.z };
+
+        for (int a = 0; a < 3; a++) {
+            // Round outward, so the float box holds the double one
+            p.bmin[a] = std::nextafter((float)l[a], -FLT_MAX);
+            p.bmax[a] = std::nextafter((float)h[a], FLT_MAX);
+            p.centroid[a] = 0.5f * (p.bmin[a] + p.bmax[a]);
+        }
+    }
+
+    void build()
+    {
+        std::vector<BuildPrim> prims;
+        prims.reserve(fSpheres.size() + fMovingSpheres.size() + fRects.size() + fOthers.size());
+
+        std::vector<BuildPrim> unbounded;
+
+        auto add = [&](uint32_t kind, uint32_t index, const aabb& box) {
+            BuildPrim p;
+            setBounds(p, box);
+            p.ref = (kind << kKindShift) | index;
+            prims.push_back(p);
+        };
+
+        for (uint32_t i = 0; i < fSpheres.size(); i++) {
+            const SphereData& s = fSpheres[i];
+            point3 c(s.center[0], s.center[1], s.center[2]);
+            vec3 r(s.radius, s.radius, s.radius);
+            add(PRIM_SPHERE, i, aabb(c - r, c + r));
+        }
+
+        for (uint32_t i = 0; i < fMovingSpheres.size(); i++) {
+            const MovingSphereData& s = fMovingSpheres[i];
+            vec3 r(s.radius, s.radius, s.radius);
+            point3 c0 = movingCenter(s, fTime0);
+            point3 c1 = movingCenter(s, fTime1);
+            add(PRIM_MOVING_SPHERE, i, SurroundingBox(aabb(c0 - r, c0 + r), aabb(c1 - r, c1 + r)));
+        }
+
+        for (uint32_t i = 0; i < fRects.size(); i++) {
+            const RectData& q = fRects[i];
+            switch (q.plane) {
+            case 0: add(PRIM_RECT, i, aabb(point3(q.a0, q.b0, q.k - 0.0001), point3(q.a1, q.b1, q.k + 0.0001))); break;
+            case 1: add(PRIM_RECT, i, aabb(point3(q.a0, q.k - 0.0001, q.b0), point3(q.a1, q.k + 0.0001, q.b1))); break;
+            default: add(PRIM_RECT, i, aabb(point3(q.k - 0.0001, q.a0, q.b0), point3(q.k + 0.0001, q.a1, q.b1))); break;
+            }
+        }
+
+        for (uint32_t i = 0; i < fOthers.size(); i++) {
+            aabb box;
+            if (fOthers[i].object->bounding_box(fTime0, fTime1, box)) {
+                add(PRIM_OTHER, i, box);
+                continue;
+            }
+
+            // Without a box, it could be anywhere
+            BuildPrim p;
+            for (int a = 0; a < 3; a++) {
+                p.bmin[a] = -FLT_MAX;
+                p.bmax[a] = FLT_MAX;
+                p.centroid[a] = 0;
+            }
+            p.ref = (PRIM_OTHER << kKindShift) | i;
+            unbounded.push_back(p);
+        }
+
+        size_t bounded = prims.size();
+        prims.insert(prims.end(), unbounded.begin(), unbounded.end());
+
+        if (prims.empty())
+            return;
+
+        // Things without a box would stretch every box on the way down
+        // to them, and throw off the split costs, so they get a subtree
+        // of their own, beside everything else
+        if (bounded == 0 || bounded == prims.size()) {
+            fNodes = buildRange(prims, 0, prims.size(), 0);
+        }
+        else {
+            std::vector<Node> boundedNodes = buildRange(prims, 0, bounded, 1);
+            std::vector<Node> unboundedNodes = buildRange(prims, bounded, prims.size(), 1);
+
+            Node root{};
+            for (int a = 0; a < 3; a++) {
+                root.bmin[a] = std::min(boundedNodes[0].bmin[a], unboundedNodes[0].bmin[a]);
+                root.bmax[a] = std::max(boundedNodes[0].bmax[a], unboundedNodes[0].bmax[a]);
+            }
+            fNodes = joinNodes(root, boundedNodes, unboundedNodes);
+        }
+
+        // Second child offsets were relative to their parent
+        for (uint32_t i = 0; i < fNodes.size(); i++) {
+            if (fNodes[i].count == 0)
+                fNodes[i].offset += i;
+        }
+
+        fPrimRefs.resize(prims.size());
+        for (size_t i = 0; i < prims.size(); i++)
+            fPrimRefs[i] = prims[i].ref;
+
+        const Node& root = fNodes[0];
+        fBounds = aabb(point3(root.bmin[0], root.bmin[1], root.bmin[2]),
+            point3(root.bmax[0], root.bmax[1], root.bmax[2]));
+    }
+
+    // Which bin a centroid falls in, kept in range even if
+    // the arithmetic overflows, or the centroid isn't a number
+    static int binOf(float centroid, float lo, float scale)
+    {
+        float f = (centroid - lo) * scale;
+        if (!(f > 0))
+            return 0;
+        if (!(f < (float)kBinCount))
+            return kBinCount - 1;
+        return (int)f;
+    }
+
+    // An interior node, followed by its two subtrees
+    static std::vector<Node> joinNodes(Node node, const std::vector<Node>& leftNodes, const std::vector<Node>& rightNodes)
+    {
+        node.offset = (uint32_t)(1 + leftNodes.size());
+        node.count = 0;
+
+        std::vector<Node> nodes;
+        nodes.reserve(1 + leftNodes.size() + rightNodes.size());
+        nodes.push_back(node);
+        nodes.insert(nodes.end(), leftNodes.begin(), leftNodes.end());
+        nodes.insert(nodes.end(), rightNodes.begin(), rightNodes.end());
+
+        return nodes;
+    }
+
+    // Build the nodes for prims[begin, end), in depth first order.
+    // Leaves refer to their primitives by absolute position, second
+    // children by their position relative to their parent.
+    static std::vector<Node> buildRange(std::vector<BuildPrim>& prims, size_t begin, size_t end, int depth)
+    {
+        Bounds bounds;
+        Bounds centroids;
+        for (size_t i = begin; i < end; i++) {
+            bounds.grow(prims[i].bmin, prims[i].bmax);
+            centroids.grow(prims[i].centroid);
+        }
+
+        Node node{};
+        for (int a = 0; a < 3; a++) {
+            node.bmin[a] = bounds.bmin[a];
+            node.bmax[a] = bounds.bmax[a];
+        }
+
+        size_t count = end - begin;
+
+        auto makeLeaf = [&]() {
+            node.offset = (uint32_t)begin;
+            node.count = (uint16_t)count;
+            return std::vector<Node>{ node };
+        };
+
+        if (count <= kMinLeafSize)
+            return makeLeaf();
+
+        // Find the cheapest split, over all three axes
+        int bestAxis = -1;
+        int bestBin = 0;
+        float bestCost = FLT_MAX;
+
+        for (int axis = 0; axis < 3 && depth < kMedianSplitDepth; axis++)
+        {
+            float lo = centroids.bmin[axis];
+            float hi = centroids.bmax[axis];
+            if (!(hi > lo))
+                continue;
+
+            Bounds bins[kBinCount];
+            size_t binCounts[kBinCount] = {};
+            float scale = kBinCount / (hi - lo);
+
+            for (size_t i = begin; i < end; i++) {
+                int b = binOf(prims[i].centroid[axis], lo, scale);
+                bins[b].grow(prims[i].bmin, prims[i].bmax);
+                binCounts[b]++;
+            }
+
+            // Areas and counts of everything to the right of each split
+            float rightArea[kBinCount];
+            size_t rightCount[kBinCount];
+            Bounds right;
+            size_t n = 0;
+            for (int b = kBinCount - 1; b > 0; b--) {
+                right.grow(bins[b].bmin, bins[b].bmax);
+                n += binCounts[b];
+                rightArea[b] = right.area();
+                rightCount[b] = n;
+            }
+
+            Bounds left;
+            n = 0;
+            for (int b = 1; b < kBinCount; b++) {
+                left.grow(bins[b - 1].bmin, bins[b - 1].bmax);
+                n += binCounts[b - 1];
+
+                if (n == 0 || rightCount[b] == 0)
+                    continue;
+
+                float cost = left.area() * n + rightArea[b] * rightCount[b];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        auto middle = prims.begin() + begin;
+
+        if (depth >= kMedianSplitDepth)
+        {
+            if (count <= kMaxLeafSize)
+                return makeLeaf();
+
+            bestAxis = 0;
+            for (int a = 1; a < 3; a++) {
+                if (centroids.bmax[a] - centroids.bmin[a] > centroids.bmax[bestAxis] - centroids.bmin[bestAxis])
+                    bestAxis = a;
+            }
+
+            middle = prims.begin() + begin + count / 2;
+            std::nth_element(prims.begin() + begin, middle, prims.begin() + end,
+                [=](const BuildPrim& a, const BuildPrim& b) { return a.centroid[bestAxis] < b.centroid[bestAxis]; });
+        }
+        else if (bestAxis < 0)
+        {
+            // Every centroid is in the same place, so no split is any
+            // better than another.  Cut the run in half if it's too long.
+            if (count <= kMaxLeafSize)
+                return makeLeaf();
+
+            bestAxis = 0;
+            middle = prims.begin() + begin + count / 2;
+        }
+        else
+        {
+            // Cost of a split, relative to intersecting everything here
+            float area = bounds.area();
+            float splitCost = area > 0 ? 0.5f + bestCost / area : (float)count;
+            if (splitCost >= (float)count && count <= kMaxLeafSize)
+                return makeLeaf();
+
+            float lo = centroids.bmin[bestAxis];
+            float scale = kBinCount / (centroids.bmax[bestAxis] - lo);
+            middle = std::partition(prims.begin() + begin, prims.begin() + end,
+                [=](const BuildPrim& p) {
+                    int b = binOf(p.centroid[bestAxis], lo, scale);
+                    return b < bestBin;
+                });
+        }
+
+        size_t mid = (size_t)(middle - prims.begin());
+        if (mid == begin || mid == end)
+            mid = begin + count / 2;
+
+        node.axis = (uint16_t)bestAxis;
+
+        // The two halves don't share any primitives, so
+        // the big ones near the top can be built at the same time
+        std::vector<Node> leftNodes;
+        std::vector<Node> rightNodes;
+        if (count >= kParallelBuildSize && depth < parallelBuildDepth())
+        {
+            auto leftFuture = std::async(std::launch::async, [&prims, begin, mid, depth]() { return buildRange(prims, begin, mid, depth + 1); });
+            rightNodes = buildRange(prims, mid, end, depth + 1);
+            leftNodes = leftFuture.get();
+        }
+        else
+        {
+            leftNodes = buildRange(prims, begin, mid, depth + 1);
+            rightNodes = buildRange(prims, mid, end, depth + 1);
+        }
+
+        return joinNodes(node, leftNodes, rightNodes);
+    }
+};
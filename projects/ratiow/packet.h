@@ -0,0 +1,157 @@
+#pragma once
+
+/*
+    Ray packets
+
+    Four rays, kept as a structure of arrays, so they can be run
+    through the same steps together, one lane of an SSE register each.
+    Camera rays for neighboring pixels go in much the same direction,
+    and hit much the same things, so they make good packets.
+    Bounced rays go every which way, and are still traced one at a time.
+
+    float4 is just enough of a 4 wide float to write the intersection
+    tests once.  Without SSE2 it's an array, and the compiler does
+    what it can.
+*/
+
+#include "rtweekend.h"
+
+#include <cstdint>
+#include <utility>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define RT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+
+struct float4 {
+#if defined(RT_SSE2)
+    __m128 v;
+
+    float4() : v(_mm_setzero_ps()) {}
+    float4(__m128 x) : v(x) {}
+    explicit float4(float x) : v(_mm_set1_ps(x)) {}
+
+    static float4 load(const float* p) { return float4(_mm_loadu_ps(p)); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+
+    friend float4 operator+(const float4& a, const float4& b) { return _mm_add_ps(a.v, b.v); }
+    friend float4 operator-(const float4& a, const float4& b) { return _mm_sub_ps(a.v, b.v); }
+    friend float4 operator*(const float4& a, const float4& b) { return _mm_mul_ps(a.v, b.v); }
+    friend float4 operator/(const float4& a, const float4& b) { return _mm_div_ps(a.v, b.v); }
+
+    friend float4 min4(const float4& a, const float4& b) { return _mm_min_ps(a.v, b.v); }
+    friend float4 max4(const float4& a, const float4& b) { return _mm_max_ps(a.v, b.v); }
+    friend float4 sqrt4(const float4& a) { return _mm_sqrt_ps(a.v); }
+
+    // Comparisons give a bit per lane
+    friend int lessMask(const float4& a, const float4& b) { return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v)); }
+    friend int lessEqualMask(const float4& a, const float4& b) { return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)); }
+
+    // Lanes of a where the mask bit is set, b elsewhere
+    friend float4 select4(int mask, const float4& a, const float4& b)
+    {
+        const __m128i bits = _mm_set_epi32(8, 4, 2, 1);
+        __m128 m = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(mask), bits), bits));
+        return _mm_or_ps(_mm_and_ps(m, a.v), _mm_andnot_ps(m, b.v));
+    }
+#else
+    float v[4];
+
+    // min and max give b if either is NaN, as SSE does
+    float4() : v{ 0, 0, 0, 0 } {}
+    explicit float4(float x) : v{ x, x, x, x } {}
+
+    static float4 load(const float* p) { float4 r; for (int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+    void store(float* p) const { for (int i = 0; i < 4; i++) p[i] = v[i]; }
+
+    friend float4 operator+(const float4& a, const float4& b) { float4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] + b.v[i]; return r; }
+    friend float4 operator-(const float4& a, const float4& b) { float4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] - b.v[i]; return r; }
+    friend float4 operator*(const float4& a, const float4& b) { float4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] * b.v[i]; return r; }
+    friend float4 operator/(const float4& a, const float4& b) { float4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] / b.v[i]; return r; }
+
+    friend float4 min4(const float4& a, const float4& b) { float4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r; }
+    friend float4 max4(const float4& a, const float4& b) { float4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r; }
+    friend float4 sqrt4(const float4& a) { float4 r; for (int i = 0; i < 4; i++) r.v[i] = std::sqrt(a.v[i]); return r; }
+
+    friend int lessMask(const float4& a, const float4& b) { int m = 0; for (int i = 0; i < 4; i++) m |= (a.v[i] < b.v[i]) << i; return m; }
+    friend int lessEqualMask(const float4& a, const float4& b) { int m = 0; for (int i = 0; i < 4; i++) m |= (a.v[i] <= b.v[i]) << i; return m; }
+
+    friend float4 select4(int mask, const float4& a, const float4& b)
+    {
+        float4 r;
+        for (int i = 0; i < 4; i++) r.v[i] = (mask >> i) & 1 ? a.v[i] : b.v[i];
+        return r;
+    }
+#endif
+};
+
+
+// How precisely the packet kernel intersects spheres and rectangles.
+// Boxes of the hierarchy are always tested in float.
+enum class PacketPrecision {
+    DOUBLE,     // each active lane on its own, exactly as a single ray would be
+    FLOAT,      // four lanes at once, in float
+};
+
+
+struct RayPacket {
+    static constexpr int kWidth = 4;
+
+    // float copies, for the SIMD tests
+    float ox[kWidth], oy[kWidth], oz[kWidth];
+    float dx[kWidth], dy[kWidth], dz[kWidth];
+    float ix[kWidth], iy[kWidth], iz[kWidth];     // 1 / direction
+
+    // the rays themselves, for everything else
+    Ray rays[kWidth];
+    int laneMask = 0;       // which lanes hold a ray
+
+    void set(int lane, const Ray& r)
+    {
+        rays[lane] = r;
+
+        const point3 o = r.origin();
+        const vec3 d = r.direction();
+        ox[lane] = (float)o.x; oy[lane] = (float)o.y; oz[lane] = (float)o.z;
+        dx[lane] = (float)d.x; dy[lane] = (float)d.y; dz[lane] = (float)d.z;
+        ix[lane] = 1.0f / dx[lane];
+        iy[lane] = 1.0f / dy[lane];
+        iz[lane] = 1.0f / dz[lane];
+
+        laneMask |= 1 << lane;
+    }
+
+    // Unused lanes get a copy of a used one, so their
+    // numbers are harmless, and are masked off
+    void fill()
+    {
+        int first = 0;
+        while (first < kWidth && !(laneMask & (1 << first)))
+            first++;
+        if (first == kWidth)
+            return;
+
+        for (int lane = 0; lane < kWidth; lane++) {
+            if (laneMask & (1 << lane))
+                continue;
+
+            rays[lane] = rays[first];
+            ox[lane] = ox[first]; oy[lane] = oy[first]; oz[lane] = oz[first];
+            dx[lane] = dx[first]; dy[lane] = dy[first]; dz[lane] = dz[first];
+            ix[lane] = ix[first]; iy[lane] = iy[first]; iz[lane] = iz[first];
+        }
+    }
+};
+
+
+// Each lane of a packet belongs to a different pixel, and each pixel
+// has its own random numbers.  While one of these is around, the lane's
+// generator is the one random_double() uses.
+struct LaneRandom {
+    rtrandom& fLane;
+
+    LaneRandom(rtrandom& lane) : fLane(lane) { std::swap(random_generator(), fLane); }
+    ~LaneRandom() { std::swap(random_generator(), fLane); }
+};
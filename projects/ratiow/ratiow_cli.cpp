@@ -0,0 +1,282 @@
+/*
+    ratiow_cli
+
+    Render one of the ratiow scenes, without a window, to an image file,
+    using all the cores of the machine, and report how fast it went.
+
+    ratiow_cli [-scene 1] [-width 800] [-height 600] [-spp 100] [-passes 1]
+               [-depth 50] [-threads 0] [-seed 24301] [-accel flat]
+               [-kernel scalar] [-ab] [-out ratiow.bmp]
+
+    -spp is the samples per pixel for each pass, so the finished image
+    has spp * passes samples per pixel.  The image is written after
+    every pass, so a long render can be looked at while it's going.
+
+    Given the same seed, the image is the same no matter how many
+    threads were used.
+
+    -accel picks how the world is searched for ray hits
+        flat - the whole world flattened into one flat_bvh (default)
+        tree - as the scene built it, with a bvh_node over the top
+        none - as the scene built it
+
+    -kernel picks how pixels are sampled (see raykernel.h)
+        scalar - one camera ray at a time (default)
+        packet - camera rays four at a time
+        float  - camera rays four at a time, spheres and rectangles
+                 intersected in float
+
+    -ab renders every scene with each kernel, one pass each, and
+    reports how fast each went, and whether the packet images are
+    the same as the scalar one.  Nothing is written.
+*/
+
+#include "scenes.h"
+#include "renderengine.h"
+#include "flat_bvh.h"
+#include "raykernel.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+
+static bool writeImage(const BLImage& img, const char* filename)
+{
+    // .png, .jpg and .qoi by name, everything else is a .bmp
+    const char* codecName = "BMP";
+    const char* ext = strrchr(filename, '.');
+    if (ext != nullptr) {
+        if (strcmp(ext, ".png") == 0) codecName = "PNG";
+        else if (strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0) codecName = "JPEG";
+        else if (strcmp(ext, ".qoi") == 0) codecName = "QOI";
+    }
+
+    BLImageCodec codec;
+    if (codec.findByName(codecName) != BL_SUCCESS)
+        return false;
+
+    return img.writeToFile(filename, codec) == BL_SUCCESS;
+}
+
+static void usage()
+{
+    printf("ratiow_cli [-scene 1-%d] [-width 800] [-height 600] [-spp 100] [-passes 1]\n", SCENE_COUNT);
+    printf("           [-depth 50] [-threads 0] [-seed 24301] [-accel flat|tree|none]\n");
+    printf("           [-kernel scalar|packet|float] [-ab] [-out ratiow.bmp]\n");
+}
+
+static bool parseKernel(const std::string& name, RayKernel& kernel, PacketPrecision& precision)
+{
+    precision = PacketPrecision::DOUBLE;
+    if (name == "scalar") kernel = RayKernel::SCALAR;
+    else if (name == "packet") kernel = RayKernel::PACKET;
+    else if (name == "float") { kernel = RayKernel::PACKET; precision = PacketPrecision::FLOAT; }
+    else return false;
+    return true;
+}
+
+static bool imagesIdentical(const BLImage& a, const BLImage& b)
+{
+    BLImageData da{};
+    BLImageData db{};
+    a.getData(&da);
+    b.getData(&db);
+
+    if ((da.size.w != db.size.w) || (da.size.h != db.size.h))
+        return false;
+
+    size_t rowBytes = (size_t)da.size.w * 4;
+    for (int y = 0; y < da.size.h; y++)
+    {
+        const uint8_t* rowA = (const uint8_t*)da.pixelData + (intptr_t)y * da.stride;
+        const uint8_t* rowB = (const uint8_t*)db.pixelData + (intptr_t)y * db.stride;
+        if (memcmp(rowA, rowB, rowBytes) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+// Every scene, with each kernel, through the same flat_bvh
+static int runAB(int width, int height, int spp, int maxDepth, unsigned threadCount, uint64_t seed)
+{
+    static const char* kernelNames[] = { "scalar", "packet", "float" };
+    const int kernelCount = 3;
+
+    printf("%dx%d, %d spp, depth %d, %u threads\n\n", width, height, spp, maxDepth, threadCount);
+    printf("%-6s", "scene");
+    for (int k = 0; k < kernelCount; k++)
+        printf(" %10s", kernelNames[k]);
+    printf("   same  (Mrays/s)\n");
+
+    for (int sceneNumber = 1; sceneNumber <= SCENE_COUNT; sceneNumber++)
+    {
+        random_seed(seed);
+
+        SceneDescription scene;
+        if (!scene_by_number(sceneNumber, scene))
+            continue;
+
+        hittable_list world;
+        world.add(make_shared<flat_bvh>(scene.world, 0.0, 1.0));
+
+        RenderEngine engine(width, height, maxDepth);
+        engine.setWorld(world);
+        engine.setCamera(scene.camera((double)width / height));
+        engine.setBackground(scene.background);
+        engine.setSeed(seed);
+
+        BLImage images[kernelCount];
+        double mrays[kernelCount];
+
+        for (int k = 0; k < kernelCount; k++)
+        {
+            RayKernel kernel;
+            PacketPrecision precision;
+            parseKernel(kernelNames[k], kernel, precision);
+            engine.setKernel(kernel, precision);
+
+            auto start = std::chrono::steady_clock::now();
+            uint64_t rays = engine.renderPass(spp, threadCount);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            mrays[k] = rays / seconds / 1.0e6;
+            engine.resolve(images[k]);
+        }
+
+        printf("%-6d", sceneNumber);
+        for (int k = 0; k < kernelCount; k++)
+            printf(" %10.2f", mrays[k]);
+        printf("   %s %s\n",
+            imagesIdentical(images[0], images[1]) ? "yes" : "NO ",
+            imagesIdentical(images[0], images[2]) ? "yes" : "NO ");
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int sceneNumber = 1;
+    int width = 800;
+    int height = 0;
+    int spp = 100;
+    int passes = 1;
+    int maxDepth = 50;
+    unsigned threadCount = 0;
+    uint64_t seed = 24301;
+    std::string accel = "flat";
+    std::string kernelName = "scalar";
+    bool abTest = false;
+    std::string outName = "ratiow.bmp";
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if (strcmp(arg, "-scene") == 0 && hasValue) sceneNumber = atoi(argv[++i]);
+        else if (strcmp(arg, "-width") == 0 && hasValue) width = atoi(argv[++i]);
+        else if (strcmp(arg, "-height") == 0 && hasValue) height = atoi(argv[++i]);
+        else if (strcmp(arg, "-spp") == 0 && hasValue) spp = atoi(argv[++i]);
+        else if (strcmp(arg, "-passes") == 0 && hasValue) passes = atoi(argv[++i]);
+        else if (strcmp(arg, "-depth") == 0 && hasValue) maxDepth = atoi(argv[++i]);
+        else if (strcmp(arg, "-threads") == 0 && hasValue) threadCount = (unsigned)atoi(argv[++i]);
+        else if (strcmp(arg, "-seed") == 0 && hasValue) seed = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(arg, "-accel") == 0 && hasValue) accel = argv[++i];
+        else if (strcmp(arg, "-kernel") == 0 && hasValue) kernelName = argv[++i];
+        else if (strcmp(arg, "-ab") == 0) abTest = true;
+        else if (strcmp(arg, "-out") == 0 && hasValue) outName = argv[++i];
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (height <= 0)
+        height = width * 3 / 4;
+
+    RayKernel kernel;
+    PacketPrecision precision;
+    if (width < 2 || height < 2 || spp < 1 || passes < 1 || !parseKernel(kernelName, kernel, precision)) {
+        usage();
+        return 1;
+    }
+
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    if (abTest)
+        return runAB(width, height, spp, maxDepth, threadCount, seed);
+
+    // Scenes are built with random numbers too, so
+    // seed before building, to get the same scene every time
+    random_seed(seed);
+
+    SceneDescription scene;
+    if (!scene_by_number(sceneNumber, scene)) {
+        printf("unknown scene: %d\n", sceneNumber);
+        usage();
+        return 1;
+    }
+
+    auto buildStart = std::chrono::steady_clock::now();
+    hittable_list world;
+    if (accel == "flat") {
+        auto bvh = make_shared<flat_bvh>(scene.world, 0.0, 1.0);
+        printf("flat_bvh: %zu primitives, %zu nodes\n", bvh->primitiveCount(), bvh->nodeCount());
+        world.add(bvh);
+    }
+    else if (accel == "tree") {
+        world.add(make_shared<bvh_node>(scene.world, 0.0, 1.0));
+    }
+    else if (accel == "none") {
+        world = scene.world;
+    }
+    else {
+        usage();
+        return 1;
+    }
+    double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+    printf("%s acceleration, built in %.3f s\n", accel.c_str(), buildSeconds);
+
+    RenderEngine engine(width, height, maxDepth);
+    engine.setWorld(world);
+    engine.setCamera(scene.camera((double)width / height));
+    engine.setBackground(scene.background);
+    engine.setSeed(seed);
+    engine.setKernel(kernel, precision);
+
+    printf("scene %d, %dx%d, %d spp x %d passes, depth %d, %u threads, %s kernel\n",
+        sceneNumber, width, height, spp, passes, maxDepth, threadCount, kernelName.c_str());
+
+    BLImage img(width, height, BL_FORMAT_PRGB32);
+    uint64_t totalRays = 0;
+    double totalSeconds = 0;
+
+    for (int pass = 0; pass < passes; pass++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t rays = engine.renderPass(spp, threadCount);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        totalRays += rays;
+        totalSeconds += seconds;
+
+        engine.resolve(img);
+        if (!writeImage(img, outName.c_str())) {
+            printf("could not write: %s\n", outName.c_str());
+            return 1;
+        }
+
+        printf("pass %d: %.3f s, %.2f Mrays/s\n", pass + 1, seconds, rays / seconds / 1.0e6);
+    }
+
+    printf("total: %llu rays, %.3f s, %.2f Mrays/s, %d spp -> %s\n",
+        (unsigned long long)totalRays, totalSeconds, totalRays / totalSeconds / 1.0e6,
+        engine.samplesPerPixel(), outName.c_str());
+
+    return 0;
+}
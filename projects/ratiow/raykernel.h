@@ -0,0 +1,162 @@
+#pragma once
+
+/*
+    Ray kernels
+
+    The part of rendering that turns a few pixels into colors, shared
+    by RayTracer and RenderEngine, so either can be switched between
+
+        SCALAR - one camera ray at a time, as it always was
+        PACKET - the camera rays of four neighboring pixels at once,
+                 through a flat_bvh, with flat_bvh::hitPacket()
+
+    Only the camera rays go in packets.  Once a ray bounces, it goes
+    its own way, and the rest of its path is traced one ray at a time.
+
+    Each pixel of a packet has its own random generator, used for
+    everything that pixel does, so a pixel gets the same random
+    numbers, and the same color, whichever kernel sampled it.  The one
+    exception is constant_medium; it draws random numbers when it's hit,
+    and the packet visits things in a slightly different order.
+*/
+
+#include "rtweekend.h"
+#include "camera.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "flat_bvh.h"
+#include "packet.h"
+
+
+enum class RayKernel {
+    SCALAR,
+    PACKET,
+};
+
+
+struct PixelSampler {
+    const hittable* world = nullptr;
+    const flat_bvh* packetWorld = nullptr;      // needed for PACKET, else SCALAR is used
+    const Camera* camera = nullptr;
+    rtcolor background{ 0, 0, 0 };
+    int maxDepth = 50;
+    int width = 1;
+    int height = 1;
+    RayKernel kernel = RayKernel::SCALAR;
+    PacketPrecision precision = PacketPrecision::DOUBLE;
+
+    // Each segment of the path a sample takes counts as a ray
+    rtcolor ray_color(const Ray& r, int depth, uint64_t& rays) const
+    {
+        hit_record rec;
+
+        if (depth <= 0)
+            return rtcolor(0, 0, 0);
+
+        rays++;
+        if (!world->hit(r, 0.001, infinity, rec))
+            return background;
+
+        return shade(r, rec, depth, rays);
+    }
+
+    // The color for a ray that's known to have hit rec
+    rtcolor shade(const Ray& r, const hit_record& rec, int depth, uint64_t& rays) const
+    {
+        Ray scattered;
+        rtcolor attenuation;
+        rtcolor emitted = rec.mat_ptr->emitted(rec.u, rec.v, rec.p);
+
+        if (!rec.mat_ptr->scatter(r, rec, attenuation, scattered))
+            return emitted;
+
+        return emitted + (attenuation * ray_color(scattered, depth - 1, rays));
+    }
+
+    // Sum spp samples for each of count (up to four) pixels of one row,
+    // starting at x.  row is counted from the bottom, as the camera does.
+    // If seeds is given, pixel k's random numbers are seeded with seeds[k],
+    // otherwise they carry on from the thread's generator.
+    // Returns the number of rays.
+    uint64_t samplePixels(int x, int row, int count, int spp, const uint64_t* seeds, rtcolor* colors) const
+    {
+        uint64_t rays = 0;
+
+        if (kernel == RayKernel::SCALAR || packetWorld == nullptr)
+        {
+            for (int k = 0; k < count; k++)
+            {
+                if (seeds)
+                    random_seed(seeds[k]);
+
+                rtcolor pixel_color(0, 0, 0);
+                for (int s = 0; s < spp; ++s)
+                    pixel_color += ray_color(cameraRay(x + k, row), maxDepth, rays);
+                colors[k] = pixel_color;
+            }
+
+            return rays;
+        }
+
+        rtrandom lanes[RayPacket::kWidth];
+        for (int k = 0; k < count; k++) {
+            lanes[k].reseed(seeds ? seeds[k] : random_generator().next());
+            colors[k] = rtcolor(0, 0, 0);
+        }
+
+        hit_record recs[RayPacket::kWidth];
+
+        for (int s = 0; s < spp; ++s)
+        {
+            RayPacket packet;
+            for (int k = 0; k < count; k++) {
+                LaneRandom lr(lanes[k]);
+                packet.set(k, cameraRay(x + k, row));
+            }
+            packet.fill();
+
+            int hits = maxDepth > 0
+                ? packetWorld->hitPacket(packet, 0.001, infinity, recs, precision, lanes)
+                : 0;
+
+            for (int k = 0; k < count; k++)
+            {
+                if (maxDepth <= 0)
+                    continue;
+
+                rays++;
+                if (!(hits & (1 << k))) {
+                    colors[k] += background;
+                    continue;
+                }
+
+                LaneRandom lr(lanes[k]);
+                colors[k] += shade(packet.rays[k], recs[k], maxDepth, rays);
+            }
+        }
+
+        return rays;
+    }
+
+private:
+    Ray cameraRay(int x, int row) const
+    {
+        auto u = (x + random_double()) / ((double)width - 1);
+        auto v = (row + random_double()) / ((double)height - 1);
+        return camera->get_ray(u, v);
+    }
+};
+
+
+// The flat_bvh to trace packets through; the world itself if it's
+// just a flat_bvh, otherwise a new one built over it.
+inline shared_ptr<flat_bvh> packet_world(const hittable_list& world, double time0 = 0.0, double time1 = 1.0)
+{
+    if (world.objects.size() == 1) {
+        auto bvh = std::dynamic_pointer_cast<flat_bvh>(world.objects[0]);
+        if (bvh)
+            return bvh;
+    }
+
+    return make_shared<flat_bvh>(world, time0, time1);
+}
@@ -7,6 +7,7 @@
 #include "box.h"
 #include "camera.h"
 #include "hittable_list.h"
+#include "raykernel.h"
 
 #include "canvas.h"
 
@@ -21,6 +22,9 @@ class RayTracer {
     Camera fCamera;
     hittable_list fWorld;
     rtcolor fBackground;
+    RayKernel fKernel = RayKernel::SCALAR;
+    PacketPrecision fPrecision = PacketPrecision::DOUBLE;
+    shared_ptr<flat_bvh> fPacketWorld;
 
 public:
     RayTracer()
@@ -58,6 +62,18 @@ public:
     void setWorld(hittable_list &world)
     {
         fWorld = world;
+        fPacketWorld = nullptr;
+
+        setKernel(fKernel, fPrecision);
+    }
+
+    RayKernel getKernel() const { return fKernel; }
+    void setKernel(RayKernel kernel, PacketPrecision precision = PacketPrecision::DOUBLE)
+    {
+        fKernel = kernel;
+        fPrecision = precision;
+        if (fKernel == RayKernel::PACKET && !fPacketWorld)
+            fPacketWorld = packet_world(fWorld);
 
         reset();
     }
@@ -99,27 +115,6 @@ public:
         fCanvas.set(x, y, p);
     }
 
-    rtcolor ray_color(const Ray& r, const rtcolor& bkgnd, int depth) {
-        hit_record rec;
-
-        // If we've exceeded the ray bounce limit, no more light is gathered.
-        if (depth <= 0)
-            return rtcolor(0, 0, 0);
-
-        // If the ray hits nothing, return the bkgnd rtcolor.
-        if (!fWorld.hit(r, 0.001, infinity, rec))
-            return bkgnd;
-
-        Ray scattered;
-        rtcolor attenuation;
-        rtcolor emitted = rec.mat_ptr->emitted(rec.u, rec.v, rec.p);
-
-        if (!rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-            return emitted;
-
-        return emitted + (attenuation * ray_color(scattered, bkgnd, depth - 1));
-    }
-
     bool renderRow()
     {
         //printf("renderRow: %d\n", fCurrentRow);
@@ -127,16 +122,26 @@ public:
         if (fCurrentRow < 0)
             return false;
 
-        for (int i = 0; i < fFrameWidth; ++i)
+        PixelSampler ps;
+        ps.world = &fWorld;
+        ps.packetWorld = fPacketWorld.get();
+        ps.camera = &fCamera;
+        ps.background = fBackground;
+        ps.maxDepth = fMaxDepth;
+        ps.width = (int)fFrameWidth;
+        ps.height = (int)fFrameHeight;
+        ps.kernel = fKernel;
+        ps.precision = fPrecision;
+
+        for (int i = 0; i < fFrameWidth; i += RayPacket::kWidth)
         {
-            rtcolor pixel_color;
-            for (int s = 0; s < fSamplesPerPixel; ++s) {
-                auto u = (i + random_double()) / ((double)fFrameWidth - 1);
-                auto v = (fCurrentRow + random_double()) / ((double)fFrameHeight - 1);
-                Ray r = fCamera.get_ray(u, v);
-                pixel_color += ray_color(r, fBackground, fMaxDepth);
-            }
-            setPixel(i, fCurrentRow, pixel_color);     // Set pixel
+            int count = std::min(RayPacket::kWidth, (int)fFrameWidth - i);
+
+            rtcolor colors[RayPacket::kWidth];
+            ps.samplePixels(i, fCurrentRow, count, fSamplesPerPixel, nullptr, colors);
+
+            for (int k = 0; k < count; k++)
+                setPixel(i + k, fCurrentRow, colors[k]);     // Set pixel
         }
 
         fCurrentRow = fCurrentRow - 1;
@@ -0,0 +1,252 @@
+#pragma once
+
+/*
+    RenderEngine
+
+    Renders a scene using all the cores of the machine.
+
+    The image is cut into square tiles.  Each thread starts out
+    owning an equal share of the tiles, and when it runs out of
+    its own, it steals from the other threads, so no thread sits
+    idle while there's work left.
+
+    Rendering is progressive.  Each call to renderPass() adds some
+    more samples to every pixel, into an accumulation buffer, and
+    resolve() turns what's been accumulated so far into an image.
+
+    Before a pixel is sampled, the random generator of the thread
+    doing the work is seeded from the pixel's location and the
+    pass number, so the image is the same no matter how many
+    threads rendered it, or which thread got which tile.
+
+    The pixels themselves are sampled by a ray kernel (raykernel.h);
+    with RayKernel::PACKET, four pixels of a row are sampled together.
+*/
+
+#include "rtweekend.h"
+#include "camera.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "raykernel.h"
+
+#include "blend2d.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+class RenderEngine {
+    // A contiguous run of tiles, that a thread works its way through
+    // from the front.  Thieves take from the front as well, so
+    // taking a tile is the same single atomic add for everyone.
+    struct alignas(64) TileRange {
+        std::atomic<uint32_t> next{ 0 };
+        uint32_t end{ 0 };
+    };
+
+    int fWidth;
+    int fHeight;
+    int fTileSize;
+    int fMaxDepth;
+    uint64_t fSeed = 0x5eed;
+
+    Camera fCamera;
+    hittable_list fWorld;
+    rtcolor fBackground{ 0, 0, 0 };
+
+    RayKernel fKernel = RayKernel::SCALAR;
+    PacketPrecision fPrecision = PacketPrecision::DOUBLE;
+    shared_ptr<flat_bvh> fPacketWorld;      // built when the packet kernel is first wanted
+
+    std::vector<rtcolor> fAccum;    // sum of all samples, per pixel
+    int fPasses = 0;
+    int fSamples = 0;               // samples per pixel, so far
+
+public:
+    RenderEngine(const int w, const int h, const int maxDepth = 50, const int tileSize = 32)
+        : fWidth(w),
+        fHeight(h),
+        fTileSize(tileSize),
+        fMaxDepth(maxDepth),
+        fAccum((size_t)w * h)
+    {
+    }
+
+    int width() const { return fWidth; }
+    int height() const { return fHeight; }
+    int passes() const { return fPasses; }
+    int samplesPerPixel() const { return fSamples; }
+
+    void setSeed(uint64_t seed) { fSeed = seed; reset(); }
+    void setBackground(const rtcolor& c) { fBackground = c; reset(); }
+    void setCamera(const Camera& cam) { fCamera = cam; reset(); }
+    void setWorld(const hittable_list& world) { fWorld = world; fPacketWorld = nullptr; setKernel(fKernel, fPrecision); }
+
+    RayKernel kernel() const { return fKernel; }
+    void setKernel(RayKernel kernel, PacketPrecision precision = PacketPrecision::DOUBLE)
+    {
+        fKernel = kernel;
+        fPrecision = precision;
+        if (fKernel == RayKernel::PACKET && !fPacketWorld)
+            fPacketWorld = packet_world(fWorld);
+        reset();
+    }
+
+    // Throw away everything accumulated so far
+    void reset()
+    {
+        std::fill(fAccum.begin(), fAccum.end(), rtcolor(0, 0, 0));
+        fPasses = 0;
+        fSamples = 0;
+    }
+
+    PixelSampler sampler() const
+    {
+        PixelSampler ps;
+        ps.world = &fWorld;
+        ps.packetWorld = fPacketWorld.get();
+        ps.camera = &fCamera;
+        ps.background = fBackground;
+        ps.maxDepth = fMaxDepth;
+        ps.width = fWidth;
+        ps.height = fHeight;
+        ps.kernel = fKernel;
+        ps.precision = fPrecision;
+        return ps;
+    }
+
+    // Add samples to every pixel of a tile.  Returns the number of rays.
+    uint64_t renderTile(int tileIndex, int spp)
+    {
+        int tilesAcross = (fWidth + fTileSize - 1) / fTileSize;
+        int x0 = (tileIndex % tilesAcross) * fTileSize;
+        int y0 = (tileIndex / tilesAcross) * fTileSize;
+        int x1 = std::min(x0 + fTileSize, fWidth);
+        int y1 = std::min(y0 + fTileSize, fHeight);
+
+        const PixelSampler ps = sampler();
+        uint64_t rays = 0;
+
+        for (int y = y0; y < y1; y++)
+        {
+            // Image rows go down, the camera's v goes up
+            int row = fHeight - 1 - y;
+
+            for (int x = x0; x < x1; x += RayPacket::kWidth)
+            {
+                int count = std::min(RayPacket::kWidth, x1 - x);
+
+                uint64_t seeds[RayPacket::kWidth];
+                rtcolor colors[RayPacket::kWidth];
+                for (int k = 0; k < count; k++)
+                    seeds[k] = random_pixel_seed(fSeed, x + k, y, fPasses);
+
+                rays += ps.samplePixels(x, row, count, spp, seeds, colors);
+
+                for (int k = 0; k < count; k++)
+                    fAccum[(size_t)y * fWidth + x + k] += colors[k];
+            }
+        }
+
+        return rays;
+    }
+
+    // Add spp samples to every pixel, using threadCount threads,
+    // or all the hardware has, if 0.  Returns the number of rays traced.
+    uint64_t renderPass(int spp, unsigned threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        int tilesAcross = (fWidth + fTileSize - 1) / fTileSize;
+        int tilesDown = (fHeight + fTileSize - 1) / fTileSize;
+        uint32_t tileCount = (uint32_t)(tilesAcross * tilesDown);
+
+        threadCount = std::min(threadCount, tileCount);
+
+        std::vector<TileRange> ranges(threadCount);
+        for (unsigned i = 0; i < threadCount; i++)
+        {
+            ranges[i].next = (uint32_t)((uint64_t)tileCount * i / threadCount);
+            ranges[i].end = (uint32_t)((uint64_t)tileCount * (i + 1) / threadCount);
+        }
+
+        std::atomic<uint64_t> totalRays{ 0 };
+
+        auto worker = [&](unsigned self) {
+            uint64_t rays = 0;
+
+            // Our own tiles first, then everyone else's
+            for (unsigned n = 0; n < threadCount; n++)
+            {
+                TileRange& range = ranges[(self + n) % threadCount];
+                while (true)
+                {
+                    uint32_t tile = range.next.fetch_add(1, std::memory_order_relaxed);
+                    if (tile >= range.end)
+                        break;
+
+                    rays += renderTile((int)tile, spp);
+                }
+            }
+
+            totalRays += rays;
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < threadCount; i++)
+            threads.emplace_back(worker, i);
+
+        worker(0);
+
+        for (auto& t : threads)
+            t.join();
+
+        fPasses++;
+        fSamples += spp;
+
+        return totalRays;
+    }
+
+    // Turn the accumulated samples into pixels; averaged,
+    // and gamma corrected for gamma=2.0
+    void resolve(BLImage& img) const
+    {
+        BLImageData data{};
+        if (img.width() != fWidth || img.height() != fHeight)
+            img.create(fWidth, fHeight, BL_FORMAT_PRGB32);
+        img.makeMutable(&data);
+
+        auto scale = fSamples > 0 ? 1.0 / fSamples : 0.0;
+
+        for (int y = 0; y < fHeight; y++)
+        {
+            uint32_t* pixels = (uint32_t*)((uint8_t*)data.pixelData + (intptr_t)y * data.stride);
+
+            for (int x = 0; x < fWidth; x++)
+            {
+                const rtcolor& c = fAccum[(size_t)y * fWidth + x];
+
+                auto r = c.r;
+                auto g = c.g;
+                auto b = c.b;
+
+                // Replace NaN components with zero.
+                if (r != r) r = 0.0;
+                if (g != g) g = 0.0;
+                if (b != b) b = 0.0;
+
+                r = sqrt(scale * r);
+                g = sqrt(scale * g);
+                b = sqrt(scale * b);
+
+                uint32_t ri = static_cast<uint32_t>(256 * clamp(r, 0.0, 0.999));
+                uint32_t gi = static_cast<uint32_t>(256 * clamp(g, 0.0, 0.999));
+                uint32_t bi = static_cast<uint32_t>(256 * clamp(b, 0.0, 0.999));
+
+                pixels[x] = 0xff000000 | (ri << 16) | (gi << 8) | bi;
+            }
+        }
+    }
+};
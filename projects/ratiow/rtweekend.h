@@ -10,6 +10,7 @@
 //==============================================================================================
 
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <limits>
 #include <memory>
@@ -37,10 +38,80 @@ inline double clamp(double x, double min, double max)
     return x;
 }
 
+// Random Numbers
+//
+// Every thread has its own generator (xoshiro256**), so there is
+// no locking, and no sharing, as there was with rand().
+// The renderer reseeds the generator for each pixel, from the
+// pixel's location and the pass number, so an image comes
+// out the same, no matter how many threads render it.
+
+// splitmix64, used to spread a seed across the generator state
+inline uint64_t splitmix64(uint64_t& x)
+{
+    uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+struct rtrandom
+{
+    uint64_t s[4];
+
+    rtrandom(uint64_t seed = 0x5eed) { reseed(seed); }
+
+    void reseed(uint64_t seed)
+    {
+        s[0] = splitmix64(seed);
+        s[1] = splitmix64(seed);
+        s[2] = splitmix64(seed);
+        s[3] = splitmix64(seed);
+    }
+
+    static inline uint64_t rotl(const uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    uint64_t next()
+    {
+        const uint64_t result = rotl(s[1] * 5, 7) * 9;
+        const uint64_t t = s[1] << 17;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+
+        return result;
+    }
+
+    // A real in [0,1), from the top 53 bits
+    double nextDouble() { return (next() >> 11) * 0x1.0p-53; }
+};
+
+inline rtrandom& random_generator()
+{
+    thread_local rtrandom gen;
+    return gen;
+}
+
+inline void random_seed(uint64_t seed) { random_generator().reseed(seed); }
+
+// A seed for one pixel, of one pass, of an image
+inline uint64_t random_pixel_seed(uint64_t imageSeed, int x, int y, int pass)
+{
+    uint64_t h = imageSeed;
+    h ^= splitmix64(h) + (uint64_t)(uint32_t)x;
+    h ^= splitmix64(h) + ((uint64_t)(uint32_t)y << 32);
+    h ^= splitmix64(h) + (uint64_t)(uint32_t)pass;
+    return splitmix64(h);
+}
+
 inline double random_double() 
 {
     // Returns a random real in [0,1).
-    return rand() / (RAND_MAX + 1.0);
+    return random_generator().nextDouble();
 }
 
 inline double random_double(double min, double max) 
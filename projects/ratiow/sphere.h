@@ -10,6 +10,7 @@ class sphere : public hittable {
     double radius;
     shared_ptr<material> mat_ptr;
 
+public:
     // Given a point on a sphere
 // figure out the u,v for texture mapping
     static void get_sphere_uv(const point3& p, double& u, double& v)
@@ -25,6 +26,10 @@ public:
     sphere(point3 cen, double r, shared_ptr<material> m)
         : center(cen), radius(r), mat_ptr(m) {};
 
+    const point3& getCenter() const { return center; }
+    double getRadius() const { return radius; }
+    const shared_ptr<material>& getMaterial() const { return mat_ptr; }
+
     // Hit testing
     // Determine where on the sphere a ray hits
     // return false if the ray misses the sphere
@@ -97,6 +97,12 @@ struct MiniRV32IMAState
 
 MINIRV32_DECORATE int32_t MiniRV32IMAStep(struct MiniRV32IMAState* state, uint8_t* image, uint32_t vProcAddress, uint32_t elapsedUs, int count);
 
+// The two halves of MiniRV32IMAStep()
+// Tick advances the timer, and returns 1 if the processor is waiting for an interrupt.
+// Run executes up to count instructions, without touching the timer.
+MINIRV32_DECORATE int32_t MiniRV32IMATick(struct MiniRV32IMAState* state, uint32_t elapsedUs);
+MINIRV32_DECORATE int32_t MiniRV32IMARun(struct MiniRV32IMAState* state, uint8_t* image, uint32_t vProcAddress, int count);
+
 #ifdef MINIRV32_IMPLEMENTATION
 
 #define CSR( x ) state->x
@@ -105,6 +111,14 @@ MINIRV32_DECORATE int32_t MiniRV32IMAStep(struct MiniRV32IMAState* state, uint8_
 #define REGSET( x, val ) { state->regs[x] = val; }
 
 MINIRV32_DECORATE int32_t MiniRV32IMAStep(struct MiniRV32IMAState* state, uint8_t* image, uint32_t vProcAddress, uint32_t elapsedUs, int count)
+{
+	if (MiniRV32IMATick(state, elapsedUs))
+		return 1;
+
+	return MiniRV32IMARun(state, image, vProcAddress, count);
+}
+
+MINIRV32_DECORATE int32_t MiniRV32IMATick(struct MiniRV32IMAState* state, uint32_t elapsedUs)
 {
 	uint32_t new_timer = CSR(timerl) + elapsedUs;
 	if (new_timer < CSR(timerl)) CSR(timerh)++;
@@ -123,6 +137,13 @@ MINIRV32_DECORATE int32_t MiniRV32IMAStep(struct MiniRV32IMAState* state, uint8_
 	if (CSR(extraflags) & 4)
 		return 1;
 
+	return 0;
+}
+
+MINIRV32_DECORATE int32_t MiniRV32IMARun(struct MiniRV32IMAState* state, uint8_t* image, uint32_t vProcAddress, int count)
+{
+	(void)vProcAddress;	// Only there to match MiniRV32IMAStep()
+
 	int icount;
 
 	for (icount = 0; icount < count; icount++)
@@ -0,0 +1,556 @@
+//
+// rv32bench
+// Runs RISC-V programs on mini-rv32ima, with the plain interpreter,
+// then through the block cache, checks they end up in exactly the
+// same state, and reports MIPS for each.
+//
+//   rv32bench [-loops 20000]
+//   rv32bench -f Image [-b dtb] [-m 64M] [-until "# "] [-c maxInstructions]
+//
+// With no image, a set of small test programs is built in memory.
+// With -f, a Linux kernel image is booted headless, until the UART
+// has printed the -until string (a shell prompt, by default).
+//
+// Time is driven by the instruction count rather than the clock (like
+// -l in rv32imac), so both runs see the timer interrupts at the same
+// instructions, and can be compared byte for byte.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "default64mbdtc.h"
+
+static uint32_t ram_amt = 64 * 1024 * 1024;
+
+static std::string uartOut;
+static uint32_t HandleControlStore(uint32_t addy, uint32_t val);
+static uint32_t HandleControlLoad(uint32_t addy);
+
+#define MINIRV32_DECORATE static
+#define MINI_RV32_RAM_SIZE ram_amt
+#define MINIRV32_IMPLEMENTATION
+#define MINIRV32_HANDLE_MEM_STORE_CONTROL( addy, val ) if( HandleControlStore( addy, val ) ) return val;
+#define MINIRV32_HANDLE_MEM_LOAD_CONTROL( addy, rval ) rval = HandleControlLoad( addy );
+
+#include "mini-rv32ima.h"
+#include "rv32blocks.h"
+
+// A 16550 with nothing to read, writing into uartOut
+static uint32_t HandleControlStore(uint32_t addy, uint32_t val)
+{
+	if (addy == 0x10000000)
+		uartOut.push_back((char)val);
+	return 0;
+}
+
+static uint32_t HandleControlLoad(uint32_t addy)
+{
+	if (addy == 0x10000005)
+		return 0x60;
+	return 0;
+}
+
+// Just enough of an assembler to write the test programs
+namespace as
+{
+	enum : uint32_t {
+		zero = 0, ra = 1, sp = 2, t0 = 5, t1 = 6, t2 = 7, s0 = 8, s1 = 9,
+		a0 = 10, a1 = 11, a2 = 12, a3 = 13, a4 = 14, a5 = 15,
+		s2 = 18, s3 = 19, s4 = 20, s5 = 21, t3 = 28, t4 = 29, t5 = 30, t6 = 31,
+	};
+
+	enum : uint32_t { CSR_MSTATUS = 0x300, CSR_MIE = 0x304, CSR_MTVEC = 0x305, CSR_MIP = 0x344 };
+
+	static uint32_t R(uint32_t f7, uint32_t rs2, uint32_t rs1, uint32_t f3, uint32_t rd, uint32_t opc) { return (f7 << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | opc; }
+	static uint32_t I(int32_t imm, uint32_t rs1, uint32_t f3, uint32_t rd, uint32_t opc) { return ((uint32_t)imm << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | opc; }
+	static uint32_t S(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t f3) { return (((uint32_t)imm >> 5) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (((uint32_t)imm & 0x1f) << 7) | 0b0100011; }
+
+	static uint32_t B(int32_t off, uint32_t rs2, uint32_t rs1, uint32_t f3)
+	{
+		uint32_t o = (uint32_t)off;
+		return (((o >> 12) & 1) << 31) | (((o >> 5) & 0x3f) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (((o >> 1) & 0xf) << 8) | (((o >> 11) & 1) << 7) | 0b1100011;
+	}
+
+	static uint32_t J(int32_t off, uint32_t rd)
+	{
+		uint32_t o = (uint32_t)off;
+		return (((o >> 20) & 1) << 31) | (((o >> 1) & 0x3ff) << 21) | (((o >> 11) & 1) << 20) | (((o >> 12) & 0xff) << 12) | (rd << 7) | 0b1101111;
+	}
+
+	struct Program
+	{
+		std::vector<uint32_t> words;
+		std::vector<int> labels;				// word index each label is at
+		struct Fix { int at; int label; bool jal; };
+		std::vector<Fix> fixes;
+
+		int here() const { return (int)words.size(); }
+		int label() { labels.push_back(-1); return (int)labels.size() - 1; }
+		void bind(int l) { labels[l] = here(); }
+		void emit(uint32_t w) { words.push_back(w); }
+
+		void addi(uint32_t rd, uint32_t rs1, int32_t imm) { emit(I(imm & 0xfff, rs1, 0, rd, 0b0010011)); }
+		void andi(uint32_t rd, uint32_t rs1, int32_t imm) { emit(I(imm & 0xfff, rs1, 7, rd, 0b0010011)); }
+		void xori(uint32_t rd, uint32_t rs1, int32_t imm) { emit(I(imm & 0xfff, rs1, 4, rd, 0b0010011)); }
+		void slli(uint32_t rd, uint32_t rs1, int32_t sh) { emit(I(sh, rs1, 1, rd, 0b0010011)); }
+		void srli(uint32_t rd, uint32_t rs1, int32_t sh) { emit(I(sh, rs1, 5, rd, 0b0010011)); }
+		void srai(uint32_t rd, uint32_t rs1, int32_t sh) { emit(I(0x400 | sh, rs1, 5, rd, 0b0010011)); }
+		void add(uint32_t rd, uint32_t rs1, uint32_t rs2) { emit(R(0, rs2, rs1, 0, rd, 0b0110011)); }
+		void sub(uint32_t rd, uint32_t rs1, uint32_t rs2) { emit(R(0x20, rs2, rs1, 0, rd, 0b0110011)); }
+		void xor_(uint32_t rd, uint32_t rs1, uint32_t rs2) { emit(R(0, rs2, rs1, 4, rd, 0b0110011)); }
+		void or_(uint32_t rd, uint32_t rs1, uint32_t rs2) { emit(R(0, rs2, rs1, 6, rd, 0b0110011)); }
+		void sltu(uint32_t rd, uint32_t rs1, uint32_t rs2) { emit(R(0, rs2, rs1, 3, rd, 0b0110011)); }
+		void sra(uint32_t rd, uint32_t rs1, uint32_t rs2) { emit(R(0x20, rs2, rs1, 5, rd, 0b0110011)); }
+		void mul(uint32_t rd, uint32_t rs1, uint32_t rs2) { emit(R(1, rs2, rs1, 0, rd, 0b0110011)); }
+		void mulh(uint32_t rd, uint32_t rs1, uint32_t rs2) { emit(R(1, rs2, rs1, 1, rd, 0b0110011)); }
+		void div(uint32_t rd, uint32_t rs1, uint32_t rs2) { emit(R(1, rs2, rs1, 4, rd, 0b0110011)); }
+		void remu(uint32_t rd, uint32_t rs1, uint32_t rs2) { emit(R(1, rs2, rs1, 7, rd, 0b0110011)); }
+		void lui(uint32_t rd, uint32_t imm) { emit((imm & 0xfffff000) | (rd << 7) | 0b0110111); }
+		void auipc(uint32_t rd, uint32_t imm) { emit((imm & 0xfffff000) | (rd << 7) | 0b0010111); }
+		void lw(uint32_t rd, uint32_t rs1, int32_t imm) { emit(I(imm & 0xfff, rs1, 2, rd, 0b0000011)); }
+		void lb(uint32_t rd, uint32_t rs1, int32_t imm) { emit(I(imm & 0xfff, rs1, 0, rd, 0b0000011)); }
+		void lhu(uint32_t rd, uint32_t rs1, int32_t imm) { emit(I(imm & 0xfff, rs1, 5, rd, 0b0000011)); }
+		void sw(uint32_t rs2, uint32_t rs1, int32_t imm) { emit(S(imm & 0xfff, rs2, rs1, 2)); }
+		void sh(uint32_t rs2, uint32_t rs1, int32_t imm) { emit(S(imm & 0xfff, rs2, rs1, 1)); }
+		void sb(uint32_t rs2, uint32_t rs1, int32_t imm) { emit(S(imm & 0xfff, rs2, rs1, 0)); }
+		void jalr(uint32_t rd, uint32_t rs1, int32_t imm) { emit(I(imm & 0xfff, rs1, 0, rd, 0b1100111)); }
+		void ret() { jalr(zero, ra, 0); }
+		void csrw(uint32_t csr, uint32_t rs1) { emit(I(csr, rs1, 1, zero, 0b1110011)); }
+		void csrsi(uint32_t csr, uint32_t imm) { emit(I(csr, imm, 6, zero, 0b1110011)); }
+		void csrc(uint32_t csr, uint32_t rs1) { emit(I(csr, rs1, 3, zero, 0b1110011)); }
+		void mret() { emit(0x30200073); }
+		void wfi() { emit(0x10500073); }
+		void fence_i() { emit(0x0000100f); }
+		void amoadd(uint32_t rd, uint32_t rs2, uint32_t rs1) { emit(R(0, rs2, rs1, 2, rd, 0b0101111)); }
+
+		void li(uint32_t rd, uint32_t value)
+		{
+			uint32_t lo = value & 0xfff;
+			uint32_t hi = value - (uint32_t)((int32_t)(lo << 20) >> 20);
+			lui(rd, hi);
+			addi(rd, rd, (int32_t)lo);
+		}
+
+		void branch(uint32_t f3, uint32_t rs1, uint32_t rs2, int l) { fixes.push_back({ here(), l, false }); emit(B(0, rs2, rs1, f3)); }
+		void beq(uint32_t rs1, uint32_t rs2, int l) { branch(0, rs1, rs2, l); }
+		void bne(uint32_t rs1, uint32_t rs2, int l) { branch(1, rs1, rs2, l); }
+		void blt(uint32_t rs1, uint32_t rs2, int l) { branch(4, rs1, rs2, l); }
+		void bltu(uint32_t rs1, uint32_t rs2, int l) { branch(6, rs1, rs2, l); }
+		void jal(uint32_t rd, int l) { fixes.push_back({ here(), l, true }); emit(J(0, rd)); }
+		void j(int l) { jal(zero, l); }
+
+		// la, for labels
+		void la(uint32_t rd, int l) { fixes.push_back({ here(), l, false }); auipc(rd, 0); addi(rd, rd, 0); }
+
+		void uartPut(char c) { li(t0, 0x10000000); li(t1, (uint8_t)c); sb(t1, t0, 0); }
+		void poweroff() { li(t0, 0x11100000); li(t1, 0x5555); sw(t1, t0, 0); }
+
+		std::vector<uint32_t> finish()
+		{
+			for (auto& f : fixes)
+			{
+				int32_t off = (labels[f.label] - f.at) * 4;
+				uint32_t& w = words[f.at];
+				if ((w & 0x7f) == 0b0010111) {
+					// auipc/addi pair
+					uint32_t lo = (uint32_t)off & 0xfff;
+					uint32_t hi = (uint32_t)off - (uint32_t)((int32_t)(lo << 20) >> 20);
+					w |= hi & 0xfffff000;
+					words[f.at + 1] |= lo << 20;
+				}
+				else if (f.jal)
+					w = J(off, (w >> 7) & 0x1f);
+				else
+					w = B(off, (w >> 20) & 0x1f, (w >> 15) & 0x1f, (w >> 12) & 7);
+			}
+			return words;
+		}
+	};
+}
+
+struct TestProgram {
+	const char* name;
+	std::vector<uint32_t> words;
+};
+
+static const uint32_t kData = 0x80040000;
+
+// Integer arithmetic, including multiply and divide
+static TestProgram alu(int loops)
+{
+	using namespace as;
+	Program pr;
+	int loop = pr.label();
+
+	pr.li(s0, loops);
+	pr.li(t0, 12345);
+	pr.li(t1, 0x9e3779b9);
+	pr.li(t3, 0);
+	pr.bind(loop);
+	pr.mul(t0, t0, t1);
+	pr.addi(t0, t0, 7);
+	pr.srli(t2, t0, 3);
+	pr.xor_(t1, t1, t2);
+	pr.slli(t2, t1, 5);
+	pr.sra(t2, t2, s0);
+	pr.mulh(t4, t0, t2);
+	pr.or_(t2, t2, s0);
+	pr.div(t5, t0, t2);
+	pr.remu(t6, t1, t2);
+	pr.add(t3, t3, t5);
+	pr.sub(t3, t3, t6);
+	pr.sltu(t4, t3, t0);
+	pr.add(t3, t3, t4);
+	pr.addi(s0, s0, -1);
+	pr.bne(s0, zero, loop);
+	pr.uartPut('a');
+	pr.poweroff();
+	return { "alu", pr.finish() };
+}
+
+// Filling and summing an array, with words, halves and bytes
+static TestProgram memory(int loops)
+{
+	using namespace as;
+	Program pr;
+	int outer = pr.label(), fill = pr.label(), sum = pr.label();
+
+	pr.li(s0, std::max(1, loops / 64));
+	pr.li(s3, 0);
+	pr.bind(outer);
+	pr.li(a0, kData);
+	pr.li(a1, 256);
+	pr.bind(fill);
+	pr.mul(t0, a1, s0);
+	pr.sw(t0, a0, 0);
+	pr.sh(a1, a0, 4);
+	pr.sb(s0, a0, 6);
+	pr.addi(a0, a0, 8);
+	pr.addi(a1, a1, -1);
+	pr.bne(a1, zero, fill);
+	pr.li(a0, kData);
+	pr.li(a1, 256);
+	pr.bind(sum);
+	pr.lw(t0, a0, 0);
+	pr.lhu(t1, a0, 4);
+	pr.lb(t2, a0, 6);
+	pr.add(s3, s3, t0);
+	pr.xor_(s3, s3, t1);
+	pr.add(s3, s3, t2);
+	pr.addi(a0, a0, 8);
+	pr.addi(a1, a1, -1);
+	pr.bne(a1, zero, sum);
+	pr.addi(s0, s0, -1);
+	pr.bne(s0, zero, outer);
+	pr.uartPut('m');
+	pr.poweroff();
+	return { "memory", pr.finish() };
+}
+
+// Recursive fib, lots of calls and returns through a stack
+static TestProgram calls(int loops)
+{
+	using namespace as;
+	Program pr;
+	int again = pr.label(), fib = pr.label(), small = pr.label();
+
+	pr.li(sp, 0x80080000);
+	pr.li(s0, std::max(1, loops / 400));
+	pr.bind(again);
+	pr.li(a0, 18);
+	pr.jal(ra, fib);
+	pr.add(s3, s3, a0);
+	pr.addi(s0, s0, -1);
+	pr.bne(s0, zero, again);
+	pr.uartPut('c');
+	pr.poweroff();
+
+	// a0 = fib(a0)
+	pr.bind(fib);
+	pr.li(t0, 2);
+	pr.blt(a0, t0, small);
+	pr.addi(sp, sp, -12);
+	pr.sw(ra, sp, 0);
+	pr.sw(a0, sp, 4);
+	pr.addi(a0, a0, -1);
+	pr.jal(ra, fib);
+	pr.sw(a0, sp, 8);
+	pr.lw(a0, sp, 4);
+	pr.addi(a0, a0, -2);
+	pr.jal(ra, fib);
+	pr.lw(t0, sp, 8);
+	pr.add(a0, a0, t0);
+	pr.lw(ra, sp, 0);
+	pr.addi(sp, sp, 12);
+	pr.bind(small);
+	pr.ret();
+	return { "calls", pr.finish() };
+}
+
+// Rewrites the immediate of one of its own instructions each time around
+static TestProgram selfModifying(int loops)
+{
+	using namespace as;
+	Program pr;
+	int loop = pr.label(), target = pr.label();
+
+	pr.li(s0, std::max(1, loops / 4));
+	pr.la(s1, target);
+	pr.lw(s2, s1, 0);			// addi t3, t3, 0
+	pr.li(t3, 0);
+	pr.bind(loop);
+	pr.andi(t0, s0, 0x7ff);
+	pr.slli(t0, t0, 20);
+	pr.or_(t0, t0, s2);
+	pr.sw(t0, s1, 0);
+	pr.fence_i();
+	pr.bind(target);
+	pr.addi(t3, t3, 0);			// patched
+	pr.addi(s0, s0, -1);
+	pr.bne(s0, zero, loop);
+	pr.uartPut('s');
+	pr.poweroff();
+	return { "selfmodifying", pr.finish() };
+}
+
+// Timer interrupts, WFI, CSRs and an atomic, in among some arithmetic
+static TestProgram interrupts(int loops)
+{
+	using namespace as;
+	Program pr;
+	int handler = pr.label(), loop = pr.label(), work = pr.label(), finished = pr.label();
+
+	pr.la(t0, handler);
+	pr.csrw(CSR_MTVEC, t0);
+	pr.li(s1, 0x11004000);			// CLINT timer match
+	pr.li(s2, 0x1100bff8);			// CLINT timer
+	pr.lw(t0, s2, 0);
+	pr.addi(t0, t0, 2000);
+	pr.sw(zero, s1, 4);
+	pr.sw(t0, s1, 0);
+	pr.li(t0, 0x80);
+	pr.csrw(CSR_MIE, t0);
+	pr.csrsi(CSR_MSTATUS, 8);
+	pr.li(s3, 0);
+	pr.li(s4, kData);
+	pr.li(s5, std::max(2, loops / 1000));
+
+	pr.bind(loop);
+	pr.li(t2, 300);
+	pr.bind(work);
+	pr.mul(t3, t3, t2);
+	pr.addi(t3, t3, 1);
+	pr.addi(t2, t2, -1);
+	pr.bne(t2, zero, work);
+	pr.wfi();
+	pr.blt(s3, s5, loop);
+	pr.j(finished);
+
+	pr.bind(handler);
+	pr.addi(s3, s3, 1);
+	pr.li(a0, 1);
+	pr.amoadd(a1, a0, s4);
+	pr.li(a2, 0x10000000);
+	pr.li(a3, '.');
+	pr.sb(a3, a2, 0);
+	pr.lw(a0, s2, 0);
+	pr.addi(a0, a0, 2000);
+	pr.sw(a0, s1, 0);
+	pr.li(a0, 0x80);
+	pr.csrc(CSR_MIP, a0);
+	pr.mret();
+
+	pr.bind(finished);
+	pr.uartPut('i');
+	pr.poweroff();
+	return { "interrupts", pr.finish() };
+}
+
+struct Machine {
+	std::vector<uint8_t> ram;
+	MiniRV32IMAState* core = nullptr;
+};
+
+static void setup(Machine& m, const std::vector<uint8_t>& image, const std::vector<uint8_t>& dtb)
+{
+	m.ram.assign(ram_amt, 0);
+	memcpy(m.ram.data(), image.data(), image.size());
+
+	uint32_t dtb_ptr = 0;
+	if (!dtb.empty())
+	{
+		dtb_ptr = ram_amt - (uint32_t)dtb.size() - sizeof(MiniRV32IMAState);
+		memcpy(m.ram.data() + dtb_ptr, dtb.data(), dtb.size());
+
+		// the default dtb has the RAM size in it, as rv32imac patches it
+		uint32_t* d = (uint32_t*)(m.ram.data() + dtb_ptr);
+		if (dtb.size() == sizeof(default64mbdtb) && d[0x13c / 4] == 0x00c0ff03)
+		{
+			uint32_t validram = dtb_ptr;
+			d[0x13c / 4] = (validram >> 24) | (((validram >> 16) & 0xff) << 8) | (((validram >> 8) & 0xff) << 16) | ((validram & 0xff) << 24);
+		}
+	}
+
+	m.core = (MiniRV32IMAState*)(m.ram.data() + ram_amt - sizeof(MiniRV32IMAState));
+	m.core->pc = MINIRV32_RAM_IMAGE_OFFSET;
+	m.core->regs[10] = 0;
+	m.core->regs[11] = dtb_ptr ? dtb_ptr + MINIRV32_RAM_IMAGE_OFFSET : 0;
+	m.core->extraflags |= 3;
+}
+
+struct RunResult {
+	uint64_t instructions = 0;
+	double seconds = 0;
+	int32_t ret = 0;
+	std::string output;
+	RV32BlockCache* cache = nullptr;
+};
+
+// Runs until poweroff, a fault, maxInstructions, or until appears on the UART
+static RunResult run(Machine& m, RV32BlockCache* cache, uint64_t maxInstructions, const char* until)
+{
+	RunResult r;
+	uartOut.clear();
+
+	const int perStep = 1024;
+	uint64_t lastTime = 0;
+	uint64_t* cycles = (uint64_t*)&m.core->cyclel;
+	size_t checked = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	while (*cycles < maxInstructions)
+	{
+		uint32_t elapsedUs = (uint32_t)(*cycles - lastTime);
+		lastTime += elapsedUs;
+
+		int32_t ret = cache ? MiniRV32IMAStepBlocks(cache, m.core, m.ram.data(), 0, elapsedUs, perStep)
+			: MiniRV32IMAStep(m.core, m.ram.data(), 0, elapsedUs, perStep);
+
+		if (ret == 1) {
+			*cycles += perStep;			// waiting for an interrupt; let time pass
+			continue;
+		}
+		if (ret != 0) {
+			r.ret = ret;
+			break;
+		}
+
+		if (until && uartOut.size() > checked)
+		{
+			size_t from = checked > 64 ? checked - 64 : 0;
+			checked = uartOut.size();
+			if (uartOut.find(until, from) != std::string::npos)
+				break;
+		}
+	}
+	r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	r.instructions = *cycles;
+	r.output = uartOut;
+	return r;
+}
+
+static std::vector<uint8_t> toBytes(const std::vector<uint32_t>& words)
+{
+	std::vector<uint8_t> bytes(words.size() * 4);
+	memcpy(bytes.data(), words.data(), bytes.size());
+	return bytes;
+}
+
+static bool readFile(const char* filename, std::vector<uint8_t>& data)
+{
+	std::ifstream f(filename, std::ios::binary);
+	if (!f)
+		return false;
+	data.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	return !f.bad();
+}
+
+// Runs image both ways, reports, and returns true if they match
+static bool compare(const char* name, const std::vector<uint8_t>& image, const std::vector<uint8_t>& dtb, uint64_t maxInstructions, const char* until)
+{
+	Machine ref, fast;
+
+	setup(ref, image, dtb);
+	RunResult a = run(ref, nullptr, maxInstructions, until);
+
+	RV32BlockCache cache(ram_amt);
+	setup(fast, image, dtb);
+	RunResult b = run(fast, &cache, maxInstructions, until);
+
+	bool same = a.instructions == b.instructions && a.ret == b.ret && a.output == b.output && ref.ram == fast.ram;
+
+	printf("%-14s %12llu %10.1f %10.1f %7.1fx   %-4s %8llu %8llu %6llu\n", name, (unsigned long long)a.instructions,
+		a.instructions / a.seconds / 1e6, b.instructions / b.seconds / 1e6, a.seconds / b.seconds, same ? "yes" : "NO",
+		(unsigned long long)cache.blocksDecoded, (unsigned long long)cache.interpreted, (unsigned long long)cache.pagesInvalidated);
+
+	if (!same) {
+		printf("  ref: %llu instructions, returned %d, pc %08x, output \"%s\"\n", (unsigned long long)a.instructions, a.ret, ref.core->pc, a.output.c_str());
+		printf("  blk: %llu instructions, returned %d, pc %08x, output \"%s\"\n", (unsigned long long)b.instructions, b.ret, fast.core->pc, b.output.c_str());
+	}
+	return same;
+}
+
+static void usage()
+{
+	printf("rv32bench [-loops 20000]\n");
+	printf("rv32bench -f Image [-b dtb] [-m 64M] [-until \"# \"] [-c maxInstructions]\n");
+}
+
+int main(int argc, char** argv)
+{
+	int loops = 20000;
+	const char* imageFile = nullptr;
+	const char* dtbFile = nullptr;
+	const char* until = "# ";
+	uint64_t maxInstructions = UINT64_MAX;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = (i + 1 < argc);
+
+		if ((strcmp(argv[i], "-loops") == 0) && hasValue) loops = std::max(1, atoi(argv[++i]));
+		else if ((strcmp(argv[i], "-f") == 0) && hasValue) imageFile = argv[++i];
+		else if ((strcmp(argv[i], "-b") == 0) && hasValue) dtbFile = argv[++i];
+		else if ((strcmp(argv[i], "-m") == 0) && hasValue) ram_amt = (uint32_t)strtoul(argv[++i], nullptr, 0) << (strchr(argv[i], 'M') ? 20 : 0);
+		else if ((strcmp(argv[i], "-until") == 0) && hasValue) until = argv[++i];
+		else if ((strcmp(argv[i], "-c") == 0) && hasValue) maxInstructions = strtoull(argv[++i], nullptr, 0);
+		else { usage(); return 1; }
+	}
+
+	printf("%-14s %12s %10s %10s %8s   %-4s %8s %8s %6s\n", "program", "instructions", "interp MIPS", "block MIPS", "speedup", "same", "blocks", "interp", "pages");
+
+	bool ok = true;
+	if (imageFile)
+	{
+		std::vector<uint8_t> image, dtb;
+		if (!readFile(imageFile, image) || image.size() > ram_amt) {
+			printf("%s: could not load\n", imageFile);
+			return 1;
+		}
+		if (dtbFile == nullptr)
+			dtb.assign(default64mbdtb, default64mbdtb + sizeof(default64mbdtb));
+		else if (strcmp(dtbFile, "disable") != 0 && !readFile(dtbFile, dtb)) {
+			printf("%s: could not load\n", dtbFile);
+			return 1;
+		}
+
+		ok = compare("linux boot", image, dtb, maxInstructions, until);
+	}
+	else
+	{
+		ram_amt = 1024 * 1024;
+
+		TestProgram programs[] = { alu(loops), memory(loops), calls(loops), selfModifying(loops), interrupts(loops) };
+		for (auto& p : programs)
+			ok &= compare(p.name, toBytes(p.words), {}, UINT64_MAX, nullptr);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,605 @@
+#pragma once
+
+// A basic block cache for mini-rv32ima
+//
+// MiniRV32IMAStep() decodes every instruction from scratch, each time
+// it's run.  MiniRV32IMAStepBlocks() runs the same machine, to the same
+// results, but decodes straight runs of instructions once, into blocks
+// of micro-ops, and keeps them in a cache keyed by PC.
+//
+// Only the everyday instructions become micro-ops; integer arithmetic,
+// branches and jumps, and loads and stores to RAM.  A block ends at the
+// first branch or jump, at the end of a 4K page, or just before anything
+// else (CSRs, ECALL, MRET, WFI, atomics, ...).  Those are left to
+// MiniRV32IMARun(), one at a time, as are loads and stores that turn out
+// not to be to RAM, and everything while a timer interrupt is waiting
+// to be taken.  So traps, interrupts and the memory mapped devices,
+// including the MINIRV32_HANDLE_* hooks, all stay in one place.
+//
+// Loads and stores to RAM are a single bounds check, then a memcpy.
+//
+// Blocks are kept in a 2 way set associative cache of 64K slots, so two
+// hot blocks whose PCs are 128K apart don't keep throwing each other out.
+// A new block goes in the first way, and what was there moves to the
+// second.  Each block remembers where it last went to, on each of its
+// two exits, so following a loop or a call doesn't need a lookup.
+//
+// Every word that's been decoded is marked, in a bitmap.  A store to
+// one throws away all the blocks in its 4K page, by bumping the page's
+// generation, so self modifying code (and the kernel loading programs)
+// works, while data that shares a page with code costs nothing.  If RAM
+// is changed from outside the emulator (loading a new image, say), call
+// invalidate().
+//
+// Every store to RAM also marks its page dirty, for anything that wants
+// to know what's changed (snapshots, say); see clearDirty().
+//
+// MINIRV32_POSTEXEC is called after each micro-op too, with the same pc
+// the interpreter would pass, the instruction word read back from RAM,
+// and a trap of 0, since micro-ops never trap.
+//
+// Include after mini-rv32ima.h, with MINIRV32_IMPLEMENTATION, then:
+//	RV32BlockCache blocks(ram_amt);
+//	int ret = MiniRV32IMAStepBlocks(&blocks, core, ram_image, 0, elapsedUs, 1024);
+//
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(MINIRV32_NO_COMPUTED_GOTO)
+#define RV32_COMPUTED_GOTO 1
+#endif
+
+enum RV32UopKind : uint8_t {
+	RV_NOP,			// fences, and arithmetic into x0
+	RV_LI,			// LUI and AUIPC, worked out when decoded
+	RV_ADDI, RV_SLTI, RV_SLTIU, RV_XORI, RV_ORI, RV_ANDI, RV_SLLI, RV_SRLI, RV_SRAI,
+	RV_ADD, RV_SUB, RV_SLL, RV_SLT, RV_SLTU, RV_XOR, RV_SRL, RV_SRA, RV_OR, RV_AND,
+	RV_MUL, RV_MULH, RV_MULHSU, RV_MULHU, RV_DIV, RV_DIVU, RV_REM, RV_REMU,
+	RV_LB, RV_LH, RV_LW, RV_LBU, RV_LHU,
+	RV_SB, RV_SH, RV_SW,
+	RV_BEQ, RV_BNE, RV_BLT, RV_BGE, RV_BLTU, RV_BGEU,	// these, and the jumps, end a block
+	RV_JAL, RV_JALR,
+	RV_KIND_COUNT,
+};
+
+struct RV32Uop {
+	uint8_t kind;
+	uint8_t rd;
+	uint8_t rs1;
+	uint8_t rs2;
+	uint32_t imm;		// immediate, or for branches and JAL, the target
+};
+
+struct RV32Block {
+	uint32_t pc = 1;			// 1 is never a valid PC, so an empty slot
+	uint32_t gen = 0;			// page generation when decoded
+	uint32_t first = 0;			// index of the first micro-op
+	uint32_t len = 0;			// 0 if the first instruction is left to the interpreter
+	RV32Block* next[2]{};		// where it went last; fell through (or branch not taken), taken
+};
+
+struct RV32BlockCache
+{
+	static constexpr uint32_t kSlotBits = 16;
+	static constexpr uint32_t kWays = 2;
+	static constexpr uint32_t kSetMask = (1u << kSlotBits) / kWays - 1;
+	static constexpr uint32_t kMaxOps = 1 << 20;
+	static constexpr uint32_t kMaxBlock = 64;
+	static constexpr uint32_t kPageBits = 12;
+
+	uint32_t ramSize;
+	std::unique_ptr<RV32Block[]> slots;
+	std::unique_ptr<RV32Uop[]> ops;
+	uint32_t opCount = 0;
+	std::unique_ptr<uint32_t[]> pageGen;
+	std::unique_ptr<uint8_t[]> codeBits;		// a bit per word of RAM that's been decoded
+	std::unique_ptr<uint8_t[]> dirtyPages;		// a byte per page stored to since clearDirty()
+
+	// what it's been up to
+	uint64_t blocksDecoded = 0;
+	uint64_t pagesInvalidated = 0;
+	uint64_t flushes = 0;
+	uint64_t interpreted = 0;
+
+	RV32BlockCache(uint32_t ramBytes)
+		: ramSize(ramBytes)
+		, slots(new RV32Block[1u << kSlotBits])
+		, ops(new RV32Uop[kMaxOps])
+		, pageGen(new uint32_t[(ramBytes >> kPageBits) + 1]())
+		, codeBits(new uint8_t[(ramBytes >> 5) + 1]())
+		, dirtyPages(new uint8_t[(ramBytes >> kPageBits) + 1]())
+	{
+	}
+
+	// Forget every block
+	void invalidate()
+	{
+		for (uint32_t i = 0; i < (1u << kSlotBits); i++)
+			slots[i] = RV32Block{};
+		memset(codeBits.get(), 0, (ramSize >> 5) + 1);
+		opCount = 0;
+		flushes++;
+	}
+
+	void invalidatePage(uint32_t page)
+	{
+		pageGen[page]++;
+		memset(&codeBits[(page << kPageBits) >> 5], 0, std::min<uint32_t>(1u << (kPageBits - 5), ((ramSize >> 5) + 1) - ((page << kPageBits) >> 5)));
+		pagesInvalidated++;
+	}
+
+	uint32_t pageCount() const { return (ramSize + (1u << kPageBits) - 1) >> kPageBits; }
+	bool isDirty(uint32_t page) const { return dirtyPages[page] != 0; }
+	void clearDirty() { memset(dirtyPages.get(), 0, (ramSize >> kPageBits) + 1); }
+
+	// A page was replaced from outside; throw away anything decoded from it
+	void pageReplaced(uint32_t page)
+	{
+		const uint32_t first = (page << kPageBits) >> 5;
+		const uint32_t count = std::min<uint32_t>(1u << (kPageBits - 5), ((ramSize >> 5) + 1) - first);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			if (codeBits[first + i]) {
+				invalidatePage(page);
+				break;
+			}
+		}
+	}
+
+	// Has anything in the size bytes at ofs (from the start of RAM) been decoded?
+	bool isCode(uint32_t ofs, uint32_t size) const
+	{
+		const uint32_t first = ofs >> 2, last = (ofs + size - 1) >> 2;
+		return ((codeBits[first >> 3] >> (first & 7)) | (codeBits[last >> 3] >> (last & 7))) & 1;
+	}
+
+	// Note a store of size (up to 4) bytes at ofs
+	// Returns true if it was over code, which has now been thrown away
+	bool written(uint32_t ofs, uint32_t size)
+	{
+		if (ofs >= ramSize - 3)
+			return false;
+
+		dirtyPages[ofs >> kPageBits] = 1;
+		dirtyPages[(ofs + size - 1) >> kPageBits] = 1;
+		if (!isCode(ofs, size))
+			return false;
+
+		invalidatePage(ofs >> kPageBits);
+		if (((ofs + size - 1) >> kPageBits) != (ofs >> kPageBits))
+			invalidatePage((ofs + size - 1) >> kPageBits);
+		return true;
+	}
+
+	// The block starting at pc, decoding it if need be
+	// nullptr if pc isn't somewhere instructions can be fetched from
+	RV32Block* lookup(uint32_t pc, const uint8_t* image)
+	{
+		uint32_t ofs = pc - MINIRV32_RAM_IMAGE_OFFSET;
+		if (ofs >= ramSize || (ofs & 3))
+			return nullptr;
+
+		RV32Block* set = &slots[((pc >> 2) & kSetMask) * kWays];
+		const uint32_t gen = pageGen[ofs >> kPageBits];
+		if (set[0].pc == pc && set[0].gen == gen)
+			return &set[0];
+		if (set[1].pc == pc && set[1].gen == gen)
+			return &set[1];
+
+		// Anything that links to either just fails isCurrent()
+		// and comes back through here
+		set[1] = set[0];
+		decode(set[0], pc, image);
+
+		return &set[0];
+	}
+
+	bool isCurrent(const RV32Block* b, uint32_t pc) const
+	{
+		return b && b->pc == pc && b->gen == pageGen[(pc - MINIRV32_RAM_IMAGE_OFFSET) >> kPageBits];
+	}
+
+	void decode(RV32Block& b, uint32_t pc, const uint8_t* image)
+	{
+		if (opCount + kMaxBlock > kMaxOps)
+			invalidate();
+
+		uint32_t ofs = pc - MINIRV32_RAM_IMAGE_OFFSET;
+		const uint32_t page = ofs >> kPageBits;
+		const uint32_t end = std::min((page + 1) << kPageBits, ramSize & ~3u);
+
+		b.pc = pc;
+		b.gen = pageGen[page];
+		b.first = opCount;
+		b.next[0] = b.next[1] = nullptr;
+
+		uint32_t len = 0;
+		for (; ofs < end && len < kMaxBlock; ofs += 4, pc += 4)
+		{
+			uint32_t ir;
+			memcpy(&ir, image + ofs, 4);
+
+			RV32Uop& op = ops[opCount + len];
+			int form = decodeOp(ir, pc, op);
+			if (form == 0)
+				break;
+			codeBits[ofs >> 5] |= 1 << ((ofs >> 2) & 7);
+			len++;
+			if (form == 2)
+				break;
+		}
+
+		b.len = len;
+		opCount += len;
+		blocksDecoded++;
+	}
+
+	// Returns 0 if the instruction is left to the interpreter,
+	// 1 for a micro-op, 2 for a micro-op that ends a block.
+	// The corner cases follow MiniRV32IMARun(), rather than the spec.
+	static int decodeOp(uint32_t ir, uint32_t pc, RV32Uop& op)
+	{
+		const uint8_t rd = (ir >> 7) & 0x1f;
+		const uint32_t funct3 = (ir >> 12) & 0x7;
+		const uint32_t immI = (uint32_t)((int32_t)ir >> 20);
+
+		op.kind = RV_NOP;
+		op.rd = rd;
+		op.rs1 = (ir >> 15) & 0x1f;
+		op.rs2 = (ir >> 20) & 0x1f;
+		op.imm = 0;
+
+		switch (ir & 0x7f)
+		{
+		case 0b0110111: // LUI
+			op.kind = rd ? RV_LI : RV_NOP;
+			op.imm = ir & 0xfffff000;
+			return 1;
+
+		case 0b0010111: // AUIPC
+			op.kind = rd ? RV_LI : RV_NOP;
+			op.imm = pc + (ir & 0xfffff000);
+			return 1;
+
+		case 0b1101111: // JAL
+		{
+			uint32_t reladdy = ((ir & 0x80000000) >> 11) | ((ir & 0x7fe00000) >> 20) | ((ir & 0x00100000) >> 9) | ((ir & 0x000ff000));
+			if (reladdy & 0x00100000) reladdy |= 0xffe00000;
+			op.kind = RV_JAL;
+			op.imm = pc + reladdy;
+			return 2;
+		}
+
+		case 0b1100111: // JALR
+			op.kind = RV_JALR;
+			op.imm = immI;
+			return 2;
+
+		case 0b1100011: // Branch
+		{
+			static const uint8_t kinds[8] = { RV_BEQ, RV_BNE, 0, 0, RV_BLT, RV_BGE, RV_BLTU, RV_BGEU };
+			if (funct3 == 0b010 || funct3 == 0b011)
+				return 0;
+
+			uint32_t immm4 = ((ir & 0xf00) >> 7) | ((ir & 0x7e000000) >> 20) | ((ir & 0x80) << 4) | ((ir >> 31) << 12);
+			if (immm4 & 0x1000) immm4 |= 0xffffe000;
+			op.kind = kinds[funct3];
+			op.imm = pc + immm4;
+			return 2;
+		}
+
+		case 0b0000011: // Load
+		{
+			static const uint8_t kinds[8] = { RV_LB, RV_LH, RV_LW, 0, RV_LBU, RV_LHU, 0, 0 };
+			if (rd == 0 || kinds[funct3] == 0)
+				return 0;
+			op.kind = kinds[funct3];
+			op.imm = immI;
+			return 1;
+		}
+
+		case 0b0100011: // Store
+		{
+			static const uint8_t kinds[3] = { RV_SB, RV_SH, RV_SW };
+			if (funct3 > 0b010)
+				return 0;
+
+			uint32_t addy = ((ir >> 7) & 0x1f) | ((ir & 0xfe000000) >> 20);
+			if (addy & 0x800) addy |= 0xfffff000;
+			op.kind = kinds[funct3];
+			op.rd = 0;
+			op.imm = addy;
+			return 1;
+		}
+
+		case 0b0010011: // Op-immediate
+		case 0b0110011: // Op
+		{
+			const bool isReg = (ir & 0b100000) != 0;
+			const bool alt = (ir & 0x40000000) != 0;
+
+			if (rd == 0)
+				return 1;
+
+			if (isReg && (ir & 0x02000000))
+			{
+				static const uint8_t kinds[8] = { RV_MUL, RV_MULH, RV_MULHSU, RV_MULHU, RV_DIV, RV_DIVU, RV_REM, RV_REMU };
+				op.kind = kinds[funct3];
+			}
+			else if (isReg)
+			{
+				static const uint8_t kinds[8] = { RV_ADD, RV_SLL, RV_SLT, RV_SLTU, RV_XOR, RV_SRL, RV_OR, RV_AND };
+				op.kind = kinds[funct3];
+				if (funct3 == 0b000 && alt) op.kind = RV_SUB;
+				if (funct3 == 0b101 && alt) op.kind = RV_SRA;
+			}
+			else
+			{
+				static const uint8_t kinds[8] = { RV_ADDI, RV_SLLI, RV_SLTI, RV_SLTIU, RV_XORI, RV_SRLI, RV_ORI, RV_ANDI };
+				op.kind = kinds[funct3];
+				if (funct3 == 0b101 && alt) op.kind = RV_SRAI;
+				op.imm = (funct3 == 0b001 || funct3 == 0b101) ? (immI & 0x1f) : immI;
+			}
+			return 1;
+		}
+
+		case 0b0001111: // Fence, ignored here too
+			return 1;
+
+		default:
+			return 0;
+		}
+	}
+};
+
+// Runs up to count instructions, without touching the timer
+MINIRV32_DECORATE int32_t MiniRV32IMARunBlocks(RV32BlockCache* cache, struct MiniRV32IMAState* state, uint8_t* image, uint32_t vProcAddress, int count)
+{
+	uint32_t* const regs = state->regs;
+	const uint32_t ramSize = cache->ramSize;
+
+	uint32_t pc = state->pc;
+	uint64_t cycles = ((uint64_t)state->cycleh << 32) | state->cyclel;
+
+	RV32Block* prev = nullptr;		// the block that just ran, and which way it left
+	int prevExit = 0;
+	bool interpret = false;			// hand the next instruction to MiniRV32IMARun()
+	int icount = 0;
+
+	// A timer interrupt is taken at the next instruction that doesn't
+	// write a register, so the interpreter sees every one until then.
+	// Only the interpreter changes mip, mie and mstatus.
+	auto irqWaiting = [state]() { return (state->mip & state->mie & (1 << 7)) && (state->mstatus & 0x8); };
+	bool irq = irqWaiting();
+
+	while (icount < count)
+	{
+		RV32Block* b = nullptr;
+
+		if (!interpret && !irq)
+		{
+			if (prev && cache->isCurrent(prev->next[prevExit], pc))
+				b = prev->next[prevExit];
+			else {
+				b = cache->lookup(pc, image);
+				if (prev)
+					prev->next[prevExit] = b;
+			}
+		}
+
+		if (b == nullptr || b->len == 0)
+		{
+			// Stores and atomics done by the interpreter still have to
+			// throw away any blocks they write over
+			uint32_t storeAt = 0xffffffff;
+			const uint32_t ofs = pc - MINIRV32_RAM_IMAGE_OFFSET;
+			if (ofs < ramSize && !(ofs & 3))
+			{
+				uint32_t ir;
+				memcpy(&ir, image + ofs, 4);
+				if ((ir & 0x7f) == 0b0100011)
+					storeAt = regs[(ir >> 15) & 0x1f] + (uint32_t)(((int32_t)(ir & 0xfe000000) >> 20) | ((ir >> 7) & 0x1f));
+				else if ((ir & 0x7f) == 0b0101111)
+					storeAt = regs[(ir >> 15) & 0x1f];
+			}
+
+			state->pc = pc;
+			state->cyclel = (uint32_t)cycles;
+			state->cycleh = (uint32_t)(cycles >> 32);
+
+			int32_t ret = MiniRV32IMARun(state, image, vProcAddress, 1);
+
+			pc = state->pc;
+			cycles = ((uint64_t)state->cycleh << 32) | state->cyclel;
+			if (storeAt != 0xffffffff)
+				cache->written(storeAt - MINIRV32_RAM_IMAGE_OFFSET, 4);
+
+			cache->interpreted++;
+			icount++;
+			interpret = false;
+			prev = nullptr;
+			irq = irqWaiting();
+
+			if (ret)
+				return ret;
+			continue;
+		}
+
+		const RV32Uop* const ops = &cache->ops[b->first];
+		const RV32Uop* const end = ops + std::min(b->len, (uint32_t)(count - icount));
+		const RV32Uop* op = ops;
+		const uint32_t bpc = b->pc;
+		const uint32_t ramLimit = ramSize - 3;
+		uint32_t next = 0;
+		uint32_t rs1, rs2;
+
+		// The hook sees each micro-op as the interpreter would show it,
+		// where a jump's pc is already its target, less 4.  With the
+		// default (empty) hook this is all thrown away.
+#define RV_POSTEXEC_PC(hookPc) { \
+			uint32_t hookIr; memcpy(&hookIr, image + (bpc + 4 * (uint32_t)(op - ops) - MINIRV32_RAM_IMAGE_OFFSET), 4); \
+			uint32_t hookTrap = 0; \
+			MINIRV32_POSTEXEC((hookPc), hookIr, hookTrap); \
+			(void)hookIr; (void)hookTrap; }
+#define RV_POSTEXEC() RV_POSTEXEC_PC(bpc + 4 * (uint32_t)(op - ops))
+
+		// Each micro-op goes straight on to the next; with gcc and clang
+		// that's a computed goto at the end of each (so each has its own
+		// indirect jump to predict), otherwise a switch.  Branches and
+		// jumps are always the last in a block.
+#if defined(RV32_COMPUTED_GOTO)
+		static void* const labels[RV_KIND_COUNT] = {
+			&&L_RV_NOP, &&L_RV_LI,
+			&&L_RV_ADDI, &&L_RV_SLTI, &&L_RV_SLTIU, &&L_RV_XORI, &&L_RV_ORI, &&L_RV_ANDI, &&L_RV_SLLI, &&L_RV_SRLI, &&L_RV_SRAI,
+			&&L_RV_ADD, &&L_RV_SUB, &&L_RV_SLL, &&L_RV_SLT, &&L_RV_SLTU, &&L_RV_XOR, &&L_RV_SRL, &&L_RV_SRA, &&L_RV_OR, &&L_RV_AND,
+			&&L_RV_MUL, &&L_RV_MULH, &&L_RV_MULHSU, &&L_RV_MULHU, &&L_RV_DIV, &&L_RV_DIVU, &&L_RV_REM, &&L_RV_REMU,
+			&&L_RV_LB, &&L_RV_LH, &&L_RV_LW, &&L_RV_LBU, &&L_RV_LHU,
+			&&L_RV_SB, &&L_RV_SH, &&L_RV_SW,
+			&&L_RV_BEQ, &&L_RV_BNE, &&L_RV_BLT, &&L_RV_BGE, &&L_RV_BLTU, &&L_RV_BGEU,
+			&&L_RV_JAL, &&L_RV_JALR,
+		};
+#define RV_CASE(x) L_##x:
+#define RV_DISPATCH() { rs1 = regs[op->rs1]; rs2 = regs[op->rs2]; goto *labels[op->kind]; }
+#define RV_NEXT() { RV_POSTEXEC(); if (++op == end) goto fellThrough; RV_DISPATCH(); }
+		RV_DISPATCH();
+#else
+#define RV_CASE(x) case x:
+#define RV_NEXT() { RV_POSTEXEC(); if (++op == end) goto fellThrough; continue; }
+		for (;;) {
+		rs1 = regs[op->rs1];
+		rs2 = regs[op->rs2];
+		switch (op->kind) {
+#endif
+#define RV_TAKEN(target) { next = target; RV_POSTEXEC_PC(next - 4); op++; goto taken; }
+#define RV_NOT_TAKEN() { RV_POSTEXEC(); op++; goto fellThrough; }
+#define RV_RAM(a) const uint32_t a = rs1 + op->imm - MINIRV32_RAM_IMAGE_OFFSET; if (a >= ramLimit) goto interpretOp;
+
+		RV_CASE(RV_NOP) RV_NEXT();
+		RV_CASE(RV_LI) { regs[op->rd] = op->imm; RV_NEXT(); }
+
+		RV_CASE(RV_ADDI) { regs[op->rd] = rs1 + op->imm; RV_NEXT(); }
+		RV_CASE(RV_SLTI) { regs[op->rd] = (int32_t)rs1 < (int32_t)op->imm; RV_NEXT(); }
+		RV_CASE(RV_SLTIU) { regs[op->rd] = rs1 < op->imm; RV_NEXT(); }
+		RV_CASE(RV_XORI) { regs[op->rd] = rs1 ^ op->imm; RV_NEXT(); }
+		RV_CASE(RV_ORI) { regs[op->rd] = rs1 | op->imm; RV_NEXT(); }
+		RV_CASE(RV_ANDI) { regs[op->rd] = rs1 & op->imm; RV_NEXT(); }
+		RV_CASE(RV_SLLI) { regs[op->rd] = rs1 << op->imm; RV_NEXT(); }
+		RV_CASE(RV_SRLI) { regs[op->rd] = rs1 >> op->imm; RV_NEXT(); }
+		RV_CASE(RV_SRAI) { regs[op->rd] = (uint32_t)((int32_t)rs1 >> op->imm); RV_NEXT(); }
+
+		RV_CASE(RV_ADD) { regs[op->rd] = rs1 + rs2; RV_NEXT(); }
+		RV_CASE(RV_SUB) { regs[op->rd] = rs1 - rs2; RV_NEXT(); }
+		RV_CASE(RV_SLL) { regs[op->rd] = rs1 << (rs2 & 0x1f); RV_NEXT(); }
+		RV_CASE(RV_SLT) { regs[op->rd] = (int32_t)rs1 < (int32_t)rs2; RV_NEXT(); }
+		RV_CASE(RV_SLTU) { regs[op->rd] = rs1 < rs2; RV_NEXT(); }
+		RV_CASE(RV_XOR) { regs[op->rd] = rs1 ^ rs2; RV_NEXT(); }
+		RV_CASE(RV_SRL) { regs[op->rd] = rs1 >> (rs2 & 0x1f); RV_NEXT(); }
+		RV_CASE(RV_SRA) { regs[op->rd] = (uint32_t)((int32_t)rs1 >> (rs2 & 0x1f)); RV_NEXT(); }
+		RV_CASE(RV_OR) { regs[op->rd] = rs1 | rs2; RV_NEXT(); }
+		RV_CASE(RV_AND) { regs[op->rd] = rs1 & rs2; RV_NEXT(); }
+
+		RV_CASE(RV_MUL) { regs[op->rd] = rs1 * rs2; RV_NEXT(); }
+		RV_CASE(RV_MULH) { regs[op->rd] = (uint32_t)(((int64_t)(int32_t)rs1 * (int64_t)(int32_t)rs2) >> 32); RV_NEXT(); }
+		RV_CASE(RV_MULHSU) { regs[op->rd] = (uint32_t)(((int64_t)(int32_t)rs1 * (uint64_t)rs2) >> 32); RV_NEXT(); }
+		RV_CASE(RV_MULHU) { regs[op->rd] = (uint32_t)(((uint64_t)rs1 * (uint64_t)rs2) >> 32); RV_NEXT(); }
+		// INT_MIN / -1 gives what the spec says, rather than a host exception
+		RV_CASE(RV_DIV) { regs[op->rd] = rs2 == 0 ? 0xffffffff : (rs2 == 0xffffffff ? 0u - rs1 : (uint32_t)((int32_t)rs1 / (int32_t)rs2)); RV_NEXT(); }
+		RV_CASE(RV_DIVU) { regs[op->rd] = rs2 == 0 ? 0xffffffff : rs1 / rs2; RV_NEXT(); }
+		RV_CASE(RV_REM) { regs[op->rd] = rs2 == 0 ? rs1 : (rs2 == 0xffffffff ? 0 : (uint32_t)((int32_t)rs1 % (int32_t)rs2)); RV_NEXT(); }
+		RV_CASE(RV_REMU) { regs[op->rd] = rs2 == 0 ? rs1 : rs1 % rs2; RV_NEXT(); }
+
+		// RAM is a bounds check and a memcpy (little endian host, as the
+		// interpreter assumes); anything else goes to the interpreter
+		RV_CASE(RV_LB) { RV_RAM(a); regs[op->rd] = (uint32_t)(int8_t)image[a]; RV_NEXT(); }
+		RV_CASE(RV_LBU) { RV_RAM(a); regs[op->rd] = image[a]; RV_NEXT(); }
+		RV_CASE(RV_LH) { RV_RAM(a); int16_t v; memcpy(&v, image + a, 2); regs[op->rd] = (uint32_t)v; RV_NEXT(); }
+		RV_CASE(RV_LHU) { RV_RAM(a); uint16_t v; memcpy(&v, image + a, 2); regs[op->rd] = v; RV_NEXT(); }
+		RV_CASE(RV_LW) { RV_RAM(a); uint32_t v; memcpy(&v, image + a, 4); regs[op->rd] = v; RV_NEXT(); }
+
+		RV_CASE(RV_SB) { RV_RAM(a); image[a] = (uint8_t)rs2; if (cache->written(a, 1)) goto codeWritten; RV_NEXT(); }
+		RV_CASE(RV_SH) { RV_RAM(a); memcpy(image + a, &rs2, 2); if (cache->written(a, 2)) goto codeWritten; RV_NEXT(); }
+		RV_CASE(RV_SW) { RV_RAM(a); memcpy(image + a, &rs2, 4); if (cache->written(a, 4)) goto codeWritten; RV_NEXT(); }
+
+		RV_CASE(RV_BEQ) { if (rs1 == rs2) RV_TAKEN(op->imm); RV_NOT_TAKEN(); }
+		RV_CASE(RV_BNE) { if (rs1 != rs2) RV_TAKEN(op->imm); RV_NOT_TAKEN(); }
+		RV_CASE(RV_BLT) { if ((int32_t)rs1 < (int32_t)rs2) RV_TAKEN(op->imm); RV_NOT_TAKEN(); }
+		RV_CASE(RV_BGE) { if ((int32_t)rs1 >= (int32_t)rs2) RV_TAKEN(op->imm); RV_NOT_TAKEN(); }
+		RV_CASE(RV_BLTU) { if (rs1 < rs2) RV_TAKEN(op->imm); RV_NOT_TAKEN(); }
+		RV_CASE(RV_BGEU) { if (rs1 >= rs2) RV_TAKEN(op->imm); RV_NOT_TAKEN(); }
+
+		RV_CASE(RV_JAL) {
+			if (op->rd) regs[op->rd] = bpc + 4 * (uint32_t)(op - ops) + 4;
+			RV_TAKEN(op->imm);
+		}
+
+		RV_CASE(RV_JALR) {
+			if (op->rd) regs[op->rd] = bpc + 4 * (uint32_t)(op - ops) + 4;
+			RV_TAKEN((rs1 + op->imm) & ~1u);
+		}
+#if !defined(RV32_COMPUTED_GOTO)
+		}
+		}
+#endif
+#undef RV_CASE
+#undef RV_DISPATCH
+#undef RV_NEXT
+#undef RV_TAKEN
+#undef RV_NOT_TAKEN
+#undef RV_RAM
+
+	fellThrough:
+		next = bpc + 4 * (uint32_t)(op - ops);
+		prev = b;
+		prevExit = 0;
+		goto done;
+
+	taken:
+		prev = b;
+		prevExit = 1;
+		goto done;
+
+	codeWritten:
+		// Might have been this block; back through the lookup
+		RV_POSTEXEC();
+		op++;
+		next = bpc + 4 * (uint32_t)(op - ops);
+		prev = nullptr;
+		goto done;
+
+	interpretOp:
+		// Not RAM after all; the interpreter works out what it is
+		next = bpc + 4 * (uint32_t)(op - ops);
+		interpret = true;
+		prev = nullptr;
+
+	done:
+		pc = next;
+		cycles += (uint32_t)(op - ops);
+		icount += (int)(op - ops);
+	}
+#undef RV_POSTEXEC
+#undef RV_POSTEXEC_PC
+
+	state->pc = pc;
+	state->cyclel = (uint32_t)cycles;
+	state->cycleh = (uint32_t)(cycles >> 32);
+	return 0;
+}
+
+// MiniRV32IMAStep(), through the block cache
+MINIRV32_DECORATE int32_t MiniRV32IMAStepBlocks(RV32BlockCache* cache, struct MiniRV32IMAState* state, uint8_t* image, uint32_t vProcAddress, uint32_t elapsedUs, int count)
+{
+#ifdef MINIRV32_CUSTOM_MEMORY_BUS
+	// RAM isn't a flat array, so no fast path
+	(void)cache;
+	return MiniRV32IMAStep(state, image, vProcAddress, elapsedUs, count);
+#else
+	if (MiniRV32IMATick(state, elapsedUs))
+		return 1;
+
+	return MiniRV32IMARunBlocks(cache, state, image, vProcAddress, count);
+#endif
+}
@@ -37,9 +37,11 @@ static int ReadKBByte();
 #define MINIRV32_OTHERCSR_WRITE( csrno, value ) HandleOtherCSRWrite( image, csrno, value );
 
 #include "mini-rv32ima.h"
+#include "rv32blocks.h"
 
 uint8_t* ram_image = 0;
 struct MiniRV32IMAState* core;
+RV32BlockCache* blocks = 0;
 
 static void DumpState(struct MiniRV32IMAState* core, uint8_t* ram_image);
 
@@ -52,6 +54,7 @@ void onLoad()
 	int fixed_update = 0;
 	int do_sleep = 1;
 	int single_step = 0;
+	int interpret_only = 0;
 	int dtb_ptr = 0;
 	const char* image_file_name = 0;
 	const char* dtb_file_name = 0;
@@ -73,6 +76,7 @@ void onLoad()
 				case 'p': param_continue = 1; do_sleep = 0; break;
 				case 's': param_continue = 1; single_step = 1; break;
 				case 'd': param_continue = 1; fail_on_all_faults = 1; break;
+				case 'i': param_continue = 1; interpret_only = 1; break;
 				case 't': if (++i < gargc) time_divisor = SimpleReadNumberInt(gargv[i], 1); break;
 				default:
 					if (param_continue)
@@ -92,7 +96,7 @@ void onLoad()
 	}
 	if (show_help || image_file_name == 0 || time_divisor <= 0)
 	{
-		fprintf(stderr, "./mini-rv32imaf [parameters]\n\t-m [ram amount]\n\t-f [running image]\n\t-b [dtb file, or 'disable']\n\t-c instruction count\n\t-s single step with full processor state\n\t-t time divion base\n\t-l lock time base to instruction count\n\t-p disable sleep when wfi\n\t-d fail out immediately on all faults\n");
+		fprintf(stderr, "./mini-rv32imaf [parameters]\n\t-m [ram amount]\n\t-f [running image]\n\t-b [dtb file, or 'disable']\n\t-c instruction count\n\t-s single step with full processor state\n\t-t time divion base\n\t-l lock time base to instruction count\n\t-p disable sleep when wfi\n\t-d fail out immediately on all faults\n\t-i interpret every instruction, without the block cache\n");
 		return ;
 	}
 
@@ -103,6 +107,9 @@ void onLoad()
 		return ;
 	}
 
+	if (!interpret_only)
+		blocks = new RV32BlockCache(ram_amt);
+
 restart:
 	{
 		FILE* f{};
@@ -129,6 +136,10 @@ restart:
 		}
 		fclose(f);
 
+		// Everything decoded came from the old image
+		if (blocks)
+			blocks->invalidate();
+
 		if (dtb_file_name)
 		{
 			if (strcmp(dtb_file_name, "disable") == 0)
@@ -202,7 +213,8 @@ restart:
 		if (single_step)
 			DumpState(core, ram_image);
 
-		int ret = MiniRV32IMAStep(core, ram_image, 0, elapsedUs, instrs_per_flip); // Execute upto 1024 cycles before breaking out.
+		int ret = blocks ? MiniRV32IMAStepBlocks(blocks, core, ram_image, 0, elapsedUs, instrs_per_flip)
+			: MiniRV32IMAStep(core, ram_image, 0, elapsedUs, instrs_per_flip); // Execute upto 1024 cycles before breaking out.
 		switch (ret)
 		{
 		case 0: break;
@@ -0,0 +1,529 @@
+#pragma once
+
+// A headless RISC-V machine, for running mini-rv32ima from tests and tools
+//
+// RV32Machine is the same machine rv32imac runs; RAM with the core state
+// at the top of it, a 16550 UART and the syscon, run through the block
+// cache.  Instead of a terminal, the UART reads from a string (feed()),
+// and writes to one (output).
+//
+// With virtualTime on (the default), the timer is driven by the
+// instruction count, like -l in rv32imac, so a run is deterministic;
+// the same start, and the same input, always gives the same output at
+// the same instruction.  WFI skips straight to the next timer interrupt,
+// rather than counting out the wait, so an idle guest costs nothing.
+//
+// snapshot() saves the whole machine; registers and CSRs (which live in
+// RAM), RAM itself, the virtual time and how it's kept (virtualTime and
+// timeDivisor, which restore() puts back too, so the guest's timer
+// carries on where it left off), and unread input.  RAM is kept
+// as 4K pages, shared between snapshots; a page that hasn't been stored
+// to since the last snapshot (the block cache tracks that) is shared
+// with it, rather than copied, and all zero pages aren't kept at all.
+// restore() works the same way round, only copying back the pages that
+// have been written since, or that differ, and keeps the decoded blocks
+// for everything else.  So going back to a booted kernel takes a few
+// milliseconds, not a reboot.
+//
+// Snapshots are immutable once taken, so any number of machines, on
+// any number of threads, can start from the same one; see
+// rv32_run_jobs(), which forks a snapshot to run a set of inputs in
+// parallel.  They can be saved to and loaded from files, too.
+//
+// Include this instead of mini-rv32ima.h; it sets the hooks up itself.
+//
+// Usage:
+//	RV32Machine m;
+//	m.load(image, dtb);
+//	m.run(UINT64_MAX, "# ");					// boot to a shell prompt
+//	auto booted = m.snapshot();
+//	booted->save("boot.snap");
+//	...
+//	m.restore(RV32Snapshot::load("boot.snap"));
+//	m.feed("ls\n");
+//	m.run(100000000, "# ");
+//
+
+#ifdef _MINI_RV32IMAH_H
+#error "rv32machine.h sets up mini-rv32ima.h's hooks itself; include it instead"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class RV32Machine;
+
+// The machine running on this thread, for the hooks
+static thread_local RV32Machine* rv32_current = nullptr;
+
+static uint32_t RV32MachineRamSize();
+static uint32_t RV32MachineControlStore(uint32_t addy, uint32_t val);
+static uint32_t RV32MachineControlLoad(uint32_t addy);
+static void RV32MachineOtherCSRWrite(uint8_t* image, uint16_t csrno, uint32_t value);
+
+#define MINIRV32_DECORATE static
+#define MINI_RV32_RAM_SIZE RV32MachineRamSize()
+#define MINIRV32_IMPLEMENTATION
+#define MINIRV32_HANDLE_MEM_STORE_CONTROL( addy, val ) if( RV32MachineControlStore( addy, val ) ) return val;
+#define MINIRV32_HANDLE_MEM_LOAD_CONTROL( addy, rval ) rval = RV32MachineControlLoad( addy );
+#define MINIRV32_OTHERCSR_WRITE( csrno, value ) RV32MachineOtherCSRWrite( image, csrno, value );
+
+#include "mini-rv32ima.h"
+#include "rv32blocks.h"
+#include "default64mbdtc.h"
+
+struct RV32MachineOptions {
+	uint32_t ramSize = 64 * 1024 * 1024;	// rounded up to a whole page
+	bool virtualTime = true;				// the timer runs off the instruction count, not the clock
+	uint32_t timeDivisor = 1;				// instructions (or microseconds) per timer tick
+};
+
+enum class RV32Exit {
+	Limit,			// ran as many instructions as it was allowed
+	Until,			// the until string turned up in the output
+	PowerOff,
+	Restart,
+	Fault,
+};
+
+static constexpr uint32_t kRV32PageBits = RV32BlockCache::kPageBits;
+static constexpr uint32_t kRV32PageSize = 1u << kRV32PageBits;
+
+struct RV32Page {
+	uint8_t bytes[kRV32PageSize];
+};
+
+struct RV32Snapshot {
+	uint32_t ramSize = 0;
+	uint64_t lastTime = 0;
+	uint32_t timeDivisor = 1;
+	bool virtualTime = true;
+	std::string input;									// UART input that hadn't been read yet
+	std::vector<std::shared_ptr<const RV32Page>> pages;	// nullptr for a page of zeros
+
+	const MiniRV32IMAState& core() const
+	{
+		static const RV32Page zeros{};
+		const uint32_t at = ramSize - sizeof(MiniRV32IMAState);
+		const RV32Page* page = pages[at >> kRV32PageBits].get();
+		// the state is word aligned, and pages end on a word, so it never straddles two
+		return *(const MiniRV32IMAState*)((page ? page : &zeros)->bytes + (at & (kRV32PageSize - 1)));
+	}
+
+	// The file is "RV32SNAP", a version, the fields above, then the
+	// index and contents of each page that isn't all zeros.
+	bool save(const char* filename) const
+	{
+		std::ofstream f(filename, std::ios::binary);
+		if (!f)
+			return false;
+
+		const uint32_t version = 2;
+		const uint32_t virtual32 = virtualTime;
+		const uint32_t inputSize = (uint32_t)input.size();
+		uint32_t used = 0;
+		for (auto& p : pages)
+			used += p != nullptr;
+
+		f.write("RV32SNAP", 8);
+		f.write((const char*)&version, 4);
+		f.write((const char*)&ramSize, 4);
+		f.write((const char*)&lastTime, 8);
+		f.write((const char*)&timeDivisor, 4);
+		f.write((const char*)&virtual32, 4);
+		f.write((const char*)&inputSize, 4);
+		f.write(input.data(), inputSize);
+		f.write((const char*)&used, 4);
+		for (uint32_t i = 0; i < (uint32_t)pages.size(); i++)
+		{
+			if (!pages[i])
+				continue;
+			f.write((const char*)&i, 4);
+			f.write((const char*)pages[i]->bytes, kRV32PageSize);
+		}
+		return f.good();
+	}
+
+	// Returns nullptr if the file can't be read, or isn't a snapshot.
+	// Sizes in the file are checked against what's left of it before
+	// anything is allocated for them.
+	static std::shared_ptr<RV32Snapshot> load(const char* filename)
+	{
+		std::ifstream f(filename, std::ios::binary | std::ios::ate);
+		if (!f)
+			return nullptr;
+
+		const uint64_t fileSize = (uint64_t)f.tellg();
+		f.seekg(0);
+		auto remaining = [&f, fileSize]() { return fileSize - (uint64_t)f.tellg(); };
+
+		char magic[8];
+		uint32_t version = 0, virtual32 = 0, inputSize = 0, used = 0;
+		auto snap = std::make_shared<RV32Snapshot>();
+
+		f.read(magic, 8);
+		f.read((char*)&version, 4);
+		if (!f || memcmp(magic, "RV32SNAP", 8) != 0 || version != 2)
+			return nullptr;
+
+		f.read((char*)&snap->ramSize, 4);
+		f.read((char*)&snap->lastTime, 8);
+		f.read((char*)&snap->timeDivisor, 4);
+		f.read((char*)&virtual32, 4);
+		f.read((char*)&inputSize, 4);
+		if (!f || snap->ramSize == 0 || (snap->ramSize & (kRV32PageSize - 1)) || snap->timeDivisor == 0 || inputSize > remaining())
+			return nullptr;
+
+		snap->virtualTime = virtual32 != 0;
+		snap->input.resize(inputSize);
+		f.read(&snap->input[0], inputSize);
+		f.read((char*)&used, 4);
+		if (!f || used > (snap->ramSize >> kRV32PageBits) || (uint64_t)used * (4 + kRV32PageSize) > remaining())
+			return nullptr;
+
+		snap->pages.resize(snap->ramSize >> kRV32PageBits);
+		for (uint32_t n = 0; n < used && f; n++)
+		{
+			uint32_t i = 0;
+			f.read((char*)&i, 4);
+			if (i >= snap->pages.size())
+				return nullptr;
+			auto page = std::make_shared<RV32Page>();
+			f.read((char*)page->bytes, kRV32PageSize);
+			snap->pages[i] = std::move(page);
+		}
+		return f ? snap : nullptr;
+	}
+};
+
+class RV32Machine
+{
+public:
+	std::string output;						// everything written to the UART since load() or restore()
+	uint64_t instructions = 0;				// run by the last run(), including time skipped in WFI
+	uint64_t pagesRestored = 0;				// pages copied back by restore(), over all
+
+	explicit RV32Machine(const RV32MachineOptions& options = RV32MachineOptions())
+		: fOptions(options)
+		, fRamSize((std::max<uint32_t>(options.ramSize, 2 * kRV32PageSize) + kRV32PageSize - 1) & ~(kRV32PageSize - 1))
+		, fRam(fRamSize)
+		, fBlocks(fRamSize)
+		, fCore((MiniRV32IMAState*)(fRam.data() + fRamSize - sizeof(MiniRV32IMAState)))
+	{
+		fOptions.timeDivisor = std::max(1u, fOptions.timeDivisor);
+	}
+
+	RV32Machine(const RV32Machine&) = delete;
+	RV32Machine& operator=(const RV32Machine&) = delete;
+
+	uint32_t ramSize() const { return fRamSize; }
+	uint8_t* ram() { return fRam.data(); }
+	MiniRV32IMAState& core() { return *fCore; }
+
+	// Load a kernel (or any program) at the start of RAM, and a device tree near the top
+	// dtb may be empty, for none; the default one has its RAM size patched to fit
+	// Returns false if they don't fit
+	bool load(const std::vector<uint8_t>& image, const std::vector<uint8_t>& dtb)
+	{
+		if (image.size() + dtb.size() + sizeof(MiniRV32IMAState) > fRamSize)
+			return false;
+
+		std::fill(fRam.begin(), fRam.end(), 0);
+		memcpy(fRam.data(), image.data(), image.size());
+
+		uint32_t dtb_ptr = 0;
+		if (!dtb.empty())
+		{
+			dtb_ptr = fRamSize - (uint32_t)dtb.size() - sizeof(MiniRV32IMAState);
+			memcpy(fRam.data() + dtb_ptr, dtb.data(), dtb.size());
+
+			uint32_t* d = (uint32_t*)(fRam.data() + dtb_ptr);
+			if (dtb.size() == sizeof(default64mbdtb) && d[0x13c / 4] == 0x00c0ff03)
+			{
+				uint32_t validram = dtb_ptr;
+				d[0x13c / 4] = (validram >> 24) | (((validram >> 16) & 0xff) << 8) | (((validram >> 8) & 0xff) << 16) | ((validram & 0xff) << 24);
+			}
+		}
+
+		fCore->pc = MINIRV32_RAM_IMAGE_OFFSET;
+		fCore->regs[10] = 0;
+		fCore->regs[11] = dtb_ptr ? dtb_ptr + MINIRV32_RAM_IMAGE_OFFSET : 0;
+		fCore->extraflags |= 3;
+
+		fBlocks.invalidate();
+		fBase = nullptr;
+		fLastTime = fOptions.virtualTime ? 0 : now();
+		fInput.clear();
+		fInputPos = 0;
+		output.clear();
+		return true;
+	}
+
+	// More UART input, read after anything already waiting
+	void feed(const std::string& text)
+	{
+		fInput.erase(0, fInputPos);
+		fInputPos = 0;
+		fInput += text;
+	}
+
+	// Runs until maxInstructions, or until appears in the output, or the machine stops
+	RV32Exit run(uint64_t maxInstructions = UINT64_MAX, const char* until = nullptr)
+	{
+		const int perStep = 1024;
+		const uint64_t div = fOptions.timeDivisor;
+		const size_t untilLen = until ? strlen(until) : 0;
+		const uint64_t start = cycles();
+		size_t checked = output.size();
+		RV32Exit exit = RV32Exit::Limit;
+
+		RV32Machine* const outer = rv32_current;
+		rv32_current = this;
+
+		while (cycles() - start < maxInstructions)
+		{
+			const uint64_t t = fOptions.virtualTime ? cycles() / div : now();
+			const uint32_t elapsedUs = (uint32_t)(t - fLastTime);
+			fLastTime += elapsedUs;
+
+			const int count = (int)std::min<uint64_t>(perStep, maxInstructions - (cycles() - start));
+			const int32_t ret = MiniRV32IMAStepBlocks(&fBlocks, fCore, fRam.data(), 0, elapsedUs, count);
+
+			if (untilLen && output.size() > checked)
+			{
+				const size_t from = checked > untilLen ? checked - untilLen : 0;
+				checked = output.size();
+				if (output.find(until, from) != std::string::npos) {
+					exit = RV32Exit::Until;
+					break;
+				}
+			}
+
+			if (ret == 1)
+			{
+				// Waiting for an interrupt; jump to the timer, if it's set, or let a little time pass.
+				// No more than 2^31 ticks at a time, so the next elapsedUs doesn't overflow.
+				const uint64_t timer = ((uint64_t)fCore->timerh << 32) | fCore->timerl;
+				const uint64_t match = ((uint64_t)fCore->timermatchh << 32) | fCore->timermatchl;
+				const uint64_t left = maxInstructions - (cycles() - start);
+				if (fOptions.virtualTime && match && match >= timer)
+					setCycles(cycles() + std::min(std::min<uint64_t>(match - timer, 0x7fffffff) * div + div, left));
+				else if (fOptions.virtualTime)
+					setCycles(cycles() + std::min<uint64_t>(perStep, left));
+				else
+					std::this_thread::yield();
+				continue;
+			}
+
+			if (ret == 0x5555) { exit = RV32Exit::PowerOff; break; }
+			if (ret == 0x7777) { exit = RV32Exit::Restart; break; }
+			if (ret != 0) { exit = RV32Exit::Fault; break; }
+		}
+
+		rv32_current = outer;
+		instructions = cycles() - start;
+		return exit;
+	}
+
+	// Save the whole machine, sharing what it can with the last snapshot
+	std::shared_ptr<const RV32Snapshot> snapshot()
+	{
+		auto snap = std::make_shared<RV32Snapshot>();
+		snap->ramSize = fRamSize;
+		snap->lastTime = fLastTime;
+		snap->timeDivisor = fOptions.timeDivisor;
+		snap->virtualTime = fOptions.virtualTime;
+		snap->input = fInput.substr(fInputPos);
+		snap->pages.resize(fRamSize >> kRV32PageBits);
+
+		for (uint32_t p = 0; p < (uint32_t)snap->pages.size(); p++)
+		{
+			if (fBase && !changed(p))
+				snap->pages[p] = fBase->pages[p];
+			else
+				snap->pages[p] = copyPage(p);
+		}
+
+		fBase = snap;
+		fBlocks.clearDirty();
+		return snap;
+	}
+
+	// Put the machine back as it was when snap was taken, keeping time
+	// the way it was kept then, whatever this machine's options said
+	// Returns false if it's from a machine with a different amount of RAM
+	bool restore(const std::shared_ptr<const RV32Snapshot>& snap)
+	{
+		if (!snap || snap->ramSize != fRamSize || snap->pages.size() != (fRamSize >> kRV32PageBits))
+			return false;
+
+		for (uint32_t p = 0; p < (uint32_t)snap->pages.size(); p++)
+		{
+			const RV32Page* page = snap->pages[p].get();
+			if (fBase && !changed(p) && fBase->pages[p].get() == page)
+				continue;
+
+			uint8_t* dest = fRam.data() + ((size_t)p << kRV32PageBits);
+			if (page)
+				memcpy(dest, page->bytes, kRV32PageSize);
+			else
+				memset(dest, 0, kRV32PageSize);
+			fBlocks.pageReplaced(p);
+			pagesRestored++;
+		}
+
+		fBase = snap;
+		fBlocks.clearDirty();
+		fOptions.virtualTime = snap->virtualTime;
+		fOptions.timeDivisor = snap->timeDivisor;
+		fLastTime = fOptions.virtualTime ? snap->lastTime : now();
+		fInput = snap->input;
+		fInputPos = 0;
+		output.clear();
+		return true;
+	}
+
+	// The hooks
+	uint32_t controlStore(uint32_t addy, uint32_t val)
+	{
+		if (addy == 0x10000000)		// UART 8250 / 16550 data buffer
+			output.push_back((char)val);
+		return 0;
+	}
+
+	uint32_t controlLoad(uint32_t addy)
+	{
+		const bool waiting = fInputPos < fInput.size();
+		if (addy == 0x10000005)
+			return 0x60 | (waiting ? 1 : 0);
+		if (addy == 0x10000000 && waiting)
+			return (uint8_t)fInput[fInputPos++];
+		return 0;
+	}
+
+	void otherCSRWrite(uint8_t* image, uint16_t csrno, uint32_t value)
+	{
+		if (csrno == 0x136)
+			output += std::to_string(value);
+		else if (csrno == 0x137)
+		{
+			char hex[9];
+			snprintf(hex, sizeof(hex), "%08x", value);
+			output += hex;
+		}
+		else if (csrno == 0x138)
+		{
+			// print a string
+			uint32_t ptr = value - MINIRV32_RAM_IMAGE_OFFSET;
+			while (ptr < fRamSize && image[ptr])
+				output.push_back((char)image[ptr++]);
+		}
+	}
+
+private:
+	RV32MachineOptions fOptions;
+	uint32_t fRamSize;
+	std::vector<uint8_t> fRam;
+	RV32BlockCache fBlocks;
+	MiniRV32IMAState* fCore;
+
+	std::shared_ptr<const RV32Snapshot> fBase;		// the snapshot RAM matches, apart from dirty pages
+	uint64_t fLastTime = 0;
+	std::string fInput;
+	size_t fInputPos = 0;
+
+	uint64_t cycles() const { return ((uint64_t)fCore->cycleh << 32) | fCore->cyclel; }
+	void setCycles(uint64_t c) { fCore->cyclel = (uint32_t)c; fCore->cycleh = (uint32_t)(c >> 32); }
+
+	static uint64_t now()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Could page p differ from fBase?  The core state isn't written
+	// through the block cache, so its page always might.
+	bool changed(uint32_t p) const
+	{
+		return fBlocks.isDirty(p) || p >= ((fRamSize - sizeof(MiniRV32IMAState)) >> kRV32PageBits);
+	}
+
+	std::shared_ptr<const RV32Page> copyPage(uint32_t p) const
+	{
+		const uint8_t* src = fRam.data() + ((size_t)p << kRV32PageBits);
+		const uint64_t* words = (const uint64_t*)src;
+		bool zero = true;
+		for (uint32_t i = 0; i < kRV32PageSize / 8 && zero; i++)
+			zero = words[i] == 0;
+		if (zero)
+			return nullptr;
+
+		auto page = std::make_shared<RV32Page>();
+		memcpy(page->bytes, src, kRV32PageSize);
+		return page;
+	}
+};
+
+static uint32_t RV32MachineRamSize() { return rv32_current->ramSize(); }
+static uint32_t RV32MachineControlStore(uint32_t addy, uint32_t val) { return rv32_current->controlStore(addy, val); }
+static uint32_t RV32MachineControlLoad(uint32_t addy) { return rv32_current->controlLoad(addy); }
+static void RV32MachineOtherCSRWrite(uint8_t* image, uint16_t csrno, uint32_t value) { rv32_current->otherCSRWrite(image, csrno, value); }
+
+// One run, forked from a snapshot
+struct RV32Job {
+	// what to run
+	std::string input;						// after anything the snapshot hadn't read yet
+	uint64_t maxInstructions = UINT64_MAX;
+	std::string until;						// stop when this is output, if it's not empty
+
+	// what happened
+	std::string output;
+	uint64_t instructions = 0;
+	RV32Exit exit = RV32Exit::Limit;
+};
+
+// Runs each job from snap, on a set of threads, each with its own
+// machine, which is restored from snap for each job it takes.
+// threads - 0 is one per hardware thread
+// The calling thread takes jobs too
+inline void rv32_run_jobs(const std::shared_ptr<const RV32Snapshot>& snap, std::vector<RV32Job>& jobs, unsigned threads = 0, RV32MachineOptions options = RV32MachineOptions())
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = (unsigned)std::min<size_t>(threads, std::max<size_t>(1, jobs.size()));
+	options.ramSize = snap->ramSize;
+
+	std::atomic<size_t> next{ 0 };
+
+	auto worker = [&]() {
+		RV32Machine m(options);
+
+		for (size_t i = next++; i < jobs.size(); i = next++)
+		{
+			RV32Job& job = jobs[i];
+
+			m.restore(snap);
+			m.feed(job.input);
+			job.exit = m.run(job.maxInstructions, job.until.empty() ? nullptr : job.until.c_str());
+			job.instructions = m.instructions;
+			job.output = std::move(m.output);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(threads - 1);
+	for (unsigned t = 1; t < threads; t++)
+		workers.emplace_back(worker);
+	worker();
+
+	for (auto& w : workers)
+		w.join();
+}
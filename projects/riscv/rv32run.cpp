@@ -0,0 +1,206 @@
+//
+// rv32run
+// Runs mini-rv32ima headless, for tests and CI, with the timer on
+// virtual time, so every run of the same thing gives the same output.
+//
+// Boot once, to a shell prompt, and save the machine as it is then:
+//   rv32run -f Image [-b dtb] [-m 64M] [-t timeDivisor] [-until "# "] [-c maxInstructions] -save boot.snap
+//
+// Then start from there, in milliseconds, as many times as needed,
+// each -input being a separate run, forked from the same snapshot,
+// and spread over -threads:
+//   rv32run -snap boot.snap -input "uname -a\n" -input "ls /\n" [-threads 0] [-until "# "] [-c ...]
+//
+// The timer keeps the -t it was booted with; the snapshot carries it.
+// -input can be given when booting too, to run from the fresh snapshot.
+// \n, \r, \t and \\ in an -input are turned into the characters.
+//
+// Exits with 1 if anything faulted, or didn't reach the -until string.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "rv32machine.h"
+
+static bool readFile(const char* filename, std::vector<uint8_t>& data)
+{
+	std::ifstream f(filename, std::ios::binary);
+	if (!f)
+		return false;
+	data.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	return !f.bad();
+}
+
+static std::string unescape(const char* s)
+{
+	std::string r;
+	for (; *s; s++)
+	{
+		if (*s != '\\' || !s[1]) {
+			r.push_back(*s);
+			continue;
+		}
+		switch (*++s)
+		{
+		case 'n': r.push_back('\n'); break;
+		case 'r': r.push_back('\r'); break;
+		case 't': r.push_back('\t'); break;
+		default: r.push_back(*s); break;
+		}
+	}
+	return r;
+}
+
+static const char* exitName(RV32Exit e)
+{
+	switch (e)
+	{
+	case RV32Exit::Limit: return "limit";
+	case RV32Exit::Until: return "until";
+	case RV32Exit::PowerOff: return "poweroff";
+	case RV32Exit::Restart: return "restart";
+	default: return "fault";
+	}
+}
+
+static bool passed(RV32Exit e, const std::string& until)
+{
+	return e == RV32Exit::PowerOff || e == RV32Exit::Restart || e == RV32Exit::Until || (e == RV32Exit::Limit && until.empty());
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void usage()
+{
+	printf("rv32run -f Image [-b dtb|disable] [-m 64M] [-t timeDivisor] [-until \"# \"] [-c maxInstructions] [-save boot.snap] [-input text]...\n");
+	printf("rv32run -snap boot.snap [-input text]... [-threads 0] [-until \"# \"] [-c maxInstructions]\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* imageFile = nullptr;
+	const char* dtbFile = nullptr;
+	const char* snapFile = nullptr;
+	const char* saveFile = nullptr;
+	std::string until = "# ";
+	uint64_t maxInstructions = UINT64_MAX;
+	unsigned threads = 0;
+	std::vector<std::string> inputs;
+	RV32MachineOptions options;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = (i + 1 < argc);
+
+		if ((strcmp(argv[i], "-f") == 0) && hasValue) imageFile = argv[++i];
+		else if ((strcmp(argv[i], "-b") == 0) && hasValue) dtbFile = argv[++i];
+		else if ((strcmp(argv[i], "-m") == 0) && hasValue) options.ramSize = (uint32_t)strtoul(argv[++i], nullptr, 0) << (strchr(argv[i], 'M') ? 20 : 0);
+		else if ((strcmp(argv[i], "-t") == 0) && hasValue) options.timeDivisor = (uint32_t)strtoul(argv[++i], nullptr, 0);
+		else if ((strcmp(argv[i], "-until") == 0) && hasValue) until = unescape(argv[++i]);
+		else if ((strcmp(argv[i], "-c") == 0) && hasValue) maxInstructions = strtoull(argv[++i], nullptr, 0);
+		else if ((strcmp(argv[i], "-snap") == 0) && hasValue) snapFile = argv[++i];
+		else if ((strcmp(argv[i], "-save") == 0) && hasValue) saveFile = argv[++i];
+		else if ((strcmp(argv[i], "-input") == 0) && hasValue) inputs.push_back(unescape(argv[++i]));
+		else if ((strcmp(argv[i], "-threads") == 0) && hasValue) threads = (unsigned)atoi(argv[++i]);
+		else { usage(); return 1; }
+	}
+
+	if ((imageFile == nullptr) == (snapFile == nullptr)) {
+		usage();
+		return 1;
+	}
+
+	std::shared_ptr<const RV32Snapshot> snap;
+	bool ok = true;
+
+	if (imageFile)
+	{
+		std::vector<uint8_t> image, dtb;
+		if (!readFile(imageFile, image)) {
+			printf("%s: could not load\n", imageFile);
+			return 1;
+		}
+		if (dtbFile == nullptr)
+			dtb.assign(default64mbdtb, default64mbdtb + sizeof(default64mbdtb));
+		else if (strcmp(dtbFile, "disable") != 0 && !readFile(dtbFile, dtb)) {
+			printf("%s: could not load\n", dtbFile);
+			return 1;
+		}
+
+		RV32Machine m(options);
+		if (!m.load(image, dtb)) {
+			printf("%s: doesn't fit in %u bytes of RAM\n", imageFile, m.ramSize());
+			return 1;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		RV32Exit e = m.run(maxInstructions, until.empty() ? nullptr : until.c_str());
+		double bootTime = secondsSince(start);
+
+		fwrite(m.output.data(), 1, m.output.size(), stdout);
+		printf("\n--- boot: %s after %llu instructions, %.2fs\n", exitName(e), (unsigned long long)m.instructions, bootTime);
+		ok = passed(e, until);
+
+		start = std::chrono::steady_clock::now();
+		snap = m.snapshot();
+		printf("--- snapshot: %.1fms\n", secondsSince(start) * 1000);
+	}
+	else
+	{
+		auto start = std::chrono::steady_clock::now();
+		snap = RV32Snapshot::load(snapFile);
+		if (!snap) {
+			printf("%s: not a snapshot\n", snapFile);
+			return 1;
+		}
+		printf("--- loaded %s: %.1fms\n", snapFile, secondsSince(start) * 1000);
+
+		if (inputs.empty())
+			inputs.push_back("");
+	}
+
+	if (saveFile)
+	{
+		auto start = std::chrono::steady_clock::now();
+		if (!snap->save(saveFile)) {
+			printf("%s: could not save\n", saveFile);
+			return 1;
+		}
+		printf("--- saved %s: %.1fms\n", saveFile, secondsSince(start) * 1000);
+	}
+
+	if (!inputs.empty())
+	{
+		std::vector<RV32Job> jobs(inputs.size());
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			jobs[i].input = inputs[i];
+			jobs[i].maxInstructions = maxInstructions;
+			jobs[i].until = until;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		rv32_run_jobs(snap, jobs, threads, options);
+		double runTime = secondsSince(start);
+
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			fwrite(jobs[i].output.data(), 1, jobs[i].output.size(), stdout);
+			printf("\n--- run %zu: %s after %llu instructions\n", i, exitName(jobs[i].exit), (unsigned long long)jobs[i].instructions);
+			ok &= passed(jobs[i].exit, until);
+		}
+		printf("--- %zu runs: %.2fs\n", jobs.size(), runTime);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+//
+// SVGArena
+// A bump allocator for the SVG node tree
+//
+// Loading a large SVG document creates tens of thousands of small
+// objects; nodes, visual properties, the containers that hold them, and
+// the strings they keep.  Getting each of those from the general heap, and
+// handing them back one at a time on teardown, costs more than the parsing itself.
+//
+// When a document is loaded in arena mode, an SVGArenaScope is put in place
+// for the duration of the load.  Everything created through svg_make_shared<>(),
+// and every SVGAllocator based container or svg_string constructed while the
+// scope is active, is carved out of a few large blocks owned by the arena.
+// Individual deallocations are ignored.
+//
+// Nodes made in an arena never have their destructors run.  Their shared_ptr
+// control blocks live in the arena too, with a deleter that does nothing, so
+// letting go of the tree is just a few reference counts going to zero.  The one
+// thing an arena node can hold that is not arena memory is a Blend2D object
+// (a path's geometry, an image, a gradient); Blend2D allocates those itself,
+// and has no way to be told otherwise.  So a node type that holds one has a
+// releaseArenaResources() that hands it back, and the arena calls that, and
+// only that, just before it frees its blocks.
+//
+// The arena is owned by the document, and everything allocated from it
+// only holds a plain pointer to it.  So nothing handed out from an arena,
+// nodes included, can be used after the document that loaded it is gone,
+// or has loaded something else.
+//
+// Outside of an arena scope, everything falls back to the regular heap, so
+// nodes can still be created standalone, exactly as before, and they are
+// destroyed the regular way.
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+#include <map>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace svg
+{
+	struct SVGArena
+	{
+		static constexpr size_t kDefaultBlockSize = 64 * 1024;
+
+	private:
+		struct Block {
+			uint8_t* fData{ nullptr };
+			size_t fSize{ 0 };
+			size_t fUsed{ 0 };
+		};
+
+		// Something to call on an object before the blocks are freed
+		// These live in the arena too, newest first
+		struct Finalizer {
+			Finalizer* fNext{ nullptr };
+			void* fObject{ nullptr };
+			void (*fRelease)(void*) { nullptr };
+		};
+
+		std::vector<Block> fBlocks{};
+		Finalizer* fFinalizers{ nullptr };
+		size_t fNextBlockSize{ kDefaultBlockSize };
+		size_t fBytesAllocated{ 0 };
+		size_t fAllocationCount{ 0 };
+
+		Block* addBlock(size_t minSize)
+		{
+			size_t sz = fNextBlockSize;
+			while (sz < minSize)
+				sz *= 2;
+
+			Block blk{};
+			blk.fData = (uint8_t*)malloc(sz);
+			if (blk.fData == nullptr)
+				throw std::bad_alloc();
+			blk.fSize = sz;
+
+			fBlocks.push_back(blk);
+
+			// Grow geometrically so a big document ends up
+			// in a handful of blocks rather than hundreds
+			fNextBlockSize = sz * 2;
+
+			return &fBlocks.back();
+		}
+
+	public:
+		SVGArena(size_t initialSize = kDefaultBlockSize)
+			: fNextBlockSize(initialSize < kDefaultBlockSize ? kDefaultBlockSize : initialSize)
+		{
+		}
+
+		SVGArena(const SVGArena&) = delete;
+		SVGArena& operator=(const SVGArena&) = delete;
+
+		~SVGArena()
+		{
+			release();
+		}
+
+		// Allocate a span of memory, with the specified alignment
+		// alignment must be a power of 2
+		void* allocate(size_t sz, size_t align = alignof(std::max_align_t))
+		{
+			Block* blk = fBlocks.empty() ? nullptr : &fBlocks.back();
+
+			if (blk != nullptr)
+			{
+				uintptr_t base = (uintptr_t)blk->fData;
+				uintptr_t p = (base + blk->fUsed + (align - 1)) & ~(uintptr_t)(align - 1);
+				if (p + sz <= base + blk->fSize)
+				{
+					blk->fUsed = (p + sz) - base;
+					fBytesAllocated += sz;
+					fAllocationCount++;
+					return (void*)p;
+				}
+			}
+
+			// Didn't fit in the current block, so start a new one
+			blk = addBlock(sz + align);
+			uintptr_t base = (uintptr_t)blk->fData;
+			uintptr_t p = (base + (align - 1)) & ~(uintptr_t)(align - 1);
+			blk->fUsed = (p + sz) - base;
+			fBytesAllocated += sz;
+			fAllocationCount++;
+
+			return (void*)p;
+		}
+
+		// Have 'release' called on 'obj' when the arena is released
+		void atRelease(void* obj, void (*release)(void*))
+		{
+			Finalizer* f = new (allocate(sizeof(Finalizer), alignof(Finalizer))) Finalizer{ fFinalizers, obj, release };
+			fFinalizers = f;
+		}
+
+		// Give all the memory back in one shot
+		void release()
+		{
+			for (Finalizer* f = fFinalizers; f != nullptr; f = f->fNext)
+				f->fRelease(f->fObject);
+			fFinalizers = nullptr;
+
+			for (auto& blk : fBlocks)
+				free(blk.fData);
+			fBlocks.clear();
+			fBytesAllocated = 0;
+			fAllocationCount = 0;
+		}
+
+		size_t bytesAllocated() const { return fBytesAllocated; }
+		size_t allocationCount() const { return fAllocationCount; }
+		size_t blockCount() const { return fBlocks.size(); }
+		size_t bytesReserved() const
+		{
+			size_t total = 0;
+			for (auto& blk : fBlocks)
+				total += blk.fSize;
+			return total;
+		}
+
+		// The arena allocations are currently being directed to
+		// on this thread, or nullptr for the regular heap
+		static SVGArena*& current()
+		{
+			static thread_local SVGArena* gCurrentArena{ nullptr };
+			return gCurrentArena;
+		}
+	};
+
+	// Direct allocations on this thread to an arena for
+	// the lifetime of the scope object
+	struct SVGArenaScope
+	{
+		SVGArena* fPrevious{ nullptr };
+
+		SVGArenaScope(SVGArena* arena)
+		{
+			fPrevious = SVGArena::current();
+			SVGArena::current() = arena;
+		}
+
+		~SVGArenaScope()
+		{
+			SVGArena::current() = fPrevious;
+		}
+
+		SVGArenaScope(const SVGArenaScope&) = delete;
+		SVGArenaScope& operator=(const SVGArenaScope&) = delete;
+	};
+
+	//
+	// SVGAllocator
+	// A standard allocator that draws from whichever arena was current
+	// when it was constructed, or from the heap if there was none.
+	// Containers that live inside nodes use this, so their storage
+	// ends up in the same arena as the nodes themselves.
+	// A copy of a container goes wherever the copy is being made,
+	// not into the arena of the container it was copied from.
+	//
+	template <typename T>
+	struct SVGAllocator
+	{
+		using value_type = T;
+
+		SVGArena* fArena{ nullptr };
+
+		SVGAllocator() noexcept : fArena(SVGArena::current()) {}
+		SVGAllocator(SVGArena* arena) noexcept : fArena(arena) {}
+
+		template <typename U>
+		SVGAllocator(const SVGAllocator<U>& other) noexcept : fArena(other.fArena) {}
+
+		T* allocate(size_t n)
+		{
+			if (fArena != nullptr)
+				return (T*)fArena->allocate(n * sizeof(T), alignof(T));
+
+			return (T*)::operator new(n * sizeof(T));
+		}
+
+		void deallocate(T* p, size_t n) noexcept
+		{
+			// Arena memory is only ever released all at once
+			if (fArena != nullptr)
+				return;
+
+			::operator delete(p);
+		}
+
+		SVGAllocator select_on_container_copy_construction() const noexcept { return SVGAllocator(); }
+	};
+
+	template <typename T, typename U>
+	bool operator==(const SVGAllocator<T>& a, const SVGAllocator<U>& b) noexcept { return a.fArena == b.fArena; }
+
+	template <typename T, typename U>
+	bool operator!=(const SVGAllocator<T>& a, const SVGAllocator<U>& b) noexcept { return a.fArena != b.fArena; }
+
+	// Containers and strings used within the node tree
+	// The maps can be searched with anything a string compares with
+	using svg_string = std::basic_string<char, std::char_traits<char>, SVGAllocator<char>>;
+
+	template <typename T>
+	using svg_vector = std::vector<T, SVGAllocator<T>>;
+
+	template <typename K, typename V>
+	using svg_map = std::map<K, V, std::less<>, SVGAllocator<std::pair<const K, V>>>;
+
+	// What an arena node's shared_ptr does when the last reference goes
+	struct SVGArenaNoDelete
+	{
+		template <typename T>
+		void operator()(T*) const noexcept {}
+	};
+
+	// Create a node, or property, in the current arena if there is one.
+	// The object and its reference count are both in the arena, and the object
+	// is never destroyed; it only gets to give back what it holds outside the arena.
+	template <typename T, typename... Args>
+	static inline std::shared_ptr<T> svg_make_shared(Args&&... args)
+	{
+		SVGArena* arena = SVGArena::current();
+		if (arena == nullptr)
+			return std::make_shared<T>(std::forward<Args>(args)...);
+
+		T* obj = new (arena->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+		if constexpr (requires (T& t) { t.releaseArenaResources(); })
+			arena->atRelease(obj, [](void* p) { ((T*)p)->releaseArenaResources(); });
+		else if constexpr (!std::is_trivially_destructible_v<T>)
+			arena->atRelease(obj, [](void* p) { ((T*)p)->~T(); });
+
+		return std::shared_ptr<T>(obj, SVGArenaNoDelete{}, SVGAllocator<T>(arena));
+	}
+}
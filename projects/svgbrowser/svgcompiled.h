@@ -0,0 +1,713 @@
+#pragma once
+
+//
+// Compiled SVG documents
+//
+// Parsing the XML, and building the node tree, is most of the cost of
+// showing an SVG document.  Once a document has been loaded, everything
+// it draws can be boiled down to a flat list of paths, each with the
+// transform and style it is drawn with already worked out.  That list
+// is what gets written to a compiled file.
+//
+// The file is laid out so it can be mapped straight into memory and used
+// where it sits.  After a fixed header come a handful of arrays of plain
+// structures, each starting on an 8 byte boundary:
+//
+//   SVGCompiledHeader		magic, version, what source it came from, sizes
+//   SVGCompiledDraw[]		one per path drawn, transform and style resolved
+//   SVGCompiledPaint[]		solid colors and gradients used by the draws
+//   SVGCompiledStop[]		gradient stops
+//   double[2 * n]			path vertices, x,y pairs, laid out as BLPoint
+//   uint8_t[n]				path commands, BLPath commands, one per vertex
+//
+// Vertices are kept at full precision, so a path drawn from the compiled
+// file is exactly the path the document drew, however large its coordinates.
+// Blend2D only draws paths that own their storage, so each one is copied
+// out of the mapped file once, at load time, with a pair of memcpy()s.
+//
+// The header carries a hash and size of the source it was compiled from,
+// so a stale file is noticed, and the caller goes back to the XML.
+//
+// Not everything a document can do fits in this form.  Text, images, and
+// pattern fills are not captured, and a document that uses them does not
+// get compiled at all.
+//
+// The file is written in the byte order of the machine writing it,
+// and it is only accepted by a machine of the same byte order.
+//
+
+#include "blend2d.h"
+#include "Graphics.h"
+#include "mmap.hpp"
+#include "svgshapes.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace svg
+{
+	static constexpr uint32_t kSVGCompiledMagic = 0x43475653;		// 'SVGC'
+	static constexpr uint32_t kSVGCompiledVersion = 2;
+	static constexpr uint32_t kSVGCompiledNoPaint = 0xffffffff;
+
+	// Which parts of the style a draw actually sets.  Anything
+	// not set is left as the context has it.
+	enum SVGCompiledStateBits : uint32_t {
+		SVGC_STATE_FILL = 0x0001,
+		SVGC_STATE_STROKE = 0x0002,
+		SVGC_STATE_FILL_OPACITY = 0x0004,
+		SVGC_STATE_FILL_RULE = 0x0008,
+		SVGC_STATE_GLOBAL_OPACITY = 0x0010,
+		SVGC_STATE_BLEND_MODE = 0x0020,
+		SVGC_STATE_STROKE_WIDTH = 0x0040,
+		SVGC_STATE_STROKE_CAPS = 0x0080,
+		SVGC_STATE_STROKE_JOIN = 0x0100,
+		SVGC_STATE_MITER_LIMIT = 0x0200,
+		SVGC_STATE_STROKE_ORDER = 0x0400,
+
+		SVGC_STATE_STROKE_BEFORE = 0x8000,		// value of the stroke order, not a 'set' bit
+	};
+
+	enum SVGCompiledPaintKind : uint32_t {
+		SVGC_PAINT_RGBA32 = 0,
+		SVGC_PAINT_RGBA64,
+		SVGC_PAINT_GRADIENT,
+	};
+
+	struct SVGCompiledHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceHash;
+		uint64_t sourceSize;
+		uint64_t fileSize;
+
+		double x, y, width, height;
+		uint64_t nodeCount;
+
+		uint32_t drawCount;
+		uint32_t paintCount;
+		uint32_t stopCount;
+		uint32_t reserved;
+		uint64_t vertexCount;
+
+		uint64_t drawOffset;
+		uint64_t paintOffset;
+		uint64_t stopOffset;
+		uint64_t vertexOffset;
+		uint64_t commandOffset;
+	};
+
+	struct SVGCompiledDraw
+	{
+		double matrix[6];		// relative to whatever the context had when the document was drawn
+		double bounds[4];		// document space x0, y0, x1, y1, stroke included
+
+		uint32_t stateBits;
+		uint32_t fillPaint;
+		uint32_t strokePaint;
+		uint32_t blendMode;
+
+		float fillOpacity;
+		float globalOpacity;
+		float strokeWidth;
+		float miterLimit;
+
+		uint8_t fillRule;
+		uint8_t strokeCaps;
+		uint8_t strokeJoin;
+		uint8_t hasBounds;
+		uint32_t vertexCount;
+		uint64_t firstVertex;
+	};
+
+	struct SVGCompiledPaint
+	{
+		uint32_t kind;
+		uint32_t gradientType;
+		uint32_t extendMode;
+		uint32_t firstStop;
+		uint32_t stopCount;
+		uint32_t reserved;
+		uint64_t rgba;			// BLRgba32 or BLRgba64 value
+		double values[BL_GRADIENT_VALUE_MAX_VALUE + 1];
+		double matrix[6];
+	};
+
+	struct SVGCompiledStop
+	{
+		double offset;
+		uint64_t rgba64;
+	};
+
+	static_assert(sizeof(SVGCompiledHeader) % 8 == 0, "compiled header must keep 8 byte alignment");
+	static_assert(sizeof(SVGCompiledDraw) % 8 == 0, "compiled draw must keep 8 byte alignment");
+	static_assert(sizeof(SVGCompiledPaint) % 8 == 0, "compiled paint must keep 8 byte alignment");
+
+	static INLINE size_t svgAlign8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+	// Whether 'count' things of 'elemSize' bytes, starting at 'offset', fit
+	// within 'size' bytes.  Written as divisions of what's left, so values
+	// from a damaged file can't wrap around and look small.
+	static INLINE bool svgArrayFits(uint64_t offset, uint64_t count, uint64_t elemSize, uint64_t size)
+	{
+		return (offset <= size) && (count <= (size - offset) / elemSize);
+	}
+
+	//
+	// Hash of the source document, used to tell whether a compiled
+	// file still matches.  FNV-1a, taken 8 bytes at a time.
+	//
+	static INLINE uint64_t svgSourceHash(const uint8_t* data, size_t size)
+	{
+		uint64_t h = 0xcbf29ce484222325ull;
+		const uint64_t prime = 0x100000001b3ull;
+
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t w;
+			memcpy(&w, data + i, 8);
+			h = (h ^ w) * prime;
+		}
+
+		for (; i < size; i++)
+			h = (h ^ data[i]) * prime;
+
+		return h;
+	}
+
+	//
+	// SVGCompileGraphics
+	// An IGraphics that draws nothing, but keeps track of the transform
+	// and style in effect at each path() call, and records the path along
+	// with them.  Drawing a document into this gives the compiled form.
+	//
+	// Anything that can't be represented marks the recording as unsupported.
+	//
+	struct SVGCompileGraphics : public IGraphics
+	{
+		struct State {
+			BLMatrix2D matrix{ BLMatrix2D::makeIdentity() };
+			uint32_t bits{ 0 };
+			uint32_t fillPaint{ kSVGCompiledNoPaint };
+			uint32_t strokePaint{ kSVGCompiledNoPaint };
+			uint32_t blendMode{ 0 };
+			float fillOpacity{ 1.0f };
+			float globalOpacity{ 1.0f };
+			float strokeWidth{ 1.0f };
+			float miterLimit{ 4.0f };
+			uint8_t fillRule{ 0 };
+			uint8_t strokeCaps{ 0 };
+			uint8_t strokeJoin{ 0 };
+		};
+
+		State fState{};
+		std::vector<State> fStack{};
+		bool fSupported{ true };
+
+		std::vector<SVGCompiledDraw> fDraws{};
+		std::vector<SVGCompiledPaint> fPaints{};
+		std::vector<SVGCompiledStop> fStops{};
+		std::vector<BLPoint> fVertices{};
+		std::vector<uint8_t> fCommands{};
+
+		// So the same color, or gradient, is only stored once
+		// The gradients are held onto, so their addresses can't be
+		// handed out again to some other gradient while recording
+		std::map<std::pair<uint32_t, uint64_t>, uint32_t> fColorIndex{};
+		std::map<const void*, uint32_t> fGradientIndex{};
+		std::vector<BLGradient> fGradients{};
+
+		bool isSupported() const { return fSupported; }
+		void unsupported() { fSupported = false; }
+
+		uint32_t addPaint(const BLVarCore& v)
+		{
+			const BLVar& var = static_cast<const BLVar&>(v);
+
+			if (var.isRgba32() || var.isRgba64() || var.isRgba())
+			{
+				SVGCompiledPaint p{};
+				if (var.isRgba32())
+				{
+					BLRgba32 c{};
+					var.toRgba32(&c);
+					p.kind = SVGC_PAINT_RGBA32;
+					p.rgba = c.value;
+				}
+				else
+				{
+					BLRgba64 c{};
+					var.toRgba64(&c);
+					p.kind = SVGC_PAINT_RGBA64;
+					p.rgba = c.value;
+				}
+
+				auto key = std::make_pair(p.kind, p.rgba);
+				auto it = fColorIndex.find(key);
+				if (it != fColorIndex.end())
+					return it->second;
+
+				uint32_t index = (uint32_t)fPaints.size();
+				fPaints.push_back(p);
+				fColorIndex[key] = index;
+				return index;
+			}
+
+			if (var.isGradient())
+			{
+				const BLGradient& g = var.as<BLGradient>();
+				auto it = fGradientIndex.find(g._d.impl);
+				if (it != fGradientIndex.end())
+					return it->second;
+
+				SVGCompiledPaint p{};
+				p.kind = SVGC_PAINT_GRADIENT;
+				p.gradientType = g.type();
+				p.extendMode = g.extendMode();
+				p.firstStop = (uint32_t)fStops.size();
+				p.stopCount = (uint32_t)g.size();
+				for (size_t i = 0; i <= BL_GRADIENT_VALUE_MAX_VALUE; i++)
+					p.values[i] = g.value(i);
+				memcpy(p.matrix, g.transform().m, sizeof(p.matrix));
+
+				for (size_t i = 0; i < g.size(); i++)
+					fStops.push_back({ g.stopAt(i).offset, g.stopAt(i).rgba.value });
+
+				uint32_t index = (uint32_t)fPaints.size();
+				fPaints.push_back(p);
+				fGradientIndex[g._d.impl] = index;
+				fGradients.push_back(g);
+				return index;
+			}
+
+			// Patterns, and anything else
+			unsupported();
+			return kSVGCompiledNoPaint;
+		}
+
+		// The attributes that matter for paths
+		void setDpiUnits(const int dpi, const float units) override {}
+		void strokeBeforeTransform(bool b) override
+		{
+			fState.bits |= SVGC_STATE_STROKE_ORDER;
+			if (b)
+				fState.bits |= SVGC_STATE_STROKE_BEFORE;
+			else
+				fState.bits &= ~SVGC_STATE_STROKE_BEFORE;
+		}
+		void angleMode(const ANGLEMODE mode) override {}
+		void ellipseMode(const ELLIPSEMODE mode) override {}
+		void rectMode(const RECTMODE mode) override {}
+		void blendMode(int mode) override { fState.bits |= SVGC_STATE_BLEND_MODE; fState.blendMode = (uint32_t)mode; }
+		void globalOpacity(double opacity) override { fState.bits |= SVGC_STATE_GLOBAL_OPACITY; fState.globalOpacity = (float)opacity; }
+
+		void strokeCaps(int caps) override { fState.bits |= SVGC_STATE_STROKE_CAPS; fState.strokeCaps = (uint8_t)caps; }
+		void strokeJoin(int join) override { fState.bits |= SVGC_STATE_STROKE_JOIN; fState.strokeJoin = (uint8_t)join; }
+		void strokeMiterLimit(float limit) override { fState.bits |= SVGC_STATE_MITER_LIMIT; fState.miterLimit = limit; }
+		void strokeWeight(float weight) override { fState.bits |= SVGC_STATE_STROKE_WIDTH; fState.strokeWidth = weight; }
+
+		bool push() override { fStack.push_back(fState); return true; }
+		bool pop() override
+		{
+			if (fStack.empty())
+				return false;
+			fState = fStack.back();
+			fStack.pop_back();
+			return true;
+		}
+		bool flush() override { return true; }
+
+		void transform(double* values) override { fState.matrix.transform(BLMatrix2D(values[0], values[1], values[2], values[3], values[4], values[5])); }
+		void translate(double dx, double dy) override { fState.matrix.translate(dx, dy); }
+		void scale(double sx, double sy) override { fState.matrix.scale(sx, sy); }
+		void rotate(double angle, double cx, double cy) override { fState.matrix.rotate(angle, cx, cy); }
+
+		void noFill() override { fState.bits |= SVGC_STATE_FILL; fState.fillPaint = kSVGCompiledNoPaint; }
+		void fill(const BLVarCore& s) override { fState.bits |= SVGC_STATE_FILL; fState.fillPaint = addPaint(s); }
+		void fill(const Pixel& c) override { fill(BLVar(c)); }
+		void fillOpacity(double opacity) override { fState.bits |= SVGC_STATE_FILL_OPACITY; fState.fillOpacity = (float)opacity; }
+		void fillRule(int rule) override { fState.bits |= SVGC_STATE_FILL_RULE; fState.fillRule = (uint8_t)rule; }
+
+		void stroke(const BLVarCore& s) override { fState.bits |= SVGC_STATE_STROKE; fState.strokePaint = addPaint(s); }
+		void stroke(const Pixel& c) override { stroke(BLVar(c)); }
+		void noStroke() override { fState.bits |= SVGC_STATE_STROKE; fState.strokePaint = kSVGCompiledNoPaint; }
+
+		void path(const BLPath& p) override
+		{
+			size_t n = p.size();
+			if (n == 0)
+				return;
+
+			SVGCompiledDraw d{};
+			memcpy(d.matrix, fState.matrix.m, sizeof(d.matrix));
+			d.stateBits = fState.bits;
+			d.fillPaint = fState.fillPaint;
+			d.strokePaint = fState.strokePaint;
+			d.blendMode = fState.blendMode;
+			d.fillOpacity = fState.fillOpacity;
+			d.globalOpacity = fState.globalOpacity;
+			d.strokeWidth = fState.strokeWidth;
+			d.miterLimit = fState.miterLimit;
+			d.fillRule = fState.fillRule;
+			d.strokeCaps = fState.strokeCaps;
+			d.strokeJoin = fState.strokeJoin;
+			d.firstVertex = fCommands.size();
+			d.vertexCount = (uint32_t)n;
+
+			// Where it lands, for skipping it when drawing tiles.  A stroke
+			// applied after the transform is sized in device pixels, which
+			// aren't known here, so that one is never skipped.
+			BLBox b{};
+			bool strokeBefore = !(fState.bits & SVGC_STATE_STROKE_ORDER) || (fState.bits & SVGC_STATE_STROKE_BEFORE);
+			bool stroked = (fState.bits & SVGC_STATE_STROKE) && (fState.strokePaint != kSVGCompiledNoPaint);
+			if ((p.getBoundingBox(&b) == BL_SUCCESS) && (strokeBefore || !stroked))
+			{
+				if (stroked)
+				{
+					double extent = (fState.strokeWidth / 2.0) * std::max(1.0, (double)fState.miterLimit);
+					b.x0 -= extent;
+					b.y0 -= extent;
+					b.x1 += extent;
+					b.y1 += extent;
+				}
+
+				b = svgTransformBox(fState.matrix, b);
+				d.bounds[0] = b.x0;
+				d.bounds[1] = b.y0;
+				d.bounds[2] = b.x1;
+				d.bounds[3] = b.y1;
+				d.hasBounds = 1;
+			}
+
+			const uint8_t* cmds = p.commandData();
+			const BLPoint* vtx = p.vertexData();
+			fCommands.insert(fCommands.end(), cmds, cmds + n);
+
+			fVertices.insert(fVertices.end(), vtx, vtx + n);
+
+			fDraws.push_back(d);
+		}
+
+		// Nothing else is captured
+		void clear() override { unsupported(); }
+		void clearRect(double x, double y, double w, double h) override { unsupported(); }
+		void background(const Pixel& c) override { unsupported(); }
+		void clip(const maths::rectf& bb) override { unsupported(); }
+		void noClip() override { unsupported(); }
+
+		void set(double x, double y, const Pixel& c) override { unsupported(); }
+		void point(double x, double y) override { unsupported(); }
+		void line(double x1, double y1, double x2, double y2) override { unsupported(); }
+		void arc(double cx, double cy, double r, double start, double sweep) override { unsupported(); }
+		void rect(double x, double y, double width, double height, double xradius, double yradius) override { unsupported(); }
+		void ellipse(double a, double b, double c, double d) override { unsupported(); }
+		void circle(double cx, double cy, double diameter) override { unsupported(); }
+		void triangle(double x1, double y1, double x2, double y2, double x3, double y3) override { unsupported(); }
+		void bezier(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4) override { unsupported(); }
+		void polyline(const BLPoint* pts, size_t n) override { unsupported(); }
+		void polygon(const BLPoint* pts, size_t n) override { unsupported(); }
+		void quad(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4) override { unsupported(); }
+
+		void beginShape(SHAPEMODE shapeKind) override { unsupported(); }
+		void vertex(double x, double y) override { unsupported(); }
+		void endShape(SHAPEEND endKind) override { unsupported(); }
+
+		void image(const BLImage& img, int x, int y) override { unsupported(); }
+		void scaleImage(const BLImage& src,
+			double srcX, double srcY, double srcWidth, double srcHeight,
+			double dstX, double dstY, double dstWidth, double dstHeight) override { unsupported(); }
+
+		// Text attributes are harmless, text itself is not
+		void textAlign(ALIGNMENT horizontal, ALIGNMENT vertical) override {}
+		void textFace(const BLFontFace& face) override {}
+		void textFont(const char* fontname) override {}
+		void textSize(float size) override {}
+		void text(const char* txt, float x, float y, float x2 = 0, float y2 = 0) override { unsupported(); }
+		void textAtBaseline(const char* txt, float x, float y, float x2 = 0, float y2 = 0) override { unsupported(); }
+		maths::vec2f textMeasure(const char* txt) override { unsupported(); return { 0, 0 }; }
+		float textAscent() override { return 0; }
+		float textDescent() override { return 0; }
+
+		//
+		// Write what was recorded out to a file
+		// The header fields describing the document itself are
+		// filled in by the caller.
+		//
+		bool save(const std::string& filename, SVGCompiledHeader hdr) const
+		{
+			if (!fSupported)
+				return false;
+
+			hdr.magic = kSVGCompiledMagic;
+			hdr.version = kSVGCompiledVersion;
+			hdr.drawCount = (uint32_t)fDraws.size();
+			hdr.paintCount = (uint32_t)fPaints.size();
+			hdr.stopCount = (uint32_t)fStops.size();
+			hdr.vertexCount = fCommands.size();
+
+			size_t offset = sizeof(SVGCompiledHeader);
+			hdr.drawOffset = offset;
+			offset = svgAlign8(offset + fDraws.size() * sizeof(SVGCompiledDraw));
+			hdr.paintOffset = offset;
+			offset = svgAlign8(offset + fPaints.size() * sizeof(SVGCompiledPaint));
+			hdr.stopOffset = offset;
+			offset = svgAlign8(offset + fStops.size() * sizeof(SVGCompiledStop));
+			hdr.vertexOffset = offset;
+			offset = svgAlign8(offset + fVertices.size() * sizeof(BLPoint));
+			hdr.commandOffset = offset;
+			offset = offset + fCommands.size();
+			hdr.fileSize = offset;
+
+			ndt::mmap_options opts{};
+			opts.writable = true;
+			opts.size = offset;
+			auto m = ndt::mmap::create_shared(filename, opts);
+			if ((m == nullptr) || (m->size() < offset))
+				return false;
+
+			uint8_t* base = (uint8_t*)m->data();
+			memset(base, 0, offset);
+			memcpy(base + hdr.drawOffset, fDraws.data(), fDraws.size() * sizeof(SVGCompiledDraw));
+			memcpy(base + hdr.paintOffset, fPaints.data(), fPaints.size() * sizeof(SVGCompiledPaint));
+			memcpy(base + hdr.stopOffset, fStops.data(), fStops.size() * sizeof(SVGCompiledStop));
+			memcpy(base + hdr.vertexOffset, fVertices.data(), fVertices.size() * sizeof(BLPoint));
+			memcpy(base + hdr.commandOffset, fCommands.data(), fCommands.size());
+
+			// Header goes in last, so a file that didn't get
+			// completely written doesn't look valid
+			memcpy(base, &hdr, sizeof(hdr));
+
+			return m->flush();
+		}
+	};
+
+	//
+	// SVGCompiledImage
+	// A compiled file, mapped into memory, ready to draw.
+	// The only work done at load time is turning the vertex arrays
+	// into BLPath objects, and the paints into BLVar objects.
+	//
+	struct SVGCompiledImage
+	{
+		std::shared_ptr<ndt::mmap> fMap{};
+		const SVGCompiledHeader* fHeader{ nullptr };
+		const SVGCompiledDraw* fDraws{ nullptr };
+
+		std::vector<BLPath> fPaths{};
+		std::vector<BLVar> fPaints{};
+
+		const SVGCompiledHeader& header() const { return *fHeader; }
+		size_t drawCount() const { return fHeader->drawCount; }
+
+		//
+		// Map a compiled file, and check it against the source it
+		// is supposed to represent.  nullptr if the file isn't there,
+		// is damaged, or was compiled from something else.
+		//
+		static std::shared_ptr<SVGCompiledImage> createFromFile(const std::string& filename, uint64_t sourceHash, uint64_t sourceSize)
+		{
+			ndt::mmap_options opts{};
+			opts.access = ndt::MMAP_ACCESS_SEQUENTIAL;
+			auto m = ndt::mmap::create_shared(filename, opts);
+			if ((m == nullptr) || (m->size() < sizeof(SVGCompiledHeader)))
+				return nullptr;
+
+			const uint8_t* base = (const uint8_t*)m->data();
+			const SVGCompiledHeader* hdr = (const SVGCompiledHeader*)base;
+
+			if ((hdr->magic != kSVGCompiledMagic) || (hdr->version != kSVGCompiledVersion))
+				return nullptr;
+			if ((hdr->sourceHash != sourceHash) || (hdr->sourceSize != sourceSize))
+				return nullptr;
+
+			// Every array has to be inside the file
+			size_t size = m->size();
+			if ((hdr->fileSize > size) ||
+				!svgArrayFits(hdr->drawOffset, hdr->drawCount, sizeof(SVGCompiledDraw), size) ||
+				!svgArrayFits(hdr->paintOffset, hdr->paintCount, sizeof(SVGCompiledPaint), size) ||
+				!svgArrayFits(hdr->stopOffset, hdr->stopCount, sizeof(SVGCompiledStop), size) ||
+				!svgArrayFits(hdr->vertexOffset, hdr->vertexCount, sizeof(BLPoint), size) ||
+				!svgArrayFits(hdr->commandOffset, hdr->vertexCount, 1, size))
+				return nullptr;
+
+			auto img = std::make_shared<SVGCompiledImage>();
+			img->fMap = m;
+			img->fHeader = hdr;
+			img->fDraws = (const SVGCompiledDraw*)(base + hdr->drawOffset);
+
+			if (!img->buildPaints() || !img->buildPaths())
+				return nullptr;
+
+			return img;
+		}
+
+		bool buildPaints()
+		{
+			const uint8_t* base = (const uint8_t*)fMap->data();
+			auto paints = (const SVGCompiledPaint*)(base + fHeader->paintOffset);
+			auto stops = (const SVGCompiledStop*)(base + fHeader->stopOffset);
+
+			fPaints.resize(fHeader->paintCount);
+			std::vector<BLGradientStop> blStops{};
+
+			for (size_t i = 0; i < fHeader->paintCount; i++)
+			{
+				const SVGCompiledPaint& p = paints[i];
+				switch (p.kind)
+				{
+				case SVGC_PAINT_RGBA32:
+					fPaints[i] = BLRgba32((uint32_t)p.rgba);
+					break;
+
+				case SVGC_PAINT_RGBA64:
+					fPaints[i] = BLRgba64(p.rgba);
+					break;
+
+				case SVGC_PAINT_GRADIENT:
+				{
+					if (!svgArrayFits(p.firstStop, p.stopCount, 1, fHeader->stopCount))
+						return false;
+
+					blStops.resize(p.stopCount);
+					for (size_t s = 0; s < p.stopCount; s++)
+						blStops[s] = BLGradientStop(stops[p.firstStop + s].offset, BLRgba64(stops[p.firstStop + s].rgba64));
+
+					BLMatrix2D m(p.matrix[0], p.matrix[1], p.matrix[2], p.matrix[3], p.matrix[4], p.matrix[5]);
+					BLGradient g{};
+					if (blGradientCreate(&g, (BLGradientType)p.gradientType, p.values, (BLExtendMode)p.extendMode,
+						blStops.data(), blStops.size(), &m) != BL_SUCCESS)
+						return false;
+
+					fPaints[i] = g;
+				}
+				break;
+
+				default:
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		bool buildPaths()
+		{
+			const uint8_t* base = (const uint8_t*)fMap->data();
+			auto vertices = (const BLPoint*)(base + fHeader->vertexOffset);
+			auto commands = base + fHeader->commandOffset;
+
+			fPaths.resize(fHeader->drawCount);
+			for (size_t i = 0; i < fHeader->drawCount; i++)
+			{
+				const SVGCompiledDraw& d = fDraws[i];
+				if (!svgArrayFits(d.firstVertex, d.vertexCount, 1, fHeader->vertexCount) ||
+					((d.fillPaint != kSVGCompiledNoPaint) && (d.fillPaint >= fHeader->paintCount)) ||
+					((d.strokePaint != kSVGCompiledNoPaint) && (d.strokePaint >= fHeader->paintCount)))
+					return false;
+
+				uint8_t* cmdOut = nullptr;
+				BLPoint* vtxOut = nullptr;
+				if (fPaths[i].modifyOp(BL_MODIFY_OP_ASSIGN_FIT, d.vertexCount, &cmdOut, &vtxOut) != BL_SUCCESS)
+					return false;
+
+				memcpy(cmdOut, commands + d.firstVertex, d.vertexCount);
+				memcpy(vtxOut, vertices + d.firstVertex, d.vertexCount * sizeof(BLPoint));
+			}
+
+			return true;
+		}
+
+		void applyStyle(IGraphics& ctx, const SVGCompiledDraw& d) const
+		{
+			uint32_t bits = d.stateBits;
+
+			if (bits & SVGC_STATE_STROKE_ORDER)
+				ctx.strokeBeforeTransform((bits & SVGC_STATE_STROKE_BEFORE) != 0);
+			if (bits & SVGC_STATE_BLEND_MODE)
+				ctx.blendMode((int)d.blendMode);
+			if (bits & SVGC_STATE_GLOBAL_OPACITY)
+				ctx.globalOpacity(d.globalOpacity);
+			if (bits & SVGC_STATE_STROKE_CAPS)
+				ctx.strokeCaps(d.strokeCaps);
+			if (bits & SVGC_STATE_STROKE_JOIN)
+				ctx.strokeJoin(d.strokeJoin);
+			if (bits & SVGC_STATE_MITER_LIMIT)
+				ctx.strokeMiterLimit(d.miterLimit);
+			if (bits & SVGC_STATE_STROKE_WIDTH)
+				ctx.strokeWeight(d.strokeWidth);
+			if (bits & SVGC_STATE_FILL_RULE)
+				ctx.fillRule(d.fillRule);
+			if (bits & SVGC_STATE_FILL_OPACITY)
+				ctx.fillOpacity(d.fillOpacity);
+
+			if (bits & SVGC_STATE_FILL)
+			{
+				if (d.fillPaint == kSVGCompiledNoPaint)
+					ctx.noFill();
+				else
+					ctx.fill(fPaints[d.fillPaint]);
+			}
+
+			if (bits & SVGC_STATE_STROKE)
+			{
+				if (d.strokePaint == kSVGCompiledNoPaint)
+					ctx.noStroke();
+				else
+					ctx.stroke(fPaints[d.strokePaint]);
+			}
+		}
+
+		//
+		// Draw everything that touches the tile (in document space)
+		// Each draw is done in its own push()/pop(), so the style of one
+		// doesn't leak into the next, except that consecutive draws with
+		// the same transform and style share one.
+		//
+		void drawTile(IGraphics& ctx, const BLBox& tile) const
+		{
+			const SVGCompiledDraw* prev = nullptr;
+
+			for (size_t i = 0; i < fHeader->drawCount; i++)
+			{
+				const SVGCompiledDraw& d = fDraws[i];
+				if (d.hasBounds && !((d.bounds[0] <= tile.x1) && (d.bounds[2] >= tile.x0) &&
+					(d.bounds[1] <= tile.y1) && (d.bounds[3] >= tile.y0)))
+					continue;
+
+				// Same transform, and same everything from stateBits up to
+				// hasBounds, means the style that's already set will do
+				bool sameState = (prev != nullptr) &&
+					(memcmp(prev->matrix, d.matrix, sizeof(d.matrix)) == 0) &&
+					(memcmp(&prev->stateBits, &d.stateBits, offsetof(SVGCompiledDraw, hasBounds) - offsetof(SVGCompiledDraw, stateBits)) == 0);
+
+				if (!sameState)
+				{
+					if (prev != nullptr)
+						ctx.pop();
+
+					ctx.push();
+					ctx.transform((double*)d.matrix);
+					applyStyle(ctx, d);
+					prev = &d;
+				}
+
+				ctx.path(fPaths[i]);
+			}
+
+			if (prev != nullptr)
+				ctx.pop();
+		}
+
+		void draw(IGraphics& ctx) const
+		{
+			drawTile(ctx, BLBox(-1e300, -1e300, 1e300, 1e300));
+		}
+	};
+}
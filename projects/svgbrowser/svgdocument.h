@@ -13,6 +13,9 @@
 #include "mmap.hpp"
 #include "xmlscan.h"
 #include "svgshapes.h"
+#include "svgarena.h"
+#include "svgtiles.h"
+#include "svgcompiled.h"
 
 
 #include <functional>
@@ -41,12 +44,35 @@ namespace svg
 namespace svg {
     struct SVGDocument : public IDrawable
     {
-        std::shared_ptr<mmap> fFileMap{};
+        std::shared_ptr<ndt::mmap> fFileMap{};
+
+        // When arena mode is on, the node tree lives in fArena
+        // The root node is declared after the arena, so it is let go
+        // of before the arena is released
+        bool fUseArena{ false };
+        std::unique_ptr<SVGArena> fArena{};
 		std::shared_ptr<SVGRootNode> fRootNode = nullptr;
+
+        // When the document came from a compiled file instead,
+        // there is no node tree, just this
+        std::shared_ptr<SVGCompiledImage> fCompiled{};
+
+        // Parallel rendering
+        int fRenderThreads{ 1 };
+        int fTileSize{ 256 };
+        std::unique_ptr<SVGWorkerPool> fWorkers{};
         
+        // A document with no file behind it, to be
+        // filled in with loadFromStream()
+        SVGDocument() = default;
+
         SVGDocument(std::string filename)
 		{
-            fFileMap = ndt::mmap::create_shared(filename);
+            // The parser goes through the file front to back, once
+            mmap_options opts{};
+            opts.access = MMAP_ACCESS_SEQUENTIAL;
+
+            fFileMap = ndt::mmap::create_shared(filename, opts);
             if (fFileMap == nullptr)
                 return ;
         }
@@ -60,6 +86,8 @@ namespace svg {
         }
         
         double x() const {
+            if (fCompiled != nullptr)
+                return fCompiled->header().x;
             if (fRootNode == nullptr)
                 return 0;
 		
@@ -67,6 +95,8 @@ namespace svg {
         }
 
         double y() const {
+            if (fCompiled != nullptr)
+                return fCompiled->header().y;
             if (fRootNode == nullptr)
                 return 0;
 
@@ -74,12 +104,16 @@ namespace svg {
         }
         
 		double width() const { 
+            if (fCompiled != nullptr)
+                return fCompiled->header().width;
 			if (fRootNode == nullptr)
 				return 100;
 			return fRootNode->width();
         }
 
 		double height() const {
+            if (fCompiled != nullptr)
+                return fCompiled->header().height;
 			if (fRootNode == nullptr)
 				return 100;
 
@@ -87,21 +121,133 @@ namespace svg {
 		}
         
 		size_t nodeCount() const {
+            if (fCompiled != nullptr)
+                return (size_t)fCompiled->header().nodeCount;
 			if (fRootNode == nullptr)
 				return 0;
 			return fRootNode->nodeCount();
 		}
+
+        // Turn arena allocation on or off for the next load()
+        void setArenaMode(bool useArena) { fUseArena = useArena; }
+        bool arenaMode() const { return fUseArena; }
+        
+        // The arena holding the current tree, if it was loaded in arena mode
+        const SVGArena* arena() const { return fArena.get(); }
+
+        // How many threads renderToImage() uses
+        // 0 means use as many as there are cores
+        void setRenderThreads(int threads)
+        {
+            if (threads <= 0)
+                threads = (int)std::max(1u, std::thread::hardware_concurrency());
+
+            if (threads != fRenderThreads)
+                fWorkers = nullptr;
+
+            fRenderThreads = threads;
+        }
+        int renderThreads() const { return fRenderThreads; }
+
+        // Size, in pixels, of the square tiles used for parallel rendering
+        void setTileSize(int tileSize) { fTileSize = std::max(16, tileSize); }
+        int tileSize() const { return fTileSize; }
         
+        // The compiled form, if that's what was loaded
+        const SVGCompiledImage* compiled() const { return fCompiled.get(); }
+
         void draw(IGraphics& ctx) override
         {
+            if (fCompiled != nullptr)
+            {
+                fCompiled->draw(ctx);
+                return;
+            }
+
             if (nullptr == fRootNode)
                 return;
             
             fRootNode->draw(ctx);
         }
+
+        //
+        // Render the document into an image, with the given transform applied
+        // With a single render thread, the whole image is drawn with one context.  
+        // Otherwise, the image is split into tiles, and the tiles are drawn 
+        // in parallel.  The results are the same either way.
+        //
+        // The pixels are written in place, so if the image is also the target
+        // of another context (a Surface for instance), flush that one first.
+        //
+        void renderToImage(BLImage& target, const BLMatrix2D& transform = BLMatrix2D::makeIdentity())
+        {
+            if ((nullptr == fRootNode) && (nullptr == fCompiled))
+                return;
+
+            BLImageData imgData{};
+            if (target.getData(&imgData) != BL_SUCCESS)
+                return;
+
+            int width = imgData.size.w;
+            int height = imgData.size.h;
+            int tileSize = fTileSize;
+            int tilesX = (width + tileSize - 1) / tileSize;
+            int tilesY = (height + tileSize - 1) / tileSize;
+            int threads = fRenderThreads;
+
+            if (threads <= 1 || (tilesX * tilesY) <= 1)
+            {
+                tileSize = std::max(width, height);
+                tilesX = 1;
+                tilesY = 1;
+                threads = 1;
+            }
+
+            // Document space box that covers the tile, expanded by a pixel
+            // to allow for antialiasing along the edges
+            BLMatrix2D inverse{};
+            bool canCull = BLMatrix2D::invert(inverse, transform) == BL_SUCCESS;
+
+            auto renderTile = [&](int tileIndex) {
+                int tx = (tileIndex % tilesX) * tileSize;
+                int ty = (tileIndex / tilesX) * tileSize;
+                int tw = std::min(tileSize, width - tx);
+                int th = std::min(tileSize, height - ty);
+
+                BLBox tileBox(-1e300, -1e300, 1e300, 1e300);
+                if (canCull)
+                    tileBox = svgTransformBox(inverse, BLBox(tx - 1.0, ty - 1.0, tx + tw + 1.0, ty + th + 1.0));
+
+                SVGTileGraphics ctx(imgData, tx, ty, tw, th);
+                ctx.transform((double*)transform.m);
+                if (fCompiled != nullptr)
+                    fCompiled->drawTile(ctx, tileBox);
+                else
+                    fRootNode->drawTile(ctx, tileBox);
+                ctx.flush();
+            };
+
+            if (threads == 1)
+            {
+                renderTile(0);
+                return;
+            }
+
+            if (!fWorkers)
+                fWorkers = std::make_unique<SVGWorkerPool>(threads - 1);
+
+            fWorkers->run(tilesX * tilesY, renderTile);
+        }
         
         void drawProgressive(IGraphics& ctx, double percent, size_t totalNodes, size_t &nodesDrawn)
         {
+            // Nothing to pace in a compiled document
+            if (fCompiled != nullptr)
+            {
+                fCompiled->draw(ctx);
+                return;
+            }
+
             if (nullptr == fRootNode)
                 return;
 
@@ -140,6 +286,10 @@ namespace svg {
                     fRootNode = SVGRootNode::createFromIterator(iter);
                     if (fRootNode != nullptr)
                     {
+                        // Figure out where everything lands, so rendering
+                        // can skip over what's not in view
+                        fRootNode->computeBounds(BLMatrix2D::makeIdentity(), 2.0);
+
 						printf("SVGDocument node count: %zd\n", fRootNode->nodeCount());
                         //addNode(fRootNode);
                     }
@@ -157,16 +307,134 @@ namespace svg {
 			DataChunk s = fFileMap->getChunk();
 			s = chunk_trim(s, wspChars);
 
+            // The node tree tends to be around the same size as the
+            // xml that describes it, so start the arena with a block that big
+            resetTree(chunk_size(s));
+            
+            SVGArenaScope scope(fArena.get());
+
 			XmlElementIterator iter(s);
 
 			loadFromIterator(iter);
 
 			return true;
         }
+
+        //
+        // Load the document as it arrives, from a socket, pipe, or 
+        // whatever else.  'readSome' fills in the buffer it's given with
+        // up to 'sz' bytes, and returns how many it filled in.  It returns 0
+        // when there is no more.
+        //
+        // Nodes are constructed as soon as their elements have arrived, 
+        // so the whole document never has to be in memory at once.
+        //
+        bool loadFromStream(std::function<size_t(uint8_t* buff, size_t sz)> readSome, size_t bufferSize = 64 * 1024)
+        {
+            if (!readSome)
+                return false;
+
+            resetTree(SVGArena::kDefaultBlockSize);
+
+            SVGArenaScope scope(fArena.get());
+
+            std::vector<uint8_t> buff(std::max<size_t>(bufferSize, 256));
+            XmlPushParser parser;
+
+            XmlElementIterator iter(parser, [&](XmlPushParser& p) {
+                size_t nRead = readSome(buff.data(), buff.size());
+                if (nRead == 0)
+                    return false;
+
+                return p.feed(DataChunk(buff.data(), buff.data() + nRead));
+            });
+
+            loadFromIterator(iter);
+
+            return fRootNode != nullptr;
+        }
         
-		static std::shared_ptr<SVGDocument> createFromFilename(const std::string& filename)
+        // Get rid of any tree we already have before
+        // the arena it might be sitting in
+        void resetTree(size_t arenaSize)
+        {
+            fCompiled = nullptr;
+            fRootNode = nullptr;
+            fArena = nullptr;
+
+            if (fUseArena)
+                fArena = std::make_unique<SVGArena>(arenaSize);
+        }
+
+        //
+        // Compiled files
+        // Once a document is loaded, what it draws can be written out in
+        // a form that is mapped back in and drawn without any parsing at all.
+        // The compiled file remembers which source it came from, so one that
+        // no longer matches the source is turned away.
+        //
+        // saveCompiled() returns false if the document uses something the
+        // compiled form can't represent (text, images, patterns), in which
+        // case the document should just be loaded from its source every time.
+        //
+        bool saveCompiled(const std::string& filename)
+        {
+            if ((fRootNode == nullptr) || (fFileMap == nullptr))
+                return false;
+
+            SVGCompileGraphics recorder;
+            fRootNode->draw(recorder);
+
+            SVGCompiledHeader hdr{};
+            hdr.sourceHash = svgSourceHash((const uint8_t*)fFileMap->data(), fFileMap->size());
+            hdr.sourceSize = fFileMap->size();
+            hdr.x = x();
+            hdr.y = y();
+            hdr.width = width();
+            hdr.height = height();
+            hdr.nodeCount = nodeCount();
+
+            return recorder.save(filename, hdr);
+        }
+
+        // Use a compiled file instead of the source, if it matches the source
+        // Returns false if it doesn't, and the document is left as it was.
+        bool loadCompiled(const std::string& filename)
+        {
+            if (fFileMap == nullptr)
+                return false;
+
+            auto img = SVGCompiledImage::createFromFile(filename,
+                svgSourceHash((const uint8_t*)fFileMap->data(), fFileMap->size()), fFileMap->size());
+            if (img == nullptr)
+                return false;
+
+            fRootNode = nullptr;
+            fArena = nullptr;
+            fCompiled = img;
+
+            return true;
+        }
+
+        // Load from the compiled file if it's good, otherwise load the source,
+        // and write a fresh compiled file for next time
+        bool loadCached(const std::string& compiledFilename)
+        {
+            if (loadCompiled(compiledFilename))
+                return true;
+
+            if (!load())
+                return false;
+
+            saveCompiled(compiledFilename);
+
+            return fRootNode != nullptr;
+        }
+
+		static std::shared_ptr<SVGDocument> createFromFilename(const std::string& filename, bool useArena = false)
 		{
 			auto doc = std::make_shared<SVGDocument>(filename);
+            doc->setArenaMode(useArena);
             doc->load();
             
             return doc;
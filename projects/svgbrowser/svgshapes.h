@@ -62,6 +62,31 @@ namespace svg {
 	};
 
 
+	// Bounding box utilities used when culling nodes against render tiles
+	static INLINE bool svgBoxesIntersect(const BLBox& a, const BLBox& b)
+	{
+		return (a.x0 < b.x1) && (a.x1 > b.x0) && (a.y0 < b.y1) && (a.y1 > b.y0);
+	}
+
+	static INLINE BLBox svgBoxUnion(const BLBox& a, const BLBox& b)
+	{
+		return BLBox(std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1));
+	}
+
+	// The axis aligned box that contains the transformed corners of a box
+	static INLINE BLBox svgTransformBox(const BLMatrix2D& m, const BLBox& b)
+	{
+		BLPoint p0 = m.mapPoint(b.x0, b.y0);
+		BLPoint p1 = m.mapPoint(b.x1, b.y0);
+		BLPoint p2 = m.mapPoint(b.x1, b.y1);
+		BLPoint p3 = m.mapPoint(b.x0, b.y1);
+
+		return BLBox(std::min(std::min(p0.x, p1.x), std::min(p2.x, p3.x)),
+			std::min(std::min(p0.y, p1.y), std::min(p2.y, p3.y)),
+			std::max(std::max(p0.x, p1.x), std::max(p2.x, p3.x)),
+			std::max(std::max(p0.y, p1.y), std::max(p2.y, p3.y)));
+	}
+
 	//
 	// SVGVisualObject
 	// This is any object that will change the state of the rendering context
@@ -70,7 +95,13 @@ namespace svg {
 	// Most things, other than basic attribute type, will be a sub-class of this
 	struct SVGVisualNode : public SVGObject
 	{
-		std::map<std::string, std::shared_ptr<SVGVisualProperty>> fVisualProperties{};
+		svg_map<svg_string, std::shared_ptr<SVGVisualProperty>> fVisualProperties{};
+
+		// Bounding box in document space, filled in by computeBounds()
+		// If fHasBounds is false, the extent is unknown, and the node
+		// is drawn in every tile.
+		BLBox fBounds{};
+		bool fHasBounds{ false };
 
 		SVGVisualNode() = default;
 		SVGVisualNode(IMapSVGNodes* root)
@@ -112,13 +143,18 @@ namespace svg {
 			for (auto& propconv : gSVGPropertyCreation)
 			{
 				// get the named attribute
-				auto attrName = propconv.first;
+				auto& attrName = propconv.first;
+
+				// Don't bother creating a property for an
+				// attribute the element doesn't have
+				if (!elem.getAttribute(attrName))
+					continue;
 
 				// We have a property and value, convert to SVGVisibleProperty
 				// and add it to our map of visual properties
 				auto prop = propconv.second(root(), attrName, elem);
 				if (prop->isSet())
-					fVisualProperties[attrName] = prop;
+					fVisualProperties.insert_or_assign(svg_string(attrName.data(), attrName.size()), prop);
 
 			}
 		}
@@ -231,7 +267,68 @@ namespace svg {
 			ctx.pop();
 		}
 		
-		
+		//
+		// Tiled drawing
+		// drawTile() is the same as draw(), except nodes whose bounds do
+		// not touch the tile (in document space) are skipped entirely.
+		// That's only safe because everything a node sets, fill and stroke
+		// included, is undone by the pop() that ends its draw.
+		//
+		bool intersectsTile(const BLBox& tile) const
+		{
+			return !fHasBounds || svgBoxesIntersect(fBounds, tile);
+		}
+
+		virtual void drawSelfTile(IGraphics& ctx, const BLBox& tile)
+		{
+			drawSelf(ctx);
+		}
+
+		virtual void drawTile(IGraphics& ctx, const BLBox& tile)
+		{
+			if (!visible() || !intersectsTile(tile))
+				return;
+
+			ctx.push();
+
+			applyAttributes(ctx);
+
+			drawSelfTile(ctx, tile);
+
+			ctx.pop();
+		}
+
+		// Combine the parent's transform and stroke extent with
+		// our own transform and stroke properties
+		void inheritedState(const BLMatrix2D& parentMatrix, double parentStroke, BLMatrix2D& m, double& strokeExtent) const
+		{
+			m = parentMatrix;
+			auto tform = fVisualProperties.find("transform");
+			if (tform != fVisualProperties.end() && tform->second->isSet())
+				m.transform(static_cast<SVGTransform*>(tform->second.get())->getTransform());
+
+			strokeExtent = parentStroke;
+			auto sw = fVisualProperties.find("stroke-width");
+			if (sw != fVisualProperties.end() && sw->second->isSet())
+			{
+				// Half the width on each side, and miter joins can
+				// reach out further still, so be generous
+				double width = static_cast<SVGStrokeWidth*>(sw->second.get())->fWidth;
+				double miter = 4.0;
+				auto ml = fVisualProperties.find("stroke-miterlimit");
+				if (ml != fVisualProperties.end() && ml->second->isSet())
+					miter = std::max(1.0, static_cast<SVGStrokeMiterLimit*>(ml->second.get())->fMiterLimit);
+
+				strokeExtent = (width / 2.0) * miter;
+			}
+		}
+
+		// Figure out where this node lands in document space
+		// The default is that we don't know
+		virtual void computeBounds(const BLMatrix2D& parentMatrix, double parentStroke)
+		{
+			fHasBounds = false;
+		}
 	};
 	
 	struct SVGShape : public SVGVisualNode
@@ -249,7 +346,7 @@ namespace svg {
 		
 		static std::shared_ptr<SVGShape> createFromXml(const XmlElement& elem)
 		{
-			auto shape = std::make_shared<SVGShape>();
+			auto shape = svg_make_shared<SVGShape>();
 			shape->loadFromXmlElement(elem);
 
 			return shape;
@@ -259,7 +356,7 @@ namespace svg {
 	struct SVGTemplateNode : public SVGVisualNode
 	{
 		std::shared_ptr<SVGObject> fWrappedNode{};
-		std::string fWrappedID{};
+		svg_string fWrappedID{};
 
 		double fX = 0;
 		double fY = 0;
@@ -325,13 +422,13 @@ namespace svg {
 			{
 				href++;
 			}
-			fWrappedID = toString(href);
+			fWrappedID.assign((const char*)href.fStart, chunk_size(href));
 		}
 
 
 		static std::shared_ptr<SVGTemplateNode> createFromXml(IMapSVGNodes* iMap, const XmlElement& elem)
 		{
-			auto shape = std::make_shared<SVGTemplateNode>(iMap);
+			auto shape = svg_make_shared<SVGTemplateNode>(iMap);
 			shape->loadFromXmlElement(elem);
 
 			return shape;
@@ -344,12 +441,39 @@ namespace svg {
 		
 		//SVGPathBasedShape() :SVGVisualNode() {}
 		SVGPathBasedShape(IMapSVGNodes* iMap) :SVGVisualNode(iMap) {}
+
+		void releaseArenaResources() override
+		{
+			fPath.reset();
+			SVGVisualNode::releaseArenaResources();
+		}
 		
 		
 		void drawSelf(IGraphics &ctx) override
 		{
 			ctx.path(fPath);
 		}
+
+		void computeBounds(const BLMatrix2D& parentMatrix, double parentStroke) override
+		{
+			fHasBounds = false;
+
+			BLMatrix2D m{};
+			double strokeExtent = 0;
+			inheritedState(parentMatrix, parentStroke, m, strokeExtent);
+
+			BLBox b{};
+			if (fPath.empty() || (fPath.getBoundingBox(&b) != BL_SUCCESS))
+				return;
+
+			b.x0 -= strokeExtent;
+			b.y0 -= strokeExtent;
+			b.x1 += strokeExtent;
+			b.y1 += strokeExtent;
+
+			fBounds = svgTransformBox(m, b);
+			fHasBounds = true;
+		}
 	};
 	
 	struct SVGLine : public SVGPathBasedShape
@@ -380,7 +504,7 @@ namespace svg {
 
 		static std::shared_ptr<SVGLine> createFromXml(IMapSVGNodes *iMap, const XmlElement& elem)
 		{
-			auto shape = std::make_shared<SVGLine>(iMap);
+			auto shape = svg_make_shared<SVGLine>(iMap);
 			shape->loadFromXmlElement(elem);
 
 			return shape;
@@ -442,7 +566,7 @@ namespace svg {
 		
 		static std::shared_ptr<SVGRect> createFromXml(IMapSVGNodes* iMap, const XmlElement& elem)
 		{
-			auto shape = std::make_shared<SVGRect>(iMap);
+			auto shape = svg_make_shared<SVGRect>(iMap);
 			shape->loadFromXmlElement(elem);
 
 			return shape;
@@ -469,7 +593,7 @@ namespace svg {
 
 		static std::shared_ptr<SVGCircle> createFromXml(IMapSVGNodes* iMap, const XmlElement& elem)
 		{
-			auto shape = std::make_shared<SVGCircle>(iMap);
+			auto shape = svg_make_shared<SVGCircle>(iMap);
 			shape->loadFromXmlElement(elem);
 
 			return shape;
@@ -497,7 +621,7 @@ namespace svg {
 
 		static std::shared_ptr<SVGEllipse> createFromXml(IMapSVGNodes* iMap, const XmlElement& elem)
 		{
-			auto shape = std::make_shared<SVGEllipse>(iMap);
+			auto shape = svg_make_shared<SVGEllipse>(iMap);
 			shape->loadFromXmlElement(elem);
 			
 			return shape;
@@ -528,7 +652,7 @@ namespace svg {
 
 		static std::shared_ptr<SVGPolyline> createFromXml(IMapSVGNodes* iMap, const XmlElement& elem)
 		{
-			auto shape = std::make_shared<SVGPolyline>(iMap);
+			auto shape = svg_make_shared<SVGPolyline>(iMap);
 			shape->loadFromXmlElement(elem);
 
 			return shape;
@@ -558,7 +682,7 @@ namespace svg {
 
 		static std::shared_ptr<SVGPolygon> createFromXml(IMapSVGNodes* iMap, const XmlElement& elem)
 		{
-			auto shape = std::make_shared<SVGPolygon>(iMap);
+			auto shape = svg_make_shared<SVGPolygon>(iMap);
 			shape->loadFromXmlElement(elem);
 
 			return shape;
@@ -576,12 +700,16 @@ namespace svg {
 			SVGPathBasedShape::loadSelfFromXml(elem);
 			
 			auto d = elem.getAttribute("d");
+
+			// Size the path up front, rather than growing it a vertex at
+			// a time.  A vertex takes several characters of path data.
+			fPath.reserve(chunk_size(d) / 6);
 			auto success = blPathFromCommands(d, fPath);
 		}
 
 		static std::shared_ptr<SVGPath> createFromXml(IMapSVGNodes* iMap, const XmlElement& elem)
 		{
-			auto path = std::make_shared<SVGPath>(iMap);
+			auto path = svg_make_shared<SVGPath>(iMap);
 			path->loadFromXmlElement(elem);
 			
 			return path;
@@ -611,6 +739,12 @@ namespace svg {
 			return *this;
 		}
 
+		void releaseArenaResources() override
+		{
+			fImage.reset();
+			SVGVisualNode::releaseArenaResources();
+		}
+
 		const BLVar& getVariant() override
 		{
 			if (fVar.isNull())
@@ -652,6 +786,16 @@ namespace svg {
 			ctx.scaleImage(fImage, 0, 0, fImage.size().w, fImage.size().h, fX, fY, fWidth, fHeight);
 		}
 
+		void computeBounds(const BLMatrix2D& parentMatrix, double parentStroke) override
+		{
+			BLMatrix2D m{};
+			double strokeExtent = 0;
+			inheritedState(parentMatrix, parentStroke, m, strokeExtent);
+
+			fBounds = svgTransformBox(m, BLBox(fX, fY, fX + fWidth, fY + fHeight));
+			fHasBounds = true;
+		}
+
 		void loadSelfFromXml(const XmlElement& elem) override
 		{
 			SVGVisualNode::loadSelfFromXml(elem);
@@ -676,7 +820,7 @@ namespace svg {
 
 		static std::shared_ptr<SVGImageNode> createFromXml(IMapSVGNodes* iMap, const XmlElement& elem)
 		{
-			auto node = std::make_shared<SVGImageNode>(iMap);
+			auto node = svg_make_shared<SVGImageNode>(iMap);
 			node->loadFromXmlElement(elem);
 
 			return node;
@@ -708,10 +852,10 @@ namespace svg {
 		
 		int buildState = BUILD_STATE_OPEN;
 		
-		std::vector<std::shared_ptr<SVGVisualNode>> fNodes{};
+		svg_vector<std::shared_ptr<SVGVisualNode>> fNodes{};
 
 		bool fInDefinitions{ false };
-		std::map<std::string, std::shared_ptr<SVGObject>> fDefinitions;
+		svg_map<svg_string, std::shared_ptr<SVGObject>> fDefinitions{};
 
 		
 		SVGCompoundNode() : SVGShape() {}
@@ -758,19 +902,26 @@ namespace svg {
 		bool inDefinitions() const override { return fInDefinitions; }
 		void setInDefinitions(bool indefs) override { fInDefinitions = indefs; };
 
-		void addDefinition(const std::string& name, std::shared_ptr<SVGObject> obj)
+		void addDefinition(std::string_view name, std::shared_ptr<SVGObject> obj)
 		{
 			if (fRoot == this)
-				fDefinitions[name] = obj;
+				fDefinitions.insert_or_assign(svg_string(name.data(), name.size()), obj);
 			else if (fRoot != nullptr)
 				fRoot->addDefinition(name, obj);
 
 		}
 		
-		std::shared_ptr<SVGObject> findNodeById(const std::string& name) override
+		std::shared_ptr<SVGObject> findNodeById(std::string_view name) override
 		{
 			if (fRoot == this)
-				return fDefinitions[name];
+			{
+				// Use find() rather than [], so a lookup never
+				// adds an entry to the map
+				auto it = fDefinitions.find(name);
+				if (it != fDefinitions.end())
+					return it->second;
+				return nullptr;
+			}
 			else if (fRoot)
 				return fRoot->findNodeById(name);
 
@@ -806,6 +957,43 @@ namespace svg {
 				node->draw(ctx);
 			}
 		}
+
+		void drawSelfTile(IGraphics& ctx, const BLBox& tile) override
+		{
+			for (auto& node : fNodes) {
+				node->drawTile(ctx, tile);
+			}
+		}
+
+		// Our bounds are the union of our children's bounds
+		// If any one of them is unknown, then so are ours
+		void computeBounds(const BLMatrix2D& parentMatrix, double parentStroke) override
+		{
+			BLMatrix2D m{};
+			double strokeExtent = 0;
+			inheritedState(parentMatrix, parentStroke, m, strokeExtent);
+
+			bool known = true;
+			bool first = true;
+			BLBox b{};
+
+			for (auto& node : fNodes)
+			{
+				node->computeBounds(m, strokeExtent);
+
+				if (!node->fHasBounds)
+				{
+					known = false;
+					continue;
+				}
+
+				b = first ? node->fBounds : svgBoxUnion(b, node->fBounds);
+				first = false;
+			}
+
+			fHasBounds = known && !first;
+			fBounds = b;
+		}
 		
 		void drawSelfProgressive(IGraphics& ctx, double percent, size_t totalNodes, size_t &nodesDrawn) override
 		{
@@ -856,7 +1044,7 @@ namespace svg {
 		
 		virtual void loadCompoundNode(XmlElementIterator& iter)
 		{
-			auto node = std::make_shared<SVGCompoundNode>(fRoot);
+			auto node = svg_make_shared<SVGCompoundNode>(fRoot);
 			node->loadFromIterator(iter);
 			addNode(node);
 		}
@@ -933,7 +1121,7 @@ namespace svg {
 		
 		static std::shared_ptr<SVGCompoundNode> createFromIterator(XmlElementIterator& iter)
 		{
-			auto node = std::make_shared<SVGCompoundNode>();
+			auto node = svg_make_shared<SVGCompoundNode>();
 			node->loadFromIterator(iter);
 
 			return node;
@@ -950,7 +1138,7 @@ namespace svg {
 		double y{};
 		double dy = 0;
 
-		std::string fText;
+		svg_string fText;
 		
 		SVGTextNode() :SVGCompoundNode() {}
 		SVGTextNode(IMapSVGNodes* root) :SVGCompoundNode(root) {}
@@ -962,6 +1150,19 @@ namespace svg {
 
 			SVGCompoundNode::drawSelf(ctx);
 		}
+
+		// We don't know how big text is until it's measured
+		// so text is drawn in full, in every tile
+		void drawSelfTile(IGraphics& ctx, const BLBox& tile) override
+		{
+			drawSelf(ctx);
+		}
+
+		void computeBounds(const BLMatrix2D& parentMatrix, double parentStroke) override
+		{
+			SVGCompoundNode::computeBounds(parentMatrix, parentStroke);
+			fHasBounds = false;
+		}
 		
 		virtual void loadSelfFromXml(const XmlElement& elem)
 		{
@@ -976,7 +1177,7 @@ namespace svg {
 		void loadContentNode(const XmlElement& elem) override
 		{
 			// Do something with content nodes	
-			fText = toString(elem.data());
+			fText.assign((const char*)elem.data().fStart, chunk_size(elem.data()));
 		}
 
 		void loadCompoundNode(XmlElementIterator& iter) override
@@ -984,7 +1185,7 @@ namespace svg {
 			// Most likely a <tspan>
 			if ((*iter).name() == "tspan")
 			{
-				auto node = std::make_shared<SVGTextNode>(fRoot);
+				auto node = svg_make_shared<SVGTextNode>(fRoot);
 				node->loadFromIterator(iter);
 				addNode(node);
 			}
@@ -1005,7 +1206,7 @@ namespace svg {
 	{
 		double x;
 		double y;
-		std::string fText;
+		svg_string fText;
 
 		SVGStyleNode() :SVGCompoundNode() {}
 		SVGStyleNode(IMapSVGNodes* root) :SVGCompoundNode(root) {}
@@ -1037,6 +1238,12 @@ namespace svg {
 
 		SVGPatternNode(IMapSVGNodes* root) :SVGCompoundNode(root) {}
 
+		void releaseArenaResources() override
+		{
+			fPattern.reset();
+			SVGCompoundNode::releaseArenaResources();
+		}
+
 		const BLVar& getVariant() override
 		{
 			// This should be called
@@ -1128,6 +1335,13 @@ namespace svg {
 		}
 		SVGGradient(const SVGGradient& other) = delete;
 		SVGGradient operator=(const SVGGradient& other) = delete;
+
+		void releaseArenaResources() override
+		{
+			fGradientVar.reset();
+			fGradient.reset();
+			SVGCompoundNode::releaseArenaResources();
+		}
 		
 		const BLVar& getVariant() override
 		{	
@@ -1377,13 +1591,13 @@ namespace svg {
 		{
 			if (elem.name() == "linearGradient")
 			{
-				auto node = std::make_shared<SVGLinearGradient>(root());
+				auto node = svg_make_shared<SVGLinearGradient>(root());
 				node->loadFromXmlElement(elem);
 				addNode(node);
 			}
 			else if (elem.name() == "radialGradient")
 			{
-				auto node = std::make_shared<SVGRadialGradient>(root());
+				auto node = svg_make_shared<SVGRadialGradient>(root());
 				node->loadFromXmlElement(elem);
 				addNode(node);
 			}
@@ -1406,57 +1620,57 @@ namespace svg {
 			// BUGBUG - "image" can be compound as well
 			if (elem.name() == "g")
 			{
-				auto node = std::make_shared<SVGGroup>(root());
+				auto node = svg_make_shared<SVGGroup>(root());
 				node->loadFromIterator(iter);
 				addNode(node);
 			}
 			else if (elem.name() == "defs")
 			{
 				setInDefinitions(true);
-				auto node = std::make_shared<SVGGroup>(root());
+				auto node = svg_make_shared<SVGGroup>(root());
 				node->loadFromIterator(iter);
 				addNode(node);
 				setInDefinitions(false);
 			}
 			else if (elem.name() == "linearGradient")
 			{
-				auto node = std::make_shared<SVGLinearGradient>(root());
+				auto node = svg_make_shared<SVGLinearGradient>(root());
 				node->loadFromIterator(iter);
 				addNode(node);
 			}
 			else if (elem.name() == "pattern")
 			{
-				auto node = std::make_shared<SVGPatternNode>(root());
+				auto node = svg_make_shared<SVGPatternNode>(root());
 				node->loadFromIterator(iter);
 				addNode(node);
 			}
 			else if (elem.name() == "radialGradient")
 			{
-				auto node = std::make_shared<SVGRadialGradient>(root());
+				auto node = svg_make_shared<SVGRadialGradient>(root());
 				node->loadFromIterator(iter);
 				addNode(node);
 			}
 			else if (elem.name() == "text")
 			{
-				auto node = std::make_shared<SVGTextNode>(root());
+				auto node = svg_make_shared<SVGTextNode>(root());
 				node->loadFromIterator(iter);
 				addNode(node);
 			}
 			else if (elem.name() == "symbol")
 			{
-				auto  node = std::make_shared<SVGGroup>(root());
+				auto  node = svg_make_shared<SVGGroup>(root());
 				node->loadFromIterator(iter);
 				addNode(node);
 			}
 			else if (elem.name() == "style")
 			{
-				auto node = std::make_shared<SVGStyleNode>(root());
+				auto node = svg_make_shared<SVGStyleNode>(root());
 				node->loadFromIterator(iter);
 				addNode(node);
 			}
 			else {
 				//printf("loadCompoundNode: UNKNOWN: %s\n", elem.name().c_str());
-				auto node = std::make_shared<SVGGroup>(root());
+				auto node = svg_make_shared<SVGGroup>(root());
 				node->loadFromIterator(iter);
 				addNode(node);
 			}
@@ -1464,7 +1678,7 @@ namespace svg {
 
 		static std::shared_ptr<SVGGroup> createFromIterator(XmlElementIterator& iter)
 		{
-			auto node = std::make_shared<SVGGroup>();
+			auto node = svg_make_shared<SVGGroup>();
 			node->loadFromIterator(iter);
 
 			return node;
@@ -1488,6 +1702,12 @@ namespace svg {
 
 		SVGPortal(IMapSVGNodes *root) :SVGVisualProperty(root) {}
 
+		void releaseArenaResources() override
+		{
+			fViewbox.releaseArenaResources();
+			SVGVisualProperty::releaseArenaResources();
+		}
+
 		
 
 		SVGPortal& operator=(const SVGPortal& rhs)
@@ -1567,7 +1787,7 @@ namespace svg {
 		
 		static std::shared_ptr<SVGPortal> createFromXml(IMapSVGNodes* root, const XmlElement& elem, const std::string &name)
 		{
-			auto node = std::make_shared<SVGPortal>(root);
+			auto node = svg_make_shared<SVGPortal>(root);
 			node->loadFromXmlElement(elem);
 
 			return node;
@@ -1585,6 +1805,12 @@ namespace svg {
 		{
 			setRoot(this);
 		}
+
+		void releaseArenaResources() override
+		{
+			fPortal.releaseArenaResources();
+			SVGGroup::releaseArenaResources();
+		}
 		
 		const SVGViewbox& viewBox() const 
 		{ 
@@ -1621,7 +1847,7 @@ namespace svg {
 
 		static std::shared_ptr<SVGRootNode> createFromIterator(XmlElementIterator& iter)
 		{
-			auto node = std::make_shared<SVGRootNode>(nullptr);
+			auto node = svg_make_shared<SVGRootNode>(nullptr);
 			node->loadFromIterator(iter);
 
 			return node;
@@ -1658,6 +1884,30 @@ namespace svg {
 			ctx.pop();
 		}
 
+		// Same as draw(), but skipping whatever falls outside the tile
+		void drawTile(IGraphics& ctx, const BLBox& tile) override
+		{
+			ctx.push();
+
+			ctx.strokeBeforeTransform(true);
+			ctx.blendMode(BLCompOp::BL_COMP_OP_SRC_OVER);
+			ctx.strokeJoin(SVG_JOIN_ROUND);
+			ctx.ellipseMode(ELLIPSEMODE::CENTER);
+			ctx.noStroke();
+			ctx.fill(Pixel(0, 0, 0));
+			
+			ctx.strokeWeight(1.0);
+
+			ctx.textSize(16);
+			ctx.textAlign(ALIGNMENT::LEFT, ALIGNMENT::BASELINE);
+
+			applyAttributes(ctx);
+
+			drawSelfTile(ctx, tile);
+
+			ctx.pop();
+		}
+
 		// draw no more children than are available based on the percent
 		void drawProgressive(IGraphics& ctx, double percent, size_t totalNodes, size_t &nodesDone) override
 		{
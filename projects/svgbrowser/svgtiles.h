@@ -0,0 +1,155 @@
+#pragma once
+
+//
+// Tile parallel rendering support for SVG documents
+//
+// The idea is simple.  The target image is carved up into square tiles.
+// Each tile gets its own BLContext, attached directly to the pixels of
+// that tile within the shared target image, so there is no copying
+// afterwards.  A tile's context has its origin shifted by the tile's
+// position, so the document is drawn with exactly the same transforms
+// as it would be if drawn into the whole image at once, and since the
+// tile offsets are whole pixels, the rasterization is the same as well.
+//
+// Nodes carry a bounding box in document space (SVGVisualNode::computeBounds)
+// so each tile only bothers with the nodes that can actually touch it.
+//
+// Tiles are handed out to a small pool of worker threads, with the calling
+// thread pitching in as well.
+//
+
+#include "BLGraphics.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace svg
+{
+	//
+	// SVGTileGraphics
+	// A BLGraphics that draws into a rectangular window of a larger image
+	//
+	struct SVGTileGraphics : public BLGraphics
+	{
+		BLImage fTileImage{};
+
+		SVGTileGraphics(const BLImageData& target, int x, int y, int w, int h)
+		{
+			uint8_t* pixels = (uint8_t*)target.pixelData + (intptr_t)y * target.stride + (intptr_t)x * 4;
+			blImageInitAsFromData(&fTileImage, w, h, (BLFormat)target.format, pixels, target.stride, BL_DATA_ACCESS_RW, nullptr, nullptr);
+
+			// Each tile is already being drawn on its own thread
+			// so the context itself should not spin up any more
+			BLContextCreateInfo createInfo{};
+			createInfo.threadCount = 0;
+			fCtx.begin(fTileImage, createInfo);
+
+			// Move the tile's origin, and make that the base
+			// for whatever transforms are applied while drawing
+			fCtx.translate(-(double)x, -(double)y);
+			fCtx.userToMeta();
+		}
+
+		virtual ~SVGTileGraphics()
+		{
+			fCtx.end();
+		}
+	};
+
+	//
+	// SVGWorkerPool
+	// A fixed set of threads that run a numbered set of jobs
+	// run() blocks until all of the jobs are done.  The calling
+	// thread takes jobs as well, so a pool of (n-1) workers gives
+	// n threads of rendering.
+	//
+	class SVGWorkerPool
+	{
+		std::vector<std::thread> fThreads{};
+		std::mutex fMutex{};
+		std::condition_variable fWake{};
+		std::condition_variable fDone{};
+
+		std::function<void(int)> fJob{};
+		std::atomic<int> fNextJob{ 0 };
+		int fJobCount{ 0 };
+		int fBusyWorkers{ 0 };
+		uint64_t fGeneration{ 0 };
+		bool fQuit{ false };
+
+		void runJobs()
+		{
+			int job;
+			while ((job = fNextJob.fetch_add(1)) < fJobCount)
+				fJob(job);
+		}
+
+		void workerLoop()
+		{
+			uint64_t seen = 0;
+
+			while (true)
+			{
+				{
+					std::unique_lock<std::mutex> lock(fMutex);
+					fWake.wait(lock, [&] { return fQuit || (fGeneration != seen); });
+					if (fQuit)
+						return;
+					seen = fGeneration;
+				}
+
+				runJobs();
+
+				{
+					std::unique_lock<std::mutex> lock(fMutex);
+					if (--fBusyWorkers == 0)
+						fDone.notify_one();
+				}
+			}
+		}
+
+	public:
+		SVGWorkerPool(int workers)
+		{
+			for (int i = 0; i < workers; i++)
+				fThreads.emplace_back([this] { workerLoop(); });
+		}
+
+		~SVGWorkerPool()
+		{
+			{
+				std::unique_lock<std::mutex> lock(fMutex);
+				fQuit = true;
+			}
+			fWake.notify_all();
+
+			for (auto& t : fThreads)
+				t.join();
+		}
+
+		size_t workerCount() const { return fThreads.size(); }
+
+		void run(int jobCount, const std::function<void(int)>& job)
+		{
+			{
+				std::unique_lock<std::mutex> lock(fMutex);
+				fJob = job;
+				fJobCount = jobCount;
+				fNextJob = 0;
+				fBusyWorkers = (int)fThreads.size();
+				fGeneration++;
+			}
+			fWake.notify_all();
+
+			runJobs();
+
+			std::unique_lock<std::mutex> lock(fMutex);
+			fDone.wait(lock, [&] { return fBusyWorkers == 0; });
+			fJob = nullptr;
+		}
+	};
+}
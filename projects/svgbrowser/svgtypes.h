@@ -10,6 +10,7 @@
 #include "cssscanner.h"
 #include "base64.h"
 #include "gifdec.h"
+#include "svgarena.h"
 
 
 // https://www.w3.org/TR/css3-values/#numbers
@@ -88,8 +89,8 @@ namespace svg {
     struct SVGObject : public IDrawable
     {
         IMapSVGNodes* fRoot{ nullptr };
-        std::string fId{};      // The id of the element
-        std::string fName{};    // The tag name of the element
+        svg_string fId{};       // The id of the element
+        svg_string fName{};     // The tag name of the element
         BLVar fVar{};
         bool fIsVisible{ true };
         maths::bbox2f fExtent{};
@@ -106,6 +107,14 @@ namespace svg {
         }
         SVGObject(IMapSVGNodes* root) :fRoot(root) {}
 		virtual ~SVGObject() = default;
+
+        // A node that lives in an arena is never destroyed, so this is where
+        // it hands back what Blend2D allocated for it.  Sub-classes holding
+        // Blend2D objects of their own release them, then call this.
+        virtual void releaseArenaResources()
+        {
+            fVar.reset();
+        }
         
 		SVGObject& operator=(const SVGObject& other) {
             fRoot = other.fRoot;
@@ -123,11 +132,11 @@ namespace svg {
 		IMapSVGNodes* root() const { return fRoot; }
         virtual void setRoot(IMapSVGNodes* root) { fRoot = root; }
         
-        const std::string& id() const { return fId; }
-        void setId(const std::string& id) { fId = id; }
+        const svg_string& id() const { return fId; }
+        void setId(std::string_view id) { fId.assign(id.data(), id.size()); }
         
-        const std::string& name() const { return fName; }
-        void setName(const std::string& name) { fName = name; }
+        const svg_string& name() const { return fName; }
+        void setName(std::string_view name) { fName.assign(name.data(), name.size()); }
 
 		const bool visible() const { return fIsVisible; }
 		void setVisible(bool visible) { 
@@ -158,7 +167,7 @@ namespace svg {
         {
             auto id = elem.getAttribute("id");
             if (id)
-                setId(std::string(id.fStart, id.fEnd));
+                setId(std::string_view((const char*)id.fStart, chunk_size(id)));
             
 
             
@@ -173,11 +182,11 @@ namespace svg {
     
     struct IMapSVGNodes
     {
-        virtual std::shared_ptr<SVGObject> findNodeById(const std::string& name) = 0;
+        virtual std::shared_ptr<SVGObject> findNodeById(std::string_view name) = 0;
         virtual std::shared_ptr<SVGObject> findNodeByHref(const DataChunk& href) = 0;
 
         
-        virtual void addDefinition(const std::string& name, std::shared_ptr<SVGObject> obj) = 0;
+        virtual void addDefinition(std::string_view name, std::shared_ptr<SVGObject> obj) = 0;
 
         virtual void setInDefinitions(bool indefs) = 0;
         virtual bool inDefinitions() const = 0;
@@ -467,7 +476,7 @@ namespace svg {
 
         static std::shared_ptr<SVGOpacity> createFromChunk(IMapSVGNodes* root, const std::string& name, const DataChunk& inChunk)
         {
-            std::shared_ptr<SVGOpacity> sw = std::make_shared<SVGOpacity>(root);
+            std::shared_ptr<SVGOpacity> sw = svg_make_shared<SVGOpacity>(root);
 
             // If the chunk is empty, return immediately 
             if (inChunk)
@@ -515,7 +524,7 @@ namespace svg {
 
         static std::shared_ptr<SVGFontSize> createFromChunk(IMapSVGNodes* root, const std::string& name, const DataChunk& inChunk)
         {
-            std::shared_ptr<SVGFontSize> sw = std::make_shared<SVGFontSize>(root);
+            std::shared_ptr<SVGFontSize> sw = svg_make_shared<SVGFontSize>(root);
 
             // If the chunk is empty, return immediately 
             if (inChunk)
@@ -534,7 +543,7 @@ namespace svg {
 	// attribute name="font-style" type="string" default="normal"
     struct SVGFontFamily : public SVGVisualProperty
     {
-        std::string fValue{ "Arial" };
+        svg_string fValue{ "Arial" };
 
 		SVGFontFamily(IMapSVGNodes* inMap) : SVGVisualProperty(inMap) {}
 		SVGFontFamily(const SVGFontFamily& other) :SVGVisualProperty(other) { fValue = other.fValue; }
@@ -556,13 +565,14 @@ namespace svg {
             if (!inChunk)
                 return;
             
-			fValue = toString(chunk_trim(inChunk, wspChars));
+			DataChunk family = chunk_trim(inChunk, wspChars);
+			fValue.assign((const char*)family.fStart, chunk_size(family));
 			set(true);
         }
 
         static std::shared_ptr<SVGFontFamily> createFromChunk(IMapSVGNodes* root, const std::string& name, const DataChunk& inChunk)
         {
-            std::shared_ptr<SVGFontFamily> sw = std::make_shared<SVGFontFamily>(root);
+            std::shared_ptr<SVGFontFamily> sw = svg_make_shared<SVGFontFamily>(root);
 
             // If the chunk is empty, return immediately 
             if (inChunk)
@@ -613,7 +623,7 @@ namespace svg {
 
         static std::shared_ptr<SVGTextAnchor> createFromChunk(IMapSVGNodes* root, const std::string& name, const DataChunk& inChunk)
         {
-            std::shared_ptr<SVGTextAnchor> sw = std::make_shared<SVGTextAnchor>(root);
+            std::shared_ptr<SVGTextAnchor> sw = svg_make_shared<SVGTextAnchor>(root);
 
             // If the chunk is empty, return immediately 
             if (inChunk)
@@ -658,7 +668,7 @@ namespace svg {
 
         static std::shared_ptr<SVGTextAlign> createFromChunk(IMapSVGNodes* root, const std::string& name, const DataChunk& inChunk)
         {
-            std::shared_ptr<SVGTextAlign> sw = std::make_shared<SVGTextAlign>(root);
+            std::shared_ptr<SVGTextAlign> sw = svg_make_shared<SVGTextAlign>(root);
 
             // If the chunk is empty, return immediately 
             if (inChunk)
@@ -946,6 +956,12 @@ namespace svg {
         {
             return fPaint;
         }
+
+        void releaseArenaResources() override
+        {
+            fPaint.reset();
+            SVGVisualProperty::releaseArenaResources();
+        }
         
         void setPaintFor(int pfor) { fPaintFor = pfor; }
         void setOpacity(float opacity)
@@ -1078,7 +1094,7 @@ namespace svg {
 
         static std::shared_ptr<SVGPaint> createFromChunk(IMapSVGNodes* root, const std::string& name, const DataChunk& inChunk)
         {
-            std::shared_ptr<SVGPaint> paint = std::make_shared<SVGPaint>(root);
+            std::shared_ptr<SVGPaint> paint = svg_make_shared<SVGPaint>(root);
 
             // If the chunk is empty, return immediately 
             if (inChunk)
@@ -1180,7 +1196,7 @@ namespace svg {
 
         static std::shared_ptr<SVGFillRule> createFromChunk(IMapSVGNodes* root, const std::string& name, const DataChunk& inChunk)
         {
-            std::shared_ptr<SVGFillRule> node = std::make_shared<SVGFillRule>(root);
+            std::shared_ptr<SVGFillRule> node = svg_make_shared<SVGFillRule>(root);
 
             // If the chunk is empty, return immediately 
             if (inChunk)
@@ -1225,7 +1241,7 @@ namespace svg {
 
 		static std::shared_ptr<SVGStrokeWidth> createFromChunk(IMapSVGNodes* root, const std::string& name, const DataChunk& inChunk)
 		{
-			std::shared_ptr<SVGStrokeWidth> sw = std::make_shared<SVGStrokeWidth>(root);
+			std::shared_ptr<SVGStrokeWidth> sw = svg_make_shared<SVGStrokeWidth>(root);
 
 			// If the chunk is empty, return immediately 
 			if (inChunk)
@@ -1274,7 +1290,7 @@ namespace svg {
 
 		static std::shared_ptr<SVGStrokeMiterLimit> createFromChunk(IMapSVGNodes* root, const std::string& name, const DataChunk& inChunk)
 		{
-			std::shared_ptr<SVGStrokeMiterLimit> sw = std::make_shared<SVGStrokeMiterLimit>(root);
+			std::shared_ptr<SVGStrokeMiterLimit> sw = svg_make_shared<SVGStrokeMiterLimit>(root);
 
 			// If the chunk is empty, return immediately 
 			if (inChunk)
@@ -1332,7 +1348,7 @@ namespace svg {
 
 		static std::shared_ptr<SVGStrokeLineCap> createFromChunk(IMapSVGNodes* root, const std::string& name, const DataChunk& inChunk)
 		{
-			std::shared_ptr<SVGStrokeLineCap> stroke = std::make_shared<SVGStrokeLineCap>(root);
+			std::shared_ptr<SVGStrokeLineCap> stroke = svg_make_shared<SVGStrokeLineCap>(root);
 
 			// If the chunk is empty, return immediately 
 			if (inChunk)
@@ -1392,7 +1408,7 @@ namespace svg {
         
 		static std::shared_ptr<SVGStrokeLineJoin> createFromChunk(IMapSVGNodes* root, const std::string& name, const DataChunk& inChunk)
 		{
-			std::shared_ptr<SVGStrokeLineJoin> stroke = std::make_shared<SVGStrokeLineJoin>(root);
+			std::shared_ptr<SVGStrokeLineJoin> stroke = svg_make_shared<SVGStrokeLineJoin>(root);
 
 			// If the chunk is empty, return immediately
 			if (inChunk)
@@ -1772,7 +1788,7 @@ namespace svg
 
         static std::shared_ptr<SVGTransform> createFromChunk(IMapSVGNodes* root, const std::string& name, const DataChunk& inChunk)
         {
-			std::shared_ptr<SVGTransform> tform = std::make_shared<SVGTransform>(root);
+			std::shared_ptr<SVGTransform> tform = svg_make_shared<SVGTransform>(root);
 
             // If the chunk is empty, return immediately 
             if (inChunk)
@@ -0,0 +1,628 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "maths.hpp"
+#include "pixelaccessor.h"
+
+#include "algebra.hpp"
+#include "renderer_gl.hpp"
+
+
+//
+// WorkerPool
+// A handful of threads that stay around between frames.
+// run() hands the same job to every worker, and waits
+// until they've all finished it.  The calling thread is
+// worker 0, so a pool of 1 has no threads at all.
+//
+class WorkerPool
+{
+    std::vector<std::thread> fThreads{};
+    std::mutex fMutex{};
+    std::condition_variable fStart{};
+    std::condition_variable fDone{};
+
+    std::function<void(unsigned)> fJob{};
+    uint64_t fGeneration = 0;
+    unsigned fRunning = 0;
+    bool fQuit = false;
+
+    void threadMain(unsigned self)
+    {
+        uint64_t seen = 0;
+        while (true)
+        {
+            std::function<void(unsigned)> job;
+            {
+                std::unique_lock<std::mutex> lock(fMutex);
+                fStart.wait(lock, [&] { return fQuit || fGeneration != seen; });
+                if (fQuit)
+                    return;
+                seen = fGeneration;
+                job = fJob;
+            }
+
+            job(self);
+
+            std::unique_lock<std::mutex> lock(fMutex);
+            if (--fRunning == 0)
+                fDone.notify_one();
+        }
+    }
+
+public:
+    WorkerPool(unsigned threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        for (unsigned i = 1; i < threadCount; i++)
+            fThreads.emplace_back(&WorkerPool::threadMain, this, i);
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(fMutex);
+            fQuit = true;
+        }
+        fStart.notify_all();
+
+        for (auto& t : fThreads)
+            t.join();
+    }
+
+    unsigned size() const { return (unsigned)fThreads.size() + 1; }
+
+    void run(const std::function<void(unsigned)>& job)
+    {
+        {
+            std::unique_lock<std::mutex> lock(fMutex);
+            fJob = job;
+            fRunning = (unsigned)fThreads.size();
+            fGeneration++;
+        }
+        fStart.notify_all();
+
+        job(0);
+
+        std::unique_lock<std::mutex> lock(fMutex);
+        fDone.wait(lock, [&] { return fRunning == 0; });
+    }
+};
+
+
+//
+// BinnedRenderer
+// Draws the same triangles SceneRenderer::triangle() does, but a whole
+// mesh at a time, in two steps, both spread across a WorkerPool.
+//
+//  1) Setup - every worker takes a run of the faces, calls the vertex
+//     shader, and sorts the triangles into the screen tiles they touch.
+//  2) Raster - workers take tiles, one at a time, and fill in the
+//     triangles of their tile, in face order.
+//
+// A tile is only ever touched by one thread, so there's no locking on
+// the pixels or the depth buffer, and triangles land in the same order
+// as they would one at a time, so the picture is the same.
+//
+// Within a tile, pixels are found with edge functions, stepped along a
+// row, four pixels at a time.  Depth is kept as float, and pixels are
+// written straight into the row.
+//
+// Hidden triangles are thrown out before they're shaded, with a
+// hierarchical depth buffer; the nearest and furthest depth of every
+// 8x8 block of pixels, and the furthest of every tile.  A triangle's
+// depth is somewhere between that of its nearest and furthest corner,
+// so if its nearest corner is behind everything in a tile, or a block,
+// none of it can be seen there.
+//
+// With setDepthPrepass(true), each tile is drawn twice; first only the
+// depth, then the color, shading only the fragments that ended up
+// nearest, so there's about one shader call per pixel that's seen.
+// That assumes the shader never discards a fragment.
+//
+// The shader needs the same two calls the demo's shader has
+//      void vertex(int iface, int nthvert, vec4f& gl_Position);
+//      bool fragment(const vec3f bar, maths::vec4b& color);
+// Each worker gets its own copy of it, and the vertex shader is run
+// again, on that copy, before shading the pixels of a face, so the
+// varyings are those of the face being shaded.
+//
+class BinnedRenderer
+{
+public:
+    static constexpr int kTileSize = 32;
+    static constexpr int kBlockSize = 8;    // of the hierarchical depth buffer
+
+    // What happened to the triangles, since the last resetStats()
+    struct Stats {
+        uint64_t triangles = 0;         // faces given to draw()
+        uint64_t trianglesCulled = 0;   // back facing, degenerate, or off screen
+        uint64_t trianglesHidden = 0;   // behind what was already drawn, everywhere they'd be
+        uint64_t tilesRejected = 0;     // a triangle, in a tile where it's hidden
+        uint64_t blocksRejected = 0;    // a triangle, in a block where it's hidden
+        uint64_t fragmentsShaded = 0;   // calls to the fragment shader
+
+        Stats& operator+=(const Stats& other)
+        {
+            triangles += other.triangles;
+            trianglesCulled += other.trianglesCulled;
+            trianglesHidden += other.trianglesHidden;
+            tilesRejected += other.tilesRejected;
+            blocksRejected += other.blocksRejected;
+            fragmentsShaded += other.fragmentsShaded;
+            return *this;
+        }
+    };
+
+private:
+    static constexpr int kBlocksPerTile = kTileSize / kBlockSize;
+
+    // One triangle, ready to be rasterized
+    struct TriSetup {
+        double x[3], y[3];  // screen position, after the perspective divide
+        double w[3];        // clip w, for perspective correct barycentrics
+        double z[3];        // clip z, interpolated for depth
+        double area;        // twice the signed area of the screen triangle
+        float minZ, maxZ;   // nearest and furthest corner
+        int face;
+        int minX, minY, maxX, maxY;     // pixels to consider, on screen
+    };
+
+    // What one worker found during setup; the bins hold
+    // indices into its own setups, for each tile
+    struct WorkerBins {
+        std::vector<TriSetup> setups{};
+        std::vector<std::vector<uint32_t>> tiles{};
+        Stats stats{};
+    };
+
+    enum class RasterPass {
+        COLOR,          // depth test, shade, write depth and color
+        DEPTH_ONLY,     // depth test, write depth
+        COLOR_EQUAL,    // shade only where the depth is the one already written
+    };
+
+    const SceneRenderer& fScene;
+    WorkerPool fPool;
+
+    int fWidth = 0;
+    int fHeight = 0;
+    int fTilesAcross = 0;
+    int fTilesDown = 0;
+    int fBlocksAcross = 0;
+    bool fDepthPrepass = false;
+
+    std::vector<float> fDepth{};
+    std::vector<float> fBlockMinZ{};    // nearest depth in each block
+    std::vector<float> fBlockMaxZ{};    // furthest depth in each block
+    std::vector<float> fTileMaxZ{};     // furthest depth in each tile
+    std::vector<WorkerBins> fBins{};
+    Stats fStats{};
+
+public:
+    BinnedRenderer(const SceneRenderer& scene, unsigned threadCount = 0)
+        : fScene(scene)
+        , fPool(threadCount)
+        , fBins(fPool.size())
+    {
+    }
+
+    unsigned threadCount() const { return fPool.size(); }
+
+    bool depthPrepass() const { return fDepthPrepass; }
+    void setDepthPrepass(const bool prepass) { fDepthPrepass = prepass; }
+
+    const Stats& stats() const { return fStats; }
+    void resetStats() { fStats = Stats{}; }
+
+    // Size the depth buffer to match, and clear it
+    void beginFrame(const int width, const int height)
+    {
+        if (width != fWidth || height != fHeight)
+        {
+            fWidth = width;
+            fHeight = height;
+            fTilesAcross = (width + kTileSize - 1) / kTileSize;
+            fTilesDown = (height + kTileSize - 1) / kTileSize;
+            fBlocksAcross = fTilesAcross * kBlocksPerTile;
+
+            fDepth.resize((size_t)width * height);
+            fBlockMinZ.resize((size_t)fBlocksAcross * fTilesDown * kBlocksPerTile);
+            fBlockMaxZ.resize(fBlockMinZ.size());
+            fTileMaxZ.resize((size_t)fTilesAcross * fTilesDown);
+
+            for (auto& bins : fBins)
+                bins.tiles.assign((size_t)fTilesAcross * fTilesDown, {});
+        }
+
+        std::fill(fDepth.begin(), fDepth.end(), std::numeric_limits<float>::max());
+        std::fill(fBlockMinZ.begin(), fBlockMinZ.end(), std::numeric_limits<float>::max());
+        std::fill(fBlockMaxZ.begin(), fBlockMaxZ.end(), std::numeric_limits<float>::max());
+        std::fill(fTileMaxZ.begin(), fTileMaxZ.end(), std::numeric_limits<float>::max());
+    }
+
+    // Render faceCount faces, with the shader, into fb
+    template <typename ShaderT>
+    void draw(const int faceCount, const ShaderT& shader, PixelAccessor<maths::vec4b>& fb)
+    {
+        // rasterBlock() writes whole rows of vec4b, so the frame buffer's
+        // rows had better be at least that big.  A PixelAccessor over a
+        // buffer with fewer bytes per pixel can't be drawn into here.
+        static_assert(sizeof(maths::vec4b) == 4, "frame buffer pixels are 4 bytes");
+        const size_t rowBytes = (size_t)(fb.stride() < 0 ? -fb.stride() : fb.stride());
+        assert(rowBytes >= fb.width() * sizeof(maths::vec4b));
+        if (rowBytes < fb.width() * sizeof(maths::vec4b))
+            return;
+
+        if (fWidth != (int)fb.width() || fHeight != (int)fb.height())
+            beginFrame((int)fb.width(), (int)fb.height());
+
+        const unsigned workers = fPool.size();
+        std::vector<ShaderT> shaders(workers, shader);
+
+        for (auto& bins : fBins) {
+            bins.setups.clear();
+            bins.stats = Stats{};
+            for (auto& tile : bins.tiles)
+                tile.clear();
+        }
+
+        // Setup, each worker a contiguous run of the faces, so
+        // reading the bins worker by worker keeps the face order
+        fPool.run([&](unsigned self) {
+            int first = (int)((int64_t)faceCount * self / workers);
+            int last = (int)((int64_t)faceCount * (self + 1) / workers);
+            setupFaces(first, last, shaders[self], fBins[self]);
+        });
+
+        for (auto& bins : fBins)
+            fStats += bins.stats;
+
+        // Raster, tiles handed out one at a time
+        std::atomic<int> nextTile{ 0 };
+        const int tileCount = fTilesAcross * fTilesDown;
+        std::vector<Stats> rasterStats(workers);
+
+        fPool.run([&](unsigned self) {
+            ShaderT& sh = shaders[self];
+            while (true)
+            {
+                int tile = nextTile.fetch_add(1, std::memory_order_relaxed);
+                if (tile >= tileCount)
+                    break;
+
+                if (fDepthPrepass) {
+                    rasterTile(tile, RasterPass::DEPTH_ONLY, sh, fb, rasterStats[self]);
+                    rasterTile(tile, RasterPass::COLOR_EQUAL, sh, fb, rasterStats[self]);
+                }
+                else {
+                    rasterTile(tile, RasterPass::COLOR, sh, fb, rasterStats[self]);
+                }
+            }
+        });
+
+        for (auto& st : rasterStats)
+            fStats += st;
+    }
+
+private:
+    template <typename ShaderT>
+    void setupFaces(const int first, const int last, ShaderT& shader, WorkerBins& bins)
+    {
+        bins.stats.triangles += last - first;
+
+        for (int face = first; face < last; face++)
+        {
+            vec4f clip_verts[3];
+            for (int j : {0, 1, 2})
+                shader.vertex(face, j, clip_verts[j]);
+
+            TriSetup tri;
+            tri.face = face;
+
+            double minX = std::numeric_limits<double>::max();
+            double minY = std::numeric_limits<double>::max();
+            double maxX = -std::numeric_limits<double>::max();
+            double maxY = -std::numeric_limits<double>::max();
+
+            for (int i = 0; i < 3; i++)
+            {
+                vec4f pt = fScene.Viewport * clip_verts[i];
+                tri.x[i] = pt[0] / pt[3];
+                tri.y[i] = pt[1] / pt[3];
+                tri.w[i] = pt[3];
+                tri.z[i] = clip_verts[i][2];
+
+                minX = std::min(minX, tri.x[i]);
+                minY = std::min(minY, tri.y[i]);
+                maxX = std::max(maxX, tri.x[i]);
+                maxY = std::max(maxY, tri.y[i]);
+            }
+
+            // Rounded outward, so they hold for the float depths of the pixels
+            tri.minZ = std::nextafter((float)std::min({ tri.z[0], tri.z[1], tri.z[2] }), -std::numeric_limits<float>::max());
+            tri.maxZ = std::nextafter((float)std::max({ tri.z[0], tri.z[1], tri.z[2] }), std::numeric_limits<float>::max());
+
+            // The same test SceneRenderer::barycentric() uses to throw
+            // away degenerate triangles, which also drops the back faces
+            tri.area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+            if (!(tri.area >= 1e-3)) {
+                bins.stats.trianglesCulled++;
+                continue;
+            }
+
+            tri.minX = (int)std::max(0., minX);
+            tri.minY = (int)std::max(0., minY);
+            tri.maxX = (int)std::min(fWidth - 1., maxX);
+            tri.maxY = (int)std::min(fHeight - 1., maxY);
+            if (tri.minX > tri.maxX || tri.minY > tri.maxY) {
+                bins.stats.trianglesCulled++;
+                continue;
+            }
+
+            // The depth of the tiles is what the meshes drawn before
+            // this one left, and doesn't change until the raster step
+            uint32_t index = (uint32_t)bins.setups.size();
+            bool binned = false;
+
+            for (int ty = tri.minY / kTileSize; ty <= tri.maxY / kTileSize; ty++)
+            {
+                for (int tx = tri.minX / kTileSize; tx <= tri.maxX / kTileSize; tx++)
+                {
+                    if (!overlapsTile(tri, tx, ty))
+                        continue;
+
+                    size_t tile = (size_t)ty * fTilesAcross + tx;
+                    if (tri.minZ > fTileMaxZ[tile]) {
+                        bins.stats.tilesRejected++;
+                        continue;
+                    }
+
+                    bins.tiles[tile].push_back(index);
+                    binned = true;
+                }
+            }
+
+            if (binned)
+                bins.setups.push_back(tri);
+            else
+                bins.stats.trianglesHidden++;
+        }
+    }
+
+    // Edge function i is positive on the inside of the edge
+    // opposite vertex i, and is area * barycentric i
+    static void edgeCoefficients(const TriSetup& tri, double a[3], double b[3], double c[3])
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            int j = (i + 1) % 3;
+            int k = (i + 2) % 3;
+            a[i] = tri.y[j] - tri.y[k];
+            b[i] = tri.x[k] - tri.x[j];
+            c[i] = tri.x[j] * tri.y[k] - tri.x[k] * tri.y[j];
+        }
+    }
+
+    // A big triangle's bounding box covers tiles it doesn't touch.
+    // If an edge is negative at all four corners of the part of the
+    // tile that matters, the whole of it is outside.
+    bool overlapsTile(const TriSetup& tri, const int tx, const int ty) const
+    {
+        int x0 = std::max(tx * kTileSize, tri.minX);
+        int y0 = std::max(ty * kTileSize, tri.minY);
+        int x1 = std::min(tx * kTileSize + kTileSize - 1, tri.maxX);
+        int y1 = std::min(ty * kTileSize + kTileSize - 1, tri.maxY);
+
+        double a[3], b[3], c[3];
+        edgeCoefficients(tri, a, b, c);
+
+        for (int i = 0; i < 3; i++)
+        {
+            // the corner furthest along the inside of the edge
+            double x = a[i] >= 0 ? x1 : x0;
+            double y = b[i] >= 0 ? y1 : y0;
+            if (a[i] * x + b[i] * y + c[i] < 0)
+                return false;
+        }
+
+        return true;
+    }
+
+    // Nearest and furthest depth of a block, from the pixels
+    void updateBlock(const int bx, const int by)
+    {
+        int x0 = bx * kBlockSize;
+        int y0 = by * kBlockSize;
+        int x1 = std::min(x0 + kBlockSize, fWidth);
+        int y1 = std::min(y0 + kBlockSize, fHeight);
+
+        float nearest = std::numeric_limits<float>::max();
+        float furthest = -std::numeric_limits<float>::max();
+        for (int y = y0; y < y1; y++)
+        {
+            const float* depthRow = &fDepth[(size_t)y * fWidth];
+            for (int x = x0; x < x1; x++) {
+                nearest = std::min(nearest, depthRow[x]);
+                furthest = std::max(furthest, depthRow[x]);
+            }
+        }
+
+        size_t block = (size_t)by * fBlocksAcross + bx;
+        fBlockMinZ[block] = nearest;
+        fBlockMaxZ[block] = furthest;
+    }
+
+    template <typename ShaderT>
+    void rasterTile(const int tile, const RasterPass pass, ShaderT& shader, PixelAccessor<maths::vec4b>& fb, Stats& stats)
+    {
+        const int tileX0 = (tile % fTilesAcross) * kTileSize;
+        const int tileY0 = (tile / fTilesAcross) * kTileSize;
+        const int tileX1 = std::min(tileX0 + kTileSize, fWidth) - 1;
+        const int tileY1 = std::min(tileY0 + kTileSize, fHeight) - 1;
+
+        int shadedFace = -1;
+
+        for (auto& bins : fBins)
+        {
+            for (uint32_t index : bins.tiles[tile])
+            {
+                const TriSetup& tri = bins.setups[index];
+
+                int x0 = std::max(tileX0, tri.minX);
+                int y0 = std::max(tileY0, tri.minY);
+                int x1 = std::min(tileX1, tri.maxX);
+                int y1 = std::min(tileY1, tri.maxY);
+
+                double a[3], b[3], c[3];
+                edgeCoefficients(tri, a, b, c);
+
+                // One block of the hierarchical depth at a time
+                for (int by = y0 / kBlockSize; by <= y1 / kBlockSize; by++)
+                {
+                    for (int bx = x0 / kBlockSize; bx <= x1 / kBlockSize; bx++)
+                    {
+                        size_t block = (size_t)by * fBlocksAcross + bx;
+                        if (tri.minZ > fBlockMaxZ[block]) {
+                            stats.blocksRejected++;
+                            continue;
+                        }
+
+                        // In front of everything in the block; no need to look
+                        bool inFront = (pass == RasterPass::COLOR) && tri.maxZ < fBlockMinZ[block];
+
+                        int written = rasterBlock(tri, a, b, c,
+                            std::max(x0, bx * kBlockSize), std::max(y0, by * kBlockSize),
+                            std::min(x1, bx * kBlockSize + kBlockSize - 1), std::min(y1, by * kBlockSize + kBlockSize - 1),
+                            pass, inFront, shader, shadedFace, fb, stats);
+
+                        if (written > 0 && pass != RasterPass::COLOR_EQUAL)
+                            updateBlock(bx, by);
+                    }
+                }
+            }
+        }
+
+        if (pass == RasterPass::COLOR_EQUAL)
+            return;
+
+        // The furthest depth of the tile, for the setup of the next mesh
+        float furthest = -std::numeric_limits<float>::max();
+        for (int by = tileY0 / kBlockSize; by <= tileY1 / kBlockSize; by++)
+            for (int bx = tileX0 / kBlockSize; bx <= tileX1 / kBlockSize; bx++)
+                furthest = std::max(furthest, fBlockMaxZ[(size_t)by * fBlocksAcross + bx]);
+        fTileMaxZ[tile] = furthest;
+    }
+
+    // The pixels of one triangle, within one block.
+    // Returns how many depths were written.
+    template <typename ShaderT>
+    int rasterBlock(const TriSetup& tri, const double a[3], const double b[3], const double c[3],
+        const int x0, const int y0, const int x1, const int y1,
+        const RasterPass pass, const bool inFront, ShaderT& shader, int& shadedFace,
+        PixelAccessor<maths::vec4b>& fb, Stats& stats)
+    {
+        int written = 0;
+
+        // The edges at the first pixel of the block; from there they
+        // only change by 'a' for each step along x, and 'b' along y.
+        // A block is small enough that the sums don't drift.
+        double rowE[3];
+        for (int i = 0; i < 3; i++)
+            rowE[i] = a[i] * x0 + b[i] * y0 + c[i];
+
+        for (int y = y0; y <= y1; y++)
+        {
+            maths::vec4b* row = (maths::vec4b*)fb.rowPointer(y);
+            float* depthRow = &fDepth[(size_t)y * fWidth];
+
+            double e[3][4];
+            for (int i = 0; i < 3; i++)
+                for (int lane = 0; lane < 4; lane++)
+                    e[i][lane] = rowE[i] + a[i] * lane;
+
+            for (int x = x0; x <= x1; x += 4)
+            {
+                // the edges at four pixels at once
+                if (x > x0)
+                {
+                    for (int i = 0; i < 3; i++)
+                        for (int lane = 0; lane < 4; lane++)
+                            e[i][lane] += 4 * a[i];
+                }
+
+                int mask = 0;
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    bool inside = (x + lane <= x1) && e[0][lane] >= 0 && e[1][lane] >= 0 && e[2][lane] >= 0;
+                    mask |= inside << lane;
+                }
+
+                if (mask == 0)
+                    continue;
+
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    if (!(mask & (1 << lane)))
+                        continue;
+
+                    const int px = x + lane;
+
+                    // perspective correct barycentrics, as SceneRenderer does them
+                    vec3f bc_clip(e[0][lane] / tri.area / tri.w[0], e[1][lane] / tri.area / tri.w[1], e[2][lane] / tri.area / tri.w[2]);
+                    bc_clip = bc_clip / (bc_clip.x + bc_clip.y + bc_clip.z);
+                    float frag_depth = (float)dot(vec3f(tri.z[0], tri.z[1], tri.z[2]), bc_clip);
+
+                    if (pass == RasterPass::COLOR_EQUAL) {
+                        if (frag_depth != depthRow[px])
+                            continue;
+                    }
+                    else if (!inFront && frag_depth > depthRow[px]) {
+                        continue;
+                    }
+
+                    if (pass == RasterPass::DEPTH_ONLY) {
+                        depthRow[px] = frag_depth;
+                        written++;
+                        continue;
+                    }
+
+                    if (shadedFace != tri.face)
+                    {
+                        vec4f unused;
+                        for (int j : {0, 1, 2})
+                            shader.vertex(tri.face, j, unused);
+                        shadedFace = tri.face;
+                    }
+
+                    maths::vec4b color;
+                    stats.fragmentsShaded++;
+                    if (shader.fragment(bc_clip, color))
+                        continue;
+
+                    if (pass == RasterPass::COLOR) {
+                        depthRow[px] = frag_depth;
+                        written++;
+                    }
+                    row[px] = maths::vec4b{ { color[0], color[1], color[2], 255 } };
+                }
+            }
+
+            for (int i = 0; i < 3; i++)
+                rowE[i] += b[i];
+        }
+
+        return written;
+    }
+};
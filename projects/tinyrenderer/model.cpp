@@ -1,49 +1,38 @@
 #include <iostream>
-#include <sstream>
 #include "model.hpp"
+#include "objloader.h"
 
 Model::Model(const std::string filename) {
-    std::ifstream in;
-    in.open(filename, std::ifstream::in);
-    if (in.fail()) return;
-    std::string line;
-    while (!in.eof()) {
-        std::getline(in, line);
-        std::istringstream iss(line.c_str());
-        char trash;
-        if (!line.compare(0, 2, "v ")) {
-            iss >> trash;
-            vec3f v;
-            for (int i=0;i<3;i++) iss >> v[i];
-            positions.push_back(v);
-        } else if (!line.compare(0, 3, "vn ")) {
-            iss >> trash >> trash;
-            vec3f n;
-            for (int i=0;i<3;i++) iss >> n[i];
-            normals.push_back(n.normalize());
-        } else if (!line.compare(0, 3, "vt ")) {
-            iss >> trash >> trash;
-            vec2f uv;
-            for (int i=0;i<2;i++) iss >> uv[i];
-            texcoords.push_back({uv.x, 1-uv.y});
-        }  else if (!line.compare(0, 2, "f ")) {
-            int f,t,n;
-            iss >> trash;
-            int cnt = 0;
-            while (iss >> f >> trash >> t >> trash >> n) {
-                facet_vrt.push_back(--f);
-                facet_tex.push_back(--t);
-                facet_nrm.push_back(--n);
-                cnt++;
-            }
-            if (3!=cnt) {
-                std::cerr << "Error: the obj file is supposed to be triangulated" << std::endl;
-                in.close();
-                return;
-            }
-        }
+    ndt::ObjMesh mesh;
+    if (!ndt::obj_load_file(filename.c_str(), mesh) && mesh.ntriangles() == 0) {
+        std::cerr << "Error: could not load " << filename << std::endl;
+        return;
     }
-    in.close();
+
+    // One entry per distinct corner, so positions, normals and
+    // texcoords all share the one index
+    positions.resize(mesh.vertices.size());
+    normals.resize(mesh.vertices.size());
+    texcoords.resize(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        const ndt::ObjVertex& v = mesh.vertices[i];
+        positions[i] = vec3f{ v.position[0], v.position[1], v.position[2] };
+        texcoords[i] = vec2f{ v.texcoord[0], 1 - v.texcoord[1] };
+        normals[i] = vec3f{ v.normal[0], v.normal[1], v.normal[2] };
+    }
+
+    // Corners the file gave no texture coordinate or normal come
+    // out as zeros; only real normals get normalized
+    for (size_t i = 0; i < mesh.indices.size(); i++) {
+        uint32_t v = mesh.indices[i];
+        if (mesh.faceTexcoords[i] < 0)
+            texcoords[v] = vec2f{};
+        if (mesh.faceNormals[i] >= 0)
+            normals[v] = normals[v].normalize();
+    }
+
+    facet_vrt = std::move(mesh.indices);
+
     std::cerr << "# v# " << nverts() << " f# "  << nfaces() << " vt# " << texcoords.size() << " vn# " << normals.size() << std::endl;
     Texture::load_texture(filename, "_diffuse.tga",    diffusemap );
     Texture::load_texture(filename, "_nm_tangent.tga", normalmap  );
@@ -72,10 +61,10 @@ vec3f Model::normal(const vec2f &uvf) const {
 }
 
 vec2f Model::uv(const int iface, const int nthvert) const {
-    return texcoords[facet_tex[iface*3+nthvert]];
+    return texcoords[facet_vrt[iface*3+nthvert]];
 }
 
 vec3f Model::normal(const int iface, const int nthvert) const {
-    return normals[facet_nrm[iface*3+nthvert]];
+    return normals[facet_vrt[iface*3+nthvert]];
 }
 
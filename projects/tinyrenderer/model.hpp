@@ -1,3 +1,6 @@
+#pragma once
+
+#include <cstdint>
 #include <vector>
 #include <string>
 
@@ -14,10 +17,7 @@ class Model {
     std::vector<vec3f> normals{};     // per-vertex array of normal vectors
     std::vector<vec2f> texcoords{}; // per-vertex array of tex coords
 
-
-    std::vector<int> facet_vrt{};
-    std::vector<int> facet_tex{};  // per-triangle indices in the above arrays
-    std::vector<int> facet_nrm{};
+    std::vector<uint32_t> facet_vrt{};  // per-triangle indices in the above arrays
 
     TGAImage diffusemap{};         // diffuse color texture
     TGAImage normalmap{};          // normal map texture
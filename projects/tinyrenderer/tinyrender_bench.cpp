@@ -0,0 +1,217 @@
+//
+// tinyrender_bench
+// Renders models without a window, with SceneRenderer::triangle(), one
+// triangle at a time, and with the BinnedRenderer, with and without its
+// depth prepass, and reports how many frames a second each manages, how
+// many times each called the fragment shader, and how many pixels came
+// out different.  The BinnedRenderer's counters show where its hidden
+// triangles were thrown out, and the time taken to load the models is
+// reported too.
+//
+//   tinyrender_bench [-frames 10] [-threads 0] [-size 800] [-out binned.tga] obj/african_head/african_head.obj ...
+//
+// The view is the one the demo uses.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "model.hpp"
+#include "renderer_gl.hpp"
+#include "binned_renderer.hpp"
+#include "demo_shader.hpp"
+
+const vec3f light_dir(1, 1, 1); // light source
+const vec3f       eye(1, 1, 3); // camera position
+const vec3f    center(0, 0, 0); // camera direction
+const vec3f        up(0, 1, 0); // camera up vector
+
+
+// A frame buffer in memory
+struct MemoryFrameBuffer : public PixelAccessor<maths::vec4b>
+{
+    std::vector<maths::vec4b> fPixels;
+
+    MemoryFrameBuffer(const int w, const int h)
+        : fPixels((size_t)w * h)
+    {
+        reset(fPixels.data(), w, h, (ptrdiff_t)w * sizeof(maths::vec4b), PixelOrientation::BottomToTop);
+    }
+
+    void clear() { std::fill(fPixels.begin(), fPixels.end(), maths::vec4b{}); }
+};
+
+// Counts fragment shader calls, for the one triangle at a time path
+struct CountingShader : public Shader
+{
+    uint64_t& fragments;
+
+    CountingShader(const Model& m, const SceneRenderer& r, const vec3f light, uint64_t& count)
+        : Shader(m, r, light)
+        , fragments(count)
+    {}
+
+    bool fragment(const vec3f bar, maths::vec4b& gl_FragColor) override
+    {
+        fragments++;
+        return Shader::fragment(bar, gl_FragColor);
+    }
+};
+
+static size_t countDifferent(const MemoryFrameBuffer& a, const MemoryFrameBuffer& b)
+{
+    size_t different = 0;
+    for (size_t i = 0; i < a.fPixels.size(); i++)
+        different += (a.fPixels[i].value != b.fPixels[i].value);
+    return different;
+}
+
+// Render every frame with the BinnedRenderer, returning the seconds it took
+static double renderBinned(BinnedRenderer& binned, const std::vector<std::unique_ptr<Model>>& models,
+    const SceneRenderer& renderer, MemoryFrameBuffer& fb, const int frames)
+{
+    binned.resetStats();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++)
+    {
+        fb.clear();
+        binned.beginFrame((int)fb.width(), (int)fb.height());
+
+        for (auto& model : models)
+        {
+            Shader shader(*model, renderer, light_dir);
+            binned.draw(model->nfaces(), shader, fb);
+        }
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void printStats(const char* name, const BinnedRenderer::Stats& st, const int frames)
+{
+    printf("%-10s triangles %llu, culled %llu, hidden %llu, tiles rejected %llu, blocks rejected %llu, fragments shaded %llu\n",
+        name,
+        (unsigned long long)(st.triangles / frames), (unsigned long long)(st.trianglesCulled / frames),
+        (unsigned long long)(st.trianglesHidden / frames), (unsigned long long)(st.tilesRejected / frames),
+        (unsigned long long)(st.blocksRejected / frames), (unsigned long long)(st.fragmentsShaded / frames));
+}
+
+static bool writeImage(const MemoryFrameBuffer& fb, const std::string& filename)
+{
+    TGAImage img((int)fb.width(), (int)fb.height(), TGAImage::RGBA);
+    for (int y = 0; y < (int)fb.height(); y++)
+        for (int x = 0; x < (int)fb.width(); x++)
+            img.setPixel(x, y, fb.getPixel(x, y));
+
+    return img.write_tga_file(filename);
+}
+
+static void usage()
+{
+    printf("tinyrender_bench [-frames 10] [-threads 0] [-size 800] [-out binned.tga] model.obj ...\n");
+}
+
+int main(int argc, char** argv)
+{
+    int frames = 10;
+    unsigned threadCount = 0;
+    int size = 800;
+    std::string outName;
+    std::vector<std::unique_ptr<Model>> models;
+    double loadSeconds = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+
+        if ((strcmp(argv[i], "-frames") == 0) && hasValue) frames = std::max(1, atoi(argv[++i]));
+        else if ((strcmp(argv[i], "-threads") == 0) && hasValue) threadCount = (unsigned)std::max(0, atoi(argv[++i]));
+        else if ((strcmp(argv[i], "-size") == 0) && hasValue) size = std::max(16, atoi(argv[++i]));
+        else if ((strcmp(argv[i], "-out") == 0) && hasValue) outName = argv[++i];
+        else if (argv[i][0] == '-') { usage(); return 1; }
+        else {
+            auto start = std::chrono::steady_clock::now();
+            models.push_back(std::make_unique<Model>(argv[i]));
+            loadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    if (models.empty()) {
+        usage();
+        return 1;
+    }
+
+    const int width = size;
+    const int height = size;
+
+    SceneRenderer renderer{};
+    renderer.setLookAt(eye, center, up);
+    renderer.setViewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
+    renderer.setProjection((center - eye).norm());
+
+    int faces = 0;
+    for (auto& model : models)
+        faces += model->nfaces();
+
+    BinnedRenderer binned(renderer, threadCount);
+    printf("%zu models, %d faces, loaded in %.2f ms, %dx%d, %d frames, %u threads\n",
+        models.size(), faces, loadSeconds * 1000.0, width, height, frames, binned.threadCount());
+
+    // One triangle at a time
+    MemoryFrameBuffer reference(width, height);
+    std::vector<double> zbuffer((size_t)width * height);
+    uint64_t triangleFragments = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++)
+    {
+        reference.clear();
+        std::fill(zbuffer.begin(), zbuffer.end(), std::numeric_limits<double>::max());
+
+        for (auto& model : models)
+        {
+            CountingShader shader(*model, renderer, light_dir, triangleFragments);
+            for (int i = 0; i < model->nfaces(); i++)
+            {
+                vec4f clip_vert[3];
+                for (int j : {0, 1, 2})
+                    shader.vertex(i, j, clip_vert[j]);
+                renderer.triangle(clip_vert, shader, reference, zbuffer);
+            }
+        }
+    }
+    double triangleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Binned, then binned with a depth prepass
+    MemoryFrameBuffer tiled(width, height);
+    double binnedSeconds = renderBinned(binned, models, renderer, tiled, frames);
+    BinnedRenderer::Stats binnedStats = binned.stats();
+
+    MemoryFrameBuffer prepassed(width, height);
+    binned.setDepthPrepass(true);
+    double prepassSeconds = renderBinned(binned, models, renderer, prepassed, frames);
+    BinnedRenderer::Stats prepassStats = binned.stats();
+
+    printf("%-10s %10s %10s %12s %10s\n", "path", "fps", "ms/frame", "fragments", "different");
+    printf("%-10s %10.2f %10.2f %12llu %10s\n", "triangle", frames / triangleSeconds, triangleSeconds * 1000.0 / frames,
+        (unsigned long long)(triangleFragments / frames), "-");
+    printf("%-10s %10.2f %10.2f %12llu %10zu\n", "binned", frames / binnedSeconds, binnedSeconds * 1000.0 / frames,
+        (unsigned long long)(binnedStats.fragmentsShaded / frames), countDifferent(reference, tiled));
+    printf("%-10s %10.2f %10.2f %12llu %10zu\n", "prepass", frames / prepassSeconds, prepassSeconds * 1000.0 / frames,
+        (unsigned long long)(prepassStats.fragmentsShaded / frames), countDifferent(reference, prepassed));
+    printf("\nper frame\n");
+    printStats("binned", binnedStats, frames);
+    printStats("prepass", prepassStats, frames);
+
+    if (!outName.empty() && !writeImage(tiled, outName)) {
+        printf("could not write: %s\n", outName.c_str());
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,11 +1,9 @@
 #pragma once
 
 
-#include <iostream>
-#include <fstream>
-#include <sstream>
 #include <vector>
 
+#include "objloader.h"
 #include "trianglemesh.h"
 #include "codec_targa.hpp"
 #include "waveobjloader.h"
@@ -31,65 +29,38 @@ TriangleMesh * loadModel(const char* filename)
 {
 	printf("loadModel: %s\n", filename);
 
-	TriangleMesh * mesh = new TriangleMesh();
+	ndt::ObjLoadOptions opts{};
+	opts.buildVertices = false;
 
-	std::ifstream in;
-	in.open(filename, std::ifstream::in);
-	if (in.fail())
+	ndt::ObjMesh obj;
+	if (!ndt::obj_load_file(filename, obj, opts) && obj.ntriangles() == 0)
 		return nullptr;
 
-	std::string sline;
-
-	while (!in.eof()) {
-		std::getline(in, sline);
-		std::istringstream iss(sline.c_str());
-		char trash;
-		//printf("line: %s\n", sline.c_str());
-
-		if (!sline.compare(0, 2, "v ")) {
-			iss >> trash;
-			vec3f v;
-			for (int i = 0; i < 3; i++)
-				iss >> v[i];
-			mesh->addVertex(v);
-		} else if (!sline.compare(0, 3, "vn ")) 
-		{
-			iss >> trash >> trash;
-			vec3f n;
-			for (int i = 0; i < 3; i++)
-				iss >> n[i];
-			mesh->addNormal(n);
-		}
-		else if (!sline.compare(0, 3, "vt ")) 
-		{
-			iss >> trash >> trash;
-			vec2f uv;
-			for (int i = 0; i < 2; i++) iss >> uv[i];
-			mesh->addUV(uv);
-		}
-		else if (!sline.compare(0, 2, "f ")) 
-		{
-			// attention, this Vec3i means vertex/uv/normal
-			std::vector<vec3i> f;
-
-			vec3i tmp;
-			iss >> trash;
-			while (iss >> tmp[0] >> trash >> tmp[1] >> trash >> tmp[2]) 
-			{
-				for (int i = 0; i < 3; i++) 
-					tmp[i]--; // in wavefront obj all indices start at 1, not zero
-
-				f.push_back(tmp);
-			}
-			vec3i vert(f[0][0], f[1][0],f[2][0]);
-			vec3i uv(f[0][1],f[1][1],f[2][1]);
-			vec3i norm(f[0][2],f[1][2],f[2][2]);
-
-			mesh->addFace(vert, norm,uv);
-		}
+	TriangleMesh * mesh = new TriangleMesh();
+
+	for (size_t i = 0; i < obj.npositions(); i++)
+		mesh->addVertex(vec3f(obj.positions[i * 3], obj.positions[i * 3 + 1], obj.positions[i * 3 + 2]));
 
+	for (size_t i = 0; i < obj.nnormals(); i++)
+		mesh->addNormal(vec3f(obj.normals[i * 3], obj.normals[i * 3 + 1], obj.normals[i * 3 + 2]));
+
+	for (size_t i = 0; i < obj.ntexcoords(); i++)
+		mesh->addUV(vec2f(obj.texcoords[i * 2], obj.texcoords[i * 2 + 1]));
+
+	// indices are 0 based, and -1 where the file left them out
+	for (size_t t = 0; t < obj.ntriangles(); t++)
+	{
+		const size_t c = t * 3;
+		if (obj.facePositions[c] < 0 || obj.facePositions[c + 1] < 0 || obj.facePositions[c + 2] < 0)
+			continue;	// a corner with a bad position can't be drawn
+
+		vec3i vert(obj.facePositions[c], obj.facePositions[c + 1], obj.facePositions[c + 2]);
+		vec3i uv(obj.faceTexcoords[c], obj.faceTexcoords[c + 1], obj.faceTexcoords[c + 2]);
+		vec3i norm(obj.faceNormals[c], obj.faceNormals[c + 1], obj.faceNormals[c + 2]);
+
+		mesh->addFace(vert, norm, uv);
 	}
-	
+
 	// Load various maps if available
 	mesh->setDiffuseMap(load_texture(filename, "_diffuse.tga"));
 	mesh->setNormalMap(load_texture(filename, "_nm_tangent.tga"));
@@ -0,0 +1,138 @@
+//
+// stl_bench
+// Loads STL files with the stlloader, and reports how fast each
+// step goes, in MB/s of file and triangles/s.
+//
+//   stl_bench [-threads 0] [-repeat 3] [-tolerance 0] models/se2.stl ...
+//
+// ASCII files are read with one thread, then with -threads of them
+// (0 is one per hardware thread), and the two are checked against
+// each other.  Every file is then welded into an indexed mesh.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "stlloader.h"
+
+using namespace stl;
+
+static const char* formatName(const Format f)
+{
+    switch (f) {
+    case Format::BINARY: return "binary";
+    case Format::ASCII: return "ascii";
+    default: return "unknown";
+    }
+}
+
+static bool sameMesh(const SoupMesh& a, const SoupMesh& b)
+{
+    return a.nx == b.nx && a.ny == b.ny && a.nz == b.nz
+        && a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+// The fastest of repeat runs of fn, in seconds
+template <typename Fn>
+static double timeBest(const int repeat, Fn&& fn)
+{
+    double best = 1e30;
+    for (int r = 0; r < repeat; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+static void report(const char* step, const double seconds, const double mb, const size_t triangles)
+{
+    printf("  %-14s %9.2f ms %10.1f MB/s %12.0f tris/s\n", step, seconds * 1000.0,
+        mb / seconds, triangles / seconds);
+}
+
+static void usage()
+{
+    printf("stl_bench [-threads 0] [-repeat 3] [-tolerance 0] model.stl ...\n");
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = 0;
+    int repeat = 3;
+    float tolerance = 0.0f;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+
+        if ((strcmp(argv[i], "-threads") == 0) && hasValue) threads = (unsigned)std::max(0, atoi(argv[++i]));
+        else if ((strcmp(argv[i], "-repeat") == 0) && hasValue) repeat = std::max(1, atoi(argv[++i]));
+        else if ((strcmp(argv[i], "-tolerance") == 0) && hasValue) tolerance = (float)atof(argv[++i]);
+        else if (argv[i][0] == '-') { usage(); return 1; }
+        else files.push_back(argv[i]);
+    }
+
+    if (files.empty()) {
+        usage();
+        return 1;
+    }
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    int failures = 0;
+    for (auto& filename : files)
+    {
+        ndt::mmap_options opts{};
+        opts.access = ndt::MMAP_ACCESS_SEQUENTIAL;
+        opts.prefault = true;
+
+        auto m = ndt::mmap::create_shared(filename, opts);
+        if (m == nullptr || !m->isValid()) {
+            printf("%s: could not open\n", filename.c_str());
+            failures++;
+            continue;
+        }
+
+        const uint8_t* data = (const uint8_t*)m->data();
+        const size_t size = m->size();
+        const double mb = size / (1024.0 * 1024.0);
+        const Format format = detectFormat(data, size);
+
+        SoupMesh soup;
+        bool ok = true;
+        double seconds = timeBest(repeat, [&] { ok = load(data, size, soup, 1); });
+
+        printf("%s: %s, %.2f MB, %zu triangles%s\n", filename.c_str(), formatName(format), mb,
+            soup.ntriangles(), ok ? "" : " (with errors)");
+        report("load", seconds, mb, soup.ntriangles());
+
+        if (format == Format::ASCII && threads > 1)
+        {
+            SoupMesh threaded;
+            seconds = timeBest(repeat, [&] { load(data, size, threaded, threads); });
+
+            char step[32];
+            snprintf(step, sizeof(step), "load x%u", threads);
+            report(step, seconds, mb, threaded.ntriangles());
+
+            if (!sameMesh(soup, threaded)) {
+                printf("  threaded load does not match\n");
+                failures++;
+            }
+        }
+
+        IndexedMesh welded;
+        seconds = timeBest(repeat, [&] { welded = weld(soup, tolerance); });
+        report("weld", seconds, mb, soup.ntriangles());
+        printf("  %zu corners welded to %zu vertices\n", soup.x.size(), welded.nverts());
+    }
+
+    return failures ? 1 : 0;
+}
@@ -5,6 +5,7 @@
 
 #include "trianglemesh.h"
 #include "filestream.h"
+#include "stlloader.h"
 
 
 // typical file structure
@@ -200,30 +201,76 @@ namespace stl {
 		return mesh;
 	}
 
-	TriangleMesh* readFromFile(const char* filename)
+	// A face per triangle, its three corners, and the facet normal
+	TriangleMesh* toTriangleMesh(const SoupMesh& soup)
 	{
-		// Create a mmap
-		auto bs = FileStream(filename);
-		
-		// Read first 80 bytes
-		uint8_t buff[256];
-		bs.readBytes(buff, 5);
+		TriangleMesh* mesh = new TriangleMesh();
+		mesh->fVertices.reserve(soup.x.size());
+		mesh->fNormals.reserve(soup.ntriangles());
+		mesh->fFaces.reserve(soup.ntriangles());
+
+		for (size_t i = 0; i < soup.ntriangles(); i++)
+		{
+			vec3 n{};
+			n.d[0] = soup.nx[i];
+			n.d[1] = soup.ny[i];
+			n.d[2] = soup.nz[i];
+			int nOffset = (int)mesh->addNormal(n);
+
+			ivec3 fVerts{};
+			for (size_t k = 0; k < 3; k++)
+				fVerts.d[k] = (int)mesh->addVertex(soup.x[i * 3 + k], soup.y[i * 3 + k], soup.z[i * 3 + k]);
+
+			mesh->addFace(fVerts, ivec3{ nOffset, nOffset, nOffset }, ivec3{});
+		}
+
+		return mesh;
+	}
+
+	// Shared vertices, with a normal each
+	TriangleMesh* toTriangleMesh(const IndexedMesh& indexed)
+	{
+		TriangleMesh* mesh = new TriangleMesh();
+		mesh->fVertices.reserve(indexed.nverts());
+		mesh->fNormals.reserve(indexed.nverts());
+		mesh->fFaces.reserve(indexed.ntriangles());
+
+		for (size_t v = 0; v < indexed.nverts(); v++)
+		{
+			mesh->addVertex(indexed.x[v], indexed.y[v], indexed.z[v]);
+
+			vec3 n{};
+			n.d[0] = indexed.nx[v];
+			n.d[1] = indexed.ny[v];
+			n.d[2] = indexed.nz[v];
+			mesh->addNormal(n);
+		}
 
-		// if it starts with 'solid', then it's an ASCII
-		// otherwise, it's binary
-		bs.seek(0);
-		TriangleMesh* mesh = nullptr;
-		std::string sig((char*)buff, 5);
-		//printf("sig: %s\n", sig);
+		for (size_t t = 0; t < indexed.ntriangles(); t++)
+		{
+			ivec3 fVerts{};
+			for (size_t k = 0; k < 3; k++)
+				fVerts.d[k] = (int)indexed.indices[t * 3 + k];
+
+			mesh->addFace(fVerts, fVerts, ivec3{});
+		}
+
+		return mesh;
+	}
+
+	// welded - merge shared corners, and smooth the normals across them
+	// threads - how many threads an ASCII file can be parsed with
+	TriangleMesh* readFromFile(const char* filename, bool welded = false, unsigned threads = 1)
+	{
+		SoupMesh soup;
+		if (!loadFile(filename, soup, threads) && soup.ntriangles() == 0)
+			return nullptr;
 
-		if (sig == "solid")
-			mesh = readASCIIFromStream(bs);
-		else
-			mesh = readBinaryFromStream(bs);
+		TriangleMesh* mesh = welded ? toTriangleMesh(weld(soup)) : toTriangleMesh(soup);
 
 		mesh->centerMesh();
 		mesh->normalizeVertices();
 
 		return mesh;
 	}
-}	// end of stl
\ No newline at end of file
+}	// end of stl
@@ -0,0 +1,520 @@
+#pragma once
+
+/*
+	stlloader
+
+	Loads STL files, binary or ASCII, straight out of a memory
+	mapped file, into flat arrays of floats.
+
+	Binary files are a run of fixed size records, which are copied
+	into the arrays in one pass.  ASCII files are scanned in place;
+	numbers are converted with std::from_chars, so nothing is allocated
+	per number, and big files can be split across threads, each
+	taking a range of facets.
+
+	What comes out is a triangle soup; three corners per triangle,
+	and the facet normal from the file.  weld() merges corners that
+	are at the same place, giving an indexed mesh, with a normal per
+	vertex, shared by all the triangles that use it.
+
+	Usage:
+	stl::SoupMesh soup;
+	if (stl::loadFile("part.stl", soup, 4))
+		stl::IndexedMesh mesh = stl::weld(soup);
+*/
+
+#include <algorithm>
+#include <charconv>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "mmap.hpp"
+
+namespace stl {
+
+	enum class Format {
+		UNKNOWN,
+		BINARY,
+		ASCII,
+	};
+
+	// Triangles as they are in the file, structure of arrays
+	// One normal per triangle, three corners per triangle
+	struct SoupMesh {
+		std::vector<float> nx, ny, nz;
+		std::vector<float> x, y, z;
+
+		size_t ntriangles() const { return nx.size(); }
+
+		void clear()
+		{
+			nx.clear(); ny.clear(); nz.clear();
+			x.clear(); y.clear(); z.clear();
+		}
+
+		void reserve(size_t triangles)
+		{
+			nx.reserve(triangles); ny.reserve(triangles); nz.reserve(triangles);
+			x.reserve(triangles * 3); y.reserve(triangles * 3); z.reserve(triangles * 3);
+		}
+
+		void append(const SoupMesh& other)
+		{
+			nx.insert(nx.end(), other.nx.begin(), other.nx.end());
+			ny.insert(ny.end(), other.ny.begin(), other.ny.end());
+			nz.insert(nz.end(), other.nz.begin(), other.nz.end());
+			x.insert(x.end(), other.x.begin(), other.x.end());
+			y.insert(y.end(), other.y.begin(), other.y.end());
+			z.insert(z.end(), other.z.begin(), other.z.end());
+		}
+	};
+
+	// Unique vertices, each with its own normal, and
+	// three indices per triangle
+	struct IndexedMesh {
+		std::vector<float> x, y, z;
+		std::vector<float> nx, ny, nz;
+		std::vector<uint32_t> indices;
+
+		size_t nverts() const { return x.size(); }
+		size_t ntriangles() const { return indices.size() / 3; }
+	};
+
+
+	static constexpr size_t kBinaryHeaderSize = 84;		// 80 byte header, uint32 count
+	static constexpr size_t kBinaryRecordSize = 50;		// normal, 3 vertices, uint16 attribute
+
+	// An ASCII file starts with 'solid', but so do plenty of binary
+	// ones, so a file whose size is exactly what its triangle count
+	// says is taken as binary, whatever it starts with.
+	inline Format detectFormat(const uint8_t* data, size_t size)
+	{
+		if (size >= kBinaryHeaderSize)
+		{
+			uint32_t count;
+			memcpy(&count, data + 80, sizeof(count));
+			if (kBinaryHeaderSize + (uint64_t)count * kBinaryRecordSize == size)
+				return Format::BINARY;
+		}
+
+		size_t i = 0;
+		while (i < size && isspace(data[i]))
+			i++;
+		if (size - i >= 5 && memcmp(data + i, "solid", 5) == 0)
+			return Format::ASCII;
+
+		return size >= kBinaryHeaderSize ? Format::BINARY : Format::UNKNOWN;
+	}
+
+	// Triangles past the end of a short file are left off
+	inline bool readBinary(const uint8_t* data, size_t size, SoupMesh& mesh)
+	{
+		mesh.clear();
+		if (size < kBinaryHeaderSize)
+			return false;
+
+		uint32_t count;
+		memcpy(&count, data + 80, sizeof(count));
+		size_t available = (size - kBinaryHeaderSize) / kBinaryRecordSize;
+		size_t n = std::min((size_t)count, available);
+
+		mesh.nx.resize(n); mesh.ny.resize(n); mesh.nz.resize(n);
+		mesh.x.resize(n * 3); mesh.y.resize(n * 3); mesh.z.resize(n * 3);
+
+		const uint8_t* rec = data + kBinaryHeaderSize;
+		for (size_t i = 0; i < n; i++, rec += kBinaryRecordSize)
+		{
+			// records are 50 bytes, so the floats are not aligned
+			float f[12];
+			memcpy(f, rec, sizeof(f));
+
+			mesh.nx[i] = f[0]; mesh.ny[i] = f[1]; mesh.nz[i] = f[2];
+			for (size_t k = 0; k < 3; k++) {
+				mesh.x[i * 3 + k] = f[3 + k * 3];
+				mesh.y[i * 3 + k] = f[4 + k * 3];
+				mesh.z[i * 3 + k] = f[5 + k * 3];
+			}
+		}
+
+		return n == count;
+	}
+
+
+	namespace detail {
+		inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v'; }
+
+		inline const char* skipSpace(const char* p, const char* end)
+		{
+			while (p < end && isSpace(*p))
+				p++;
+			return p;
+		}
+
+		inline const char* skipLine(const char* p, const char* end)
+		{
+			while (p < end && *p != '\n')
+				p++;
+			return p;
+		}
+
+		inline bool keyword(const char* p, const char* tokEnd, const char* word, size_t len)
+		{
+			return (size_t)(tokEnd - p) == len && memcmp(p, word, len) == 0;
+		}
+
+		// The next number, skipping leading space.  from_chars does
+		// not take a leading '+', which some exporters write.
+		inline bool parseFloat(const char*& p, const char* end, float& value)
+		{
+			p = skipSpace(p, end);
+			if (p < end && *p == '+')
+				p++;
+
+			auto res = std::from_chars(p, end, value);
+			if (res.ec != std::errc())
+				return false;
+
+			p = res.ptr;
+			return true;
+		}
+
+		inline bool parseFloat3(const char*& p, const char* end, float& a, float& b, float& c)
+		{
+			return parseFloat(p, end, a) && parseFloat(p, end, b) && parseFloat(p, end, c);
+		}
+
+		// Facets in [p, end).  Anything that isn't a facet, a vertex, or
+		// the end of one is skipped, and a facet without three vertices
+		// is dropped.  Returns false if a number could not be read.
+		inline bool parseFacets(const char* p, const char* end, SoupMesh& mesh)
+		{
+			float n[3]{};
+			float v[3][3]{};
+			int nverts = 0;
+			bool ok = true;
+
+			while (true)
+			{
+				p = skipSpace(p, end);
+				if (p >= end)
+					break;
+
+				const char* tok = p;
+				while (p < end && !isSpace(*p))
+					p++;
+
+				if (keyword(tok, p, "vertex", 6))
+				{
+					float a, b, c;
+					if (!parseFloat3(p, end, a, b, c)) {
+						ok = false;
+						p = skipLine(p, end);
+						continue;
+					}
+					if (nverts < 3) {
+						v[nverts][0] = a; v[nverts][1] = b; v[nverts][2] = c;
+					}
+					nverts++;
+				}
+				else if (keyword(tok, p, "facet", 5))
+				{
+					// facet normal nx ny nz
+					nverts = 0;
+					p = skipSpace(p, end);
+					while (p < end && !isSpace(*p))
+						p++;
+					if (!parseFloat3(p, end, n[0], n[1], n[2])) {
+						ok = false;
+						n[0] = n[1] = n[2] = 0;
+						p = skipLine(p, end);
+					}
+				}
+				else if (keyword(tok, p, "endfacet", 8))
+				{
+					if (nverts == 3)
+					{
+						mesh.nx.push_back(n[0]); mesh.ny.push_back(n[1]); mesh.nz.push_back(n[2]);
+						for (int k = 0; k < 3; k++) {
+							mesh.x.push_back(v[k][0]);
+							mesh.y.push_back(v[k][1]);
+							mesh.z.push_back(v[k][2]);
+						}
+					}
+					nverts = 0;
+				}
+				else if (keyword(tok, p, "solid", 5) || keyword(tok, p, "endsolid", 8))
+				{
+					// the name runs to the end of the line
+					p = skipLine(p, end);
+				}
+				// outer, loop, endloop
+			}
+
+			return ok;
+		}
+
+		// Where the first 'facet' at or after p starts, or end
+		inline const char* nextFacet(const char* p, const char* begin, const char* end)
+		{
+			while (p + 5 <= end)
+			{
+				const char* f = (const char*)memchr(p, 'f', end - p);
+				if (f == nullptr || f + 5 > end)
+					break;
+
+				bool startsToken = (f == begin) || isSpace(f[-1]);
+				bool endsToken = (f + 5 == end) || isSpace(f[5]);
+				if (startsToken && endsToken && memcmp(f, "facet", 5) == 0)
+					return f;
+
+				p = f + 1;
+			}
+			return end;
+		}
+	}
+
+	// threads - how many ranges to split the file into; 0 uses
+	// one per hardware thread.  Small files are done in one piece.
+	inline bool readASCII(const uint8_t* data, size_t size, SoupMesh& mesh, unsigned threads = 1)
+	{
+		mesh.clear();
+
+		const char* begin = (const char*)data;
+		const char* end = begin + size;
+
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+
+		// A facet is around 250 bytes
+		static constexpr size_t kMinBytesPerThread = 1 << 20;
+		threads = (unsigned)std::min<size_t>(threads, std::max<size_t>(1, size / kMinBytesPerThread));
+
+		if (threads <= 1)
+		{
+			mesh.reserve(size / 250);
+			return detail::parseFacets(begin, end, mesh);
+		}
+
+		// Split on facet boundaries, so each range is whole facets
+		std::vector<const char*> starts(threads + 1);
+		starts[0] = begin;
+		starts[threads] = end;
+		for (unsigned t = 1; t < threads; t++)
+			starts[t] = detail::nextFacet(std::max(starts[t - 1], begin + size / threads * t), begin, end);
+
+		std::vector<SoupMesh> parts(threads);
+		std::vector<char> results(threads, 1);
+		std::vector<std::thread> workers;
+		workers.reserve(threads - 1);
+
+		auto parse = [&](unsigned t) {
+			parts[t].reserve((starts[t + 1] - starts[t]) / 250);
+			results[t] = detail::parseFacets(starts[t], starts[t + 1], parts[t]);
+		};
+
+		for (unsigned t = 1; t < threads; t++)
+			workers.emplace_back(parse, t);
+		parse(0);
+		for (auto& w : workers)
+			w.join();
+
+		size_t total = 0;
+		for (auto& part : parts)
+			total += part.ntriangles();
+
+		mesh.reserve(total);
+		bool ok = true;
+		for (unsigned t = 0; t < threads; t++) {
+			mesh.append(parts[t]);
+			ok = ok && results[t];
+		}
+
+		return ok;
+	}
+
+	inline bool load(const uint8_t* data, size_t size, SoupMesh& mesh, unsigned threads = 1)
+	{
+		switch (detectFormat(data, size))
+		{
+		case Format::BINARY:
+			return readBinary(data, size, mesh);
+		case Format::ASCII:
+			return readASCII(data, size, mesh, threads);
+		default:
+			mesh.clear();
+			return false;
+		}
+	}
+
+	inline bool loadFile(const char* filename, SoupMesh& mesh, unsigned threads = 1)
+	{
+		ndt::mmap_options opts{};
+		opts.access = ndt::MMAP_ACCESS_SEQUENTIAL;
+
+		auto m = ndt::mmap::create_shared(filename, opts);
+		if (m == nullptr || !m->isValid()) {
+			mesh.clear();
+			return false;
+		}
+
+		return load((const uint8_t*)m->data(), m->size(), mesh, threads);
+	}
+
+
+	namespace detail {
+		struct WeldKey {
+			uint32_t k[3];
+
+			bool operator==(const WeldKey& o) const { return k[0] == o.k[0] && k[1] == o.k[1] && k[2] == o.k[2]; }
+		};
+
+		// The bits of the float, with -0 made the same as 0
+		inline uint32_t floatKey(float f)
+		{
+			if (f == 0.0f)
+				return 0;
+
+			uint32_t bits;
+			memcpy(&bits, &f, sizeof(bits));
+			return bits;
+		}
+
+		// The grid cell a coordinate falls in.  A coordinate that's huge
+		// compared to the tolerance, or NaN, gives a cell that doesn't fit
+		// in an int32, and casting it would be undefined.  So those are
+		// clamped: everything beyond the range ends up in the cell at the
+		// edge, and NaN gets a cell of its own.
+		inline uint32_t gridKey(float f, float inv)
+		{
+			float cell = std::floor(f * inv + 0.5f);
+			if (cell != cell)
+				return (uint32_t)INT32_MIN;
+
+			// 2^31 is exact as a float, INT32_MAX is not
+			if (cell >= 2147483648.0f)
+				return (uint32_t)INT32_MAX;
+			if (cell <= -2147483648.0f)
+				return (uint32_t)(INT32_MIN + 1);
+
+			return (uint32_t)(int32_t)cell;
+		}
+
+		inline uint32_t hashKey(const WeldKey& key)
+		{
+			uint32_t h = key.k[0] * 0x9E3779B1u;
+			h ^= key.k[1] * 0x85EBCA77u + (h << 6) + (h >> 2);
+			h ^= key.k[2] * 0xC2B2AE3Du + (h << 6) + (h >> 2);
+			return h ^ (h >> 15);
+		}
+	}
+
+	// Merge corners that are at the same place, and give each merged
+	// vertex the area weighted average of the normals of the triangles
+	// around it.  With a tolerance, positions are snapped to a grid that
+	// size before being compared, so corners that differ by rounding
+	// come together; two that straddle a grid line will not.
+	inline IndexedMesh weld(const SoupMesh& soup, float tolerance = 0.0f)
+	{
+		IndexedMesh mesh;
+
+		const size_t corners = soup.x.size();
+		mesh.indices.resize(corners);
+
+		// Closed meshes have about one vertex per two triangles
+		size_t capacity = 1024;
+		while (capacity < corners / 2)
+			capacity <<= 1;
+
+		std::vector<uint32_t> table(capacity, UINT32_MAX);
+		std::vector<detail::WeldKey> keys;
+		keys.reserve(capacity / 2);
+		mesh.x.reserve(capacity / 2); mesh.y.reserve(capacity / 2); mesh.z.reserve(capacity / 2);
+
+		const float inv = tolerance > 0.0f ? 1.0f / tolerance : 0.0f;
+		auto makeKey = [&](size_t i) {
+			detail::WeldKey key;
+			if (tolerance > 0.0f) {
+				key.k[0] = detail::gridKey(soup.x[i], inv);
+				key.k[1] = detail::gridKey(soup.y[i], inv);
+				key.k[2] = detail::gridKey(soup.z[i], inv);
+			} else {
+				key.k[0] = detail::floatKey(soup.x[i]);
+				key.k[1] = detail::floatKey(soup.y[i]);
+				key.k[2] = detail::floatKey(soup.z[i]);
+			}
+			return key;
+		};
+
+		for (size_t i = 0; i < corners; i++)
+		{
+			// keep the table at most half full
+			if (keys.size() * 2 >= capacity)
+			{
+				capacity <<= 1;
+				table.assign(capacity, UINT32_MAX);
+				for (uint32_t v = 0; v < (uint32_t)keys.size(); v++) {
+					size_t slot = detail::hashKey(keys[v]) & (capacity - 1);
+					while (table[slot] != UINT32_MAX)
+						slot = (slot + 1) & (capacity - 1);
+					table[slot] = v;
+				}
+			}
+
+			detail::WeldKey key = makeKey(i);
+			size_t slot = detail::hashKey(key) & (capacity - 1);
+			while (table[slot] != UINT32_MAX && !(keys[table[slot]] == key))
+				slot = (slot + 1) & (capacity - 1);
+
+			if (table[slot] == UINT32_MAX) {
+				table[slot] = (uint32_t)keys.size();
+				keys.push_back(key);
+				mesh.x.push_back(soup.x[i]);
+				mesh.y.push_back(soup.y[i]);
+				mesh.z.push_back(soup.z[i]);
+			}
+
+			mesh.indices[i] = table[slot];
+		}
+
+		// Normals; the cross product's length is twice the area, so
+		// summing them weights each triangle by its size.
+		const size_t nverts = mesh.x.size();
+		mesh.nx.assign(nverts, 0.0f);
+		mesh.ny.assign(nverts, 0.0f);
+		mesh.nz.assign(nverts, 0.0f);
+
+		for (size_t t = 0; t < soup.ntriangles(); t++)
+		{
+			const size_t c = t * 3;
+			float ex = soup.x[c + 1] - soup.x[c], ey = soup.y[c + 1] - soup.y[c], ez = soup.z[c + 1] - soup.z[c];
+			float fx = soup.x[c + 2] - soup.x[c], fy = soup.y[c + 2] - soup.y[c], fz = soup.z[c + 2] - soup.z[c];
+			float cx = ey * fz - ez * fy;
+			float cy = ez * fx - ex * fz;
+			float cz = ex * fy - ey * fx;
+
+			// keep to the file's winding, if the two disagree
+			if (cx * soup.nx[t] + cy * soup.ny[t] + cz * soup.nz[t] < 0.0f) {
+				cx = -cx; cy = -cy; cz = -cz;
+			}
+
+			for (size_t k = 0; k < 3; k++) {
+				uint32_t v = mesh.indices[c + k];
+				mesh.nx[v] += cx; mesh.ny[v] += cy; mesh.nz[v] += cz;
+			}
+		}
+
+		for (size_t v = 0; v < nverts; v++)
+		{
+			float len = std::sqrt(mesh.nx[v] * mesh.nx[v] + mesh.ny[v] * mesh.ny[v] + mesh.nz[v] * mesh.nz[v]);
+			if (len > 0.0f) {
+				mesh.nx[v] /= len; mesh.ny[v] /= len; mesh.nz[v] /= len;
+			}
+		}
+
+		return mesh;
+	}
+}	// end of stl
@@ -0,0 +1,379 @@
+//
+// melbench
+// Times the mel spectrogram stage of whisper, frames per second, the way
+// it used to be done (recursive FFT, scalar filterbank) against
+// whisper_mel.h, and checks that every frame comes out bit for bit the same.
+//
+//   melbench [-t seconds] [-m ggml-model.bin] [-s seconds of audio]
+//
+// The audio is made up; a sweep, a few harmonics and some noise.  The mel
+// filters are read from a model file with -m, otherwise built the way
+// librosa builds them (which is where whisper's come from).
+//
+// Both the plain spectrogram (400 point FFT) and the phase vocoder
+// one (800 points, speed_up) are run, on one thread.
+//
+
+#define _USE_MATH_DEFINES
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "whisper/whisper_mel.h"
+
+static const int kSampleRate = 16000;
+static const int kFFTSize = 400;
+static const int kHopLength = 160;
+static const int kMels = 80;
+
+//
+// The way whisper.cpp did it before
+//
+
+// naive Discrete Fourier Transform
+// input is real-valued
+// output is complex-valued
+static void dft(const std::vector<float> & in, std::vector<float> & out) {
+    int N = in.size();
+
+    out.resize(N*2);
+
+    for (int k = 0; k < N; k++) {
+        float re = 0;
+        float im = 0;
+
+        for (int n = 0; n < N; n++) {
+            float angle = 2*M_PI*k*n/N;
+            re += in[n]*cos(angle);
+            im -= in[n]*sin(angle);
+        }
+
+        out[k*2 + 0] = re;
+        out[k*2 + 1] = im;
+    }
+}
+
+// Cooley-Tukey FFT
+// poor man's implementation - use something better
+// input is real-valued
+// output is complex-valued
+static void fft(const std::vector<float> & in, std::vector<float> & out) {
+    out.resize(in.size()*2);
+
+    int N = in.size();
+
+    if (N == 1) {
+        out[0] = in[0];
+        out[1] = 0;
+        return;
+    }
+
+    if (N%2 == 1) {
+        dft(in, out);
+        return;
+    }
+
+    std::vector<float> even;
+    std::vector<float> odd;
+
+    for (int i = 0; i < N; i++) {
+        if (i % 2 == 0) {
+            even.push_back(in[i]);
+        } else {
+            odd.push_back(in[i]);
+        }
+    }
+
+    std::vector<float> even_fft;
+    std::vector<float> odd_fft;
+
+    fft(even, even_fft);
+    fft(odd, odd_fft);
+
+    for (int k = 0; k < N/2; k++) {
+        float theta = 2*M_PI*k/N;
+
+        float re = cos(theta);
+        float im = -sin(theta);
+
+        float re_odd = odd_fft[2*k + 0];
+        float im_odd = odd_fft[2*k + 1];
+
+        out[2*k + 0] = even_fft[2*k + 0] + re*re_odd - im*im_odd;
+        out[2*k + 1] = even_fft[2*k + 1] + re*im_odd + im*re_odd;
+
+        out[2*(k + N/2) + 0] = even_fft[2*k + 0] - re*re_odd + im*im_odd;
+        out[2*(k + N/2) + 1] = even_fft[2*k + 1] - re*im_odd - im*re_odd;
+    }
+}
+
+// One frame of the old log_mel_spectrogram() worker loop
+static void reference_frame(const std::vector<float> & hann, const std::vector<float> & samples, int offset,
+    int fft_size, int n_fft, bool speed_up, const std::vector<float> & filters,
+    std::vector<float> & fft_in, std::vector<float> & fft_out, float * out, int out_stride) {
+
+    const int n_samples = (int) samples.size();
+
+    // apply Hanning window
+    for (int j = 0; j < fft_size; j++) {
+        if (offset + j < n_samples) {
+            fft_in[j] = hann[j]*samples[offset + j];
+        } else {
+            fft_in[j] = 0.0;
+        }
+    }
+
+    // FFT -> mag^2
+    fft(fft_in, fft_out);
+
+    for (int j = 0; j < fft_size; j++) {
+        fft_out[j] = (fft_out[2*j + 0]*fft_out[2*j + 0] + fft_out[2*j + 1]*fft_out[2*j + 1]);
+    }
+    for (int j = 1; j < fft_size/2; j++) {
+        fft_out[j] += fft_out[fft_size - j];
+    }
+
+    if (speed_up) {
+        for (int j = 0; j < n_fft; j++) {
+            fft_out[j] = 0.5*(fft_out[2*j] + fft_out[2*j + 1]);
+        }
+    }
+
+    // mel spectrogram
+    for (int j = 0; j < kMels; j++) {
+        double sum = 0.0;
+
+        for (int k = 0; k < n_fft; k++) {
+            sum += fft_out[k]*filters[j*n_fft + k];
+        }
+        if (sum < 1e-10) {
+            sum = 1e-10;
+        }
+
+        sum = log10(sum);
+
+        out[j*out_stride] = sum;
+    }
+}
+
+//
+// Test data
+//
+
+// Slaney style mel filterbank, normalized by area, like librosa.filters.mel()
+static std::vector<float> makeFilters(int n_fft)
+{
+	auto hzToMel = [](double f) {
+		const double fsp = 200.0 / 3;
+		const double minLogHz = 1000.0, minLogMel = minLogHz / fsp, logStep = log(6.4) / 27.0;
+		return f < minLogHz ? f / fsp : minLogMel + log(f / minLogHz) / logStep;
+	};
+	auto melToHz = [](double m) {
+		const double fsp = 200.0 / 3;
+		const double minLogHz = 1000.0, minLogMel = minLogHz / fsp, logStep = log(6.4) / 27.0;
+		return m < minLogMel ? m * fsp : minLogHz * exp(logStep * (m - minLogMel));
+	};
+
+	std::vector<double> hz(kMels + 2);
+	const double melMax = hzToMel(kSampleRate / 2.0);
+	for (int i = 0; i < kMels + 2; i++)
+		hz[i] = melToHz(melMax * i / (kMels + 1));
+
+	std::vector<float> filters(kMels * n_fft, 0.0f);
+	for (int j = 0; j < kMels; j++)
+	{
+		const double norm = 2.0 / (hz[j + 2] - hz[j]);
+		for (int k = 0; k < n_fft; k++)
+		{
+			const double f = (double)k * kSampleRate / kFFTSize;
+			const double lower = (f - hz[j]) / (hz[j + 1] - hz[j]);
+			const double upper = (hz[j + 2] - f) / (hz[j + 2] - hz[j + 1]);
+			filters[j * n_fft + k] = (float)(std::max(0.0, std::min(lower, upper)) * norm);
+		}
+	}
+
+	return filters;
+}
+
+// The filters out of a ggml whisper model, which come right after the magic and hparams
+static bool loadFilters(const char* filename, std::vector<float>& filters)
+{
+	std::ifstream f(filename, std::ios::binary);
+	uint32_t magic = 0;
+	int32_t hparams[11];
+	int32_t n_mel = 0, n_fft = 0;
+
+	f.read((char*)&magic, sizeof(magic));
+	f.read((char*)hparams, sizeof(hparams));
+	f.read((char*)&n_mel, sizeof(n_mel));
+	f.read((char*)&n_fft, sizeof(n_fft));
+	if (!f || magic != 0x67676d6c || n_mel != kMels || n_fft != 1 + kFFTSize / 2)
+		return false;
+
+	filters.resize(n_mel * n_fft);
+	f.read((char*)filters.data(), filters.size() * sizeof(float));
+	return (bool)f;
+}
+
+static std::vector<float> makeAudio(int seconds)
+{
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> noise(-0.05f, 0.05f);
+
+	std::vector<float> samples(seconds * kSampleRate);
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		const double t = (double)i / kSampleRate;
+		const double sweep = sin(2 * M_PI * (100.0 + 400.0 * t / seconds) * t);
+		const double voice = 0.3 * sin(2 * M_PI * 220.0 * t) + 0.2 * sin(2 * M_PI * 440.0 * t) + 0.1 * sin(2 * M_PI * 1320.0 * t);
+		samples[i] = (float)(0.4 * sweep + voice) + noise(rng);
+	}
+
+	return samples;
+}
+
+//
+// Benchmark
+//
+
+struct MelSetup {
+	const char* name;
+	int fftSize;
+	int hop;
+	bool speedUp;
+};
+
+template <typename F>
+static double framesPerSecond(int nFrames, double seconds, F&& frame)
+{
+	uint64_t frames = 0;
+	double elapsed = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	do {
+		for (int i = 0; i < nFrames; i++)
+			frame(i);
+		frames += nFrames;
+		elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} while (elapsed < seconds);
+
+	return frames / elapsed;
+}
+
+int main(int argc, char** argv)
+{
+	double seconds = 1.0;
+	int audioSeconds = 30;
+	const char* modelName = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-t") == 0) && (i + 1 < argc))
+			seconds = atof(argv[++i]);
+		else if ((strcmp(argv[i], "-m") == 0) && (i + 1 < argc))
+			modelName = argv[++i];
+		else if ((strcmp(argv[i], "-s") == 0) && (i + 1 < argc))
+			audioSeconds = std::max(1, atoi(argv[++i]));
+		else {
+			printf("usage: melbench [-t seconds] [-m ggml-model.bin] [-s seconds of audio]\n");
+			return 1;
+		}
+	}
+
+	const int n_fft = 1 + kFFTSize / 2;
+	std::vector<float> filters;
+	if (modelName != nullptr) {
+		if (!loadFilters(modelName, filters)) {
+			printf("%s: could not read mel filters\n", modelName);
+			return 1;
+		}
+	}
+	else {
+		filters = makeFilters(n_fft);
+	}
+
+	const std::vector<float> samples = makeAudio(audioSeconds);
+	const int n_samples = (int)samples.size();
+
+	static const MelSetup setups[] = {
+		{ "mel", kFFTSize, kHopLength, false },
+		{ "mel phase vocoder", 2 * kFFTSize, 2 * kHopLength, true },
+	};
+
+	printf("%d s of audio, %s filters\n\n", audioSeconds, modelName ? modelName : "librosa");
+	printf("%-18s %7s %12s %12s %8s %10s %12s\n", "", "frames", "old frame/s", "new frame/s", "speedup", "identical", "max diff");
+
+	bool allSame = true;
+
+	for (auto& setup : setups)
+	{
+		const int nFrames = n_samples / setup.hop;
+		const int n_bins = 1 + (setup.speedUp ? setup.fftSize / 4 : setup.fftSize / 2);
+
+		const std::vector<float> hann = whisper_hann(setup.fftSize);
+		const whisper_fft_plan plan(setup.fftSize);
+		const whisper_mel_filterbank bank(filters.data(), kMels, n_bins);
+
+		std::vector<float> fft_in(setup.fftSize, 0.0f);
+		std::vector<float> fft_out(2 * setup.fftSize);
+		whisper_mel_scratch scratch;
+		scratch.init(plan, bank);
+
+		std::vector<float> oldMel(kMels * nFrames);
+		std::vector<float> newMel(kMels * nFrames);
+
+		auto oldFrame = [&](int i) {
+			reference_frame(hann, samples, i * setup.hop, setup.fftSize, n_bins, setup.speedUp, filters, fft_in, fft_out, oldMel.data() + i, nFrames);
+		};
+		auto newFrame = [&](int i) {
+			whisper_mel_frame(plan, bank, hann.data(), samples.data(), n_samples, i * setup.hop, setup.speedUp, scratch, newMel.data() + i, nFrames);
+		};
+
+		const double oldRate = framesPerSecond(nFrames, seconds, oldFrame);
+		const double newRate = framesPerSecond(nFrames, seconds, newFrame);
+
+		// Compare frame by frame, and the FFTs on their own
+		int identical = 0;
+		double maxDiff = 0;
+		for (int i = 0; i < nFrames; i++)
+		{
+			bool same = true;
+			for (int j = 0; j < kMels; j++)
+			{
+				const float a = oldMel[j * nFrames + i];
+				const float b = newMel[j * nFrames + i];
+				if (memcmp(&a, &b, sizeof(float)) != 0) {
+					same = false;
+					maxDiff = std::max(maxDiff, (double)fabs(a - b));
+				}
+			}
+
+			const int offset = i * setup.hop;
+			for (int j = 0; j < setup.fftSize; j++)
+				fft_in[j] = (offset + j < n_samples) ? hann[j] * samples[offset + j] : 0.0f;
+			fft(fft_in, fft_out);
+			plan.forward(fft_in.data(), scratch.fft_out.data());
+			if (memcmp(fft_out.data(), scratch.fft_out.data(), 2 * setup.fftSize * sizeof(float)) != 0)
+				same = false;
+
+			identical += same;
+		}
+
+		allSame = allSame && (identical == nFrames);
+
+		printf("%-18s %7d %12.0f %12.0f %7.1fx %10s %12g\n", setup.name, nFrames, oldRate, newRate, newRate / oldRate,
+			identical == nFrames ? "all" : std::to_string(identical).c_str(), maxDiff);
+	}
+
+	printf("\n%s\n", allSame ? "bit exact" : "DIFFERENT");
+
+	return allSame ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+//
+// test_charset
+// Check that a charset's literal list always agrees with its
+// bitset, and that the vectorized scanners in chunkscan.h find
+// the same things the scalar reference loops do.
+//
+
+#include "chunkscan.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace ndt;
+
+static int failures = 0;
+
+static void check(bool cond, const char* what)
+{
+	if (!cond) {
+		printf("FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+// The literal list must hold exactly the members of the set,
+// or be -1 when there are too many of them
+static bool literalsAgree(const charset& cs)
+{
+	int members = 0;
+	for (int i = 0; i < 256; i++)
+		if (cs.contains((uint8_t)i))
+			members++;
+
+	if (members > charset::kMaxLiterals)
+		return cs.literalCount() == -1;
+
+	if (cs.literalCount() != members)
+		return false;
+
+	for (int i = 0; i < cs.literalCount(); i++)
+		if (!cs.contains(cs.literals()[i]))
+			return false;
+
+	return true;
+}
+
+void test_literals()
+{
+	printf("==== test_literals ====\n");
+
+	charset ws(" \t\r\n");
+	check(ws.literalCount() == 4, "4 whitespace literals");
+	check(literalsAgree(ws), "whitespace literals");
+
+	ws += ' ';
+	check(ws.literalCount() == 4, "adding a member twice");
+
+	ws -= '\t';
+	check(ws.literalCount() == 3 && literalsAgree(ws), "subtract");
+
+	charset digits("0123456789");
+	charset both = ws | digits;
+	check(both.literalCount() == 13 && literalsAgree(both), "union");
+
+	charset none = ws & digits;
+	check(none.literalCount() == 0 && literalsAgree(none), "intersection");
+
+	charset some = both ^ digits;
+	check(some.literalCount() == 3 && literalsAgree(some), "exclusive or");
+
+	// Growing past the limit, then shrinking back under it
+	charset alpha("abcdefghijklmnopqrstuvwxyz");
+	check(alpha.literalCount() == -1 && literalsAgree(alpha), "too many literals");
+
+	alpha &= charset("xyz");
+	check(alpha.literalCount() == 3 && literalsAgree(alpha), "shrink back under the limit");
+
+	alpha |= charset("abcdefghijklmnop");
+	check(alpha.literalCount() == -1 && literalsAgree(alpha), "grow past the limit");
+
+	alpha ^= alpha;
+	check(alpha.literalCount() == 0 && literalsAgree(alpha), "empty");
+}
+
+void test_scanners()
+{
+	printf("==== test_scanners ====\n");
+
+	const char* sets[] = { " \t\r\n", "<>&\"'", "0123456789abcdef", "0123456789abcdefg" };
+
+	srand(17);
+	std::vector<uint8_t> buff(4096);
+	for (auto& b : buff)
+		b = (rand() % 4) ? (uint8_t)(' ' + rand() % 95) : (uint8_t)(" \t\r\n"[rand() % 4]);
+
+	for (const char* chars : sets)
+	{
+		charset cs(chars);
+
+		// Every start and length up to a few blocks, so each
+		// kernel sees its head, body and tail
+		for (size_t start = 0; start < 70; start++)
+		{
+			for (size_t len = 0; len < 140; len++)
+			{
+				const uint8_t* s = buff.data() + start;
+				const uint8_t* e = s + len;
+
+				check(scan_find_in_set(s, e, cs) == scan_find_in_set_scalar(s, e, cs), "find_in_set");
+				check(scan_find_not_in_set(s, e, cs) == scan_find_not_in_set_scalar(s, e, cs), "find_not_in_set");
+				check(scan_rfind_not_in_set(s, e, cs) == scan_rfind_not_in_set_scalar(s, e, cs), "rfind_not_in_set");
+				check(scan_find_byte(s, e, (uint8_t)chars[0]) == scan_find_byte_scalar(s, e, (uint8_t)chars[0]), "find_byte");
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	test_literals();
+	test_scanners();
+
+	printf("%s, %d failures\n", failures ? "FAILED" : "PASSED", failures);
+
+	return failures ? 1 : 0;
+}
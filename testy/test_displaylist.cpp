@@ -0,0 +1,209 @@
+//
+// test_displaylist
+// Drawing a static scene directly, versus replaying it from a DisplayList
+//
+// The scene is the kind of background our dashboards draw over and
+// over; a calendar grid, gauge faces with tick marks, a clock face, and
+// a few decorative paths.  It is drawn into an offscreen image
+//   direct - the drawing code runs every frame
+//   replay - recorded once, replayed every frame
+//   merged - recorded once, mergeDraws(), replayed every frame
+//
+// The replayed images are compared against the directly drawn one.
+//
+//   test_displaylist [-frames 200] [-threads 0]
+//
+
+#include "DisplayList.hpp"
+#include "stopwatch.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+// A BLGraphics drawing into an image
+struct ImageGraphics : public BLGraphics
+{
+	ImageGraphics(BLImage& img, uint32_t threadCount)
+	{
+		BLContextCreateInfo createInfo{};
+		createInfo.threadCount = threadCount;
+		fCtx.begin(img, createInfo);
+	}
+
+	virtual ~ImageGraphics()
+	{
+		fCtx.end();
+	}
+};
+
+static bool imagesIdentical(const BLImage& a, const BLImage& b)
+{
+	BLImageData da{};
+	BLImageData db{};
+	a.getData(&da);
+	b.getData(&db);
+
+	if ((da.size.w != db.size.w) || (da.size.h != db.size.h))
+		return false;
+
+	size_t rowBytes = (size_t)da.size.w * 4;
+	for (int y = 0; y < da.size.h; y++)
+	{
+		const uint8_t* rowA = (const uint8_t*)da.pixelData + (intptr_t)y * da.stride;
+		const uint8_t* rowB = (const uint8_t*)db.pixelData + (intptr_t)y * db.stride;
+		if (memcmp(rowA, rowB, rowBytes) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+static void drawCalendar(IGraphics& ctx, double x, double y, double cellSize)
+{
+	ctx.strokeWeight(1);
+	ctx.stroke(Pixel(0x40, 0x40, 0x40));
+	ctx.fill(Pixel(0xf0, 0xf0, 0xf0));
+
+	for (int row = 0; row < 6; row++)
+	{
+		for (int col = 0; col < 7; col++)
+		{
+			double cx = x + col * cellSize;
+			double cy = y + row * cellSize;
+			double s = cellSize - 4;
+			ctx.quad(cx, cy, cx + s, cy, cx + s, cy + s, cx, cy + s);
+		}
+	}
+}
+
+static void drawGauge(IGraphics& ctx, double cx, double cy, double r)
+{
+	BLPath face{};
+	face.addCircle(BLCircle(cx, cy, r));
+
+	ctx.strokeWeight(3);
+	ctx.stroke(Pixel(0x20, 0x20, 0x20));
+	ctx.fill(Pixel(0xe0, 0xe8, 0xf0));
+	ctx.path(face);
+
+	// tick marks
+	ctx.strokeWeight(2);
+	ctx.stroke(Pixel(0, 0, 0));
+	for (int i = 0; i <= 40; i++)
+	{
+		double angle = maths::radians(135.0 + i * 270.0 / 40.0);
+		double inner = (i % 5 == 0) ? r * 0.75 : r * 0.85;
+		ctx.line(cx + cos(angle) * inner, cy + sin(angle) * inner,
+			cx + cos(angle) * (r * 0.95), cy + sin(angle) * (r * 0.95));
+	}
+}
+
+static void drawClockFace(IGraphics& ctx, double cx, double cy, double r)
+{
+	ctx.noStroke();
+	ctx.fill(Pixel(0x30, 0x30, 0x60));
+
+	// hour markers, as little triangles pointing at the center
+	for (int i = 0; i < 12; i++)
+	{
+		double angle = maths::radians(i * 30.0);
+		double c = cos(angle);
+		double s = sin(angle);
+		double outer = r * 0.95;
+		double inner = r * 0.8;
+		double half = r * 0.04;
+		ctx.triangle(cx + c * outer - s * half, cy + s * outer + c * half,
+			cx + c * outer + s * half, cy + s * outer - c * half,
+			cx + c * inner, cy + s * inner);
+	}
+}
+
+static void drawScene(IGraphics& ctx, int width, int height)
+{
+	ctx.push();
+	ctx.background(Pixel(0xff, 0xff, 0xff));
+
+	drawCalendar(ctx, 20, 20, 40);
+
+	for (int i = 0; i < 4; i++)
+		drawGauge(ctx, 420 + i * 220.0, 140, 100);
+
+	drawClockFace(ctx, 160, 480, 140);
+
+	// decorative waves along the bottom
+	ctx.noFill();
+	ctx.stroke(Pixel(0x80, 0x80, 0xc0));
+	ctx.strokeWeight(2);
+	for (int i = 0; i < 8; i++)
+	{
+		double y = 380 + i * 30.0;
+		ctx.bezier(360, y, 600, y - 20, 900, y + 20, width - 20.0, y);
+	}
+
+	ctx.pop();
+	ctx.flush();
+}
+
+int main(int argc, char** argv)
+{
+	int frames = 200;
+	uint32_t threads = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-frames") == 0) && (i + 1 < argc))
+			frames = std::max(1, atoi(argv[++i]));
+		else if ((strcmp(argv[i], "-threads") == 0) && (i + 1 < argc))
+			threads = (uint32_t)std::max(0, atoi(argv[++i]));
+	}
+
+	const int width = 1280;
+	const int height = 720;
+
+	DisplayList recorded{};
+	drawScene(recorded, width, height);
+
+	DisplayList merged{};
+	drawScene(merged, width, height);
+	size_t folded = merged.mergeDraws();
+
+	printf("%d frames, %dx%d, %u threads\n", frames, width, height, threads);
+	printf("recorded: %zu commands, %zu bytes\n", recorded.commandCount(), recorded.commandBytes());
+	printf("merged:   %zu commands, %zu bytes, %zu draws folded\n\n", merged.commandCount(), merged.commandBytes(), folded);
+
+	BLImage reference(width, height, BL_FORMAT_PRGB32);
+	BLImage replayed(width, height, BL_FORMAT_PRGB32);
+	BLImage mergedImg(width, height, BL_FORMAT_PRGB32);
+
+	StopWatch sw;
+	double start = sw.seconds();
+	for (int f = 0; f < frames; f++)
+	{
+		ImageGraphics ctx(reference, threads);
+		drawScene(ctx, width, height);
+	}
+	double directMs = (sw.seconds() - start) * 1000.0 / frames;
+
+	start = sw.seconds();
+	for (int f = 0; f < frames; f++)
+	{
+		ImageGraphics ctx(replayed, threads);
+		recorded.replay(ctx);
+	}
+	double replayMs = (sw.seconds() - start) * 1000.0 / frames;
+
+	start = sw.seconds();
+	for (int f = 0; f < frames; f++)
+	{
+		ImageGraphics ctx(mergedImg, threads);
+		merged.replay(ctx);
+	}
+	double mergedMs = (sw.seconds() - start) * 1000.0 / frames;
+
+	printf("%-8s %12s %10s\n", "mode", "ms/frame", "same");
+	printf("%-8s %12.3f %10s\n", "direct", directMs, "-");
+	printf("%-8s %12.3f %10s\n", "replay", replayMs, imagesIdentical(reference, replayed) ? "yes" : "NO");
+	printf("%-8s %12.3f %10s\n", "merged", mergedMs, imagesIdentical(reference, mergedImg) ? "yes" : "NO");
+
+	return 0;
+}
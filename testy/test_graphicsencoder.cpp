@@ -0,0 +1,451 @@
+//
+// test_graphicsencoder
+// Size and speed of the GraphicsEncoder command stream encodings
+//
+// First, a check that the encodings are faithful.  A sequence of drawing
+// is done straight into a graphics object that records the state in effect
+// at every shape, and what the shape was.  The same drawing is then encoded,
+// decoded into another recorder, and the two records must match.  This is
+// done with a recorder whose pop() restores everything, and one whose
+// pop() restores nothing, since the compact encoding must not assume
+// anything about what the other side does on pop().
+//
+// Then a frame of typical drawing (shapes, polylines, paths, and a lot of
+// repeated state setting) is encoded with the raw encoding, and then with
+// the compact encoding, and each stream is decoded into a graphics
+// object that does nothing but count what it's asked to do.  Reported
+// are the bytes per frame, and the time to encode and decode a frame.
+//
+//   test_graphicsencoder [-frames 200] [-shapes 2000]
+//
+
+#include "GraphicsEncoder.hpp"
+#include "GraphicsDecoder.hpp"
+#include "stopwatch.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Counts the drawing calls, and ignores everything else
+struct CountingGraphics : public IGraphics
+{
+    size_t fState{ 0 };
+    size_t fShapes{ 0 };
+    size_t fPoints{ 0 };
+
+    void setDpiUnits(const int dpi, const float units) override {}
+    void strokeBeforeTransform(bool b) override { fState++; }
+    void angleMode(const ANGLEMODE mode) override { fState++; }
+    void ellipseMode(const ELLIPSEMODE mode) override { fState++; }
+    void rectMode(const RECTMODE mode) override { fState++; }
+    void blendMode(int mode) override { fState++; }
+    void globalOpacity(double opacity) override { fState++; }
+    void strokeCaps(int caps) override { fState++; }
+    void strokeJoin(int join) override { fState++; }
+    void strokeMiterLimit(float limit) override { fState++; }
+    void strokeWeight(float weight) override { fState++; }
+
+    bool push() override { return true; }
+    bool pop() override { return true; }
+    bool flush() override { return true; }
+
+    void transform(double* values) override {}
+    void translate(double dx, double dy) override {}
+    void scale(double sx, double sy) override {}
+    void rotate(double angle, double cx, double cy) override {}
+
+    void noFill() override { fState++; }
+    void fill(const BLVarCore& s) override { fState++; }
+    void fill(const Pixel& c) override { fState++; }
+    void fillOpacity(double opacity) override { fState++; }
+    void fillRule(int rule) override { fState++; }
+    void stroke(const BLVarCore& s) override { fState++; }
+    void stroke(const Pixel& c) override { fState++; }
+    void noStroke() override { fState++; }
+
+    void clear() override {}
+    void clearRect(double x, double y, double w, double h) override {}
+    void background(const Pixel& c) override {}
+    void clip(const maths::rectf& bb) override {}
+    void noClip() override {}
+
+    void set(double x, double y, const Pixel& c) override { fShapes++; }
+    void point(double x, double y) override { fShapes++; }
+    void line(double x1, double y1, double x2, double y2) override { fShapes++; }
+    void arc(double cx, double cy, double r, double start, double sweep) override { fShapes++; }
+    void rect(double x, double y, double width, double height, double xradius, double yradius) override { fShapes++; }
+    void rect(double x, double y, double width, double height) override { fShapes++; }
+    void ellipse(double a, double b, double c, double d) override { fShapes++; }
+    void circle(double cx, double cy, double diameter) override { fShapes++; }
+    void triangle(double x1, double y1, double x2, double y2, double x3, double y3) override { fShapes++; }
+    void bezier(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4) override { fShapes++; }
+    void polyline(const BLPoint* pts, size_t n) override { fShapes++; fPoints += n; }
+    void polygon(const BLPoint* pts, size_t n) override { fShapes++; fPoints += n; }
+    void quad(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4) override { fShapes++; }
+    void path(const BLPath& path) override { fShapes++; fPoints += path.size(); }
+
+    void beginShape(SHAPEMODE shapeKind) override {}
+    void vertex(double x, double y) override { fPoints++; }
+    void endShape(SHAPEEND endKind) override { fShapes++; }
+
+    void image(const BLImage& img, int x, int y) override {}
+    void scaleImage(const BLImage& src,
+        double srcX, double srcY, double srcWidth, double srcHeight,
+        double dstX, double dstY, double dstWidth, double dstHeight) override {}
+
+    void textAlign(ALIGNMENT horizontal, ALIGNMENT vertical) override {}
+    void textFace(const BLFontFace& face) override {}
+    void textFont(const char* fontname) override {}
+    void textSize(float size) override {}
+    void text(const char* txt, float x, float y, float x2 = 0, float y2 = 0) override { fShapes++; }
+    void textAtBaseline(const char* txt, float x, float y, float x2 = 0, float y2 = 0) override { fShapes++; }
+    maths::vec2f textMeasure(const char* txt) override { return { 0, 0 }; }
+    float textAscent() override { return 0; }
+    float textDescent() override { return 0; }
+};
+
+// Keeps track of the state it's been given, and writes down that
+// state, along with the shape, every time it's asked to draw something
+struct RecordingGraphics : public IGraphics
+{
+    struct State {
+        std::string fill{ "default" };
+        std::string stroke{ "default" };
+        double weight{ 1 };
+        double miter{ 4 };
+        double globalOpacity{ 1 };
+        double fillOpacity{ 1 };
+        double textSize{ 12 };
+        int caps{ 0 };
+        int join{ 0 };
+        int blend{ 0 };
+        int fillRule{ 0 };
+        int strokeOrder{ 0 };
+        int angleMode{ 0 };
+        int ellipseMode{ 0 };
+        int rectMode{ 0 };
+    };
+
+    bool fRestoreOnPop{ true };
+    State fState{};
+    std::vector<State> fStack{};
+    std::vector<std::string> fLog{};
+
+    RecordingGraphics(bool restoreOnPop) : fRestoreOnPop(restoreOnPop) {}
+
+    static std::string color(const Pixel& c)
+    {
+        char buff[16];
+        snprintf(buff, sizeof(buff), "%08x", (unsigned)c.value);
+        return buff;
+    }
+
+    // %a so values are compared exactly
+    void record(const char* what, std::initializer_list<double> args)
+    {
+        char buff[512];
+        int n = snprintf(buff, sizeof(buff), "%s fill:%s stroke:%s w:%a m:%a go:%a fo:%a ts:%a caps:%d join:%d blend:%d rule:%d so:%d am:%d em:%d rm:%d |",
+            what, fState.fill.c_str(), fState.stroke.c_str(), fState.weight, fState.miter, fState.globalOpacity,
+            fState.fillOpacity, fState.textSize, fState.caps, fState.join, fState.blend, fState.fillRule,
+            fState.strokeOrder, fState.angleMode, fState.ellipseMode, fState.rectMode);
+        for (double v : args)
+            n += snprintf(buff + n, sizeof(buff) - n, " %a", v);
+
+        fLog.push_back(buff);
+    }
+
+    void setDpiUnits(const int dpi, const float units) override {}
+    void strokeBeforeTransform(bool b) override { fState.strokeOrder = b; }
+    void angleMode(const ANGLEMODE mode) override { fState.angleMode = (int)mode; }
+    void ellipseMode(const ELLIPSEMODE mode) override { fState.ellipseMode = (int)mode; }
+    void rectMode(const RECTMODE mode) override { fState.rectMode = (int)mode; }
+    void blendMode(int mode) override { fState.blend = mode; }
+    void globalOpacity(double opacity) override { fState.globalOpacity = opacity; }
+    void strokeCaps(int caps) override { fState.caps = caps; }
+    void strokeJoin(int join) override { fState.join = join; }
+    void strokeMiterLimit(float limit) override { fState.miter = limit; }
+    void strokeWeight(float weight) override { fState.weight = weight; }
+
+    bool push() override { fStack.push_back(fState); return true; }
+    bool pop() override
+    {
+        if (fStack.empty())
+            return false;
+        if (fRestoreOnPop)
+            fState = fStack.back();
+        fStack.pop_back();
+        return true;
+    }
+    bool flush() override { return true; }
+
+    void transform(double* values) override { record("transform", { values[0], values[1], values[2], values[3], values[4], values[5] }); }
+    void translate(double dx, double dy) override { record("translate", { dx, dy }); }
+    void scale(double sx, double sy) override { record("scale", { sx, sy }); }
+    void rotate(double angle, double cx, double cy) override { record("rotate", { angle, cx, cy }); }
+
+    void noFill() override { fState.fill = "none"; }
+    void fill(const BLVarCore& s) override { fState.fill = "style"; }
+    void fill(const Pixel& c) override { fState.fill = color(c); }
+    void fillOpacity(double opacity) override { fState.fillOpacity = opacity; }
+    void fillRule(int rule) override { fState.fillRule = rule; }
+    void stroke(const BLVarCore& s) override { fState.stroke = "style"; }
+    void stroke(const Pixel& c) override { fState.stroke = color(c); }
+    void noStroke() override { fState.stroke = "none"; }
+
+    void clear() override { record("clear", {}); }
+    void clearRect(double x, double y, double w, double h) override { record("clearRect", { x, y, w, h }); }
+    void background(const Pixel& c) override { record("background", { (double)c.value }); }
+    void clip(const maths::rectf& bb) override {}
+    void noClip() override {}
+
+    void set(double x, double y, const Pixel& c) override { record("set", { x, y, (double)c.value }); }
+    void point(double x, double y) override { record("point", { x, y }); }
+    void line(double x1, double y1, double x2, double y2) override { record("line", { x1, y1, x2, y2 }); }
+    void arc(double cx, double cy, double r, double start, double sweep) override { record("arc", { cx, cy, r, start, sweep }); }
+    void rect(double x, double y, double width, double height, double xradius, double yradius) override { record("rect", { x, y, width, height, xradius, yradius }); }
+    void rect(double x, double y, double width, double height) override { record("rect", { x, y, width, height }); }
+    void ellipse(double a, double b, double c, double d) override { record("ellipse", { a, b, c, d }); }
+    void circle(double cx, double cy, double diameter) override { record("circle", { cx, cy, diameter }); }
+    void triangle(double x1, double y1, double x2, double y2, double x3, double y3) override { record("triangle", { x1, y1, x2, y2, x3, y3 }); }
+    void bezier(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4) override { record("bezier", { x1, y1, x2, y2, x3, y3, x4, y4 }); }
+    void polyline(const BLPoint* pts, size_t n) override { record("polyline", { (double)n }); for (size_t i = 0; i < n; i++) record("pt", { pts[i].x, pts[i].y }); }
+    void polygon(const BLPoint* pts, size_t n) override { record("polygon", { (double)n }); for (size_t i = 0; i < n; i++) record("pt", { pts[i].x, pts[i].y }); }
+    void quad(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4) override { record("quad", { x1, y1, x2, y2, x3, y3, x4, y4 }); }
+    void path(const BLPath& path) override { record("path", { (double)path.size() }); }
+
+    void beginShape(SHAPEMODE shapeKind) override { record("beginShape", { (double)shapeKind }); }
+    void vertex(double x, double y) override { record("vertex", { x, y }); }
+    void endShape(SHAPEEND endKind) override { record("endShape", { (double)endKind }); }
+
+    void image(const BLImage& img, int x, int y) override {}
+    void scaleImage(const BLImage& src,
+        double srcX, double srcY, double srcWidth, double srcHeight,
+        double dstX, double dstY, double dstWidth, double dstHeight) override {}
+
+    void textAlign(ALIGNMENT horizontal, ALIGNMENT vertical) override {}
+    void textFace(const BLFontFace& face) override {}
+    void textFont(const char* fontname) override {}
+    void textSize(float size) override { fState.textSize = size; }
+    void text(const char* txt, float x, float y, float x2 = 0, float y2 = 0) override { record(txt, { x, y }); }
+    void textAtBaseline(const char* txt, float x, float y, float x2 = 0, float y2 = 0) override { record(txt, { x, y }); }
+    maths::vec2f textMeasure(const char* txt) override { return { 0, 0 }; }
+    float textAscent() override { return 0; }
+    float textDescent() override { return 0; }
+};
+
+// Drawing that leans on push() and pop() to put state back, and
+// sets state to what it already is.  All the values are ones that
+// go through the compact encoding unchanged: coordinates in 1/16ths,
+// and everything else representable as a float.
+static void drawStateFrame(IGraphics& ctx)
+{
+    ctx.fill(Pixel(255, 0, 0));
+    ctx.stroke(Pixel(0, 0, 255));
+    ctx.strokeWeight(2.0f);
+    ctx.rect(10, 10, 20, 20);
+
+    // The state set inside is gone after the pop()
+    ctx.push();
+    ctx.noFill();
+    ctx.noStroke();
+    ctx.strokeWeight(5.0f);
+    ctx.ellipseMode(ELLIPSEMODE::CORNER);
+    ctx.textSize(30);
+    ctx.circle(40.5, 40.25, 8);
+    ctx.pop();
+
+    // So setting it back to what it was before must get through
+    ctx.fill(Pixel(255, 0, 0));
+    ctx.stroke(Pixel(0, 0, 255));
+    ctx.strokeWeight(2.0f);
+    ctx.ellipseMode(ELLIPSEMODE::CENTER);
+    ctx.textSize(12);
+    ctx.rect(50, 50, 20, 20);
+    ctx.text("after pop", 1, 2);
+
+    // Nested, with state set to the same thing on both sides
+    ctx.push();
+    ctx.fill(Pixel(255, 0, 0));
+    ctx.push();
+    ctx.fill(Pixel(0, 255, 0));
+    ctx.fillOpacity(0.5);
+    ctx.line(0, 0, 100.0625, 100);
+    ctx.pop();
+    ctx.fill(Pixel(255, 0, 0));
+    ctx.fillOpacity(0.5);
+    ctx.triangle(1, 2, 3, 4, 5, 6);
+    ctx.pop();
+
+    // Unbalanced pop, nothing can be assumed
+    ctx.pop();
+    ctx.fill(Pixel(255, 0, 0));
+    ctx.rect(1, 1, 2, 2);
+
+    std::vector<BLPoint> pts{ { 1, 1 }, { 2.5, 3 }, { -4, 6.125 }, { 1000, -1000 } };
+    ctx.polygon(pts.data(), pts.size());
+    ctx.bezier(0, 0, 10, 20, 30, 40, 50, 60.5);
+
+    ctx.flush();
+}
+
+// Drawing straight into a recorder, and through an encoder and
+// decoder into another one, must give the same record
+static bool checkRoundTrip(const char* name, GRENCODING encoding, uint32_t features, bool restoreOnPop)
+{
+    RecordingGraphics direct(restoreOnPop);
+    drawStateFrame(direct);
+
+    std::vector<uint8_t> buff(64 * 1024);
+    BinStream bs(buff.data(), buff.size());
+    GraphicsEncoder enc(bs, encoding, features);
+    drawStateFrame(enc);
+    size_t bytes = bs.tell();
+
+    auto decoded = std::make_shared<RecordingGraphics>(restoreOnPop);
+    BinStream in(buff.data(), bytes);
+    GraphicsDecoder dec(in, decoded);
+    dec.run();
+
+    bool same = direct.fLog == decoded->fLog;
+    printf("%-22s pop %-10s %s\n", name, restoreOnPop ? "restores" : "doesn't", same ? "matches" : "MISMATCH");
+
+    if (!same)
+    {
+        size_t n = std::max(direct.fLog.size(), decoded->fLog.size());
+        for (size_t i = 0; i < n; i++)
+        {
+            const char* a = i < direct.fLog.size() ? direct.fLog[i].c_str() : "(none)";
+            const char* b = i < decoded->fLog.size() ? decoded->fLog[i].c_str() : "(none)";
+            if (strcmp(a, b) != 0)
+            {
+                printf("  first difference, at %zu\n    drawn:   %s\n    decoded: %s\n", i, a, b);
+                break;
+            }
+        }
+    }
+
+    return same;
+}
+
+// One frame worth of drawing, the same every time
+static void drawFrame(IGraphics& ctx, int shapes, const BLPath& wave)
+{
+    uint32_t seed = 12345;
+    auto next = [&seed]() { seed = seed * 1664525 + 1013904223; return (seed >> 8) & 0xffff; };
+
+    ctx.background(Pixel(0xc0, 0xc0, 0xc0));
+
+    std::vector<BLPoint> pts(24);
+
+    for (int i = 0; i < shapes; i++)
+    {
+        double x = (next() % 1920) + 0.5;
+        double y = (next() % 1080) + 0.25;
+        double w = 4 + (next() % 60);
+        double h = 4 + (next() % 60);
+
+        // The kind of state setting drawing code does before
+        // every shape, whether it has changed or not
+        ctx.stroke(Pixel(0, 0, 0));
+        ctx.strokeWeight(1.0f);
+        ctx.fill(Pixel(255, (i / 50) & 0xff, 0));
+
+        switch (i % 5)
+        {
+        case 0: ctx.rect(x, y, w, h); break;
+        case 1: ctx.line(x, y, x + w, y + h); break;
+        case 2: ctx.circle(x, y, w); break;
+        case 3:
+            for (size_t p = 0; p < pts.size(); p++)
+                pts[p] = BLPoint(x + p * 3.0, y + (next() % 32));
+            ctx.polyline(pts.data(), pts.size());
+            break;
+        case 4:
+            ctx.push();
+            ctx.translate(x, y);
+            ctx.path(wave);
+            ctx.pop();
+            break;
+        }
+    }
+
+    ctx.flush();
+}
+
+int main(int argc, char** argv)
+{
+    int frames = 200;
+    int shapes = 2000;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-frames") == 0) && (i + 1 < argc))
+            frames = std::max(1, atoi(argv[++i]));
+        else if ((strcmp(argv[i], "-shapes") == 0) && (i + 1 < argc))
+            shapes = std::max(1, atoi(argv[++i]));
+    }
+
+    struct Mode {
+        const char* name;
+        GRENCODING encoding;
+        uint32_t features;
+    };
+    Mode modes[] = {
+        { "raw", GRENCODING_RAW, 0 },
+        { "compact", GRENCODING_COMPACT, GCS_FEATURE_ALL },
+        { "compact, no elision", GRENCODING_COMPACT, GCS_FEATURE_DELTA_COORDS | GCS_FEATURE_BULK_POINTS },
+    };
+
+    bool faithful = true;
+    for (auto& mode : modes)
+    {
+        faithful &= checkRoundTrip(mode.name, mode.encoding, mode.features, true);
+        faithful &= checkRoundTrip(mode.name, mode.encoding, mode.features, false);
+    }
+    printf("\n");
+
+    if (!faithful)
+        return 1;
+
+    BLPath wave{};
+    wave.moveTo(0, 0);
+    for (int i = 1; i <= 16; i++)
+        wave.quadTo(i * 4.0 - 2.0, (i & 1) ? -6.0 : 6.0, i * 4.0, 0);
+
+    std::vector<uint8_t> buff(64 * 1024 * 1024);
+    StopWatch sw;
+
+    printf("%d shapes per frame, %d frames\n\n", shapes, frames);
+    printf("%-22s %12s %12s %12s %10s\n", "encoding", "bytes/frame", "encode ms", "decode ms", "shapes");
+
+    for (auto& mode : modes)
+    {
+        size_t frameBytes = 0;
+
+        double start = sw.seconds();
+        for (int f = 0; f < frames; f++)
+        {
+            BinStream bs(buff.data(), buff.size());
+            GraphicsEncoder enc(bs, mode.encoding, mode.features);
+            drawFrame(enc, shapes, wave);
+            frameBytes = bs.tell();
+        }
+        double encodeMs = (sw.seconds() - start) * 1000.0 / frames;
+
+        auto counter = std::make_shared<CountingGraphics>();
+        start = sw.seconds();
+        for (int f = 0; f < frames; f++)
+        {
+            BinStream bs(buff.data(), frameBytes);
+            GraphicsDecoder dec(bs, counter);
+            dec.run();
+        }
+        double decodeMs = (sw.seconds() - start) * 1000.0 / frames;
+
+        printf("%-22s %12zu %12.3f %12.3f %10zu\n", mode.name, frameBytes, encodeMs, decodeMs, counter->fShapes / frames);
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+//
+// test_svgarena
+// Compare loading an SVG document into the regular shared_ptr
+// node tree against loading it into an arena.
+//
+// Peak memory only ever goes up for a process, so each mode
+// should be measured in its own run:
+//
+//   test_svgarena <file.svg> shared
+//   test_svgarena <file.svg> arena
+//
+// Reports nodes/sec for load and teardown, and the peak working set.
+//
+
+#include "svgdocument.h"
+#include "stopwatch.hpp"
+
+#include <psapi.h>
+#include <cstdio>
+#include <cstring>
+
+#pragma comment(lib, "psapi.lib")
+
+static size_t peakWorkingSet()
+{
+	PROCESS_MEMORY_COUNTERS pmc{};
+	pmc.cb = sizeof(pmc);
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0;
+
+	return pmc.PeakWorkingSetSize;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("usage: test_svgarena <file.svg> [shared | arena] [iterations]\n");
+		return 1;
+	}
+
+	const char* filename = argv[1];
+	bool useArena = (argc > 2) && (strcmp(argv[2], "arena") == 0);
+	int iterations = (argc > 3) ? atoi(argv[3]) : 10;
+	if (iterations < 1)
+		iterations = 1;
+
+	size_t baseline = peakWorkingSet();
+
+	StopWatch sw;
+	double loadSeconds = 0;
+	double freeSeconds = 0;
+	size_t nodes = 0;
+
+	for (int i = 0; i < iterations; i++)
+	{
+		auto doc = std::make_shared<svg::SVGDocument>(filename);
+		doc->setArenaMode(useArena);
+
+		double start = sw.seconds();
+		doc->load();
+		loadSeconds += sw.seconds() - start;
+
+		nodes = doc->nodeCount();
+
+		if ((i == 0) && (doc->arena() != nullptr))
+		{
+			printf("arena: %zu allocations, %zu bytes used, %zu bytes reserved in %zu blocks\n",
+				doc->arena()->allocationCount(), doc->arena()->bytesAllocated(),
+				doc->arena()->bytesReserved(), doc->arena()->blockCount());
+		}
+
+		start = sw.seconds();
+		doc = nullptr;
+		freeSeconds += sw.seconds() - start;
+	}
+
+	size_t peak = peakWorkingSet();
+
+	printf("mode: %s\n", useArena ? "arena" : "shared");
+	printf("nodes: %zu\n", nodes);
+	printf("load: %8.3f ms/doc  %12.0f nodes/sec\n", loadSeconds * 1000.0 / iterations, (nodes * (double)iterations) / loadSeconds);
+	printf("free: %8.3f ms/doc  %12.0f nodes/sec\n", freeSeconds * 1000.0 / iterations, (nodes * (double)iterations) / freeSeconds);
+	printf("peak RSS: %.2f MB (%.2f MB over startup)\n", peak / (1024.0 * 1024.0), (peak - baseline) / (1024.0 * 1024.0));
+
+	return 0;
+}
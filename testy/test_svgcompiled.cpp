@@ -0,0 +1,188 @@
+//
+// test_svgcompiled
+// A compiled SVG file must draw exactly what the document
+// it was compiled from draws.
+//
+// Each document is rendered from its source, compiled, loaded back
+// from the compiled file, and rendered again, and the two images are
+// compared pixel for pixel.  The compiled file is written over a larger
+// file full of junk first, to make sure none of that is left behind.
+//
+//   test_svgcompiled [-size 512] [file.svg ...]
+//
+// With no files, a generated document is used, with coordinates far
+// from the origin under a long chain of transforms, where anything
+// less than full precision in the compiled vertices shows up.
+//
+
+#include "svgdocument.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static void clearImage(BLImage& img)
+{
+	BLImageData data{};
+	img.getData(&data);
+	for (int y = 0; y < data.size.h; y++)
+		memset((uint8_t*)data.pixelData + (intptr_t)y * data.stride, 0, (size_t)data.size.w * 4);
+}
+
+// Number of pixels that differ
+static size_t imageDifferences(const BLImage& a, const BLImage& b)
+{
+	BLImageData da{};
+	BLImageData db{};
+	a.getData(&da);
+	b.getData(&db);
+
+	if ((da.size.w != db.size.w) || (da.size.h != db.size.h))
+		return SIZE_MAX;
+
+	size_t diffs = 0;
+	for (int y = 0; y < da.size.h; y++)
+	{
+		const uint32_t* rowA = (const uint32_t*)((const uint8_t*)da.pixelData + (intptr_t)y * da.stride);
+		const uint32_t* rowB = (const uint32_t*)((const uint8_t*)db.pixelData + (intptr_t)y * db.stride);
+		for (int x = 0; x < da.size.w; x++)
+			if (rowA[x] != rowB[x])
+				diffs++;
+	}
+
+	return diffs;
+}
+
+// Leave a file bigger than any compiled file will be
+static void writeJunk(const std::string& filename, size_t size)
+{
+	FILE* f = fopen(filename.c_str(), "wb");
+	if (f == nullptr)
+		return;
+
+	std::vector<uint8_t> junk(size, 0xcd);
+	fwrite(junk.data(), 1, junk.size(), f);
+	fclose(f);
+}
+
+static const char* kGeneratedName = "test_svgcompiled_generated.svg";
+
+static void writeGenerated(const char* filename)
+{
+	FILE* f = fopen(filename, "wb");
+	if (f == nullptr)
+		return;
+
+	fprintf(f, "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"0 0 100 100\" width=\"100\" height=\"100\">\n");
+	for (int i = 0; i < 24; i++)
+		fprintf(f, "<g transform=\"translate(0.37 0.11) scale(0.9993)\">\n");
+	fprintf(f, "<g transform=\"translate(-1000000 -2000000)\">\n");
+	for (int i = 0; i < 40; i++)
+	{
+		double x = 1000000.0 + 3.0 + (i % 8) * 11.7;
+		double y = 2000000.0 + 3.0 + (i / 8) * 17.3;
+		fprintf(f, "<path d=\"M%.4f %.4f L%.4f %.4f L%.4f %.4f Z\" fill=\"#%06x\" stroke=\"black\" stroke-width=\"0.3\"/>\n",
+			x, y, x + 9.13, y + 1.07, x + 4.41, y + 13.29, (i * 0x3f17d5) & 0xffffff);
+	}
+	fprintf(f, "</g>\n");
+	for (int i = 0; i < 24; i++)
+		fprintf(f, "</g>\n");
+	fprintf(f, "</svg>\n");
+
+	fclose(f);
+}
+
+static size_t fileSize(const std::string& filename)
+{
+	FILE* f = fopen(filename.c_str(), "rb");
+	if (f == nullptr)
+		return 0;
+
+	fseek(f, 0, SEEK_END);
+	size_t size = (size_t)ftell(f);
+	fclose(f);
+
+	return size;
+}
+
+int main(int argc, char** argv)
+{
+	int size = 512;
+	std::vector<const char*> files{};
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-size") == 0) && (i + 1 < argc))
+			size = atoi(argv[++i]);
+		else
+			files.push_back(argv[i]);
+	}
+
+	bool generated = files.empty();
+	if (generated)
+	{
+		writeGenerated(kGeneratedName);
+		files.push_back(kGeneratedName);
+	}
+
+	int failures = 0;
+
+	for (auto filename : files)
+	{
+		auto doc = svg::SVGDocument::createFromFilename(filename);
+		if (doc->nodeCount() == 0)
+		{
+			printf("%s: nothing to render\n", filename);
+			continue;
+		}
+
+		double scale = std::min(size / doc->width(), size / doc->height());
+		BLMatrix2D m = BLMatrix2D::makeScaling(scale);
+
+		BLImage fromSource(size, size, BL_FORMAT_PRGB32);
+		clearImage(fromSource);
+		doc->renderToImage(fromSource, m);
+
+		std::string compiledName = std::string(filename) + ".compiled";
+		size_t junkSize = fileSize(filename) * 4 + 1024 * 1024;
+		writeJunk(compiledName, junkSize);
+
+		if (!doc->saveCompiled(compiledName))
+		{
+			printf("%s: can't be compiled, skipped\n", filename);
+			continue;
+		}
+
+		if (!doc->loadCompiled(compiledName))
+		{
+			printf("FAIL: %s: compiled file would not load\n", filename);
+			failures++;
+			continue;
+		}
+
+		size_t written = fileSize(compiledName);
+		if (written != doc->fCompiled->header().fileSize)
+		{
+			printf("FAIL: %s: compiled file is %zu bytes, should be %zu\n", filename, written, (size_t)doc->fCompiled->header().fileSize);
+			failures++;
+		}
+
+		BLImage fromCompiled(size, size, BL_FORMAT_PRGB32);
+		clearImage(fromCompiled);
+		doc->renderToImage(fromCompiled, m);
+
+		size_t diffs = imageDifferences(fromSource, fromCompiled);
+		printf("%s  %zu draws, %zu pixels differ  %s\n", filename, doc->fCompiled->drawCount(), diffs, diffs ? "MISMATCH" : "identical");
+		if (diffs)
+			failures++;
+
+		remove(compiledName.c_str());
+	}
+
+	if (generated)
+		remove(kGeneratedName);
+
+	printf("%s, %d failures\n", failures ? "FAILED" : "PASSED", failures);
+
+	return failures ? 1 : 0;
+}
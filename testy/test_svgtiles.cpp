@@ -0,0 +1,139 @@
+//
+// test_svgtiles
+// Headless benchmark of tile parallel SVG rendering
+//
+// Each document given on the command line is rendered, scaled to fit,
+// into an offscreen image using 1, 2, 4 ... N threads.  The time per frame is
+// reported for each thread count, and every frame is compared against the
+// single threaded frame to make sure the output is identical.  The single
+// threaded frame is itself compared against a plain draw() of the whole
+// document, which does no culling at all.
+//
+//   test_svgtiles [-size 1024] [-tile 256] [-frames 20] file.svg [file.svg ...]
+//
+
+#include "svgdocument.h"
+#include "stopwatch.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+static bool imagesIdentical(const BLImage& a, const BLImage& b)
+{
+	BLImageData da{};
+	BLImageData db{};
+	a.getData(&da);
+	b.getData(&db);
+
+	if ((da.size.w != db.size.w) || (da.size.h != db.size.h))
+		return false;
+
+	size_t rowBytes = (size_t)da.size.w * 4;
+	for (int y = 0; y < da.size.h; y++)
+	{
+		const uint8_t* rowA = (const uint8_t*)da.pixelData + (intptr_t)y * da.stride;
+		const uint8_t* rowB = (const uint8_t*)db.pixelData + (intptr_t)y * db.stride;
+		if (memcmp(rowA, rowB, rowBytes) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+// Draw the whole document through draw(), no tiles, no culling
+static void renderSerial(svg::SVGDocument& doc, BLImage& img, const BLMatrix2D& m)
+{
+	BLImageData data{};
+	img.getData(&data);
+	for (int y = 0; y < data.size.h; y++)
+		memset((uint8_t*)data.pixelData + (intptr_t)y * data.stride, 0, (size_t)data.size.w * 4);
+
+	svg::SVGTileGraphics ctx(data, 0, 0, data.size.w, data.size.h);
+	ctx.transform((double*)m.m);
+	doc.draw(ctx);
+	ctx.flush();
+}
+
+static double renderFrames(svg::SVGDocument& doc, BLImage& img, const BLMatrix2D& m, int frames)
+{
+	StopWatch sw;
+	for (int i = 0; i < frames; i++)
+	{
+		BLImageData data{};
+		img.getData(&data);
+		for (int y = 0; y < data.size.h; y++)
+			memset((uint8_t*)data.pixelData + (intptr_t)y * data.stride, 0, (size_t)data.size.w * 4);
+
+		doc.renderToImage(img, m);
+	}
+
+	return sw.millis() / frames;
+}
+
+int main(int argc, char** argv)
+{
+	int size = 1024;
+	int tileSize = 256;
+	int frames = 20;
+	int maxThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<const char*> files{};
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-size") == 0) && (i + 1 < argc))
+			size = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-tile") == 0) && (i + 1 < argc))
+			tileSize = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-frames") == 0) && (i + 1 < argc))
+			frames = atoi(argv[++i]);
+		else
+			files.push_back(argv[i]);
+	}
+
+	if (files.empty())
+	{
+		printf("usage: test_svgtiles [-size 1024] [-tile 256] [-frames 20] file.svg [file.svg ...]\n");
+		return 1;
+	}
+
+	for (auto filename : files)
+	{
+		auto doc = svg::SVGDocument::createFromFilename(filename);
+		if (doc->nodeCount() == 0)
+		{
+			printf("%s: nothing to render\n", filename);
+			continue;
+		}
+
+		doc->setTileSize(tileSize);
+
+		// Scale the document to fit the image
+		double scale = std::min(size / doc->width(), size / doc->height());
+		BLMatrix2D m = BLMatrix2D::makeScaling(scale);
+
+		printf("\n%s  (%zu nodes, %dx%d, tile %d)\n", filename, doc->nodeCount(), size, size, tileSize);
+
+		BLImage reference(size, size, BL_FORMAT_PRGB32);
+		doc->setRenderThreads(1);
+		double serialMs = renderFrames(*doc, reference, m, frames);
+		printf("  threads: %3d  %8.3f ms/frame  speedup: %5.2f\n", 1, serialMs, 1.0);
+
+		BLImage untiled(size, size, BL_FORMAT_PRGB32);
+		renderSerial(*doc, untiled, m);
+		printf("  draw(), no culling:  %s\n", imagesIdentical(reference, untiled) ? "identical" : "MISMATCH");
+
+		for (int threads = 2; threads <= maxThreads; threads *= 2)
+		{
+			BLImage img(size, size, BL_FORMAT_PRGB32);
+			doc->setRenderThreads(threads);
+			double ms = renderFrames(*doc, img, m, frames);
+
+			printf("  threads: %3d  %8.3f ms/frame  speedup: %5.2f  %s\n", threads, ms, serialMs / ms,
+				imagesIdentical(reference, img) ? "identical" : "MISMATCH");
+		}
+	}
+
+	return 0;
+}
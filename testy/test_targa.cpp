@@ -0,0 +1,115 @@
+//
+// test_targa
+// Decode throughput of the targa codec
+//
+// Each file is decoded repeatedly from memory, once with the original
+// pixel at a time decoder, and once with the bulk decoder, and the speed
+// of each is reported in MB/s of decoded pixels.  The two results are
+// compared as well.  The bulk decoder premultiplies alpha, so for 32-bit
+// images with alpha, the pixel decoder's output is premultiplied before
+// comparing.
+//
+//   test_targa [-iterations 20] file.tga [file.tga ...]
+//
+
+#include "elements/codec_targa.hpp"
+#include "stopwatch.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+static bool sameImage(BLImage& a, BLImage& b, bool premultiplyA)
+{
+	BLImageData da{};
+	BLImageData db{};
+	a.getData(&da);
+	b.getData(&db);
+
+	if ((da.size.w != db.size.w) || (da.size.h != db.size.h))
+		return false;
+
+	std::vector<uint32_t> row(da.size.w);
+	for (int y = 0; y < da.size.h; y++)
+	{
+		memcpy(row.data(), (uint8_t*)da.pixelData + (intptr_t)y * da.stride, row.size() * 4);
+		if (premultiplyA)
+			targa::premultiplyRow(row.data(), (int)row.size());
+
+		if (memcmp(row.data(), (uint8_t*)db.pixelData + (intptr_t)y * db.stride, row.size() * 4) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	int iterations = 20;
+	std::vector<const char*> files{};
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-iterations") == 0) && (i + 1 < argc))
+			iterations = std::max(1, atoi(argv[++i]));
+		else
+			files.push_back(argv[i]);
+	}
+
+	if (files.empty())
+	{
+		printf("usage: test_targa [-iterations 20] file.tga [file.tga ...]\n");
+		return 1;
+	}
+
+	StopWatch sw;
+
+	printf("%-48s %11s %6s %12s %12s %8s\n", "file", "size", "type", "pixel MB/s", "bulk MB/s", "same");
+
+	for (auto filename : files)
+	{
+		ndt::FileStream bs(filename);
+		if (!bs.isValid())
+		{
+			printf("%-48s could not open\n", filename);
+			continue;
+		}
+
+		targa::TargaMeta meta{};
+		if (!targa::readMetaInformation(bs, meta))
+		{
+			printf("%-48s could not read header\n", filename);
+			continue;
+		}
+
+		size_t bodyStart = bs.tell();
+		double pixelMB = ((double)meta.header.Width * meta.header.Height * 4) / (1024.0 * 1024.0);
+
+		BLImage byPixel{};
+		double start = sw.seconds();
+		for (int i = 0; i < iterations; i++)
+		{
+			bs.seek(bodyStart);
+			targa::readBodyByPixel(bs, meta, byPixel);
+		}
+		double pixelSeconds = (sw.seconds() - start) / iterations;
+
+		BLImage bulk{};
+		start = sw.seconds();
+		for (int i = 0; i < iterations; i++)
+		{
+			bs.seek(bodyStart);
+			targa::readBodyFast(bs, meta, bulk);
+		}
+		double bulkSeconds = (sw.seconds() - start) / iterations;
+
+		bool premultiply = (meta.header.PixelDepth == 32) && (meta.header.AttrBits != 0);
+		char sizeStr[32];
+		snprintf(sizeStr, sizeof(sizeStr), "%dx%dx%d", meta.header.Width, meta.header.Height, meta.header.PixelDepth);
+
+		printf("%-48s %11s %6d %12.1f %12.1f %8s\n", filename, sizeStr, meta.header.ImageType,
+			pixelMB / pixelSeconds, pixelMB / bulkSeconds,
+			sameImage(byPixel, bulk, premultiply) ? "yes" : "NO");
+	}
+
+	return 0;
+}
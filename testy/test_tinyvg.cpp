@@ -0,0 +1,219 @@
+//
+// test_tinyvg
+// Parse and render throughput for tinyvg files
+//
+// For each file, three ways of getting to something drawable are timed:
+//   legacy - tvgparser::next(), then VGCommandPath from the contours
+//   bake   - tvg_bake(), then the paths built from the baked vertices
+//   replay - paths built from an already baked image
+//
+// and then the time to render the figures into an offscreen image.
+//
+// Before anything is timed, the figures built from the baked image are
+// checked against the legacy ones; the same figures, with the same path
+// commands, and every vertex within a small distance of the legacy one.
+//
+//   test_tinyvg [-iterations 200] file.tvg [file.tvg ...]
+//
+// With no files, the ones bundled with the tinyvg project are used.
+//
+
+#include "elements/tinyvggraphic.h"
+#include "mmap.hpp"
+#include "stopwatch.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// A BLGraphics drawing into an image
+struct ImageGraphics : public BLGraphics
+{
+	ImageGraphics(BLImage& img)
+	{
+		BLContextCreateInfo createInfo{};
+		createInfo.threadCount = 0;
+		fCtx.begin(img, createInfo);
+	}
+
+	virtual ~ImageGraphics()
+	{
+		fCtx.end();
+	}
+};
+
+static size_t legacyParse(uint8_t* data, size_t size, std::vector<VGCommandPath>& figures)
+{
+	BinStream bs(data, size);
+	tvgparser parser(bs);
+
+	while (true)
+	{
+		tvg_command_t cmd;
+		if (!parser.next(cmd))
+			break;
+
+		figures.emplace_back(cmd);
+	}
+
+	return figures.size();
+}
+
+static size_t replay(const tvg_baked_t& baked, std::vector<VGCommandPath>& figures)
+{
+	figures.reserve(baked.draws.size());
+	for (const auto& d : baked.draws)
+		figures.emplace_back(baked, d);
+
+	return figures.size();
+}
+
+static bool closeEnough(const BLPoint& a, const BLPoint& b)
+{
+	return (fabs(a.x - b.x) <= 1e-4 * std::max(1.0, fabs(a.x))) &&
+		(fabs(a.y - b.y) <= 1e-4 * std::max(1.0, fabs(a.y)));
+}
+
+// Number of figures whose paths differ between the two
+static size_t figureDifferences(const char* filename, const std::vector<VGCommandPath>& legacy, const std::vector<VGCommandPath>& baked)
+{
+	if (legacy.size() != baked.size())
+	{
+		printf("FAIL: %s: %zu figures from bake, %zu from legacy\n", filename, baked.size(), legacy.size());
+		return std::max<size_t>(1, std::max(legacy.size(), baked.size()));
+	}
+
+	size_t diffs = 0;
+	for (size_t f = 0; f < legacy.size(); f++)
+	{
+		const BLPath& a = legacy[f].fPath;
+		const BLPath& b = baked[f].fPath;
+
+		bool same = (legacy[f].fCommand == baked[f].fCommand) && (a.size() == b.size());
+		for (size_t i = 0; same && i < a.size(); i++)
+		{
+			// A close command's vertex isn't a point, so only the command counts
+			uint8_t cmd = a.commandData()[i];
+			same = (cmd == b.commandData()[i]) &&
+				((cmd == BL_PATH_CMD_CLOSE) || closeEnough(a.vertexData()[i], b.vertexData()[i]));
+		}
+
+		if (!same)
+		{
+			if (diffs == 0)
+				printf("FAIL: %s: figure %zu differs (%zu vertices from bake, %zu from legacy)\n", filename, f, b.size(), a.size());
+			diffs++;
+		}
+	}
+
+	return diffs;
+}
+
+int main(int argc, char** argv)
+{
+	int iterations = 200;
+	std::vector<const char*> files{};
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-iterations") == 0) && (i + 1 < argc))
+			iterations = std::max(1, atoi(argv[++i]));
+		else
+			files.push_back(argv[i]);
+	}
+
+	if (files.empty())
+	{
+		files = {
+			"../projects/tinyvg/app-icon.tvg",
+			"../projects/tinyvg/chart.tvg",
+			"../projects/tinyvg/comic.tvg",
+			"../projects/tinyvg/everything.tvg",
+			"../projects/tinyvg/flowchart.tvg",
+			"../projects/tinyvg/shield.tvg",
+			"../projects/tinyvg/tiger.tvg",
+		};
+	}
+
+	StopWatch sw;
+	int failures = 0;
+
+	printf("%-36s %8s %10s %10s %10s %10s %10s\n", "file", "bytes", "legacy", "bake", "replay", "render", "MB/s bake");
+
+	for (auto filename : files)
+	{
+		auto fmap = ndt::mmap::create_shared(filename);
+		if (fmap == nullptr)
+		{
+			printf("%-36s could not open\n", filename);
+			continue;
+		}
+
+		uint8_t* data = (uint8_t*)fmap->data();
+		size_t size = fmap->size();
+
+		auto baked = tvg_bake(data, size);
+		if (!baked->isValid)
+		{
+			printf("%-36s not a valid tinyvg file\n", filename);
+			continue;
+		}
+
+		{
+			std::vector<VGCommandPath> legacyFigures;
+			std::vector<VGCommandPath> bakedFigures;
+			legacyParse(data, size, legacyFigures);
+			replay(*baked, bakedFigures);
+			if (figureDifferences(filename, legacyFigures, bakedFigures) != 0)
+				failures++;
+		}
+
+		double start = sw.seconds();
+		for (int i = 0; i < iterations; i++)
+		{
+			std::vector<VGCommandPath> figures;
+			legacyParse(data, size, figures);
+		}
+		double legacyMs = (sw.seconds() - start) * 1000.0 / iterations;
+
+		start = sw.seconds();
+		for (int i = 0; i < iterations; i++)
+		{
+			std::vector<VGCommandPath> figures;
+			auto b = tvg_bake(data, size);
+			replay(*b, figures);
+		}
+		double bakeMs = (sw.seconds() - start) * 1000.0 / iterations;
+
+		start = sw.seconds();
+		for (int i = 0; i < iterations; i++)
+		{
+			std::vector<VGCommandPath> figures;
+			replay(*baked, figures);
+		}
+		double replayMs = (sw.seconds() - start) * 1000.0 / iterations;
+
+		// Render
+		std::vector<VGCommandPath> figures;
+		replay(*baked, figures);
+
+		BLImage img(std::max<int>(1, baked->header.width), std::max<int>(1, baked->header.height), BL_FORMAT_PRGB32);
+		start = sw.seconds();
+		for (int i = 0; i < iterations; i++)
+		{
+			ImageGraphics ctx(img);
+			ctx.clear();
+			for (auto& fig : figures)
+				fig.draw(ctx);
+			ctx.flush();
+		}
+		double renderMs = (sw.seconds() - start) * 1000.0 / iterations;
+
+		printf("%-36s %8zu %8.3fms %8.3fms %8.3fms %8.3fms %10.1f\n", filename, size,
+			legacyMs, bakeMs, replayMs, renderMs, (size / (1024.0 * 1024.0)) / (bakeMs / 1000.0));
+	}
+
+	printf("%s, %d failures\n", failures ? "FAILED" : "PASSED", failures);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+//
+// test_whisper_mmap
+// A model loaded with whisper_init_mmap() must give exactly the
+// same results as the same model loaded with whisper_init().
+//
+// Each model is loaded both ways, the same half minute of made up
+// audio is encoded, the first tokens decoded, and the two sets of
+// token probabilities compared bit for bit.
+//
+//   test_whisper_mmap ggml-model.bin [ggml-model.bin ...]
+//
+
+#include "whisper/whisper.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// Token probabilities after the start of a transcript,
+// empty if the model could not be loaded or run
+static std::vector<float> firstProbs(whisper_context* ctx)
+{
+	if (ctx == nullptr)
+		return {};
+
+	std::vector<float> pcm(WHISPER_SAMPLE_RATE * 30);
+	for (size_t i = 0; i < pcm.size(); i++)
+		pcm[i] = 0.3f * sinf(i * 0.05f) + 0.1f * sinf(i * 0.31f);
+
+	std::vector<float> probs{};
+	whisper_token tokens[2] = { whisper_token_sot(ctx), whisper_token_beg(ctx) };
+	if (whisper_pcm_to_mel(ctx, pcm.data(), (int)pcm.size(), 1) == 0
+		&& whisper_encode(ctx, 0, 1) == 0
+		&& whisper_decode(ctx, tokens, 2, 0, 1) == 0)
+	{
+		const float* p = whisper_get_probs(ctx);
+		probs.assign(p, p + whisper_n_vocab(ctx));
+	}
+
+	whisper_free(ctx);
+
+	return probs;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("usage: test_whisper_mmap ggml-model.bin [ggml-model.bin ...]\n");
+		return 1;
+	}
+
+	int failures = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		auto expected = firstProbs(whisper_init(argv[i]));
+		if (expected.empty())
+		{
+			printf("%s: could not load or run, skipped\n", argv[i]);
+			continue;
+		}
+
+		auto got = firstProbs(whisper_init_mmap(argv[i]));
+		if (got.empty())
+		{
+			printf("FAIL: %s: whisper_init_mmap could not load or run it\n", argv[i]);
+			failures++;
+			continue;
+		}
+
+		size_t diffs = 0;
+		for (size_t t = 0; t < expected.size() && t < got.size(); t++)
+			if (memcmp(&expected[t], &got[t], sizeof(float)) != 0)
+				diffs++;
+
+		bool same = (got.size() == expected.size()) && (diffs == 0);
+		printf("%s  %zu tokens, %zu differ  %s\n", argv[i], expected.size(), diffs, same ? "identical" : "MISMATCH");
+		if (!same)
+			failures++;
+	}
+
+	printf("%s, %d failures\n", failures ? "FAILED" : "PASSED", failures);
+
+	return failures ? 1 : 0;
+}
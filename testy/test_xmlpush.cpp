@@ -0,0 +1,187 @@
+//
+// test_xmlpush
+// The push parser must produce exactly the same elements as the
+// one shot XmlElementIterator, no matter where the document is
+// split between feed() calls.
+//
+// Each document is scanned once in one piece, then fed in pieces
+// of every size from 1 byte up, and again in randomly sized pieces.
+//
+//   test_xmlpush [file.xml ...]
+//
+// With no files, a built in set of small documents is used.
+//
+
+#include "xmlscan.h"
+#include "mmap.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace ndt;
+
+// A flattened record of an element, which does not refer
+// back into the buffer it came from
+struct ElementRecord
+{
+	int kind{ 0 };
+	std::string data{};
+	std::string name{};
+	std::vector<std::pair<std::string, std::string>> attributes{};
+
+	bool operator==(const ElementRecord& other) const
+	{
+		return kind == other.kind && data == other.data && name == other.name && attributes == other.attributes;
+	}
+};
+
+static ElementRecord record(const XmlElement& elem)
+{
+	ElementRecord rec{};
+	rec.kind = elem.kind();
+	rec.data = std::string(elem.data().fStart, elem.data().fEnd);
+	rec.name = elem.name();
+	for (auto& attr : elem.attributes())
+		rec.attributes.push_back({ attr.first, std::string(attr.second.fStart, attr.second.fEnd) });
+
+	return rec;
+}
+
+static std::vector<ElementRecord> scanOneShot(const std::string& doc)
+{
+	std::vector<ElementRecord> records{};
+
+	XmlElementIterator iter(DataChunk((const uint8_t*)doc.data(), (const uint8_t*)doc.data() + doc.size()));
+	while (iter)
+	{
+		// Attributes are only scanned when asked for
+		XmlElement elem = *iter;
+		if (elem.isStart() || elem.isSelfClosing())
+			elem.scanAttributes();
+		records.push_back(record(elem));
+		iter++;
+	}
+
+	return records;
+}
+
+// Feed the document in pieces whose sizes come from 'nextSize'
+template <typename F>
+static std::vector<ElementRecord> scanPushed(const std::string& doc, F nextSize)
+{
+	std::vector<ElementRecord> records{};
+
+	XmlPushParser parser([&records](const XmlElement& elem) {
+		records.push_back(record(elem));
+	});
+
+	const uint8_t* s = (const uint8_t*)doc.data();
+	const uint8_t* e = s + doc.size();
+	while (s < e)
+	{
+		size_t n = std::min<size_t>(nextSize(), e - s);
+		parser.feed(DataChunk(s, s + n));
+		s += n;
+	}
+	parser.finish();
+
+	return records;
+}
+
+static int failures = 0;
+
+static void compare(const char* label, const std::string& doc)
+{
+	auto expected = scanOneShot(doc);
+
+	size_t maxSplit = std::min<size_t>(doc.size(), 300);
+	for (size_t split = 1; split <= maxSplit; split++)
+	{
+		auto got = scanPushed(doc, [split]() { return split; });
+		if (got != expected)
+		{
+			printf("FAIL: %s, pieces of %zu bytes: %zu elements, expected %zu\n", label, split, got.size(), expected.size());
+			failures++;
+			return;
+		}
+	}
+
+	srand(5);
+	for (int trial = 0; trial < 50; trial++)
+	{
+		auto got = scanPushed(doc, []() { return (size_t)(1 + rand() % 64); });
+		if (got != expected)
+		{
+			printf("FAIL: %s, random pieces, trial %d\n", label, trial);
+			failures++;
+			return;
+		}
+	}
+
+	printf("%s: %zu elements\n", label, expected.size());
+}
+
+static const char* builtins[] = {
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n"
+	"<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"100\" height=\"100\">\n"
+	"  <!-- a comment, with a > in it -->\n"
+	"  <g fill='red' stroke=\"blue\">\n"
+	"    <rect x=\"10\" y=\"10\" width=\"20\" height=\"20\"/>\n"
+	"    <circle cx=\"50\" cy=\"50\" r=\"10\" />\n"
+	"  </g>\n"
+	"  <text x=\"5\" y=\"90\">Some   text &amp; more</text>\n"
+	"  <style><![CDATA[ .a { fill: green; } ]]></style>\n"
+	"</svg>\n",
+
+	"<!DOCTYPE note [\n"
+	"  <!ELEMENT note (to,from)>\n"
+	"  <!ENTITY writer \"Someone\">\n"
+	"]>\n"
+	"<note><to>you</to><from>&writer;</from></note>",
+
+	"<a><b/><c attr=\"1\"/>  trailing content with no tag",
+
+	"plain text with no tags at all",
+
+	"<unclosed attr=\"",
+};
+
+int main(int argc, char** argv)
+{
+	if (argc > 1)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			auto m = mmap::create_shared(argv[i]);
+			if ((m == nullptr) || !m->isValid())
+			{
+				printf("could not open: %s\n", argv[i]);
+				continue;
+			}
+
+			compare(argv[i], std::string((const char*)m->data(), m->size()));
+		}
+	}
+	else
+	{
+		int i = 0;
+		for (const char* doc : builtins)
+		{
+			std::string label = "builtin " + std::to_string(i++);
+			compare(label.c_str(), doc);
+		}
+
+		// Long content and CDATA, split over many feeds, which is
+		// where picking the search back up where it left off matters
+		std::string big = "<svg><text>" + std::string(256 * 1024, 't') + "</text><style><![CDATA["
+			+ std::string(256 * 1024, 'c') + "]]></style></svg>";
+		compare("large elements", big);
+	}
+
+	printf("%s, %d failures\n", failures ? "FAILED" : "PASSED", failures);
+
+	return failures ? 1 : 0;
+}